@@ -0,0 +1,130 @@
+/** $lic$
+ * Copyright (C) 2012-2015 by Massachusetts Institute of Technology
+ * Copyright (C) 2010-2013 by The Board of Trustees of Stanford University
+ *
+ * This file is part of zsim.
+ *
+ * zsim is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, version 2.
+ *
+ * If you use this software in your research, we request that you reference
+ * the zsim paper ("ZSim: Fast and Accurate Microarchitectural Simulation of
+ * Thousand-Core Systems", Sanchez and Kozyrakis, ISCA-40, June 2013) as the
+ * source of the simulator in any publications that use this software, and that
+ * you send us a citation of your work.
+ *
+ * zsim is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef ACCESS_SCRATCH_H_
+#define ACCESS_SCRATCH_H_
+
+#include <string.h>
+#include "event_recorder.h"
+#include "g_std/g_vector.h"
+#include "galloc.h"
+#include "pad.h"
+#include "stats.h"
+
+/* Per-cache working state of the compressed caches' access() path.
+ *
+ * Everything here is allocated once, at construction, and reused: the line
+ * buffer holds the accessed line's contents, and the vectors are cleared (not
+ * freed) on every access, so after warmup an access makes no shared-heap
+ * allocations. Only use it between cc->startAccess() and cc->endAccess(),
+ * which serialize accesses to the cache.
+ *
+ * The line's contents are copied lazily, on the first fetchLine() of an
+ * access, so paths that never look at the data (e.g., read hits) skip the
+ * copy. They come from the request if it carries them (trace-driven
+ * simulation), and otherwise from simulated memory (or are all zeros in
+ * trace-driven simulations, which have no simulated memory). Later fetchLine() calls in the same access return the
+ * same buffer, including any in-place changes (e.g., approximation).
+ *
+ * If the compression memo is enabled (see compression_memo.h), fill() also
+ * samples the line's store generation before copying its contents, so memo
+ * entries are tagged with the generation of the data they were computed from.
+ *
+ * heapAllocs counts the calling thread's shared-heap allocations made between
+ * begin() and end(), including those made by lower levels. It only counts
+ * when the per-thread heap caches are enabled (see galloc.h).
+ */
+class AccessScratch {
+    public:
+        g_vector<TimingRecord> writebackRecords;
+        g_vector<uint64_t> wbStartCycles;
+        g_vector<uint64_t> wbEndCycles;
+        g_vector<uint32_t> keptFromEvictions;
+
+    private:
+        DataLine line;  // line-aligned, lineSize bytes
+        uint32_t lineSize;
+        Address lineAddr;  // byte address
+        const void* reqData;
+        bool fetchable;
+        bool fetched;
+        uint32_t fetchGen;  // store generation of the fetched contents, if tracked
+        uint64_t startAllocs;
+        Counter profHeapAllocs;
+        Counter profLineFetches;
+
+    public:
+        // maxEvictions: most lines a single access can evict (sizes the vectors)
+        AccessScratch(uint32_t _lineSize, uint32_t maxEvictions) : lineSize(_lineSize), lineAddr(0), reqData(nullptr), fetchable(false), fetched(false), fetchGen(0), startAllocs(0) {
+            line = gm_memalign<uint8_t>(CACHE_LINE_BYTES, lineSize);
+            memset(line, 0, lineSize);
+            writebackRecords.reserve(maxEvictions);
+            wbStartCycles.reserve(maxEvictions);
+            wbEndCycles.reserve(maxEvictions);
+            keptFromEvictions.reserve(maxEvictions);
+        }
+
+        void initStats(AggregateStat* cacheStat) {
+            profHeapAllocs.init("heapAllocs", "Shared-heap allocations during accesses (incl. lower levels)");
+            cacheStat->append(&profHeapAllocs);
+            profLineFetches.init("lineFetches", "Accesses that copied the line's contents from simulated memory");
+            cacheStat->append(&profLineFetches);
+        }
+
+        // _reqData: the request's data (MemReq::data), if any. If !_fetchable, fetchLine() returns a zeroed line instead of the contents
+        inline void begin(Address _lineAddr, const void* _reqData, bool _fetchable = true) {
+            lineAddr = _lineAddr;
+            reqData = _reqData;
+            fetchable = _fetchable;
+            fetched = false;
+            startAllocs = gm_thread_allocs();
+            writebackRecords.clear();
+            wbStartCycles.clear();
+            wbEndCycles.clear();
+            keptFromEvictions.clear();
+        }
+
+        inline DataLine fetchLine() {
+            if (!fetched) fill();
+            return line;
+        }
+
+        inline Address lineAddress() const {return lineAddr;}
+
+        // Store generation of the contents returned by fetchLine(); only valid after it
+        inline uint32_t fetchGeneration() const {
+            assert(fetched);
+            return fetchGen;
+        }
+
+        inline void end() {
+            profHeapAllocs.inc(gm_thread_allocs() - startAllocs);
+        }
+
+    private:
+        void fill();
+};
+
+#endif  // ACCESS_SCRATCH_H_
@@ -24,46 +24,332 @@
  */
 
 #include "access_tracing.h"
+#include <algorithm>
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 #include "bithacks.h"
 #include <hdf5.h>
 #include <hdf5_hl.h>
 
 #define PT_CHUNKSIZE (1024*256u)  // 256K records (~6MB)
+#define LINES_CHUNKSIZE (1024*4u)  // 4K lines (256KB with 64-byte lines)
+#define BYTES_CHUNKSIZE (1024*1024u)  // 1MB of encoded records
+#define BLOCK_ENDS_CHUNKSIZE 1024u
+#define REGIONS_CHUNKSIZE 1024u
 
-AccessTraceReader::AccessTraceReader(std::string _fname) : fname(_fname.c_str()) {
+// xxHash64-style mixing of the line's words, like XXLineHasher (kept here so the trace tools need no other zsim code)
+static uint64_t hashLine(const void* line, uint32_t size, uint64_t seed) {
+    const uint64_t* words = (const uint64_t*) line;
+    uint64_t h = seed + size;
+    for (uint32_t i = 0; i < size/8; i++) {
+        uint64_t k = words[i] * 0xC2B2AE3D27D4EB4FULL;
+        k = ((k << 31) | (k >> 33)) * 0x9E3779B185EBCA87ULL;
+        h ^= k;
+        h = ((h << 27) | (h >> 37)) * 0x9E3779B185EBCA87ULL + 0x85EBCA77C2B2AE63ULL;
+    }
+    h ^= h >> 33;
+    h *= 0xC2B2AE3D27D4EB4FULL;
+    h ^= h >> 29;
+    h *= 0x165667B19E3779F9ULL;
+    h ^= h >> 32;
+    return h;
+}
+
+// The HDF5 library is not thread-safe, and prefetching readers call it from their own threads
+static lock_t hdf5Lock = 0;
+
+// Reads count packets of the named table, starting at packet start
+static void readPackets(hid_t fid, const char* name, uint64_t start, size_t count, void* buf) {
+    hid_t table = H5PTopen(fid, name);
+    if (table == H5I_INVALID_HID) panic("Could not open HDF5 packet table %s", name);
+    H5PTread_packets(table, start, count, buf);
+    H5PTclose(table);
+}
+
+static void appendPackets(hid_t fid, const char* name, size_t count, const void* buf) {
+    hid_t table = H5PTopen(fid, name);
+    if (table == H5I_INVALID_HID) panic("Could not open HDF5 packet table %s", name);
+    herr_t err = H5PTappend(table, count, buf);
+    assert(err >= 0);
+    H5PTclose(table);
+}
+
+/* Compact record encoding. Blocks are encoded independently; within a block,
+ * each child's addresses and cycles are delta-encoded against its previous
+ * record, and all fields are varints (7 bits per byte, high bit set on all but
+ * the last byte). Each record is:
+ *  - a byte with the access type (low 2 bits) and the child id (high 6 bits),
+ *    or CHILD_ESCAPE in the high bits and the child id in a varint after it
+ *  - the address and cycle deltas, zigzagged (so small negatives stay short)
+ *  - the latency
+ *  - the data id, if the trace has data
+ * Traces are then deflated by HDF5, a chunk of bytes at a time.
+ */
+#define CHILD_ESCAPE 63u
+#define MAX_ENCODED_RECORD (1 + 3 + 10 + 10 + 5 + 5)  // bytes
+
+struct ChildDeltas {
+    uint64_t lineAddr;
+    uint64_t reqCycle;
+};
+
+static inline void putVarint(uint8_t*& p, uint64_t v) {
+    while (v >= 0x80) {
+        *p++ = v | 0x80;
+        v >>= 7;
+    }
+    *p++ = v;
+}
+
+static inline uint64_t getVarint(const uint8_t*& p, const uint8_t* end) {
+    uint64_t v = 0;
+    for (uint32_t shift = 0; shift < 64; shift += 7) {
+        if (unlikely(p == end)) break;
+        uint8_t b = *p++;
+        v |= ((uint64_t)(b & 0x7f)) << shift;
+        if (!(b & 0x80)) return v;
+    }
+    panic("Corrupt trace block (bad varint)");
+}
+
+static inline uint64_t zigzag(uint64_t delta) {
+    return (delta << 1) ^ (uint64_t)(((int64_t)delta) >> 63);
+}
+
+static inline uint64_t unzigzag(uint64_t v) {
+    return (v >> 1) ^ -(v & 1);
+}
+
+// Encodes n records into out, growing it if needed; returns the encoded size. ids is null if the trace has no data
+static uint64_t encodeBlock(const PackedAccessRecord* recs, const uint32_t* ids, uint32_t n, uint32_t numChildren, g_vector<uint8_t>& out) {
+    if (out.size() < (uint64_t)n*MAX_ENCODED_RECORD) out.resize((uint64_t)n*MAX_ENCODED_RECORD);
+    ChildDeltas* last = gm_calloc<ChildDeltas>(numChildren);
+    uint8_t* p = &out[0];
+    for (uint32_t i = 0; i < n; i++) {
+        const PackedAccessRecord& r = recs[i];
+        uint32_t c = r.childId;
+        assert(c < numChildren && r.type < 4);
+        if (c < CHILD_ESCAPE) {
+            *p++ = r.type | (c << 2);
+        } else {
+            *p++ = r.type | (CHILD_ESCAPE << 2);
+            putVarint(p, c);
+        }
+        putVarint(p, zigzag(r.lineAddr - last[c].lineAddr));
+        putVarint(p, zigzag(r.reqCycle - last[c].reqCycle));
+        putVarint(p, r.latency);
+        if (ids) putVarint(p, ids[i]);
+        last[c].lineAddr = r.lineAddr;
+        last[c].reqCycle = r.reqCycle;
+    }
+    gm_free(last);
+    return p - &out[0];
+}
+
+static void decodeBlock(const uint8_t* p, uint64_t bytes, uint64_t n, uint32_t numChildren, PackedAccessRecord* recs, uint32_t* ids) {
+    const uint8_t* end = p + bytes;
+    ChildDeltas* last = gm_calloc<ChildDeltas>(numChildren);
+    for (uint64_t i = 0; i < n; i++) {
+        if (unlikely(p == end)) panic("Corrupt trace block (%ld records, expected %ld)", i, n);
+        uint8_t hdr = *p++;
+        uint32_t c = hdr >> 2;
+        if (c == CHILD_ESCAPE) c = getVarint(p, end);
+        if (unlikely(c >= numChildren)) panic("Corrupt trace block (child %d, trace has %d)", c, numChildren);
+        PackedAccessRecord& r = recs[i];
+        r.lineAddr = last[c].lineAddr + unzigzag(getVarint(p, end));
+        r.reqCycle = last[c].reqCycle + unzigzag(getVarint(p, end));
+        r.latency = getVarint(p, end);
+        r.childId = c;
+        r.type = hdr & 3;
+        if (ids) ids[i] = getVarint(p, end);
+        last[c].lineAddr = r.lineAddr;
+        last[c].reqCycle = r.reqCycle;
+    }
+    if (p != end) panic("Corrupt trace block (%ld trailing bytes)", end - p);
+    gm_free(last);
+}
+
+// Reads count records, and their data ids if idBuf is set, starting at record start (a block boundary in compact traces)
+static void readRecords(hid_t fid, bool compact, uint32_t numChildren, uint64_t start, uint64_t count, PackedAccessRecord* recBuf, uint32_t* idBuf) {
+    if (!compact) {
+        readPackets(fid, "accs", start, count, recBuf);
+        if (idBuf) readPackets(fid, "accData", start, count, idBuf);
+        return;
+    }
+
+    assert(start % PT_CHUNKSIZE == 0);
+    uint64_t block = start / PT_CHUNKSIZE;
+    uint64_t ends[2] = {0, 0};  // where the previous block and this one end
+    if (block) readPackets(fid, "blockEnds", block - 1, 2, ends);
+    else readPackets(fid, "blockEnds", 0, 1, &ends[1]);
+    uint64_t bytes = ends[1] - ends[0];
+    uint8_t* enc = gm_calloc<uint8_t>(MAX(bytes, 1ul));
+    readPackets(fid, "accBytes", ends[0], bytes, enc);
+    decodeBlock(enc, bytes, count, numChildren, recBuf, idBuf);
+    gm_free(enc);
+}
+
+static uint32_t readUintAttr(hid_t fid, const char* name) {
+    uint32_t val;
+    hid_t attr = H5Aopen(fid, name, H5P_DEFAULT);
+    H5Aread(attr, H5T_NATIVE_UINT, &val);
+    H5Aclose(attr);
+    return val;
+}
+
+static uint64_t readUlongAttr(hid_t fid, const char* name) {
+    uint64_t val;
+    hid_t attr = H5Aopen(fid, name, H5P_DEFAULT);
+    H5Aread(attr, H5T_NATIVE_ULONG, &val);
+    H5Aclose(attr);
+    return val;
+}
+
+static void writeAttr(hid_t fid, const char* name, hid_t type, const void* val, bool create) {
+    hid_t attr = create? H5Acreate2(fid, name, type, H5Screate(H5S_SCALAR), H5P_DEFAULT, H5P_DEFAULT) : H5Aopen(fid, name, H5P_DEFAULT);
+    H5Awrite(attr, type, val);
+    H5Aclose(attr);
+}
+
+static bool isCompact(hid_t fid) {
+    return H5Lexists(fid, "accBytes", H5P_DEFAULT) > 0;
+}
+
+static uint64_t numPackets(hid_t fid, const char* name) {
+    hid_t table = H5PTopen(fid, name);
+    if (table == H5I_INVALID_HID) panic("Could not open HDF5 packet table %s", name);
+    hsize_t n;
+    H5PTget_num_packets(table, &n);
+    H5PTclose(table);
+    return n;
+}
+
+AccessTraceReader::AccessTraceReader(std::string _fname, SpawnThreadFn spawnThread) : fname(_fname.c_str()), prefetch(false) {
+    curFrameRecord = 0;
+    cur = 0;
+    lineSize = 0;
+    lines = nullptr;
+    dataIds = nullptr;
+    regions = nullptr;
+    numRegions = 0;
+    nextRegion = 0;
+    hasRegionTable = false;
+
+    // Binary traces are told apart by their magic
+    int fd = open(fname.c_str(), O_RDONLY);
+    if (fd < 0) panic("Could not open trace file %s", fname.c_str());
+    char magic[sizeof(BinaryTraceHeader::magic)];
+    if (pread(fd, magic, sizeof(magic), 0) == (ssize_t)sizeof(magic) && memcmp(magic, BINARY_TRACE_MAGIC, sizeof(magic)) == 0) {
+        openBinary(fd);
+        return;
+    }
+    close(fd);
+
+    futex_lock(&hdf5Lock);
     hid_t fid = H5Fopen(fname.c_str(), H5F_ACC_RDONLY, H5P_DEFAULT);
     if (fid == H5I_INVALID_HID) panic("Could not open HDF5 file %s", fname.c_str());
 
     // Check that the trace finished
-    hid_t fAttr = H5Aopen(fid, "finished", H5P_DEFAULT);
-    uint32_t finished;
-    H5Aread(fAttr, H5T_NATIVE_UINT, &finished);
-    H5Aclose(fAttr);
-
-    if (!finished) panic("Trace file %s unfinished (halted simulation?)", fname.c_str());
+    if (!readUintAttr(fid, "finished")) panic("Trace file %s unfinished (halted simulation?)", fname.c_str());
 
     // Populate numRecords & numChildren
-    hsize_t nPackets;
-    hid_t table = H5PTopen(fid, "accs");
-    if (table == H5I_INVALID_HID) panic("Could not open HDF5 packet table");
-    H5PTget_num_packets(table, &nPackets);
-    numRecords = nPackets;
+    compact = isCompact(fid);
+    numRecords = compact? readUlongAttr(fid, "numRecords") : numPackets(fid, "accs");
+    numChildren = readUintAttr(fid, "numChildren");
 
-    hid_t ncAttr = H5Aopen(fid, "numChildren", H5P_DEFAULT);
-    H5Aread(ncAttr, H5T_NATIVE_UINT, &numChildren);
-    H5Aclose(ncAttr);
+    // Read in all distinct lines
+    if (H5Aexists(fid, "lineSize") > 0) {
+        lineSize = readUintAttr(fid, "lineSize");
+        assert(lineSize);
+        uint64_t numLines = numPackets(fid, "lines");
+        lines = gm_calloc<uint8_t>(MAX(numLines, 1ul)*lineSize);
+        if (numLines) readPackets(fid, "lines", 0, numLines, lines);
+    }
 
-    curFrameRecord = 0;
-    cur = 0;
+    // Read in all region records (there are few)
+    if (H5Lexists(fid, "regions", H5P_DEFAULT) > 0) {
+        hasRegionTable = true;
+        numRegions = numPackets(fid, "regions");
+        regions = gm_calloc<PackedRegionRecord>(MAX(numRegions, 1ul));
+        if (numRegions) readPackets(fid, "regions", 0, numRegions, regions);
+    }
+    H5Fclose(fid);
+    futex_unlock(&hdf5Lock);
+
+    // Read the first chunk
     max = MIN(PT_CHUNKSIZE, numRecords);
     buf = max? gm_calloc<PackedAccessRecord>(max) : nullptr;
+    dataIds = (max && lineSize)? gm_calloc<uint32_t>(max) : nullptr;
+    if (max) readChunk(0, max, buf, dataIds);
 
-    if (max) {
-        H5PTread_packets(table, 0, max, buf);
+    // Prefetch the rest, if there is more than one chunk
+    if (spawnThread && max < numRecords) {
+        prefetch = true;
+        spareBuf = gm_calloc<PackedAccessRecord>(max);
+        spareDataIds = lineSize? gm_calloc<uint32_t>(max) : nullptr;
+        futex_init(&spareFull);
+        futex_lock(&spareFull);
+        futex_init(&spareEmpty);
+        spawnThread(prefetchThread, this);
     }
+}
 
-    H5PTclose(table);
+void AccessTraceReader::openBinary(int fd) {
+    BinaryTraceHeader hdr;
+    if (pread(fd, &hdr, sizeof(hdr), 0) != (ssize_t)sizeof(hdr)) panic("Truncated binary trace %s", fname.c_str());
+    if (hdr.version < 1 || hdr.version > BINARY_TRACE_VERSION) panic("Binary trace %s has version %d, expected at most %d", fname.c_str(), hdr.version, BINARY_TRACE_VERSION);
+    if (hdr.recordSize != sizeof(PackedAccessRecord)) panic("Binary trace %s has %d-byte records, expected %ld", fname.c_str(), hdr.recordSize, sizeof(PackedAccessRecord));
+
+    struct stat st;
+    if (fstat(fd, &st) != 0) panic("Could not stat binary trace %s", fname.c_str());
+    uint64_t end = hdr.lineSize? hdr.linesOffset + hdr.numLines*hdr.lineSize : hdr.recordsOffset + hdr.numRecords*sizeof(PackedAccessRecord);
+    uint64_t seqEnd = hdr.lineSize? hdr.linesOffset : end;
+    if (hdr.numRegions) end = hdr.regionsOffset + hdr.numRegions*sizeof(PackedRegionRecord);
+    if ((uint64_t)st.st_size < end) panic("Truncated binary trace %s (%ld bytes, expected %ld)", fname.c_str(), st.st_size, end);
+
+    uint8_t* base = (uint8_t*) mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    if (base == MAP_FAILED) panic("Could not mmap binary trace %s", fname.c_str());
+    close(fd);
+
+    // Records and data ids are read front to back; lines are accessed at random
+    madvise(base, seqEnd, MADV_SEQUENTIAL);
+
+    numRecords = hdr.numRecords;
+    numChildren = hdr.numChildren;
+    lineSize = hdr.lineSize;
+    buf = (PackedAccessRecord*) (base + hdr.recordsOffset);
+    max = numRecords;
+    if (lineSize) {
+        dataIds = (uint32_t*) (base + hdr.dataIdsOffset);
+        lines = base + hdr.linesOffset;
+    }
+    if (hdr.regionsOffset) {
+        hasRegionTable = true;
+        numRegions = hdr.numRegions;
+        regions = (PackedRegionRecord*) (base + hdr.regionsOffset);
+    }
+}
+
+// Reads count records, and their data ids if the trace has data, starting at record start
+void AccessTraceReader::readChunk(uint64_t start, uint64_t count, PackedAccessRecord* recBuf, uint32_t* idBuf) {
+    futex_lock(&hdf5Lock);
+    hid_t fid = H5Fopen(fname.c_str(), H5F_ACC_RDONLY, H5P_DEFAULT);
+    if (fid == H5I_INVALID_HID) panic("Could not open HDF5 file %s", fname.c_str());
+    readRecords(fid, compact, numChildren, start, count, recBuf, lineSize? idBuf : nullptr);
     H5Fclose(fid);
+    futex_unlock(&hdf5Lock);
+}
+
+void AccessTraceReader::prefetchLoop() {
+    for (uint64_t start = max; start < numRecords; start += PT_CHUNKSIZE) {
+        futex_lock(&spareEmpty);
+        readChunk(start, MIN(PT_CHUNKSIZE, numRecords - start), spareBuf, spareDataIds);
+        futex_unlock(&spareFull);
+    }
 }
 
 void AccessTraceReader::nextChunk() {
@@ -73,50 +359,24 @@ void AccessTraceReader::nextChunk() {
     if (curFrameRecord < numRecords) {
         cur = 0;
         max = MIN(PT_CHUNKSIZE, numRecords - curFrameRecord);
-        hid_t fid = H5Fopen(fname.c_str(), H5F_ACC_RDONLY, H5P_DEFAULT);
-        if (fid == H5I_INVALID_HID) panic("Could not open HDF5 file %s", fname.c_str());
-        hid_t table = H5PTopen(fid, "accs");
-        if (table == H5I_INVALID_HID) panic("Could not open HDF5 packet table");
-        H5PTread_packets(table, curFrameRecord, max, buf);
-        H5PTclose(table);
-        H5Fclose(fid);
+        if (prefetch) {
+            futex_lock(&spareFull);
+            std::swap(buf, spareBuf);
+            std::swap(dataIds, spareDataIds);
+            futex_unlock(&spareEmpty);
+        } else {
+            readChunk(curFrameRecord, max, buf, dataIds);
+        }
     } else {
         assert_msg(curFrameRecord == numRecords, "%ld %ld", curFrameRecord, numRecords);  // aaand we're done
     }
 }
 
 
-AccessTraceWriter::AccessTraceWriter(g_string _fname, uint32_t numChildren) : fname(_fname) {
-    // Create record structure
-    hid_t accType = H5Tenum_create(H5T_NATIVE_USHORT);
-    uint16_t val;
-    H5Tenum_insert(accType, "GETS", (val=GETS,&val));
-    H5Tenum_insert(accType, "GETX", (val=GETX,&val));
-    H5Tenum_insert(accType, "PUTS", (val=PUTS,&val));
-    H5Tenum_insert(accType, "PUTX", (val=PUTX,&val));
-
-    size_t offset = 0;
-    size_t size = H5Tget_size(H5T_NATIVE_ULONG)*2 + H5Tget_size(H5T_NATIVE_UINT) + H5Tget_size(H5T_NATIVE_USHORT) + H5Tget_size(accType);
-    hid_t recType = H5Tcreate(H5T_COMPOUND, size);
-    auto insertType = [&](const char* name, hid_t type) {
-        H5Tinsert(recType, name, offset, type);
-        offset += H5Tget_size(type);
-    };
-
-    insertType("lineAddr", H5T_NATIVE_ULONG);
-    insertType("cycle", H5T_NATIVE_ULONG);
-    insertType("lat", H5T_NATIVE_UINT);
-    insertType("childId", H5T_NATIVE_USHORT);
-    insertType("accType", accType);
-
-    hid_t fid = H5Fcreate(fname.c_str(), H5F_ACC_TRUNC, H5P_DEFAULT, H5P_DEFAULT);
-    if (fid == H5I_INVALID_HID) panic("Could not create HDF5 file %s", fname.c_str());
-
-    // HACK: We want to use the SHUF filter... create the raw dataset instead of the packet table
-    // hid_t table = H5PTcreate_fl(fid, "accs", recType, PT_CHUNKSIZE, 9);
-    // if (table == H5I_INVALID_HID) panic("Could not create HDF5 packet table");
+// Creates an empty, unlimited, compressed 1-D dataset, which can be opened and appended to as a packet table
+static void createTable(hid_t fid, const char* name, hid_t type, hsize_t chunkSize) {
     hsize_t dims[1] = {0};
-    hsize_t dims_chunk[1] = {PT_CHUNKSIZE};
+    hsize_t dims_chunk[1] = {chunkSize};
     hsize_t maxdims[1] = {H5S_UNLIMITED};
     hid_t space_id = H5Screate_simple(1, dims, maxdims);
 
@@ -125,52 +385,230 @@ AccessTraceWriter::AccessTraceWriter(g_string _fname, uint32_t numChildren) : fn
     H5Pset_shuffle(plist_id);
     H5Pset_deflate(plist_id, 9);
 
-    hid_t table = H5Dcreate2(fid, "accs", recType, space_id, H5P_DEFAULT, plist_id, H5P_DEFAULT);
-    if (table == H5I_INVALID_HID) panic("Could not create HDF5 dataset");
+    hid_t table = H5Dcreate2(fid, name, type, space_id, H5P_DEFAULT, plist_id, H5P_DEFAULT);
+    if (table == H5I_INVALID_HID) panic("Could not create HDF5 dataset %s", name);
     H5Dclose(table);
+}
+
+AccessTraceWriter::AccessTraceWriter(g_string _fname, uint32_t _numChildren, uint32_t _lineSize, SpawnThreadFn spawnThread)
+    : fname(_fname), numChildren(_numChildren), writtenRecords(0), writtenBytes(0), numWritten(0), lineSize(_lineSize)
+{
+    futex_init(&regionLock);
+    futex_lock(&hdf5Lock);
+    hid_t fid = H5Fcreate(fname.c_str(), H5F_ACC_TRUNC, H5P_DEFAULT, H5P_DEFAULT);
+    if (fid == H5I_INVALID_HID) panic("Could not create HDF5 file %s", fname.c_str());
 
-    // info("%ld %ld %ld %ld", sizeof(PackedAccessRecord), size, offset, H5Tget_size(recType));
-    assert(offset == size);
-    assert(size == sizeof(PackedAccessRecord));
+    createTable(fid, "accBytes", H5T_NATIVE_UCHAR, BYTES_CHUNKSIZE);
+    createTable(fid, "blockEnds", H5T_NATIVE_ULONG, BLOCK_ENDS_CHUNKSIZE);
+    hsize_t regionDims[1] = {sizeof(PackedRegionRecord)};
+    createTable(fid, "regions", H5Tarray_create2(H5T_NATIVE_UCHAR, 1, regionDims), REGIONS_CHUNKSIZE);
 
-    hid_t ncAttr = H5Acreate2(fid, "numChildren", H5T_NATIVE_UINT, H5Screate(H5S_SCALAR), H5P_DEFAULT, H5P_DEFAULT);
-    H5Awrite(ncAttr, H5T_NATIVE_UINT, &numChildren);
-    H5Aclose(ncAttr);
+    if (lineSize) {
+        assert(lineSize % 8 == 0);
+        hsize_t lineDims[1] = {lineSize};
+        createTable(fid, "lines", H5Tarray_create2(H5T_NATIVE_UCHAR, 1, lineDims), LINES_CHUNKSIZE);
+        writeAttr(fid, "lineSize", H5T_NATIVE_UINT, &lineSize, true);
+    }
 
-    hid_t fAttr = H5Acreate2(fid, "finished", H5T_NATIVE_UINT, H5Screate(H5S_SCALAR), H5P_DEFAULT, H5P_DEFAULT);
+    writeAttr(fid, "numChildren", H5T_NATIVE_UINT, &numChildren, true);
+    writeAttr(fid, "numRecords", H5T_NATIVE_ULONG, &writtenRecords, true);
     uint32_t finished = 0;
-    H5Awrite(fAttr, H5T_NATIVE_UINT, &finished);
-    H5Aclose(fAttr);
+    writeAttr(fid, "finished", H5T_NATIVE_UINT, &finished, true);
 
     H5Fclose(fid);
+    futex_unlock(&hdf5Lock);
 
-    // Initialize buffer
-    buf = gm_calloc<PackedAccessRecord>(PT_CHUNKSIZE);
+    // Initialize buffers
+    numBlocks = spawnThread? TRACE_WRITE_BLOCKS : 1;
+    for (uint32_t i = 0; i < numBlocks; i++) {
+        Block& b = blocks[i];
+        b.recs = gm_calloc<PackedAccessRecord>(PT_CHUNKSIZE);
+        b.dataIds = lineSize? gm_calloc<uint32_t>(PT_CHUNKSIZE) : nullptr;
+        b.numRecs = 0;
+        b.last = false;
+        futex_init(&b.full);
+        futex_lock(&b.full);
+        futex_init(&b.empty);
+    }
+    curBlock = 0;
+    futex_lock(&blocks[0].empty);
+    buf = blocks[0].recs;
+    dataIds = blocks[0].dataIds;
     cur = 0;
     max = PT_CHUNKSIZE;
-    assert((uint32_t)(((char*) &buf[1]) - ((char*) &buf[0])) == sizeof(PackedAccessRecord));
+
+    if (spawnThread) spawnThread(ioThread, this);
+}
+
+uint32_t AccessTraceWriter::lineId(const void* data) {
+    assert(data);
+    uint64_t check = hashLine(data, lineSize, 0x5bd1e995ull);
+    // Lines whose hashes collide take the next free hash (open addressing; there are no removals)
+    for (uint64_t h = hashLine(data, lineSize, 0); ; h++) {
+        g_unordered_map<uint64_t, uint32_t>::iterator it = lineIds.find(h);
+        if (it == lineIds.end()) {
+            uint32_t id = lineChecks.size();
+            assert_msg(id != (uint32_t)-1, "Trace %s has too many distinct lines", fname.c_str());
+            lineIds[h] = id;
+            lineChecks.push_back(check);
+            newLines.insert(newLines.end(), (const uint8_t*) data, ((const uint8_t*) data) + lineSize);
+            return id;
+        }
+        if (lineChecks[it->second] == check) return it->second;
+    }
+}
+
+void AccessTraceWriter::writeRegion(const PackedRegionRecord& reg) {
+    futex_lock(&regionLock);
+    regions.push_back(reg);
+    regions.back().position = numWritten;
+    futex_unlock(&regionLock);
 }
 
 void AccessTraceWriter::dump(bool cont) {
+    if (!buf) return;  // already finished
+    assert_msg(!cont || cur == max, "Trace %s: only full blocks can be written before the trace ends", fname.c_str());
+    Block& b = blocks[curBlock];
+    b.numRecs = cur;
+    b.last = !cont;
+    b.newLines.swap(newLines);
+
+    if (numBlocks == 1) {
+        writeBlock(b);
+    } else {
+        futex_unlock(&b.full);
+        if (!cont) futex_lock(&b.empty);  // blocks are written in order, so once this one is, the trace is done
+    }
+
+    if (cont) {
+        curBlock = (curBlock + 1) % numBlocks;
+        Block& nb = blocks[curBlock];
+        if (numBlocks > 1) futex_lock(&nb.empty);  // stalls only if the I/O thread is behind by all the other blocks
+        buf = nb.recs;
+        dataIds = nb.dataIds;
+        cur = 0;
+    } else {
+        for (uint32_t i = 0; i < numBlocks; i++) {
+            gm_free(blocks[i].recs);
+            if (blocks[i].dataIds) gm_free(blocks[i].dataIds);
+        }
+        buf = nullptr;
+        dataIds = nullptr;
+        cur = 0;
+        max = 0;
+    }
+}
+
+void AccessTraceWriter::writeBlock(Block& b) {
+    // Encode outside the HDF5 lock, so other traces can be read and written meanwhile
+    uint64_t bytes = encodeBlock(b.recs, b.dataIds, b.numRecs, numChildren, encoded);
+    writtenRecords += b.numRecs;
+    writtenBytes += bytes;
+
+    futex_lock(&hdf5Lock);
     hid_t fid = H5Fopen(fname.c_str(), H5F_ACC_RDWR, H5P_DEFAULT);
     if (fid == H5I_INVALID_HID) panic("Could not open HDF5 file %s", fname.c_str());
-    hid_t table = H5PTopen(fid, "accs");
-    if (table == H5I_INVALID_HID) panic("Could not open HDF5 packet table");
-    herr_t err = H5PTappend(table, cur, buf);
-    assert(err >= 0);
 
-    if (!cont) {
-        hid_t fAttr = H5Aopen(fid, "finished", H5P_DEFAULT);
+    if (b.numRecs) {
+        appendPackets(fid, "accBytes", bytes, &encoded[0]);
+        appendPackets(fid, "blockEnds", 1, &writtenBytes);
+    }
+    if (!b.newLines.empty()) appendPackets(fid, "lines", b.newLines.size()/lineSize, &b.newLines[0]);
+
+    if (b.last) {
+        futex_lock(&regionLock);
+        if (!regions.empty()) appendPackets(fid, "regions", regions.size(), &regions[0]);
+        futex_unlock(&regionLock);
+        writeAttr(fid, "numRecords", H5T_NATIVE_ULONG, &writtenRecords, false);
         uint32_t finished = 1;
-        H5Awrite(fAttr, H5T_NATIVE_UINT, &finished);
-        H5Aclose(fAttr);
+        writeAttr(fid, "finished", H5T_NATIVE_UINT, &finished, false);
+    }
 
-        gm_free(buf);
-        buf = nullptr;
-        max = 0;
+    H5Fclose(fid);
+    futex_unlock(&hdf5Lock);
+    b.newLines.clear();
+}
+
+void AccessTraceWriter::ioLoop() {
+    for (uint32_t i = 0; ; i = (i + 1) % numBlocks) {
+        Block& b = blocks[i];
+        futex_lock(&b.full);
+        bool last = b.last;  // once we release it, a finished writer frees the block
+        writeBlock(b);
+        futex_unlock(&b.empty);
+        if (last) break;
     }
+}
+
+static void writeAt(int fd, const void* buf, size_t bytes, uint64_t offset, const char* fname) {
+    const char* p = (const char*) buf;
+    while (bytes) {
+        ssize_t res = pwrite(fd, p, bytes, offset);
+        if (res <= 0) panic("Write to %s failed: %s", fname, strerror(errno));
+        p += res;
+        offset += res;
+        bytes -= res;
+    }
+}
+
+// Copies count packets of an HDF5 table, of packetSize bytes each, to the binary file at offset, a chunk at a time
+static void copyTable(hid_t fid, const char* table, uint64_t count, size_t packetSize, uint64_t chunkSize, int fd, uint64_t offset, const char* fname) {
+    uint8_t* chunk = gm_calloc<uint8_t>(chunkSize*packetSize);
+    for (uint64_t start = 0; start < count; start += chunkSize) {
+        uint64_t n = MIN(chunkSize, count - start);
+        readPackets(fid, table, start, n, chunk);
+        writeAt(fd, chunk, n*packetSize, offset + start*packetSize, fname);
+    }
+    gm_free(chunk);
+}
+
+void ConvertTraceToBinary(const char* hdf5File, const char* binaryFile) {
+    auto align = [](uint64_t off) { return (off + BINARY_TRACE_ALIGN - 1) & ~(BINARY_TRACE_ALIGN - 1); };
+
+    futex_lock(&hdf5Lock);
+    hid_t fid = H5Fopen(hdf5File, H5F_ACC_RDONLY, H5P_DEFAULT);
+    if (fid == H5I_INVALID_HID) panic("Could not open HDF5 file %s", hdf5File);
+    if (!readUintAttr(fid, "finished")) panic("Trace file %s unfinished (halted simulation?)", hdf5File);
+
+    BinaryTraceHeader hdr;
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, BINARY_TRACE_MAGIC, sizeof(hdr.magic));
+    hdr.version = BINARY_TRACE_VERSION;
+    hdr.recordSize = sizeof(PackedAccessRecord);
+    bool compact = isCompact(fid);
+    hdr.numRecords = compact? readUlongAttr(fid, "numRecords") : numPackets(fid, "accs");
+    hdr.numChildren = readUintAttr(fid, "numChildren");
+    hdr.recordsOffset = align(sizeof(hdr));
+    if (H5Aexists(fid, "lineSize") > 0) {
+        hdr.lineSize = readUintAttr(fid, "lineSize");
+        hdr.numLines = numPackets(fid, "lines");
+        hdr.dataIdsOffset = align(hdr.recordsOffset + hdr.numRecords*sizeof(PackedAccessRecord));
+        hdr.linesOffset = align(hdr.dataIdsOffset + hdr.numRecords*sizeof(uint32_t));
+    }
+    if (H5Lexists(fid, "regions", H5P_DEFAULT) > 0) {
+        hdr.numRegions = numPackets(fid, "regions");
+        uint64_t prevEnd = hdr.lineSize? hdr.linesOffset + hdr.numLines*hdr.lineSize : hdr.recordsOffset + hdr.numRecords*sizeof(PackedAccessRecord);
+        hdr.regionsOffset = align(prevEnd);
+    }
+
+    int fd = open(binaryFile, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) panic("Could not create binary trace %s", binaryFile);
+    PackedAccessRecord* recs = gm_calloc<PackedAccessRecord>(PT_CHUNKSIZE);
+    uint32_t* ids = hdr.lineSize? gm_calloc<uint32_t>(PT_CHUNKSIZE) : nullptr;
+    for (uint64_t start = 0; start < hdr.numRecords; start += PT_CHUNKSIZE) {
+        uint64_t n = MIN(PT_CHUNKSIZE, hdr.numRecords - start);
+        readRecords(fid, compact, hdr.numChildren, start, n, recs, ids);
+        writeAt(fd, recs, n*sizeof(PackedAccessRecord), hdr.recordsOffset + start*sizeof(PackedAccessRecord), binaryFile);
+        if (ids) writeAt(fd, ids, n*sizeof(uint32_t), hdr.dataIdsOffset + start*sizeof(uint32_t), binaryFile);
+    }
+    gm_free(recs);
+    if (ids) gm_free(ids);
+    if (hdr.lineSize) copyTable(fid, "lines", hdr.numLines, hdr.lineSize, LINES_CHUNKSIZE, fd, hdr.linesOffset, binaryFile);
+    if (hdr.regionsOffset) copyTable(fid, "regions", hdr.numRegions, sizeof(PackedRegionRecord), REGIONS_CHUNKSIZE, fd, hdr.regionsOffset, binaryFile);
+    // Write the header last, so an interrupted conversion is not mistaken for a binary trace
+    writeAt(fd, &hdr, sizeof(hdr), 0, binaryFile);
+    close(fd);
 
-    cur = 0;
-    H5PTclose(table);
     H5Fclose(fid);
+    futex_unlock(&hdf5Lock);
 }
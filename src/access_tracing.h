@@ -27,9 +27,47 @@
 #define ACCESS_TRACING_H_
 
 #include "g_std/g_string.h"
+#include "g_std/g_unordered_map.h"
+#include "g_std/g_vector.h"
+#include "locks.h"
 #include "memory_hierarchy.h"
 
-/* HDF5-based classes read and write address traces in a consistent format */
+/* HDF5-based classes read and write address traces in a consistent format.
+ *
+ * Traces may optionally carry the contents of each accessed line, so that
+ * caches that look at the data (e.g., compressed caches) can be trace-driven.
+ * Line contents are stored once per distinct content: the "lines" table holds
+ * each distinct line, and the "accData" table, parallel to the records in
+ * "accs", holds the index of each record's line in it. The "lineSize"
+ * attribute is only present in traces with data.
+ *
+ * AccessTraceWriter stores records in a compact encoding (see
+ * access_tracing.cpp): blocks of records, each with per-child delta-encoded
+ * addresses and cycles in varints, are appended to the "accBytes" byte
+ * table, and "blockEnds" holds the byte offset where each block ends. Every
+ * block but the last holds the same number of records. Data ids are part of
+ * the records, and the "numRecords" attribute holds the record count. Older
+ * traces store PackedAccessRecords in the "accs" table instead (and data ids
+ * in "accData"); AccessTraceReader reads both.
+ *
+ * Traces also record the updates to the application's approximate regions
+ * (see PackedRegionRecord) in the "regions" table, so trace-driven caches
+ * classify lines as they did when the trace was recorded. Traces without a
+ * "regions" table predate this and cannot drive caches that classify lines.
+ *
+ * AccessTraceReader also reads flat binary traces (see BinaryTraceHeader),
+ * produced from HDF5 traces by convtrace. They are memory-mapped, and records
+ * and data are used in place.
+ *
+ * Memory: readers of HDF5 traces with data load the whole "lines" table on
+ * construction (numLines*lineSize bytes of the shared heap, e.g., 64MB per
+ * million distinct 64-byte lines), as records reference lines at random. For
+ * traces with many distinct lines, convert them to binary: their lines are
+ * mapped, and only paged in as they are used.
+ */
+
+// Runs fn(arg) on a new thread (e.g., with PIN_SpawnInternalThread, as pintools cannot use pthreads)
+typedef void (*SpawnThreadFn)(void (*fn)(void*), void* arg);
 
 struct AccessRecord {
     Address lineAddr;
@@ -37,6 +75,7 @@ struct AccessRecord {
     uint32_t latency;
     uint32_t childId;
     AccessType type;
+    const void* data;  // line contents, or nullptr if the trace has none
 };
 
 struct PackedAccessRecord {
@@ -47,56 +86,192 @@ struct PackedAccessRecord {
     uint16_t type;  // could be uint8_t, but causes corruption in HDF5? (wtf...)
 } /*__attribute__((packed))*/;  // 24 bytes --> no packing needed
 
+enum RegionOp {REGION_ADD, REGION_RESIZE, REGION_REMOVE};
+
+// An update to the approximate regions, applied before the record at position
+struct PackedRegionRecord {
+    uint64_t position;  // number of access records written before the update
+    uint64_t cycle;
+    uint64_t start;
+    uint64_t end;  // new end for REGION_ADD and REGION_RESIZE
+    DataValue min;  // REGION_ADD only
+    DataValue max;
+    uint32_t op;  // RegionOp
+    uint32_t type;  // DataType, REGION_ADD only
+};
+
+/* Binary traces: this header, then the records (PackedAccessRecord), then, if
+ * the trace has data, the data id of each record (uint32_t) and the distinct
+ * lines, then the region records (PackedRegionRecord). Sections start at
+ * 4KB-aligned offsets. Host byte order. regionsOffset is 0 if the source
+ * trace had no region records, as in version 1 traces (whose headers end at
+ * linesOffset, and the rest of the header page is zeros).
+ */
+#define BINARY_TRACE_MAGIC "zsimtrc"  // 8 bytes with the NUL
+#define BINARY_TRACE_VERSION 2
+#define BINARY_TRACE_ALIGN 4096ul
+
+struct BinaryTraceHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t recordSize;  // sizeof(PackedAccessRecord), to catch mismatched builds
+    uint64_t numRecords;
+    uint32_t numChildren;
+    uint32_t lineSize;  // 0 if the trace has no data
+    uint64_t numLines;
+    uint64_t recordsOffset;
+    uint64_t dataIdsOffset;
+    uint64_t linesOffset;
+    uint64_t numRegions;
+    uint64_t regionsOffset;
+};
+
+// Converts an HDF5 trace to a binary one
+void ConvertTraceToBinary(const char* hdf5File, const char* binaryFile);
+
 
 class AccessTraceReader {
     private:
+        // The chunk of records being read. Binary traces are a single chunk, mapped in place
         PackedAccessRecord* buf;
-        uint32_t cur;
-        uint32_t max;
+        uint64_t cur;
+        uint64_t max;
         g_string fname;
 
         uint64_t curFrameRecord;
         uint64_t numRecords;
         uint32_t numChildren; //i.e., how many parallel streams does this file contain?
+        bool compact;  // HDF5 trace in the compact encoding
+
+        // Data, if the trace has it (lineSize > 0). The distinct lines are all read in (or mapped) on
+        // construction, so the data of a record stays valid for the reader's lifetime
+        uint32_t lineSize;
+        uint8_t* lines;
+        uint32_t* dataIds;  // parallel to buf
+
+        // HDF5 prefetching, if given a SpawnThreadFn: a thread reads the next chunk into the spare buffers
+        // while the current one is consumed. spareFull and spareEmpty are held as semaphores
+        bool prefetch;
+        PackedAccessRecord* spareBuf;
+        uint32_t* spareDataIds;
+        lock_t spareFull;
+        lock_t spareEmpty;
+
+        // Region records, all read in (or mapped) on construction; null if the trace has none
+        PackedRegionRecord* regions;
+        uint64_t numRegions;
+        uint64_t nextRegion;
+        bool hasRegionTable;
 
     public:
-        AccessTraceReader(std::string fname);
+        explicit AccessTraceReader(std::string fname, SpawnThreadFn spawnThread = nullptr);
 
         inline bool empty() const {return (cur == max);}
         uint32_t getNumChildren() const {return numChildren;}
         uint64_t getNumRecords() const {return numRecords;}
+        uint32_t getLineSize() const {return lineSize;}  // 0 if the trace has no data
+        bool hasRegions() const {return hasRegionTable;}  // false for traces that predate region records
+
+        // Region records are interleaved with the access records: before each read(), apply the
+        // region records returned by readRegion() while regionDue()
+        inline bool regionDue() const {
+            return nextRegion < numRegions && regions[nextRegion].position <= curFrameRecord + cur;
+        }
+
+        inline const PackedRegionRecord& readRegion() {
+            assert(regionDue());
+            return regions[nextRegion++];
+        }
 
         inline AccessRecord read() {
             assert(cur < max);
+            const void* data = lineSize? &lines[(uint64_t)dataIds[cur]*lineSize] : nullptr;
             PackedAccessRecord& pr = buf[cur++];
-            AccessRecord rec = {pr.lineAddr, pr.reqCycle, pr.latency, pr.childId, (AccessType) pr.type};
+            AccessRecord rec = {pr.lineAddr, pr.reqCycle, pr.latency, pr.childId, (AccessType) pr.type, data};
             if (unlikely(cur == max)) nextChunk();
             return rec;
         }
 
     private:
         void nextChunk();
+        void readChunk(uint64_t start, uint64_t count, PackedAccessRecord* recBuf, uint32_t* idBuf);
+        void openBinary(int fd);
+        void prefetchLoop();
+        static void prefetchThread(void* arg) {static_cast<AccessTraceReader*>(arg)->prefetchLoop();}
 };
 
+#define TRACE_WRITE_BLOCKS 3  // with an I/O thread: one block filling, and up to two queued or being written
+
 class AccessTraceWriter : public GlobAlloc {
     private:
-        PackedAccessRecord* buf;
+        // Records are buffered in fixed-size blocks. Without an I/O thread, each full block is encoded and
+        // written on the spot; with one, it is handed to the I/O thread, which writes it while the next
+        // ones fill, and the writer only stalls when all blocks are queued. full and empty are held as
+        // semaphores: the writer holds empty while filling the block, the I/O thread holds full otherwise
+        struct Block {
+            PackedAccessRecord* recs;
+            uint32_t* dataIds;
+            uint32_t numRecs;
+            bool last;
+            g_vector<uint8_t> newLines;  // lines first seen in this block
+            lock_t full;
+            lock_t empty;
+        };
+
+        PackedAccessRecord* buf;  // records and data ids of the block being filled
+        uint32_t* dataIds;
         uint32_t cur;
         uint32_t max;
         g_string fname;
+        uint32_t numChildren;
+
+        Block blocks[TRACE_WRITE_BLOCKS];
+        uint32_t numBlocks;  // 1 if writing synchronously
+        uint32_t curBlock;
+
+        // Written by whoever writes blocks (the I/O thread, if any)
+        uint64_t writtenRecords;
+        uint64_t writtenBytes;
+        g_vector<uint8_t> encoded;
+
+        // Region records, written when the trace finishes. Unlike records, these may be written by any thread
+        g_vector<PackedRegionRecord> regions;
+        volatile uint64_t numWritten;  // records so far, which positions region records
+        lock_t regionLock;
+
+        // Data (lineSize > 0): lines are deduplicated by a 64-bit content hash, checked against a second one
+        uint32_t lineSize;
+        g_vector<uint8_t> newLines;  // lines first seen in the block being filled
+        g_unordered_map<uint64_t, uint32_t> lineIds;  // hash -> data id
+        g_vector<uint64_t> lineChecks;  // data id -> check hash
 
     public:
-        AccessTraceWriter(g_string fname, uint32_t numChildren);
+        // lineSize > 0 writes each record's data (AccessRecord::data, which must then be set). With a
+        // spawnThread, full blocks are written by an I/O thread
+        AccessTraceWriter(g_string fname, uint32_t numChildren, uint32_t lineSize = 0, SpawnThreadFn spawnThread = nullptr);
 
         inline void write(AccessRecord& acc) {
+            if (lineSize) dataIds[cur] = lineId(acc.data);
             buf[cur++] = {acc.lineAddr, acc.reqCycle, acc.latency, (uint16_t) acc.childId, (uint8_t) acc.type};
+            numWritten++;
             if (unlikely(cur == max)) {
                 dump(true);
                 assert(cur < max);
             }
         }
 
+        // Records a region update after the records written so far (its position is ignored). Thread-safe
+        void writeRegion(const PackedRegionRecord& reg);
+
+        // Writes out the records so far; only call with cont == true on a full block. With cont == false,
+        // finishes the trace, and returns once it is all written
         void dump(bool cont);
+
+    private:
+        uint32_t lineId(const void* data);
+        void writeBlock(Block& b);
+        void ioLoop();
+        static void ioThread(void* arg) {static_cast<AccessTraceWriter*>(arg)->ioLoop();}
 };
 
 #endif  // _ACCESS_TRACING_H
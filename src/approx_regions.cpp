@@ -0,0 +1,244 @@
+/** $lic$
+ * Copyright (C) 2012-2015 by Massachusetts Institute of Technology
+ * Copyright (C) 2010-2013 by The Board of Trustees of Stanford University
+ *
+ * This file is part of zsim.
+ *
+ * zsim is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, version 2.
+ *
+ * If you use this software in your research, we request that you reference
+ * the zsim paper ("ZSim: Fast and Accurate Microarchitectural Simulation of
+ * Thousand-Core Systems", Sanchez and Kozyrakis, ISCA-40, June 2013) as the
+ * source of the simulator in any publications that use this software, and that
+ * you send us a citation of your work.
+ *
+ * zsim is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "approx_regions.h"
+#include <string.h>
+#include <algorithm>
+#include "log.h"
+
+ApproxRegionIndex::ApproxRegionIndex() : retired(NULL), nextSeq(0) {
+    futex_init(&updateLock);
+    current = allocSnapshot(0);
+    buildIntervals(current);
+}
+
+ApproxRegionIndex::Snapshot* ApproxRegionIndex::allocSnapshot(uint32_t numRegions) {
+    // One block for the header and regions; buildIntervals() allocates the intervals
+    size_t bytes = sizeof(Snapshot) + numRegions*sizeof(Region);
+    Snapshot* snap = static_cast<Snapshot*>(gm_malloc(bytes));
+    snap->numRegions = numRegions;
+    snap->regions = reinterpret_cast<Region*>(snap + 1);
+    snap->numIntervals = 0;
+    snap->intervals = NULL;
+    snap->covers = NULL;
+    snap->nextRetired = NULL;
+    return snap;
+}
+
+void ApproxRegionIndex::freeSnapshot(Snapshot* snap) {
+    if (snap->intervals) gm_free(snap->intervals);
+    gm_free(snap);
+}
+
+void ApproxRegionIndex::buildIntervals(Snapshot* snap) {
+    const uint32_t n = snap->numRegions;
+    const Region* regions = snap->regions;
+
+    // Interval boundaries: every region start and every address right past a region end. Boundary j starts the
+    // range [bounds[j], bounds[j+1]), and the last one runs to the end of the address space
+    uint64_t* bounds = gm_calloc<uint64_t>(2*n + 1);
+    uint32_t numBounds = 0;
+    for (uint32_t i = 0; i < n; i++) {
+        bounds[numBounds++] = regions[i].start;
+        if (regions[i].end != ~0ull) bounds[numBounds++] = regions[i].end + 1;
+    }
+    std::sort(bounds, bounds + numBounds);
+    numBounds = std::unique(bounds, bounds + numBounds) - bounds;
+
+    // Regions in registration order, so that each range's covers come out sorted by seq
+    uint32_t* bySeq = gm_calloc<uint32_t>(n + 1);
+    for (uint32_t i = 0; i < n; i++) bySeq[i] = i;
+    std::sort(bySeq, bySeq + n, [regions](uint32_t a, uint32_t b) { return regions[a].seq < regions[b].seq; });
+
+    // Range each region spans, as [first, last] boundary indexes, and how many regions cover each range
+    uint32_t* firstBound = gm_calloc<uint32_t>(n + 1);
+    uint32_t* lastBound = gm_calloc<uint32_t>(n + 1);
+    uint32_t* counts = gm_calloc<uint32_t>(numBounds + 1);
+    uint32_t numCovers = 0;
+    for (uint32_t i = 0; i < n; i++) {
+        const Region& r = regions[i];
+        firstBound[i] = std::lower_bound(bounds, bounds + numBounds, r.start) - bounds;
+        lastBound[i] = (r.end == ~0ull)? numBounds - 1 : (std::lower_bound(bounds, bounds + numBounds, r.end + 1) - bounds) - 1;
+        for (uint32_t j = firstBound[i]; j <= lastBound[i]; j++) counts[j]++;
+        numCovers += lastBound[i] - firstBound[i] + 1;
+    }
+
+    // Keep the covered ranges as intervals; counts[j] becomes the next free cover slot of range j
+    uint32_t numIntervals = 0;
+    for (uint32_t j = 0; j < numBounds; j++) if (counts[j]) numIntervals++;
+    void* block = gm_malloc(numIntervals*sizeof(Interval) + numCovers*sizeof(uint32_t) + 1);
+    Interval* intervals = static_cast<Interval*>(block);
+    uint32_t* covers = reinterpret_cast<uint32_t*>(intervals + numIntervals);
+    uint32_t* slot = gm_calloc<uint32_t>(numBounds + 1);
+    uint32_t iv = 0;
+    uint32_t nextCover = 0;
+    for (uint32_t j = 0; j < numBounds; j++) {
+        if (!counts[j]) continue;
+        intervals[iv].start = bounds[j];
+        intervals[iv].end = (j + 1 < numBounds)? bounds[j + 1] - 1 : ~0ull;
+        intervals[iv].firstCover = nextCover;
+        intervals[iv].numCovers = counts[j];
+        slot[j] = nextCover;
+        nextCover += counts[j];
+        iv++;
+    }
+    assert(nextCover == numCovers);
+    for (uint32_t k = 0; k < n; k++) {
+        uint32_t i = bySeq[k];
+        for (uint32_t j = firstBound[i]; j <= lastBound[i]; j++) covers[slot[j]++] = i;
+    }
+
+    gm_free(bounds);
+    gm_free(bySeq);
+    gm_free(firstBound);
+    gm_free(lastBound);
+    gm_free(counts);
+    gm_free(slot);
+
+    snap->numIntervals = numIntervals;
+    snap->intervals = intervals;
+    snap->covers = covers;
+}
+
+bool ApproxRegionIndex::lookup(uint64_t start, uint64_t end, DataType* type, DataValue* min, DataValue* max) const {
+    const Snapshot* snap = __atomic_load_n(&current, __ATOMIC_ACQUIRE);
+    const Interval* intervals = snap->intervals;
+
+    // Find the last interval that starts at or before start
+    uint32_t lo = 0, hi = snap->numIntervals;
+    while (lo < hi) {
+        uint32_t mid = (lo + hi)/2;
+        if (intervals[mid].start <= start) lo = mid + 1;
+        else hi = mid;
+    }
+    if (lo == 0 || intervals[lo - 1].end < start) return false;  // no region contains start
+    const Interval* iv = &intervals[lo - 1];
+
+    // Every region covering the interval contains start, and the earliest one contains the whole range unless it
+    // crosses into the next interval
+    const uint32_t* covers = snap->covers + iv->firstCover;
+    const Region* found = NULL;
+    if (end <= iv->end) {
+        found = &snap->regions[covers[0]];
+    } else {
+        for (uint32_t c = 0; c < iv->numCovers; c++) {
+            const Region* r = &snap->regions[covers[c]];
+            if (r->end >= end) {
+                found = r;
+                break;
+            }
+        }
+    }
+
+    if (!found) return false;
+    *type = found->type;
+    if (min) *min = found->min;
+    if (max) *max = found->max;
+    return true;
+}
+
+int32_t ApproxRegionIndex::findByStart(const Snapshot* snap, uint64_t start) const {
+    int32_t idx = -1;
+    for (uint32_t i = 0; i < snap->numRegions; i++) {
+        const Region& r = snap->regions[i];
+        if (r.start > start) break;
+        if (r.start == start && (idx == -1 || r.seq < snap->regions[idx].seq)) idx = i;
+    }
+    return idx;
+}
+
+void ApproxRegionIndex::publish(Snapshot* snap) {
+    buildIntervals(snap);
+    Snapshot* old = current;
+    __atomic_store_n(&current, snap, __ATOMIC_RELEASE);
+    old->nextRetired = retired;
+    retired = old;
+}
+
+void ApproxRegionIndex::add(uint64_t start, uint64_t end, DataType type, DataValue min, DataValue max) {
+    futex_lock(&updateLock);
+    const Snapshot* old = current;
+    Snapshot* snap = allocSnapshot(old->numRegions + 1);
+
+    // Keep regions sorted by start; equal starts stay in registration order
+    uint32_t pos = 0;
+    while (pos < old->numRegions && old->regions[pos].start <= start) pos++;
+    memcpy(snap->regions, old->regions, pos*sizeof(Region));
+    memcpy(snap->regions + pos + 1, old->regions + pos, (old->numRegions - pos)*sizeof(Region));
+    Region& r = snap->regions[pos];
+    r.start = start;
+    r.end = end;
+    r.seq = nextSeq++;
+    r.type = type;
+    r.min = min;
+    r.max = max;
+
+    publish(snap);
+    futex_unlock(&updateLock);
+}
+
+bool ApproxRegionIndex::resize(uint64_t start, uint64_t newEnd) {
+    futex_lock(&updateLock);
+    const Snapshot* old = current;
+    int32_t idx = findByStart(old, start);
+    if (idx != -1) {
+        Snapshot* snap = allocSnapshot(old->numRegions);
+        memcpy(snap->regions, old->regions, old->numRegions*sizeof(Region));
+        snap->regions[idx].end = newEnd;
+        publish(snap);
+    }
+    futex_unlock(&updateLock);
+    return idx != -1;
+}
+
+bool ApproxRegionIndex::remove(uint64_t start) {
+    futex_lock(&updateLock);
+    const Snapshot* old = current;
+    int32_t idx = findByStart(old, start);
+    if (idx != -1) {
+        Snapshot* snap = allocSnapshot(old->numRegions - 1);
+        memcpy(snap->regions, old->regions, idx*sizeof(Region));
+        memcpy(snap->regions + idx, old->regions + idx + 1, (old->numRegions - idx - 1)*sizeof(Region));
+        publish(snap);
+    }
+    futex_unlock(&updateLock);
+    return idx != -1;
+}
+
+uint32_t ApproxRegionIndex::size() const {
+    return __atomic_load_n(&current, __ATOMIC_ACQUIRE)->numRegions;
+}
+
+void ApproxRegionIndex::reclaim() {
+    futex_lock(&updateLock);
+    Snapshot* snap = retired;
+    retired = NULL;
+    futex_unlock(&updateLock);
+    while (snap) {
+        Snapshot* next = snap->nextRetired;
+        freeSnapshot(snap);
+        snap = next;
+    }
+}
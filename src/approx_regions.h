@@ -0,0 +1,109 @@
+/** $lic$
+ * Copyright (C) 2012-2015 by Massachusetts Institute of Technology
+ * Copyright (C) 2010-2013 by The Board of Trustees of Stanford University
+ *
+ * This file is part of zsim.
+ *
+ * zsim is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, version 2.
+ *
+ * If you use this software in your research, we request that you reference
+ * the zsim paper ("ZSim: Fast and Accurate Microarchitectural Simulation of
+ * Thousand-Core Systems", Sanchez and Kozyrakis, ISCA-40, June 2013) as the
+ * source of the simulator in any publications that use this software, and that
+ * you send us a citation of your work.
+ *
+ * zsim is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef APPROX_REGIONS_H_
+#define APPROX_REGIONS_H_
+
+#include <stdint.h>
+#include "galloc.h"
+#include "locks.h"
+#include "memory_hierarchy.h"
+
+/* Index of the approximate memory regions registered by the application
+ * (zsim_allocate_approximate and friends), queried by the compressed caches on
+ * every access.
+ *
+ * Readers never lock: the index publishes immutable snapshots and lookup()
+ * binary-searches the current one. Updates are serialized by a lock, build a
+ * new snapshot and swap it in (RCU-style). The replaced snapshots are retired
+ * and only freed by reclaim(), which must be called when no lookup can be in
+ * flight (at the end of a phase).
+ *
+ * Regions may overlap. As with the linear scan this replaces, a lookup
+ * returns the earliest-registered region that contains the whole range, and
+ * resize()/remove() act on the earliest-registered region with that start.
+ * To keep lookups logarithmic however regions nest, each snapshot splits the
+ * address space at every region boundary into disjoint elementary intervals,
+ * each with the regions that cover it in registration order. A range within
+ * one interval takes the first of them; a range that crosses into the next
+ * interval (only possible when a region boundary falls inside it) takes the
+ * first of them that reaches its end.
+ */
+class ApproxRegionIndex : public GlobAlloc {
+    private:
+        struct Region {
+            uint64_t start;
+            uint64_t end;  // inclusive
+            uint64_t seq;  // registration order
+            DataType type;
+            DataValue min;
+            DataValue max;
+        };
+
+        // Maximal address range covered by the same regions
+        struct Interval {
+            uint64_t start;
+            uint64_t end;  // inclusive
+            uint32_t firstCover;  // its regions are covers[firstCover..firstCover+numCovers), by seq
+            uint32_t numCovers;
+        };
+
+        struct Snapshot {
+            uint32_t numRegions;
+            Region* regions;  // sorted by start
+            uint32_t numIntervals;
+            Interval* intervals;  // sorted by start, disjoint; gaps between regions are left out
+            uint32_t* covers;  // indexes into regions
+            Snapshot* nextRetired;
+        };
+
+        Snapshot* volatile current;
+        Snapshot* retired;
+        uint64_t nextSeq;
+        lock_t updateLock;
+
+    public:
+        ApproxRegionIndex();
+
+        // If some region contains [start, end], returns true and fills its
+        // type and value range (min and max may be NULL)
+        bool lookup(uint64_t start, uint64_t end, DataType* type, DataValue* min, DataValue* max) const;
+
+        void add(uint64_t start, uint64_t end, DataType type, DataValue min, DataValue max);
+        bool resize(uint64_t start, uint64_t newEnd);  // false if no region starts at start
+        bool remove(uint64_t start);  // ditto
+
+        uint32_t size() const;
+        void reclaim();
+
+    private:
+        static Snapshot* allocSnapshot(uint32_t numRegions);
+        static void freeSnapshot(Snapshot* snap);
+        static void buildIntervals(Snapshot* snap);
+        int32_t findByStart(const Snapshot* snap, uint64_t start) const;
+        void publish(Snapshot* snap);
+};
+
+#endif  // APPROX_REGIONS_H_
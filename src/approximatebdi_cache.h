@@ -1,27 +1,13 @@
 #ifndef APPROXIMATEBDI_CACHE_H_
 #define APPROXIMATEBDI_CACHE_H_
 
-#include "timing_cache.h"
-#include "stats.h"
+#include "compressed_timing_cache.h"
 
-class aHitWritebackEvent;
+class ApproximateBDICache : public CompressedTimingCache<ApproximateBDICache, ApproximateBDITagArray, ApproximateBDIDataArray> {
+    friend class CompressedTimingCache<ApproximateBDICache, ApproximateBDITagArray, ApproximateBDIDataArray>;
 
-class ApproximateBDICache : public TimingCache {
     protected:
         // Cache stuff
-        uint32_t numTagLines;
-        uint32_t numDataLines;
-
-        ApproximateBDITagArray* tagArray;
-        ApproximateBDIDataArray* dataArray;
-
-        ReplPolicy* tagRP;
-        ReplPolicy* dataRP;
-
-        RunningStats* crStats;
-        RunningStats* evStats;
-        RunningStats* tutStats;
-        RunningStats* dutStats;
         RunningStats* bdiStats;
         RunningStats* mutStats;
 
@@ -31,25 +17,29 @@ class ApproximateBDICache : public TimingCache {
 
     public:
         ApproximateBDICache(uint32_t _numTagLines, uint32_t _numDataLines, CC* _cc, ApproximateBDITagArray* _tagArray, ApproximateBDIDataArray* _dataArray, ReplPolicy* tagRP, ReplPolicy* dataRP, uint32_t _accLat, uint32_t _invLat,
-                        uint32_t mshrs, uint32_t ways, uint32_t cands, uint32_t _domain, const g_string& _name, RunningStats* _crStats, RunningStats* _evStats, RunningStats* _tutStats, RunningStats* _dutStats, Counter* _tag_hits, Counter* _tag_misses, Counter* _tag_all);
+                        uint32_t mshrs, uint32_t ways, uint32_t cands, uint32_t _domain, const g_string& _name, RunningStats* _crStats, RunningStats* _evStats, RunningStats* _tutStats, RunningStats* _dutStats, Counter* _tag_hits, Counter* _tag_misses, Counter* _tag_all,
+                        const CompressionTiming* _compTiming);
 
-        uint64_t access(MemReq& req);
         void dumpStats();
 
-        void initStats(AggregateStat* parentStat);
-        void simulateHitWriteback(aHitWritebackEvent* ev, uint64_t cycle, HitEvent* he);
-
     protected:
         void initCacheStats(AggregateStat* cacheStat);
-};
+        void sampleOccupancy(uint64_t weight);
+
+        // access() hooks, see CompressedTimingCache
+        static const bool countsTagAccesses = false;
+        static const bool tagWritebackAfterDataRead = true;
+        static const bool fetchesExactLines = true;
+        // Timing: to evict, need to read the data array too.
+        uint32_t victimReadLat(const Access& a) const {return accLat;}
+        void releaseTagVictim(Access& a, int32_t victimTagId, bool evicted);
+        FillPlan fill(Access& a, int32_t victimTagId);
+        HitPlan hit(Access& a, int32_t tagId);
+        void checkArrays();
 
-class aHitWritebackEvent : public TimingEvent {
     private:
-        ApproximateBDICache* cache;
-        HitEvent* he;
-    public:
-        aHitWritebackEvent(ApproximateBDICache* _cache,  HitEvent* _he, uint32_t postDelay, int32_t domain) : TimingEvent(0, postDelay, domain), cache(_cache), he(_he) {}
-        void simulate(uint64_t startCycle) {cache->simulateHitWriteback(this, startCycle, he);}
+        // Evicts lines from the accessed line's set until a lineSize line fits, accessed line and keptFromEvictions aside
+        void evictToFit(Access& a, uint16_t lineSize, uint64_t evBeginCycle, uint64_t* lastEvDoneCycle, uint64_t* caused);
 };
 
 #endif // APPROXIMATEBDI_CACHE_H_
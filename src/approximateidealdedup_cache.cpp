@@ -3,9 +3,11 @@
 
 ApproximateIdealDedupCache::ApproximateIdealDedupCache(uint32_t _numTagLines, uint32_t _numDataLines, CC* _cc, ApproximateDedupTagArray* _tagArray, ApproximateDedupDataArray* _dataArray, ApproximateDedupHashArray* _hashArray, ReplPolicy* tagRP,
 ReplPolicy* dataRP, ReplPolicy* hashRP, uint32_t _accLat, uint32_t _invLat, uint32_t mshrs, uint32_t ways, uint32_t cands, uint32_t _domain, const g_string& _name, RunningStats* _crStats,
-RunningStats* _evStats, RunningStats* _tutStats, RunningStats* _dutStats, Counter* _tag_hits, Counter* _tag_misses, Counter* _tag_all) : TimingCache(_numTagLines, _cc, NULL, tagRP, _accLat, _invLat, mshrs, tagLat, ways, cands, _domain, _name, _evStats, _tag_hits, _tag_misses, _tag_all), numTagLines(_numTagLines),
-numDataLines(_numDataLines), tagArray(_tagArray), dataArray(_dataArray), hashArray(_hashArray), tagRP(tagRP), dataRP(dataRP), hashRP(hashRP), crStats(_crStats), evStats(_evStats), tutStats(_tutStats), dutStats(_dutStats) {
+RunningStats* _evStats, RunningStats* _tutStats, RunningStats* _dutStats, Counter* _tag_hits, Counter* _tag_misses, Counter* _tag_all,
+const CompressionTiming* _compTiming) : CompressedTimingCache(_numTagLines, _numDataLines, _cc, _tagArray, _dataArray, tagRP, dataRP, _accLat, _invLat, mshrs, ways, cands, _domain, _name, _crStats, _evStats, _tutStats, _dutStats, _tag_hits, _tag_misses, _tag_all, _compTiming,
+"Approximate BDI cache stats"), hashArray(_hashArray), hashRP(hashRP) {
     hashArray->registerDataArray(dataArray);
+    dataArray->enableContentIndex();
     TM_DS = 0;
     TM_DD = 0;
     WD_TH_DS = 0;
@@ -21,26 +23,6 @@ numDataLines(_numDataLines), tagArray(_tagArray), dataArray(_dataArray), hashArr
     dupStats = new RunningStats(statName);
 }
 
-void ApproximateIdealDedupCache::initStats(AggregateStat* parentStat) {
-    AggregateStat* cacheStat = new AggregateStat();
-    cacheStat->init(name.c_str(), "Approximate BDI cache stats");
-    initCacheStats(cacheStat);
-
-    //Stats specific to timing cacheStat
-    profOccHist.init("occHist", "Occupancy MSHR cycle histogram", numMSHRs+1);
-    cacheStat->append(&profOccHist);
-
-    profHitLat.init("latHit", "Cumulative latency accesses that hit (demand and non-demand)");
-    profMissRespLat.init("latMissResp", "Cumulative latency for miss start to response");
-    profMissLat.init("latMiss", "Cumulative latency for miss start to finish (free MSHR)");
-
-    cacheStat->append(&profHitLat);
-    cacheStat->append(&profMissRespLat);
-    cacheStat->append(&profMissLat);
-
-    parentStat->append(cacheStat);
-}
-
 void ApproximateIdealDedupCache::initCacheStats(AggregateStat* cacheStat) {
     cc->initStats(cacheStat);
     tagArray->initStats(cacheStat);
@@ -48,518 +30,190 @@ void ApproximateIdealDedupCache::initCacheStats(AggregateStat* cacheStat) {
     dataArray->initStats(cacheStat);
     dataRP->initStats(cacheStat);
     hashRP->initStats(cacheStat);
+    appendRunningStats(cacheStat, dupStats, "dedupRatio", "Tags per distinct data line");
+    appendCounter(cacheStat, &TM_DS, "TM_DS", "Tag misses, duplicate found");
+    appendCounter(cacheStat, &TM_DD, "TM_DD", "Tag misses, no duplicate");
+    appendCounter(cacheStat, &WD_TH_DS, "WD_TH_DS", "Tag hits writing different data, duplicate found");
+    appendCounter(cacheStat, &WD_TH_DD_1, "WD_TH_DD_1", "Tag hits writing different data, no duplicate, old data unshared");
+    appendCounter(cacheStat, &WD_TH_DD_M, "WD_TH_DD_M", "Tag hits writing different data, no duplicate, old data shared");
+    appendCounter(cacheStat, &WSR_TH, "WSR_TH", "Tag hits by reads or same-data writes");
+    appendCounter(cacheStat, &DS_HI, "DS_HI", "Duplicate found, no hash entry");
+    appendCounter(cacheStat, &DS_HS, "DS_HS", "Duplicate found, hash to the same data");
+    appendCounter(cacheStat, &DS_HD, "DS_HD", "Duplicate found, hash to other data");
+    appendCounter(cacheStat, &DD_HI, "DD_HI", "No duplicate, no hash entry");
+    appendCounter(cacheStat, &DD_HD, "DD_HD", "No duplicate, hash to other data");
 }
 
-uint64_t ApproximateIdealDedupCache::access(MemReq& req) {
-    if (tag_all) tag_all->inc();
-    DataLine data = gm_calloc<uint8_t>(zinfo->lineSize);
-    DataType type = ZSIM_FLOAT;
-    bool approximate = false;
-    uint64_t Evictions = 0;
-    uint64_t readAddress = req.lineAddr;
-    for(uint32_t i = 0; i < zinfo->approximateRegions->size(); i++) {
-        if ((readAddress << lineBits) >= std::get<0>((*zinfo->approximateRegions)[i]) && (readAddress << lineBits) <= std::get<1>((*zinfo->approximateRegions)[i])
-        && (readAddress << lineBits)+zinfo->lineSize-1 >= std::get<0>((*zinfo->approximateRegions)[i]) && (readAddress << lineBits)+zinfo->lineSize-1 <= std::get<1>((*zinfo->approximateRegions)[i])) {
-            type = std::get<2>((*zinfo->approximateRegions)[i]);
-            approximate = true;
-            break;
-        }
+void ApproximateIdealDedupCache::releaseData(Access& a, int32_t tagId, int32_t dataId) {
+    int32_t newLLHead = -1;
+    bool approximateVictim;
+    bool evictDataLine = tagArray->evictAssociatedData(tagId, &newLLHead, &approximateVictim);
+    if (evictDataLine) {
+        // Clear (Evict, Tags already evicted) data line
+        dataArray->postinsert(-1, &a.req, 0, dataId, false, NULL, false);
+    } else if (newLLHead != -1) {
+        // Change Tag
+        uint32_t victimCounter = dataArray->readCounter(dataId);
+        dataArray->changeInPlace(newLLHead, &a.req, victimCounter-1, dataId, approximateVictim, NULL, false);
+    } else if (dataId != -1) {
+        uint32_t victimCounter = dataArray->readCounter(dataId);
+        int32_t LLHead = dataArray->readListHead(dataId);
+        dataArray->changeInPlace(LLHead, &a.req, victimCounter-1, dataId, approximateVictim, NULL, false);
     }
-    PIN_SafeCopy(data, (void*)(readAddress << lineBits), zinfo->lineSize);
-    // // // info("\tData type: %s, Data: %f,%f,%f,%f,%f,%f,%f,%f,%f,%f,%f,%f,%f,%f,%f,%f", DataTypeName(type), ((float*)data)[0], ((float*)data)[1], ((float*)data)[2], ((float*)data)[3], ((float*)data)[4], ((float*)data)[5], ((float*)data)[6], ((float*)data)[7], ((float*)data)[8], ((float*)data)[9], ((float*)data)[10], ((float*)data)[11], ((float*)data)[12], ((float*)data)[13], ((float*)data)[14], ((float*)data)[15]);
-
-    EventRecorder* evRec = zinfo->eventRecorders[req.srcId];
-    assert_msg(evRec, "ApproximateBDI is not connected to TimingCore");
-
-    // Tie two events to an optional timing record
-    // TODO: Promote to evRec if this is more generally useful
-    auto connect = [evRec](const TimingRecord* r, TimingEvent* startEv, TimingEvent* endEv, uint64_t startCycle, uint64_t endCycle) {
-        assert_msg(startCycle <= endCycle, "start > end? %ld %ld", startCycle, endCycle);
-        if (r) {
-            assert_msg(startCycle <= r->reqCycle, "%ld / %ld", startCycle, r->reqCycle);
-            assert_msg(r->respCycle <= endCycle, "%ld %ld %ld %ld", startCycle, r->reqCycle, r->respCycle, endCycle);
-            uint64_t upLat = r->reqCycle - startCycle;
-            uint64_t downLat = endCycle - r->respCycle;
+}
 
-            if (upLat) {
-                DelayEvent* dUp = new (evRec) DelayEvent(upLat);
-                // // // info("uCREATE: %p at %u", dUp, __LINE__);
-                dUp->setMinStartCycle(startCycle);
-                startEv->addChild(dUp, evRec)->addChild(r->startEvent, evRec);
-            } else {
-                startEv->addChild(r->startEvent, evRec);
-            }
+void ApproximateIdealDedupCache::releaseTagVictim(Access& a, int32_t victimTagId, bool evicted) {
+    releaseData(a, victimTagId, tagArray->readDataId(victimTagId));
+    tagArray->postinsert(0, &a.req, victimTagId, -1, -1, false, false);
+}
 
-            if (downLat) {
-                DelayEvent* dDown = new (evRec) DelayEvent(downLat);
-                // // // info("uCREATE: %p at %u", dDown, __LINE__);
-                dDown->setMinStartCycle(r->respCycle);
-                r->endEvent->addChild(dDown, evRec)->addChild(endEv, evRec);
-            } else {
-                r->endEvent->addChild(endEv, evRec);
-            }
+ApproximateIdealDedupCache::FillPlan ApproximateIdealDedupCache::fill(Access& a, int32_t victimTagId) {
+    MemReq& req = a.req;
+    DataLine data = scratch.fetchLine();
+    if(a.approximate)
+        hashArray->approximate(data, a.type);
+    int32_t dataId = dataArray->findSame(data);
+    uint64_t hash = hashLine(hashArray, data, a.approximate, a.type);
+    // Timing: hashing the fill delays the data array update, not the response
+    uint32_t fillLat = compTiming->hashLat;
+    int32_t hashId = hashArray->lookup(hash, &req, false);
+    if (dataId != -1) {
+        if (hashId == -1) {
+            DS_HI++;
+            hashId = hashArray->preinsert(hash, &req);
+            if(hashId != -1)
+                hashArray->postinsert(hash, &req, dataId, hashId, true);
+        } else if (hashArray->readDataPointer(hashId) == dataId) {
+            DS_HS++;
         } else {
-            if (startCycle == endCycle) {
-                startEv->addChild(endEv, evRec);
-            } else {
-                DelayEvent* dEv = new (evRec) DelayEvent(endCycle - startCycle);
-                // // // info("uCREATE: %p at %u", dEv, __LINE__);
-                dEv->setMinStartCycle(startCycle);
-                startEv->addChild(dEv, evRec)->addChild(endEv, evRec);
-            }
+            DS_HD++;
+            if(dataArray->readCounter(hashArray->readDataPointer(hashId)) == 1)
+                hashArray->postinsert(hash, &req, dataId, hashId, true);
         }
-    };
-
-    TimingRecord tagWritebackRecord, accessRecord, tr;
-    tagWritebackRecord.clear();
-    accessRecord.clear();
-    g_vector<TimingRecord> writebackRecords;
-    g_vector<uint64_t> wbStartCycles;
-    g_vector<uint64_t> wbEndCycles;
-    uint64_t tagEvDoneCycle = 0;
-    uint64_t respCycle = req.cycle;
-    uint64_t evictCycle = req.cycle;
-
-    g_vector<uint32_t> keptFromEvictions;
-
-    bool skipAccess = cc->startAccess(req); //may need to skip access due to races (NOTE: may change req.type!)
-    if (likely(!skipAccess)) {
-        // info("%lu: REQ %s to address %lu in %s region", req.cycle, AccessTypeName(req.type), req.lineAddr << lineBits, approximate? "approximate":"exact");
-        // info("Req data type: %s, data: %f,%f,%f,%f,%f,%f,%f,%f,%f,%f,%f,%f,%f,%f,%f,%f", DataTypeName(type), ((float*)data)[0], ((float*)data)[1], ((float*)data)[2], ((float*)data)[3], ((float*)data)[4], ((float*)data)[5], ((float*)data)[6], ((float*)data)[7], ((float*)data)[8], ((float*)data)[9], ((float*)data)[10], ((float*)data)[11], ((float*)data)[12], ((float*)data)[13], ((float*)data)[14], ((float*)data)[15]);
-        bool updateReplacement = (req.type == GETS) || (req.type == GETX);
-        int32_t tagId = tagArray->lookup(req.lineAddr, &req, updateReplacement);
-        zinfo->tagAll++;
-        respCycle += accLat;
-        evictCycle += accLat;
-
-        MissStartEvent* mse;
-        MissResponseEvent* mre;
-        MissWritebackEvent* mwe;
-        if (tagId == -1) {
-            if (tag_misses) tag_misses->inc();
-            zinfo->tagMisses++;
-            // info("\tTag Miss");
-            assert(cc->shouldAllocate(req));
-            // Get the eviction candidate
-            Address wbLineAddr;
-            int32_t victimTagId = tagArray->preinsert(req.lineAddr, &req, &wbLineAddr); //find the lineId to replace
-            // info("\t\tEvicting tagId: %i", victimTagId);
-            keptFromEvictions.push_back(victimTagId);
-            trace(Cache, "[%s] Evicting 0x%lx", name.c_str(), wbLineAddr);
-            // Need to evict the tag.
-            tagEvDoneCycle = cc->processEviction(req, wbLineAddr, victimTagId, evictCycle);
-            // // // info("\t\t\tEviction finished at %lu", tagEvDoneCycle);
-            int32_t newLLHead = -1;
-            bool approximateVictim;
-            bool evictDataLine = tagArray->evictAssociatedData(victimTagId, &newLLHead, &approximateVictim);
-            int32_t victimDataId = tagArray->readDataId(victimTagId);
-            if (evictDataLine) {
-                // info("\t\tAlong with dataId: %i", victimDataId);
-                // Clear (Evict, Tags already evicted) data line
-                dataArray->postinsert(-1, &req, 0, victimDataId, false, NULL, false);
-            } else if (newLLHead != -1) {
-                // Change Tag
-                // info("\t\tAnd decremented tag counter and decremented LL Head for dataline %i", victimDataId);
-                uint32_t victimCounter = dataArray->readCounter(victimDataId);
-                dataArray->changeInPlace(newLLHead, &req, victimCounter-1, victimDataId, approximateVictim, NULL, false);
-            } else if (victimDataId != -1) {
-                // info("\t\tAnd decremented dedup counter for dataline %i.", victimDataId);
-                uint32_t victimCounter = dataArray->readCounter(victimDataId);
-                int32_t LLHead = dataArray->readListHead(victimDataId);
-                dataArray->changeInPlace(LLHead, &req, victimCounter-1, victimDataId, approximateVictim, NULL, false);
-            }
-            tagArray->postinsert(0, &req, victimTagId, -1, -1, false, false);
-            if (evRec->hasRecord()) {
-                // // info("\t\tEvicting tagId: %i", victimTagId);
-                Evictions++;
-                tagWritebackRecord.clear();
-                tagWritebackRecord = evRec->popRecord();
-            }
-
-            // Need to get the line we want
-            uint64_t getDoneCycle = respCycle;
-            respCycle = cc->processAccess(req, victimTagId, respCycle, &getDoneCycle);
-            tr = {req.lineAddr << lineBits, req.cycle, respCycle, req.type, nullptr, nullptr};
-            if (evRec->hasRecord()) accessRecord = evRec->popRecord();
-
-            if(approximate)
-                hashArray->approximate(data, type);
-            int32_t dataId = -1;
-            for (uint32_t i = 0; i < numDataLines; i++) {
-                if (dataArray->readCounter(i) && dataArray->isSame(i, data)) {
-                    dataId = i;
-                    break;
-                }
-            }
-            uint64_t hash = hashArray->hash(data);
-            int32_t hashId = hashArray->lookup(hash, &req, false);
-            if (dataId != -1) {
-                if (hashId == -1) {
-                    DS_HI++;
-                    hashId = hashArray->preinsert(hash, &req);
-                    if(hashId != -1)
-                        hashArray->postinsert(hash, &req, dataId, hashId, true);
-                } else if (hashArray->readDataPointer(hashId) == dataId) {
-                    DS_HS++;
-                } else {
-                    DS_HD++;
-                    if(dataArray->readCounter(hashArray->readDataPointer(hashId)) == 1)
-                        hashArray->postinsert(hash, &req, dataId, hashId, true);
-                }
-                TM_DS++;
-                // info("\t\tfound matching data at %i.", dataId);
-                int32_t oldListHead = dataArray->readListHead(dataId);
-                // // info("With a list head at %i", oldListHead);
-                uint32_t dataCounter = dataArray->readCounter(dataId);
-                tagArray->postinsert(req.lineAddr, &req, victimTagId, dataId, oldListHead, true, updateReplacement);
-                // // info("postinsert %i with oldListHead %i", victimTagId, oldListHead);
-                dataArray->postinsert(victimTagId, &req, dataCounter+1, dataId, true, NULL, updateReplacement);
-
-                assert_msg(getDoneCycle == respCycle, "gdc %ld rc %ld", getDoneCycle, respCycle);
-
-                mse = new (evRec) MissStartEvent(this, accLat, domain);
-                // // // info("uCREATE: %p at %u", mse, __LINE__);
-                mre = new (evRec) MissResponseEvent(this, mse, domain);
-                // // // info("uCREATE: %p at %u", mre, __LINE__);
-                mwe = new (evRec) MissWritebackEvent(this, mse, accLat, domain);
-                // // // info("uCREATE: %p at %u", mwe, __LINE__);
-
-                mse->setMinStartCycle(req.cycle);
-                // // // info("\t\t\tMiss Start Event: %lu, %u", req.cycle, accLat);
-                mre->setMinStartCycle(respCycle);
-                // // // info("\t\t\tMiss Response Event: %lu", respCycle);
-                mwe->setMinStartCycle(MAX(respCycle, tagEvDoneCycle));
-                // // // info("\t\t\tMiss writeback event: %lu, %u", MAX(respCycle, tagEvDoneCycle), accLat);
-
-                connect(accessRecord.isValid()? &accessRecord : nullptr, mse, mre, req.cycle + accLat, respCycle);
-                mre->addChild(mwe, evRec);
-                if (tagEvDoneCycle) {
-                    connect(tagWritebackRecord.isValid()? &tagWritebackRecord : nullptr, mse, mwe, req.cycle + accLat, tagEvDoneCycle);
-                }
-            } else {
-                TM_DD++;
-                // info("\t\tCouldn't find matching hash.");
-                // Select data to evict
-                evictCycle = respCycle + accLat;
-                int32_t victimListHeadId, newVictimListHeadId;
-                int32_t victimDataId = dataArray->preinsert(&victimListHeadId);
-                if (hashId == -1) {
-                    DD_HI++;
-                    hashId = hashArray->preinsert(hash, &req);
-                    if(hashId != -1)
-                        hashArray->postinsert(hash, &req, victimDataId, hashId, true);
-                } else {
-                    DD_HD++;
-                    if(dataArray->readCounter(hashArray->readDataPointer(hashId)) == 1)
-                        hashArray->postinsert(hash, &req, victimDataId, hashId, true);
-                }
-                // info("\t\tEvicting dataline %i", victimDataId);
-                uint64_t evBeginCycle = evictCycle;
-                TimingRecord writebackRecord;
-                uint64_t lastEvDoneCycle = tagEvDoneCycle;
-                uint64_t evDoneCycle = evBeginCycle;
-                if (evRec->hasRecord()) accessRecord = evRec->popRecord();
-                while (victimListHeadId != -1) {
-                    if (victimListHeadId != victimTagId) {
-                        Address wbLineAddr = tagArray->readAddress(victimListHeadId);
-                        // info("\t\tAlong with tagId: %i", victimListHeadId);
-                        // // info("\t\tEvicting tagId: %i", victimListHeadId);
-                        evDoneCycle = cc->processEviction(req, wbLineAddr, victimListHeadId, evBeginCycle);
-                        // // // info("\t\t\tEviction finished at %lu", evDoneCycle);
-                        newVictimListHeadId = tagArray->readNextLL(victimListHeadId);
-                        tagArray->postinsert(0, &req, victimListHeadId, -1, -1, false, false);
-                    } else {
-                        newVictimListHeadId = tagArray->readNextLL(victimListHeadId);
-                    }
-                    if (evRec->hasRecord()) {
-                        Evictions++;
-                        writebackRecord.clear();
-                        writebackRecord = evRec->popRecord();
-                        writebackRecords.push_back(writebackRecord);
-                        wbStartCycles.push_back(evBeginCycle);
-                        wbEndCycles.push_back(evDoneCycle);
-                        lastEvDoneCycle = evDoneCycle;
-                        evBeginCycle += accLat;
-                    }
-                    victimListHeadId = newVictimListHeadId;
-                }
-                tagArray->postinsert(req.lineAddr, &req, victimTagId, victimDataId, -1, true, updateReplacement);
-                // // info("postinsert %i", victimTagId);
-                dataArray->postinsert(victimTagId, &req, 1, victimDataId, true, data, updateReplacement);
-                assert_msg(getDoneCycle == respCycle, "gdc %ld rc %ld", getDoneCycle, respCycle);
-                mse = new (evRec) MissStartEvent(this, accLat, domain);
-                // // // info("uCREATE: %p at %u", mse, __LINE__);
-                mre = new (evRec) MissResponseEvent(this, mse, domain);
-                // // // info("uCREATE: %p at %u", mre, __LINE__);
-                mwe = new (evRec) MissWritebackEvent(this, mse, accLat, domain);
-                // // // info("uCREATE: %p at %u", mwe, __LINE__);
+        TM_DS++;
+        debug("%s: found matching data at %i.", name.c_str(), dataId);
+        int32_t oldListHead = dataArray->readListHead(dataId);
+        uint32_t dataCounter = dataArray->readCounter(dataId);
+        tagArray->postinsert(req.lineAddr, &req, victimTagId, dataId, oldListHead, true, a.updateReplacement);
+        dataArray->postinsert(victimTagId, &req, dataCounter+1, dataId, true, NULL, a.updateReplacement);
+        return FillPlan(fillLat, accLat, MAX(a.respCycle, a.tagEvDoneCycle));
+    }
+    TM_DD++;
+    debug("%s: found no matching data.", name.c_str());
+    // Select data to evict
+    uint64_t evBeginCycle = a.respCycle + fillLat + accLat;
+    int32_t victimListHeadId;
+    int32_t victimDataId = dataArray->preinsert(&victimListHeadId);
+    if (hashId == -1) {
+        DD_HI++;
+        hashId = hashArray->preinsert(hash, &req);
+        if(hashId != -1)
+            hashArray->postinsert(hash, &req, victimDataId, hashId, true);
+    } else {
+        DD_HD++;
+        if(dataArray->readCounter(hashArray->readDataPointer(hashId)) == 1)
+            hashArray->postinsert(hash, &req, victimDataId, hashId, true);
+    }
+    debug("%s: Picked victim data line %i", name.c_str(), victimDataId);
+    uint64_t lastEvDoneCycle = a.tagEvDoneCycle;
+    evictList(a, victimListHeadId, victimTagId, &evBeginCycle, &lastEvDoneCycle, NULL);
+    tagArray->postinsert(req.lineAddr, &req, victimTagId, victimDataId, -1, true, a.updateReplacement);
+    dataArray->postinsert(victimTagId, &req, 1, victimDataId, true, data, a.updateReplacement);
+    return FillPlan(fillLat, accLat, MAX(lastEvDoneCycle, a.tagEvDoneCycle));
+}
 
-                mse->setMinStartCycle(req.cycle);
-                // // // info("\t\t\tMiss Start Event: %lu, %u", req.cycle, accLat);
-                mre->setMinStartCycle(respCycle);
-                // // // info("\t\t\tMiss Response Event: %lu", respCycle);
-                mwe->setMinStartCycle(MAX(lastEvDoneCycle, tagEvDoneCycle));
-                // // // info("\t\t\tMiss writeback event: %lu, %u", MAX(lastEvDoneCycle, tagEvDoneCycle), accLat);
+ApproximateIdealDedupCache::HitPlan ApproximateIdealDedupCache::hit(Access& a, int32_t tagId) {
+    MemReq& req = a.req;
+    HitPlan plan(0, 0);
+    // Only writes look at the line's contents
+    DataLine data = NULL;
+    if (req.type == PUTX) {
+        data = scratch.fetchLine();
+        if(a.approximate)
+            hashArray->approximate(data, a.type);
+    }
+    int32_t dataId = tagArray->readDataId(tagId);
+    if (req.type != PUTX || dataArray->isSame(dataId, data)) {
+        WSR_TH++;
+        dataArray->lookup(tagArray->readDataId(tagId), &req, a.updateReplacement);
+        return plan;
+    }
 
-                connect(accessRecord.isValid()? &accessRecord : nullptr, mse, mre, req.cycle + accLat, respCycle);
-                if(wbStartCycles.size()) {
-                    for(uint32_t i = 0; i < wbStartCycles.size(); i++) {
-                        DelayEvent* del = new (evRec) DelayEvent(wbStartCycles[i] - respCycle);
-                        // // // info("uCREATE: %p at %u", del, __LINE__);
-                        del->setMinStartCycle(respCycle);
-                        mre->addChild(del, evRec);
-                        connect(writebackRecords[i].isValid()? &writebackRecords[i] : nullptr, del, mwe, wbStartCycles[i], wbEndCycles[i]);
-                    }
-                }
-                mre->addChild(mwe, evRec);
-                if (tagEvDoneCycle) {
-                    connect(tagWritebackRecord.isValid()? &tagWritebackRecord : nullptr, mse, mwe, req.cycle + accLat, tagEvDoneCycle);
-                }
-            }
-            tr.startEvent = mse;
-            tr.endEvent = mre;
+    debug("%s: write data is found different from before.", name.c_str());
+    uint64_t hash = hashLine(hashArray, data, a.approximate, a.type);
+    // Timing: writes of different data hash it first
+    plan.compLat = compTiming->hashLat;
+    a.respCycle += plan.compLat;
+    int32_t hashId = hashArray->lookup(hash, &req, false);
+    int32_t targetDataId = dataArray->findSame(data);
+    if (targetDataId != -1) {
+        if (hashId == -1) {
+            DS_HI++;
+            hashId = hashArray->preinsert(hash, &req);
+            if(hashId != -1)
+                hashArray->postinsert(hash, &req, targetDataId, hashId, true);
+        } else if (hashArray->readDataPointer(hashId) == targetDataId) {
+            DS_HS++;
         } else {
-            if (tag_hits) tag_hits->inc();
-            zinfo->tagHits++;
-            if(approximate)
-                hashArray->approximate(data, type);
-            int32_t dataId = tagArray->readDataId(tagId);
-            if (req.type == PUTX && !dataArray->isSame(dataId, data)) {
-                // int32_t dataId = hashArray->readDataPointer(hashId);
-                // info("\tWrite Tag Hit, Data different");
-                uint64_t hash = hashArray->hash(data);
-                int32_t hashId = hashArray->lookup(hash, &req, false);
-                int32_t targetDataId = -1;
-                for (uint32_t i = 0; i < numDataLines; i++) {
-                    if (dataArray->readCounter(i) && dataArray->isSame(i, data)) {
-                        targetDataId = i;
-                        break;
-                    }
-                }
-                if (targetDataId != -1) {
-                    if (hashId == -1) {
-                        DS_HI++;
-                        hashId = hashArray->preinsert(hash, &req);
-                        if(hashId != -1)
-                            hashArray->postinsert(hash, &req, targetDataId, hashId, true);
-                    } else if (hashArray->readDataPointer(hashId) == targetDataId) {
-                        DS_HS++;
-                    } else {
-                        DS_HD++;
-                        if(dataArray->readCounter(hashArray->readDataPointer(hashId)) == 1)
-                            hashArray->postinsert(hash, &req, targetDataId, hashId, true);
-                    }
-                    WD_TH_DS++;
-                    // info("\t\tFound matching data at %i.", targetDataId);
-                    // // info("Data is also similar to %i.", targetDataId);
-                    bool approximateVictim;
-                    int32_t newLLHead;
-                    bool evictDataLine = tagArray->evictAssociatedData(tagId, &newLLHead, &approximateVictim);
-                    if (evictDataLine) {
-                        // info("\t\tDeleting old dataId at %i", dataId);
-                        // // info("\t\tAlong with dataId: %i", dataId);
-                        // Clear (Evict, Tags already evicted) data line
-                        dataArray->postinsert(-1, &req, 0, dataId, false, NULL, false);
-                    } else if (newLLHead != -1) {
-                        // info("\t\tchanging LL pointer for old dataId at %i and decremented it's counter", dataId);
-                        // Change Tag
-                        uint32_t victimCounter = dataArray->readCounter(dataId);
-                        dataArray->changeInPlace(newLLHead, &req, victimCounter-1, dataId, approximateVictim, NULL, false);
-                    } else {
-                        // info("\t\tdecremented the counter at dataId %i", dataId);
-                        // // info("\t\tAlso decremented dedup counter.");
-                        uint32_t victimCounter = dataArray->readCounter(dataId);
-                        int32_t LLHead = dataArray->readListHead(dataId);
-                        dataArray->changeInPlace(LLHead, &req, victimCounter-1, dataId, approximateVictim, NULL, false);
-                    }
-                    respCycle += 2*accLat;
-                    int32_t oldListHead = dataArray->readListHead(targetDataId);
-                    // // info("With a list head at %i", oldListHead);
-                    uint32_t dataCounter = dataArray->readCounter(targetDataId);
-                    tagArray->changeInPlace(req.lineAddr, &req, tagId, targetDataId, oldListHead, true, updateReplacement);
-                    // // info("postinsert %i with oldListHead %i", tagId, oldListHead);
-                    dataArray->postinsert(tagId, &req, dataCounter+1, targetDataId, true, NULL, updateReplacement);
-
-                    uint64_t getDoneCycle = respCycle;
-                    respCycle = cc->processAccess(req, tagId, respCycle, &getDoneCycle);
-                    if (evRec->hasRecord()) accessRecord = evRec->popRecord();
-                    tr = {req.lineAddr << lineBits, req.cycle, respCycle, req.type, nullptr, nullptr};
-
-                    HitEvent* he = new (evRec) HitEvent(this, respCycle - req.cycle, domain);
-                    // // // info("uCREATE: %p at %u", he, __LINE__);
-                    idHitWritebackEvent* hwe = new (evRec) idHitWritebackEvent(this, he, respCycle - req.cycle, domain);
-                    // // // info("uCREATE: %p at %u", hwe, __LINE__);
-
-                    he->setMinStartCycle(req.cycle);
-                    hwe->setMinStartCycle(respCycle);
-                    // // // info("\t\t\tHit Event: %lu, %lu", req.cycle, respCycle - req.cycle);
-                    // // // info("\t\t\tHit writeback Event: %lu, %lu", lastEvDoneCycle, respCycle - req.cycle);
-
-                    if(wbStartCycles.size()) {
-                        for(uint32_t i = 0; i < wbStartCycles.size(); i++) {
-                            DelayEvent* del = new (evRec) DelayEvent(wbStartCycles[i] - (req.cycle + accLat));
-                            // // // info("uCREATE: %p at %u", del, __LINE__);
-                            del->setMinStartCycle(req.cycle + accLat);
-                            he->addChild(del, evRec);
-                            connect(writebackRecords[i].isValid()? &writebackRecords[i] : nullptr, del, hwe, wbStartCycles[i], wbEndCycles[i]);
-                        }
-                    }
-                        he->addChild(hwe, evRec);
-                        tr.startEvent = tr.endEvent = he;
-                } else {
-                    // info("\t\tCouldn't find a matching hash.");
-                    if (dataArray->readCounter(dataId) == 1) {
-                        if (hashId == -1) {
-                            DD_HI++;
-                            hashId = hashArray->preinsert(hash, &req);
-                            if(hashId != -1)
-                                hashArray->postinsert(hash, &req, dataId, hashId, true);
-                        } else {
-                            DD_HD++;
-                            if(dataArray->readCounter(hashArray->readDataPointer(hashId)) == 1)
-                                hashArray->postinsert(hash, &req, dataId, hashId, true);
-                        }
-                        WD_TH_DD_1++;
-                        // info("\t\tOnly had one tag. Overwriting self instead of picking random data victim.");
-                        // Data only exists once, just update.
-                        // // info("PUTX only once.");
-                        dataArray->writeData(dataId, data, &req, true);
-                        uint64_t getDoneCycle = respCycle;
-                        respCycle = cc->processAccess(req, tagId, respCycle, &getDoneCycle);
-                        if (evRec->hasRecord()) accessRecord = evRec->popRecord();
-                        tr = {req.lineAddr << lineBits, req.cycle, respCycle, req.type, nullptr, nullptr};
-                        HitEvent* ev = new (evRec) HitEvent(this, respCycle - req.cycle, domain);
-                        // // // info("uCREATE: %p at %u", ev, __LINE__);
-                        // // // info("\t\t\tHit Event: %lu, %lu", req.cycle, respCycle - req.cycle);
-                        ev->setMinStartCycle(req.cycle);
-                        tr.startEvent = tr.endEvent = ev;
-                    } else {
-                        WD_TH_DD_M++;
-                        // Data exists more than once, evict from LL.
-                        // // info("PUTX more than once");
-                        bool approximateVictim;
-                        int32_t newLLHead;
-                        bool evictDataLine = tagArray->evictAssociatedData(tagId, &newLLHead, &approximateVictim);
-                        if (evictDataLine) {
-                            // info("\t\tDeleting old dataId at %i", dataId);
-                            // // info("\t\tAlong with dataId: %i", dataId);
-                            // Clear (Evict, Tags already evicted) data line
-                            dataArray->postinsert(-1, &req, 0, dataId, false, NULL, false);
-                        } else if (newLLHead != -1) {
-                            // info("\t\tchanging LL pointer for old dataId at %i and decremented it's counter", dataId);
-                            // Change Tag
-                            uint32_t victimCounter = dataArray->readCounter(dataId);
-                            dataArray->changeInPlace(newLLHead, &req, victimCounter-1, dataId, approximateVictim, NULL, false);
-                        } else {
-                            // info("\t\tdecremented the counter at dataId %i", dataId);
-                            // // info("\t\tAlso decremented dedup counter.");
-                            uint32_t victimCounter = dataArray->readCounter(dataId);
-                            int32_t LLHead = dataArray->readListHead(dataId);
-                            dataArray->changeInPlace(LLHead, &req, victimCounter-1, dataId, approximateVictim, NULL, false);
-                        }
-                        evictCycle = respCycle + accLat;
-                        respCycle += 2*accLat;
-                        int32_t victimListHeadId, newVictimListHeadId;
-                        int32_t victimDataId = dataArray->preinsert(&victimListHeadId);
-                        while (victimDataId == dataId)
-                            victimDataId = dataArray->preinsert(&victimListHeadId);
-                        if (hashId == -1) {
-                            DD_HI++;
-                            hashId = hashArray->preinsert(hash, &req);
-                            if(hashId != -1)
-                                hashArray->postinsert(hash, &req, victimDataId, hashId, true);
-                        } else {
-                            DD_HD++;
-                            if(dataArray->readCounter(hashArray->readDataPointer(hashId)) == 1)
-                                hashArray->postinsert(hash, &req, victimDataId, hashId, true);
-                        }
-                        // info("\t\tEvicting dataline %i", victimDataId);
-                        uint64_t evBeginCycle = evictCycle;
-                        uint64_t evDoneCycle = evBeginCycle;
-                        TimingRecord writebackRecord;
-                        uint64_t lastEvDoneCycle = tagEvDoneCycle;
-                        if (evRec->hasRecord()) accessRecord = evRec->popRecord();
-                        while (victimListHeadId != -1) {
-                            if (victimListHeadId != tagId) {
-                                // info("\t\tAlong with tagId: %i", victimListHeadId);
-                                Address wbLineAddr = tagArray->readAddress(victimListHeadId);
-                                // // info("\t\tEvicting tagId: %i", victimListHeadId);
-                                evDoneCycle = cc->processEviction(req, wbLineAddr, victimListHeadId, evBeginCycle);
-                                // // // info("\t\t\tEviction finished at %lu", evDoneCycle);
-                                newVictimListHeadId = tagArray->readNextLL(victimListHeadId);
-                                tagArray->postinsert(0, &req, victimListHeadId, -1, -1, false, false);
-                            } else {
-                                newVictimListHeadId = tagArray->readNextLL(victimListHeadId);
-                            }
-                            if (evRec->hasRecord()) {
-                                Evictions++;
-                                writebackRecord.clear();
-                                writebackRecord = evRec->popRecord();
-                                writebackRecords.push_back(writebackRecord);
-                                wbStartCycles.push_back(evBeginCycle);
-                                wbEndCycles.push_back(evDoneCycle);
-                                lastEvDoneCycle = evDoneCycle;
-                                evBeginCycle += accLat;
-                            }
-                            victimListHeadId = newVictimListHeadId;
-                        }
-                        tagArray->changeInPlace(req.lineAddr, &req, tagId, victimDataId, -1, true, false);
-                        // // info("changeInPlace %i", tagId);
-                        dataArray->postinsert(tagId, &req, 1, victimDataId, true, data, updateReplacement);
-                        respCycle += accLat;
-
-                        uint64_t getDoneCycle = respCycle;
-                        respCycle = cc->processAccess(req, tagId, respCycle, &getDoneCycle);
-                        if (evRec->hasRecord()) accessRecord = evRec->popRecord();
-                        tr = {req.lineAddr << lineBits, req.cycle, respCycle, req.type, nullptr, nullptr};
-
-                        HitEvent* he = new (evRec) HitEvent(this, respCycle - req.cycle, domain);
-                        // // // info("uCREATE: %p at %u", he, __LINE__);
-                        idHitWritebackEvent* hwe = new (evRec) idHitWritebackEvent(this, he, respCycle - req.cycle, domain);
-                        // // // info("uCREATE: %p at %u", hwe, __LINE__);
-
-                        he->setMinStartCycle(req.cycle);
-                        hwe->setMinStartCycle(lastEvDoneCycle);
-                        // // // info("\t\t\tHit Event: %lu, %lu", req.cycle, respCycle - req.cycle);
-                        // // // info("\t\t\tHit writeback Event: %lu, %lu", lastEvDoneCycle, respCycle - req.cycle);
-
-                        if(wbStartCycles.size()) {
-                            for(uint32_t i = 0; i < wbStartCycles.size(); i++) {
-                                DelayEvent* del = new (evRec) DelayEvent(wbStartCycles[i] - (req.cycle + accLat));
-                                // // // info("uCREATE: %p at %u", del, __LINE__);
-                                del->setMinStartCycle(req.cycle + accLat);
-                                he->addChild(del, evRec);
-                                connect(writebackRecords[i].isValid()? &writebackRecords[i] : nullptr, del, hwe, wbStartCycles[i], wbEndCycles[i]);
-                            }
-                        }
-                        he->addChild(hwe, evRec);
-                        tr.startEvent = tr.endEvent = he;
-                    }
-                }
-            } else {
-                WSR_TH++;
-                // info("\tTag Hit");
-                dataArray->lookup(tagArray->readDataId(tagId), &req, updateReplacement);
-                uint64_t getDoneCycle = respCycle;
-                respCycle = cc->processAccess(req, tagId, respCycle, &getDoneCycle);
-                if (evRec->hasRecord()) accessRecord = evRec->popRecord();
-                tr = {req.lineAddr << lineBits, req.cycle, respCycle, req.type, nullptr, nullptr};
-                HitEvent* ev = new (evRec) HitEvent(this, respCycle - req.cycle, domain);
-                // // // info("uCREATE: %p at %u", ev, __LINE__);
-                // // // info("\t\t\tHit Event: %lu, %lu", req.cycle, respCycle - req.cycle);
-                ev->setMinStartCycle(req.cycle);
-                tr.startEvent = tr.endEvent = ev;
-            }
+            DS_HD++;
+            if(dataArray->readCounter(hashArray->readDataPointer(hashId)) == 1)
+                hashArray->postinsert(hash, &req, targetDataId, hashId, true);
         }
-        gm_free(data);
-        evRec->pushRecord(tr);
-
-        // tagArray->print();
-        // dataArray->print();
-        // hashArray->print();
+        WD_TH_DS++;
+        debug("%s: found matching data at %i.", name.c_str(), targetDataId);
+        releaseData(a, tagId, dataId);
+        a.respCycle += 2*accLat;
+        int32_t oldListHead = dataArray->readListHead(targetDataId);
+        uint32_t dataCounter = dataArray->readCounter(targetDataId);
+        tagArray->changeInPlace(req.lineAddr, &req, tagId, targetDataId, oldListHead, true, a.updateReplacement);
+        dataArray->postinsert(tagId, &req, dataCounter+1, targetDataId, true, NULL, a.updateReplacement);
+        plan.writeBack(HitPlan::UNTIL_RESPONSE, HitPlan::AT_RESPONSE, req.cycle + accLat);
+    } else if (dataArray->readCounter(dataId) == 1) {
+        if (hashId == -1) {
+            DD_HI++;
+            hashId = hashArray->preinsert(hash, &req);
+            if(hashId != -1)
+                hashArray->postinsert(hash, &req, dataId, hashId, true);
+        } else {
+            DD_HD++;
+            if(dataArray->readCounter(hashArray->readDataPointer(hashId)) == 1)
+                hashArray->postinsert(hash, &req, dataId, hashId, true);
+        }
+        WD_TH_DD_1++;
+        // Data only exists once, just update.
+        debug("%s: The old line was not deduped, overriding old.", name.c_str());
+        dataArray->writeData(dataId, data, &req, true);
+    } else {
+        WD_TH_DD_M++;
+        // Data exists more than once, evict from LL.
+        debug("%s: The old line was deduped.", name.c_str());
+        releaseData(a, tagId, dataId);
+        uint64_t evBeginCycle = a.respCycle + accLat;
+        a.respCycle += 2*accLat;
+        int32_t victimListHeadId;
+        int32_t victimDataId = dataArray->preinsert(&victimListHeadId, dataId);
+        if (hashId == -1) {
+            DD_HI++;
+            hashId = hashArray->preinsert(hash, &req);
+            if(hashId != -1)
+                hashArray->postinsert(hash, &req, victimDataId, hashId, true);
+        } else {
+            DD_HD++;
+            if(dataArray->readCounter(hashArray->readDataPointer(hashId)) == 1)
+                hashArray->postinsert(hash, &req, victimDataId, hashId, true);
+        }
+        debug("%s: Picked victim data line %i", name.c_str(), victimDataId);
+        uint64_t lastEvDoneCycle = a.tagEvDoneCycle;
+        evictList(a, victimListHeadId, tagId, &evBeginCycle, &lastEvDoneCycle, NULL);
+        tagArray->changeInPlace(req.lineAddr, &req, tagId, victimDataId, -1, true, false);
+        dataArray->postinsert(tagId, &req, 1, victimDataId, true, data, a.updateReplacement);
+        a.respCycle += accLat;
+        plan.writeBack(HitPlan::UNTIL_RESPONSE, lastEvDoneCycle, req.cycle + accLat);
     }
-    cc->endAccess(req);
+    return plan;
+}
 
+void ApproximateIdealDedupCache::checkArrays() {
     // uint32_t count = 0;
     // for (int32_t i = 0; i < (signed)numDataLines; i++) {
     //     if (dataArray->readListHead(i) == -1)
@@ -572,47 +226,28 @@ uint64_t ApproximateIdealDedupCache::access(MemReq& req) {
 
     // info("Valid Tags: %u", tagArray->getValidLines());
     // info("Valid Lines: %u", dataArray->getValidLines());
+#ifdef __DEBUG__
+    // Occupancy counters are kept incrementally by the arrays; cross-check them against full scans
     assert(tagArray->getValidLines() == tagArray->countValidLines());
     assert(dataArray->getValidLines() == dataArray->countValidLines());
+#endif
     assert(tagArray->getValidLines() >= dataArray->getValidLines());
     assert(tagArray->getValidLines() <= numTagLines);
     assert(dataArray->getValidLines() <= numDataLines);
-    double sample = (double)dataArray->getValidLines()/(double)tagArray->getValidLines();
-    crStats->add(sample,1);
+}
 
-    if (req.type != PUTS) {
-        sample = Evictions;
-        evStats->add(sample,1);
-    }
+void ApproximateIdealDedupCache::sampleOccupancy(uint64_t weight) {
+    double sample = (double)dataArray->getValidLines()/(double)tagArray->getValidLines();
+    addSample(crStats, &crHist, sample, weight);
 
     sample = (double)dataArray->getValidLines()/numDataLines;
-    dutStats->add(sample, 1);
+    addSample(dutStats, &dutHist, sample, weight);
 
     sample = (double)tagArray->getValidLines()/numTagLines;
-    tutStats->add(sample, 1);
+    addSample(tutStats, &tutHist, sample, weight);
 
     sample = (double)tagArray->getValidLines()/dataArray->getValidLines();
-    dupStats->add(sample, 1);
-
-    assert_msg(respCycle >= req.cycle, "[%s] resp < req? 0x%lx type %s childState %s, respCycle %ld reqCycle %ld",
-            name.c_str(), req.lineAddr, AccessTypeName(req.type), MESIStateName(*req.state), respCycle, req.cycle);
-    return respCycle;
-}
-
-void ApproximateIdealDedupCache::simulateHitWriteback(idHitWritebackEvent* ev, uint64_t cycle, HitEvent* he) {
-    uint64_t lookupCycle = tryLowPrioAccess(cycle);
-    if (lookupCycle) { //success, release MSHR
-        if (!pendingQueue.empty()) {
-            //// // info("XXX %ld elems in pending queue", pendingQueue.size());
-            for (TimingEvent* qev : pendingQueue) {
-                qev->requeue(cycle+1);
-            }
-            pendingQueue.clear();
-        }
-        ev->done(cycle);
-    } else {
-        ev->requeue(cycle+1);
-    }
+    dupStats->add(sample, weight);
 }
 
 void ApproximateIdealDedupCache::dumpStats() {
@@ -1,29 +1,17 @@
 #ifndef APPROXIMATEIDEALDEDUP_CACHE_H_
 #define APPROXIMATEIDEALDEDUP_CACHE_H_
 
-#include "timing_cache.h"
-#include "stats.h"
+#include "compressed_timing_cache.h"
 
-class idHitWritebackEvent;
+class ApproximateIdealDedupCache : public CompressedTimingCache<ApproximateIdealDedupCache, ApproximateDedupTagArray, ApproximateDedupDataArray> {
+    friend class CompressedTimingCache<ApproximateIdealDedupCache, ApproximateDedupTagArray, ApproximateDedupDataArray>;
 
-class ApproximateIdealDedupCache : public TimingCache {
     protected:
         // Cache stuff
-        uint32_t numTagLines;
-        uint32_t numDataLines;
-
-        ApproximateDedupTagArray* tagArray;
-        ApproximateDedupDataArray* dataArray;
         ApproximateDedupHashArray* hashArray;
 
-        ReplPolicy* tagRP;
-        ReplPolicy* dataRP;
         ReplPolicy* hashRP;
 
-        RunningStats* crStats;
-        RunningStats* evStats;
-        RunningStats* tutStats;
-        RunningStats* dutStats;
         RunningStats* dupStats;
 
         uint64_t TM_DS;
@@ -42,24 +30,28 @@ class ApproximateIdealDedupCache : public TimingCache {
     public:
         ApproximateIdealDedupCache(uint32_t _numTagLines, uint32_t _numDataLines, CC* _cc, ApproximateDedupTagArray* _tagArray, ApproximateDedupDataArray* _dataArray, ApproximateDedupHashArray* _hashArray, ReplPolicy* tagRP,
                         ReplPolicy* dataRP, ReplPolicy* hashRP, uint32_t _accLat, uint32_t _invLat, uint32_t mshrs, uint32_t ways, uint32_t cands, uint32_t _domain, const g_string& _name, RunningStats* _crStats,
-                        RunningStats* _evStats, RunningStats* _tutStats, RunningStats* _dutStats, Counter* _tag_hits, Counter* _tag_misses, Counter* _tag_all);
-        uint64_t access(MemReq& req);
+                        RunningStats* _evStats, RunningStats* _tutStats, RunningStats* _dutStats, Counter* _tag_hits, Counter* _tag_misses, Counter* _tag_all,
+                        const CompressionTiming* _compTiming);
         void dumpStats();
 
-        void initStats(AggregateStat* parentStat);
-        void simulateHitWriteback(idHitWritebackEvent* ev, uint64_t cycle, HitEvent* he);
-
     protected:
         void initCacheStats(AggregateStat* cacheStat);
-};
+        void sampleOccupancy(uint64_t weight);
+
+        // access() hooks, see CompressedTimingCache
+        static const bool countsTagAccesses = true;
+        static const bool tagWritebackAfterDataRead = false;
+        static const bool fetchesExactLines = true;
+        uint32_t victimReadLat(const Access& a) const {return 0;}
+        void releaseTagVictim(Access& a, int32_t victimTagId, bool evicted);
+        FillPlan fill(Access& a, int32_t victimTagId);
+        HitPlan hit(Access& a, int32_t tagId);
+        void invalidateTag(Access& a, int32_t tagId) {tagArray->postinsert(0, &a.req, tagId, -1, -1, false, false);}
+        void checkArrays();
 
-class idHitWritebackEvent : public TimingEvent {
     private:
-        ApproximateIdealDedupCache* cache;
-        HitEvent* he;
-    public:
-        idHitWritebackEvent(ApproximateIdealDedupCache* _cache,  HitEvent* _he, uint32_t postDelay, int32_t domain) : TimingEvent(0, postDelay, domain), cache(_cache), he(_he) {}
-        void simulate(uint64_t startCycle) {cache->simulateHitWriteback(this, startCycle, he);}
+        // Unlinks the tag from data line dataId, freeing the line if it was the last one pointing to it
+        void releaseData(Access& a, int32_t tagId, int32_t dataId);
 };
 
 #endif // APPROXIMATEIDEALDEDUP_CACHE_H_
@@ -1,30 +1,19 @@
 #ifndef APPROXIMATENAIIVEDEDUPBDI_CACHE_H_
 #define APPROXIMATENAIIVEDEDUPBDI_CACHE_H_
 
-#include "timing_cache.h"
-#include "stats.h"
+#include "compressed_timing_cache.h"
 
-class ndbHitWritebackEvent;
+class ApproximateNaiiveDedupBDICache : public CompressedTimingCache<ApproximateNaiiveDedupBDICache, ApproximateDedupBDITagArray, ApproximateNaiiveDedupBDIDataArray> {
+    friend class CompressedTimingCache<ApproximateNaiiveDedupBDICache, ApproximateDedupBDITagArray, ApproximateNaiiveDedupBDIDataArray>;
 
-class ApproximateNaiiveDedupBDICache : public TimingCache {
     protected:
         // Cache stuff
-        uint32_t numTagLines;
-        uint32_t numDataLines;
         uint32_t dataAssoc;
 
-        ApproximateDedupBDITagArray* tagArray;
-        ApproximateNaiiveDedupBDIDataArray* dataArray;
         ApproximateDedupBDIHashArray* hashArray;
 
-        ReplPolicy* tagRP;
-        ReplPolicy* dataRP;
         ReplPolicy* hashRP;
 
-        RunningStats* crStats;
-        RunningStats* evStats;
-        RunningStats* tutStats;
-        RunningStats* dutStats;
         RunningStats* hutStats;
         RunningStats* dupStats;
         RunningStats* bdiStats;
@@ -63,25 +52,31 @@ class ApproximateNaiiveDedupBDICache : public TimingCache {
     public:
         ApproximateNaiiveDedupBDICache(uint32_t _numTagLines, uint32_t _numDataLines, CC* _cc, ApproximateDedupBDITagArray* _tagArray, ApproximateNaiiveDedupBDIDataArray* _dataArray, ApproximateDedupBDIHashArray* _hashArray, ReplPolicy* tagRP,
                         ReplPolicy* dataRP, ReplPolicy* hashRP, uint32_t _accLat, uint32_t _invLat, uint32_t mshrs, uint32_t ways, uint32_t cands, uint32_t _domain, const g_string& _name, RunningStats* _crStats,
-                        RunningStats* _evStats, RunningStats* _tutStats, RunningStats* _dutStats, Counter* _tag_hits, Counter* _tag_misses, Counter* _all_misses);
+                        RunningStats* _evStats, RunningStats* _tutStats, RunningStats* _dutStats, Counter* _tag_hits, Counter* _tag_misses, Counter* _all_misses,
+                        const CompressionTiming* _compTiming);
 
-        uint64_t access(MemReq& req);
         void dumpStats();
 
-        void initStats(AggregateStat* parentStat);
-        void simulateHitWriteback(ndbHitWritebackEvent* ev, uint64_t cycle, HitEvent* he);
-
     protected:
         void initCacheStats(AggregateStat* cacheStat);
-};
+        void sampleOccupancy(uint64_t weight);
+
+        // access() hooks, see CompressedTimingCache
+        static const bool countsTagAccesses = true;
+        static const bool tagWritebackAfterDataRead = true;
+        static const bool fetchesExactLines = true;
+        // Timing: to evict, need to read the data array too.
+        uint32_t victimReadLat(const Access& a) const {return accLat;}
+        void releaseTagVictim(Access& a, int32_t victimTagId, bool evicted);
+        FillPlan fill(Access& a, int32_t victimTagId);
+        HitPlan hit(Access& a, int32_t tagId);
+        void invalidateTag(Access& a, int32_t tagId) {tagArray->postinsert(0, &a.req, tagId, -1, -1, NONE, -1, false);}
+        void checkArrays();
 
-class ndbHitWritebackEvent : public TimingEvent {
     private:
-        ApproximateNaiiveDedupBDICache* cache;
-        HitEvent* he;
-    public:
-        ndbHitWritebackEvent(ApproximateNaiiveDedupBDICache* _cache,  HitEvent* _he, uint32_t postDelay, int32_t domain) : TimingEvent(0, postDelay, domain), cache(_cache), he(_he) {}
-        void simulate(uint64_t startCycle) {cache->simulateHitWriteback(this, startCycle, he);}
+        // Unlinks a hit tag from its segment before it is rewritten, freeing the segment if it was the last one
+        // pointing to it, which cannot happen if the segment is known to be deduped
+        void releaseData(Access& a, int32_t tagId, int32_t dataId, int32_t segmentId, bool deduped);
 };
 
 #endif // APPROXIMATENAIIVEDEDUPBDI_CACHE_H_
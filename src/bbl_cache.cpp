@@ -0,0 +1,232 @@
+/** $lic$
+ * Copyright (C) 2012-2015 by Massachusetts Institute of Technology
+ * Copyright (C) 2010-2013 by The Board of Trustees of Stanford University
+ *
+ * This file is part of zsim.
+ *
+ * zsim is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, version 2.
+ *
+ * If you use this software in your research, we request that you reference
+ * the zsim paper ("ZSim: Fast and Accurate Microarchitectural Simulation of
+ * Thousand-Core Systems", Sanchez and Kozyrakis, ISCA-40, June 2013) as the
+ * source of the simulator in any publications that use this software, and that
+ * you send us a citation of your work.
+ *
+ * zsim is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "bbl_cache.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stddef.h>
+#include <string.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "bithacks.h"
+#include "core.h"
+#include "decoder.h"
+#include "log.h"
+
+struct BblCacheHeader {
+    char magic[8];
+    char build[32];  // Decoder::buildId()
+    uint32_t uopBytes;  // sizeof(DynUop) and offsetof(BblInfo, oooBbl) catch layout changes
+    uint32_t infoHeaderBytes;
+};
+
+static void initHeader(BblCacheHeader* hdr) {
+    memset(hdr, 0, sizeof(BblCacheHeader));
+    strncpy(hdr->magic, "ZSIMBBL", sizeof(hdr->magic) - 1);
+    strncpy(hdr->build, Decoder::buildId(), sizeof(hdr->build) - 1);
+    hdr->uopBytes = sizeof(DynUop);
+    hdr->infoHeaderBytes = offsetof(BblInfo, oooBbl);
+}
+
+static bool readFully(int fd, void* buf, size_t bytes) {
+    uint8_t* p = static_cast<uint8_t*>(buf);
+    while (bytes) {
+        ssize_t res = read(fd, p, bytes);
+        if (res < 0 && errno == EINTR) continue;
+        if (res <= 0) return false;
+        p += res;
+        bytes -= res;
+    }
+    return true;
+}
+
+static bool writeFully(int fd, const void* buf, size_t bytes) {
+    const uint8_t* p = static_cast<const uint8_t*>(buf);
+    while (bytes) {
+        ssize_t res = write(fd, p, bytes);
+        if (res < 0 && errno == EINTR) continue;
+        if (res <= 0) return false;
+        p += res;
+        bytes -= res;
+    }
+    return true;
+}
+
+// xxHash64-style mixing of the code, read as 64-bit words (the last one zero-padded)
+static uint64_t hashCode(const uint8_t* code, uint32_t bytes, uint32_t fetchOffset) {
+    uint64_t h = 0x27D4EB2F165667C5ULL + bytes + ((uint64_t)fetchOffset << 32);
+    for (uint32_t i = 0; i < bytes; i += 8) {
+        uint64_t k = 0;
+        memcpy(&k, code + i, MIN(8u, bytes - i));
+        k *= 0xC2B2AE3D27D4EB4FULL;
+        k = ((k << 31) | (k >> 33)) * 0x9E3779B185EBCA87ULL;
+        h ^= k;
+        h = ((h << 27) | (h >> 37)) * 0x9E3779B185EBCA87ULL + 0x85EBCA77C2B2AE63ULL;
+    }
+    h ^= h >> 33;
+    h *= 0xC2B2AE3D27D4EB4FULL;
+    h ^= h >> 29;
+    h *= 0x165667B19E3779F9ULL;
+    h ^= h >> 32;
+    return h;
+}
+
+/* Process-local append descriptor: descriptors are not shared across processes,
+ * and forked children must open their own so that flock() excludes them too.
+ */
+static int appendFd = -1;
+static pid_t appendPid = 0;
+
+DecodedBblCache::DecodedBblCache(const char* _file) : file(_file) {
+    futex_init(&lock);
+    int fd = open(_file, O_RDWR | O_CREAT, 0644);
+    if (fd < 0) panic("Could not open decoded-BBL cache %s: %s", _file, strerror(errno));
+    flock(fd, LOCK_EX);
+    load(fd);
+    flock(fd, LOCK_UN);
+    close(fd);
+    info("Decoded-BBL cache %s: %lu blocks", _file, records.size());
+}
+
+void DecodedBblCache::initStats(AggregateStat* parentStat) {
+    AggregateStat* cacheStat = new AggregateStat();
+    cacheStat->init("bblCache", "Decoded-BBL cache stats");
+    profHits.init("hits", "Basic blocks found in the cache");
+    profMisses.init("misses", "Basic blocks decoded");
+    profInserts.init("inserts", "Decoded basic blocks added to the cache");
+    cacheStat->append(&profHits);
+    cacheStat->append(&profMisses);
+    cacheStat->append(&profInserts);
+    parentStat->append(cacheStat);
+}
+
+void DecodedBblCache::load(int fd) {
+    struct stat st;
+    if (fstat(fd, &st) != 0) panic("Could not stat decoded-BBL cache %s: %s", file.c_str(), strerror(errno));
+    size_t size = st.st_size;
+
+    BblCacheHeader hdr, expected;
+    initHeader(&expected);
+    bool valid = size >= sizeof(hdr) && readFully(fd, &hdr, sizeof(hdr)) && memcmp(&hdr, &expected, sizeof(hdr)) == 0;
+    if (!valid) {
+        if (size) warn("Decoded-BBL cache %s was written by another zsim build, discarding it", file.c_str());
+        if (ftruncate(fd, 0) != 0 || lseek(fd, 0, SEEK_SET) != 0 || !writeFully(fd, &expected, sizeof(expected))) {
+            panic("Could not initialize decoded-BBL cache %s: %s", file.c_str(), strerror(errno));
+        }
+        return;
+    }
+
+    // Records stay in the shared heap for the whole simulation, so hits are a copy away
+    size_t bodyBytes = size - sizeof(hdr);
+    if (!bodyBytes) return;
+    uint8_t* body = gm_malloc<uint8_t>(bodyBytes);
+    if (!readFully(fd, body, bodyBytes)) panic("Could not read decoded-BBL cache %s: %s", file.c_str(), strerror(errno));
+
+    size_t pos = 0;
+    while (pos + sizeof(Record) <= bodyBytes) {
+        const Record* rec = reinterpret_cast<const Record*>(body + pos);
+        uint64_t expBytes = sizeof(Record) + ((rec->codeBytes + 7ul) & ~7ul) + rec->infoBytes;
+        if (rec->recBytes != expBytes || pos + expBytes > bodyBytes || rec->infoBytes < offsetof(BblInfo, oooBbl) + DynBbl::bytes(0)) break;
+        if (rec->infoBytes != offsetof(BblInfo, oooBbl) + DynBbl::bytes(rec->bblInfo()->oooBbl[0].uops)) break;
+        records[rec->key] = rec;  // repeated keys come from simulations that missed concurrently, and are identical
+        pos += expBytes;
+    }
+
+    if (pos < bodyBytes) {
+        // Only an interrupted append leaves a partial record, and it can only be the last one
+        warn("Decoded-BBL cache %s ends in a partial record, dropping its last %lu bytes", file.c_str(), bodyBytes - pos);
+        if (ftruncate(fd, sizeof(hdr) + pos) != 0) panic("Could not truncate decoded-BBL cache %s: %s", file.c_str(), strerror(errno));
+    }
+}
+
+BblInfo* DecodedBblCache::lookup(Address addr, const uint8_t* code, uint32_t bytes) {
+    uint32_t fetchOffset = addr & 15;
+    uint64_t key = hashCode(code, bytes, fetchOffset);
+
+    futex_lock(&lock);
+    g_unordered_map<uint64_t, const Record*>::iterator it = records.find(key);
+    const Record* rec = (it != records.end())? it->second : nullptr;
+    if (rec && (rec->codeBytes != bytes || rec->fetchOffset != fetchOffset || memcmp(rec->code(), code, bytes) != 0)) rec = nullptr;
+    if (rec) profHits.inc();
+    else profMisses.inc();
+    futex_unlock(&lock);
+
+    if (!rec) return nullptr;
+
+    // Records are immutable, so we can copy outside the lock
+    BblInfo* bblInfo = static_cast<BblInfo*>(gm_malloc(rec->infoBytes));
+    memcpy(bblInfo, rec->bblInfo(), rec->infoBytes);
+    bblInfo->oooBbl[0].addr = addr;
+    return bblInfo;
+}
+
+void DecodedBblCache::insert(Address addr, const uint8_t* code, uint32_t bytes, const BblInfo* bblInfo) {
+    uint32_t codeBytes = (bytes + 7) & ~7;
+    uint32_t infoBytes = offsetof(BblInfo, oooBbl) + DynBbl::bytes(bblInfo->oooBbl[0].uops);
+    uint32_t recBytes = sizeof(Record) + codeBytes + infoBytes;
+
+    Record* rec = reinterpret_cast<Record*>(gm_calloc<uint8_t>(recBytes));  // zeroes the padding, keeping files deterministic
+    rec->fetchOffset = addr & 15;
+    rec->key = hashCode(code, bytes, rec->fetchOffset);
+    rec->recBytes = recBytes;
+    rec->codeBytes = bytes;
+    rec->infoBytes = infoBytes;
+    memcpy(rec->data, code, bytes);
+    BblInfo* recInfo = reinterpret_cast<BblInfo*>(rec->data + codeBytes);
+    memcpy(recInfo, bblInfo, infoBytes);
+    recInfo->oooBbl[0].addr = 0;  // set on every hit
+
+    futex_lock(&lock);
+    bool added = records.insert(std::make_pair(rec->key, rec)).second;
+    if (added) profInserts.inc();
+    futex_unlock(&lock);
+
+    // Not added if another process raced us to this block, or on a hash collision (we then keep the first block)
+    if (added) append(rec);
+    else gm_free(rec);
+}
+
+void DecodedBblCache::append(const Record* rec) {
+    if (appendPid != getpid()) {
+        appendPid = getpid();
+        appendFd = open(file.c_str(), O_RDWR | O_APPEND);
+        if (appendFd < 0) warn("Could not open decoded-BBL cache %s: %s, new blocks will not be saved", file.c_str(), strerror(errno));
+    }
+    if (appendFd < 0) return;
+
+    flock(appendFd, LOCK_EX);
+    // A simulation from another build may have reset the file since we loaded it
+    BblCacheHeader hdr, expected;
+    initHeader(&expected);
+    if (pread(appendFd, &hdr, sizeof(hdr), 0) != sizeof(hdr) || memcmp(&hdr, &expected, sizeof(hdr)) != 0) {
+        warn("Decoded-BBL cache %s was reset by another zsim build, new blocks will not be saved", file.c_str());
+        close(appendFd);
+        appendFd = -1;
+    } else if (!writeFully(appendFd, rec, rec->recBytes)) {
+        warn("Could not append to decoded-BBL cache %s: %s", file.c_str(), strerror(errno));
+    }
+    if (appendFd >= 0) flock(appendFd, LOCK_UN);
+}
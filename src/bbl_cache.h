@@ -0,0 +1,90 @@
+/** $lic$
+ * Copyright (C) 2012-2015 by Massachusetts Institute of Technology
+ * Copyright (C) 2010-2013 by The Board of Trustees of Stanford University
+ *
+ * This file is part of zsim.
+ *
+ * zsim is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, version 2.
+ *
+ * If you use this software in your research, we request that you reference
+ * the zsim paper ("ZSim: Fast and Accurate Microarchitectural Simulation of
+ * Thousand-Core Systems", Sanchez and Kozyrakis, ISCA-40, June 2013) as the
+ * source of the simulator in any publications that use this software, and that
+ * you send us a citation of your work.
+ *
+ * zsim is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef BBL_CACHE_H_
+#define BBL_CACHE_H_
+
+#include <stdint.h>
+#include "g_std/g_string.h"
+#include "g_std/g_unordered_map.h"
+#include "galloc.h"
+#include "locks.h"
+#include "memory_hierarchy.h"
+#include "stats.h"
+
+struct BblInfo;  // defined in core.h
+
+/* Persistent cache of OOO-decoded basic blocks, shared by every process of
+ * the simulation and across simulations through a file.
+ *
+ * Decoding only depends on a block's code bytes and on its offset within its
+ * 16-byte fetch block (which the predecoder model uses), so blocks are keyed
+ * by those rather than by binary and address. This makes entries survive
+ * ASLR and rebuilds that leave a block unchanged, and lets binaries share the
+ * blocks of their common libraries. Hits compare the full code bytes, so hash
+ * collisions only cost a decode.
+ *
+ * The file starts with the decoder's build id; a file written by another build
+ * is discarded. Records are appended under flock() as blocks miss, so
+ * concurrent simulations can share a file. The file is never trimmed; delete
+ * it to reclaim space.
+ */
+class DecodedBblCache : public GlobAlloc {
+    private:
+        struct Record {
+            uint64_t key;
+            uint32_t recBytes;  // header + code (padded to 8 bytes) + BblInfo
+            uint32_t codeBytes;
+            uint32_t infoBytes;
+            uint32_t fetchOffset;
+            uint8_t data[0];  // code, then the BblInfo
+
+            const uint8_t* code() const {return data;}
+            const BblInfo* bblInfo() const {return (const BblInfo*) (data + ((codeBytes + 7) & ~7));}
+        };
+
+        g_string file;
+        g_unordered_map<uint64_t, const Record*> records;
+        lock_t lock;
+
+        Counter profHits, profMisses, profInserts;
+
+    public:
+        explicit DecodedBblCache(const char* _file);
+
+        void initStats(AggregateStat* parentStat);
+
+        // Returns a private copy of the block decoded from code (bytes long, at addr), or nullptr if not cached
+        BblInfo* lookup(Address addr, const uint8_t* code, uint32_t bytes);
+
+        // Adds bblInfo, just decoded from code, to the cache and its file
+        void insert(Address addr, const uint8_t* code, uint32_t bytes, const BblInfo* bblInfo);
+
+    private:
+        void load(int fd);
+        void append(const Record* rec);
+};
+
+#endif  // BBL_CACHE_H_
@@ -0,0 +1,548 @@
+/** $lic$
+ * Copyright (C) 2012-2015 by Massachusetts Institute of Technology
+ * Copyright (C) 2010-2013 by The Board of Trustees of Stanford University
+ *
+ * This file is part of zsim.
+ *
+ * zsim is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, version 2.
+ *
+ * If you use this software in your research, we request that you reference
+ * the zsim paper ("ZSim: Fast and Accurate Microarchitectural Simulation of
+ * Thousand-Core Systems", Sanchez and Kozyrakis, ISCA-40, June 2013) as the
+ * source of the simulator in any publications that use this software, and that
+ * you send us a citation of your work.
+ *
+ * zsim is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "bdi.h"
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE4_2__)
+#include <nmmintrin.h>
+#endif
+
+/* Scalar kernel */
+
+static inline uint64_t absDelta(uint64_t base, uint64_t val) {
+    uint64_t d = base - val;
+    uint64_t t = (uint64_t)((int64_t)d >> 63);
+    return (d ^ t) - t;
+}
+
+// Values are zero-extended to 64 bits and deltas taken in 64-bit arithmetic,
+// exactly as the reference does. The explicit base is the first value the
+// zero base cannot cover.
+template <typename T>
+static inline bool fitsBaseDelta(const T* values, uint32_t n, uint64_t limit) {
+    bool haveBase = false;
+    uint64_t base = 0;
+    for (uint32_t i = 0; i < n; i++) {
+        uint64_t v = values[i];
+        if (absDelta(0, v) <= limit) continue;
+        if (!haveBase) {
+            base = v;
+            haveBase = true;
+        } else if (absDelta(base, v) > limit) {
+            return false;
+        }
+    }
+    return true;
+}
+
+uint32_t BDICompressLineScalar(const void* line) {
+    uint64_t w8[BDI_LINE_BYTES/8];
+    uint32_t w4[BDI_LINE_BYTES/4];
+    uint16_t w2[BDI_LINE_BYTES/2];
+    memcpy(w8, line, BDI_LINE_BYTES);
+    memcpy(w4, line, BDI_LINE_BYTES);
+    memcpy(w2, line, BDI_LINE_BYTES);
+
+    bool zero = true, same = true;
+    for (uint32_t i = 0; i < BDI_LINE_BYTES/8; i++) {
+        zero &= (w8[i] == 0);
+        same &= (w8[i] == w8[0]);
+    }
+    if (zero) return 1;
+    if (same) return 8;
+
+    // Schemes in increasing size order, so the first match is the best one
+    if (fitsBaseDelta(w8, BDI_LINE_BYTES/8, 0xFF)) return 16;
+    if (fitsBaseDelta(w4, BDI_LINE_BYTES/4, 0xFF)) return 20;
+    if (fitsBaseDelta(w8, BDI_LINE_BYTES/8, 0xFFFF)) return 24;
+    if (fitsBaseDelta(w2, BDI_LINE_BYTES/2, 0xFF)) return 34;
+    if (fitsBaseDelta(w4, BDI_LINE_BYTES/4, 0xFFFF)) return 36;
+    if (fitsBaseDelta(w8, BDI_LINE_BYTES/8, 0xFFFFFFFF)) return 40;
+    return BDI_LINE_BYTES;
+}
+
+/* SIMD kernel
+ *
+ * Every check produces a per-byte "ok" mask for the whole line (bit i covers
+ * byte i), so all schemes share a single load of the line, and the explicit
+ * base of a scheme is the element holding the first byte the zero base fails.
+ *
+ * 4- and 2-byte elements are compared in their own lane width. This is exact:
+ * the base is a value the zero base cannot cover (i.e., > limit), so a delta
+ * that only fits after wrapping belongs to a value the zero base covers anyway.
+ */
+
+#if defined(__AVX2__) || defined(__SSE4_2__)
+
+#if defined(__AVX2__)
+typedef __m256i BDIVec;
+static inline BDIVec vload(const uint8_t* p) { return _mm256_loadu_si256((const __m256i*)p); }
+static inline BDIVec vxor(BDIVec a, BDIVec b) { return _mm256_xor_si256(a, b); }
+static inline BDIVec vset64(uint64_t x) { return _mm256_set1_epi64x(x); }
+static inline BDIVec vset32(uint32_t x) { return _mm256_set1_epi32(x); }
+static inline BDIVec vset16(uint16_t x) { return _mm256_set1_epi16(x); }
+static inline BDIVec vadd64(BDIVec a, BDIVec b) { return _mm256_add_epi64(a, b); }
+static inline BDIVec vadd32(BDIVec a, BDIVec b) { return _mm256_add_epi32(a, b); }
+static inline BDIVec vadd16(BDIVec a, BDIVec b) { return _mm256_add_epi16(a, b); }
+static inline BDIVec vsub64(BDIVec a, BDIVec b) { return _mm256_sub_epi64(a, b); }
+static inline BDIVec vsub32(BDIVec a, BDIVec b) { return _mm256_sub_epi32(a, b); }
+static inline BDIVec vsub16(BDIVec a, BDIVec b) { return _mm256_sub_epi16(a, b); }
+static inline BDIVec vminu32(BDIVec a, BDIVec b) { return _mm256_min_epu32(a, b); }
+static inline BDIVec vminu16(BDIVec a, BDIVec b) { return _mm256_min_epu16(a, b); }
+static inline BDIVec vcmpeq64(BDIVec a, BDIVec b) { return _mm256_cmpeq_epi64(a, b); }
+static inline BDIVec vcmpeq32(BDIVec a, BDIVec b) { return _mm256_cmpeq_epi32(a, b); }
+static inline BDIVec vcmpeq16(BDIVec a, BDIVec b) { return _mm256_cmpeq_epi16(a, b); }
+static inline BDIVec vcmpgt64(BDIVec a, BDIVec b) { return _mm256_cmpgt_epi64(a, b); }
+static inline uint64_t vmovemask(BDIVec a) { return (uint32_t)_mm256_movemask_epi8(a); }
+#else
+typedef __m128i BDIVec;
+static inline BDIVec vload(const uint8_t* p) { return _mm_loadu_si128((const __m128i*)p); }
+static inline BDIVec vxor(BDIVec a, BDIVec b) { return _mm_xor_si128(a, b); }
+static inline BDIVec vset64(uint64_t x) { return _mm_set1_epi64x(x); }
+static inline BDIVec vset32(uint32_t x) { return _mm_set1_epi32(x); }
+static inline BDIVec vset16(uint16_t x) { return _mm_set1_epi16(x); }
+static inline BDIVec vadd64(BDIVec a, BDIVec b) { return _mm_add_epi64(a, b); }
+static inline BDIVec vadd32(BDIVec a, BDIVec b) { return _mm_add_epi32(a, b); }
+static inline BDIVec vadd16(BDIVec a, BDIVec b) { return _mm_add_epi16(a, b); }
+static inline BDIVec vsub64(BDIVec a, BDIVec b) { return _mm_sub_epi64(a, b); }
+static inline BDIVec vsub32(BDIVec a, BDIVec b) { return _mm_sub_epi32(a, b); }
+static inline BDIVec vsub16(BDIVec a, BDIVec b) { return _mm_sub_epi16(a, b); }
+static inline BDIVec vminu32(BDIVec a, BDIVec b) { return _mm_min_epu32(a, b); }
+static inline BDIVec vminu16(BDIVec a, BDIVec b) { return _mm_min_epu16(a, b); }
+static inline BDIVec vcmpeq64(BDIVec a, BDIVec b) { return _mm_cmpeq_epi64(a, b); }
+static inline BDIVec vcmpeq32(BDIVec a, BDIVec b) { return _mm_cmpeq_epi32(a, b); }
+static inline BDIVec vcmpeq16(BDIVec a, BDIVec b) { return _mm_cmpeq_epi16(a, b); }
+static inline BDIVec vcmpgt64(BDIVec a, BDIVec b) { return _mm_cmpgt_epi64(a, b); }
+static inline uint64_t vmovemask(BDIVec a) { return (uint32_t)_mm_movemask_epi8(a); }
+#endif
+
+#define BDI_VEC_BYTES ((uint32_t)sizeof(BDIVec))
+#define BDI_LINE_VECS (BDI_LINE_BYTES/BDI_VEC_BYTES)
+#define BDI_VEC_FULL ((BDI_VEC_BYTES == 64)? ~0ull : ((1ull << BDI_VEC_BYTES) - 1))
+
+// Per-element-width delta checks; ok() returns the byte mask of one vector
+template <uint32_t W> struct BDILane;
+
+template <> struct BDILane<8> {
+    // |x| <= limit (as signed) iff (x + limit) <= 2*limit (as unsigned); the
+    // unsigned compare is done as a signed one with the sign bits flipped
+    BDIVec sign, lim, twoLim;
+    explicit BDILane(uint64_t limit) : sign(vset64(1ull << 63)), lim(vset64(limit)), twoLim(vxor(vset64(2*limit), sign)) {}
+    static inline BDIVec set(uint64_t x) { return vset64(x); }
+    inline uint64_t fits(BDIVec x) const { return ~vmovemask(vcmpgt64(vxor(vadd64(x, lim), sign), twoLim)) & BDI_VEC_FULL; }
+    inline uint64_t zeroOk(BDIVec v) const { return fits(v); }
+    inline uint64_t baseOk(BDIVec b, BDIVec v) const { return fits(vsub64(b, v)); }
+};
+
+template <> struct BDILane<4> {
+    BDIVec lim, twoLim;
+    explicit BDILane(uint64_t limit) : lim(vset32(limit)), twoLim(vset32(2*limit)) {}
+    static inline BDIVec set(uint64_t x) { return vset32(x); }
+    inline uint64_t zeroOk(BDIVec v) const { return vmovemask(vcmpeq32(vminu32(v, lim), v)); }
+    inline uint64_t baseOk(BDIVec b, BDIVec v) const {
+        BDIVec x = vadd32(vsub32(b, v), lim);
+        return vmovemask(vcmpeq32(vminu32(x, twoLim), x));
+    }
+};
+
+template <> struct BDILane<2> {
+    BDIVec lim, twoLim;
+    explicit BDILane(uint64_t limit) : lim(vset16(limit)), twoLim(vset16(2*limit)) {}
+    static inline BDIVec set(uint64_t x) { return vset16(x); }
+    inline uint64_t zeroOk(BDIVec v) const { return vmovemask(vcmpeq16(vminu16(v, lim), v)); }
+    inline uint64_t baseOk(BDIVec b, BDIVec v) const {
+        BDIVec x = vadd16(vsub16(b, v), lim);
+        return vmovemask(vcmpeq16(vminu16(x, twoLim), x));
+    }
+};
+
+template <uint32_t W>
+static inline bool fitsBaseDeltaVec(const BDIVec* vecs, const uint8_t* line, uint64_t limit) {
+    const BDILane<W> lane(limit);
+    uint64_t ok = 0;
+    for (uint32_t k = 0; k < BDI_LINE_VECS; k++) ok |= lane.zeroOk(vecs[k]) << (k*BDI_VEC_BYTES);
+    if (ok == ~0ull) return true;
+
+    uint64_t base = 0;
+    memcpy(&base, line + (__builtin_ctzll(~ok)/W)*W, W);
+    BDIVec b = BDILane<W>::set(base);
+    for (uint32_t k = 0; k < BDI_LINE_VECS; k++) ok |= lane.baseOk(b, vecs[k]) << (k*BDI_VEC_BYTES);
+    return ok == ~0ull;
+}
+
+uint32_t BDICompressLine(const void* line) {
+    const uint8_t* bytes = (const uint8_t*)line;
+    BDIVec vecs[BDI_LINE_VECS];
+    for (uint32_t k = 0; k < BDI_LINE_VECS; k++) vecs[k] = vload(bytes + k*BDI_VEC_BYTES);
+
+    uint64_t first;
+    memcpy(&first, bytes, sizeof(first));
+    BDIVec zeroVec = vset64(0);
+    BDIVec firstVec = vset64(first);
+    uint64_t zero = 0, same = 0;
+    for (uint32_t k = 0; k < BDI_LINE_VECS; k++) {
+        zero |= vmovemask(vcmpeq64(vecs[k], zeroVec)) << (k*BDI_VEC_BYTES);
+        same |= vmovemask(vcmpeq64(vecs[k], firstVec)) << (k*BDI_VEC_BYTES);
+    }
+    if (zero == ~0ull) return 1;
+    if (same == ~0ull) return 8;
+
+    // Schemes in increasing size order, so the first match is the best one
+    if (fitsBaseDeltaVec<8>(vecs, bytes, 0xFF)) return 16;
+    if (fitsBaseDeltaVec<4>(vecs, bytes, 0xFF)) return 20;
+    if (fitsBaseDeltaVec<8>(vecs, bytes, 0xFFFF)) return 24;
+    if (fitsBaseDeltaVec<2>(vecs, bytes, 0xFF)) return 34;
+    if (fitsBaseDeltaVec<4>(vecs, bytes, 0xFFFF)) return 36;
+    if (fitsBaseDeltaVec<8>(vecs, bytes, 0xFFFFFFFF)) return 40;
+    return BDI_LINE_BYTES;
+}
+
+#else  // no SIMD support
+
+uint32_t BDICompressLine(const void* line) {
+    return BDICompressLineScalar(line);
+}
+
+#endif
+
+const char* BDICompressLineKernel() {
+#if defined(__AVX2__)
+    return "AVX2";
+#elif defined(__SSE4_2__)
+    return "SSE4.2";
+#else
+    return "scalar";
+#endif
+}
+
+/* Lossless encoding */
+
+// Value width and delta bytes of the base/delta scheme of each size; false for the others
+static inline bool baseDeltaScheme(uint32_t size, uint32_t* width, uint32_t* deltaBytes) {
+    switch (size) {
+        case 16: *width = 8; *deltaBytes = 1; return true;
+        case 20: *width = 4; *deltaBytes = 1; return true;
+        case 24: *width = 8; *deltaBytes = 2; return true;
+        case 34: *width = 2; *deltaBytes = 1; return true;
+        case 36: *width = 4; *deltaBytes = 2; return true;
+        case 40: *width = 8; *deltaBytes = 4; return true;
+        default: return false;
+    }
+}
+
+// Same base choice as fitsBaseDelta, which must hold for these values
+template <typename T>
+static inline void encodeBaseDelta(const uint8_t* line, uint32_t deltaBytes, uint8_t* payload, uint64_t* selectors) {
+    const uint32_t n = BDI_LINE_BYTES/sizeof(T);
+    uint64_t limit = (deltaBytes == 8)? ~0ull : ((1ull << (8*deltaBytes)) - 1);
+    bool haveBase = false;
+    uint64_t base = 0;
+    uint8_t* deltas = payload + sizeof(T);
+    *selectors = 0;
+    for (uint32_t i = 0; i < n; i++) {
+        T value;
+        memcpy(&value, line + i*sizeof(T), sizeof(T));
+        uint64_t v = value;
+        uint64_t from = 0;
+        if (absDelta(0, v) <= limit) {
+            *selectors |= 1ull << i;
+        } else {
+            if (!haveBase) {
+                base = v;
+                haveBase = true;
+            }
+            from = base;
+        }
+        uint64_t delta = v - from;
+        if ((int64_t)delta < 0) {
+            *selectors |= 1ull << (32 + i);
+            delta = -delta;
+        }
+        memcpy(deltas + i*deltaBytes, &delta, deltaBytes);  // little-endian, low bytes
+    }
+    T b = base;
+    memcpy(payload, &b, sizeof(T));
+}
+
+template <typename T>
+static inline void decodeBaseDelta(const uint8_t* payload, uint32_t deltaBytes, uint64_t selectors, uint8_t* line) {
+    const uint32_t n = BDI_LINE_BYTES/sizeof(T);
+    T b;
+    memcpy(&b, payload, sizeof(T));
+    uint64_t base = b;
+    const uint8_t* deltas = payload + sizeof(T);
+    for (uint32_t i = 0; i < n; i++) {
+        uint64_t delta = 0;
+        memcpy(&delta, deltas + i*deltaBytes, deltaBytes);
+        if (selectors & (1ull << (32 + i))) delta = -delta;
+        T value = ((selectors & (1ull << i))? 0 : base) + delta;
+        memcpy(line + i*sizeof(T), &value, sizeof(T));
+    }
+}
+
+uint32_t BDIEncodeLine(const void* line, uint8_t* payload, uint64_t* selectors) {
+    const uint8_t* bytes = (const uint8_t*)line;
+    uint32_t size = BDICompressLine(line);
+    uint32_t width, deltaBytes;
+    *selectors = 0;
+    if (baseDeltaScheme(size, &width, &deltaBytes)) {
+        switch (width) {
+            case 8: encodeBaseDelta<uint64_t>(bytes, deltaBytes, payload, selectors); break;
+            case 4: encodeBaseDelta<uint32_t>(bytes, deltaBytes, payload, selectors); break;
+            default: encodeBaseDelta<uint16_t>(bytes, deltaBytes, payload, selectors); break;
+        }
+    } else {
+        memcpy(payload, bytes, BDIPayloadBytes(size));  // the repeated value, or the whole line
+    }
+    return size;
+}
+
+void BDIDecodeLine(uint32_t size, const uint8_t* payload, uint64_t selectors, void* line) {
+    uint8_t* bytes = (uint8_t*)line;
+    uint32_t width, deltaBytes;
+    if (baseDeltaScheme(size, &width, &deltaBytes)) {
+        switch (width) {
+            case 8: decodeBaseDelta<uint64_t>(payload, deltaBytes, selectors, bytes); break;
+            case 4: decodeBaseDelta<uint32_t>(payload, deltaBytes, selectors, bytes); break;
+            default: decodeBaseDelta<uint16_t>(payload, deltaBytes, selectors, bytes); break;
+        }
+    } else if (size == 8) {
+        for (uint32_t i = 0; i < BDI_LINE_BYTES/8; i++) memcpy(bytes + 8*i, payload, 8);
+    } else if (size == BDI_LINE_BYTES) {
+        memcpy(bytes, payload, BDI_LINE_BYTES);
+    } else {
+        memset(bytes, 0, BDI_LINE_BYTES);
+    }
+}
+
+/* Reference implementation */
+
+static unsigned long long my_llabs ( long long x )
+{
+   unsigned long long t = x >> 63;
+   return (x ^ t) - t;
+}
+
+long long unsigned * convertBuffer2Array (char * buffer, unsigned size, unsigned step)
+{
+      long long unsigned * values = (long long unsigned *) malloc(sizeof(long long unsigned) * size/step);
+//      std::cout << std::dec << "ConvertBuffer = " << size/step << std::endl;
+     //init
+     unsigned int i,j; 
+     for (i = 0; i < size / step; i++) {
+          values[i] = 0;    // Initialize all elements to zero.
+      }
+      //SIM_printf("Element Size = %d \n", step);
+      for (i = 0; i < size; i += step ){
+          for (j = 0; j < step; j++){
+              //SIM_printf("Buffer = %02x \n", (unsigned char) buffer[i + j]);
+              values[i / step] += (long long unsigned)((unsigned char)buffer[i + j]) << (8*j);
+              //SIM_printf("step %d value = ", j);
+              //printLLwithSize(values[i / step], step);  
+          }
+          //std::cout << "Current value = " << values[i / step] << std::endl;
+          //printLLwithSize(values[i / step], step);
+          //SIM_printf("\n");
+      }
+      //std::cout << "End ConvertBuffer = " << size/step << std::endl;
+      return values;
+}
+
+///
+/// Check if the cache line consists of only zero values
+///
+int isZeroPackable ( long long unsigned * values, unsigned size){
+  int nonZero = 0;
+  unsigned int i;
+  for (i = 0; i < size; i++) {
+      if( values[i] != 0){
+          nonZero = 1;
+          break;
+      }
+  }
+  return !nonZero;
+}
+
+///
+/// Check if the cache line consists of only same values
+///
+int isSameValuePackable ( long long unsigned * values, unsigned size){
+  int notSame = 0;
+  unsigned int i;
+  for (i = 0; i < size; i++) {
+      if( values[0] != values[i]){
+          notSame = 1;
+          break;
+      }
+  }
+  return !notSame;
+}
+
+///
+/// Check if the cache line values can be compressed with multiple base + 1,2,or 4-byte offset 
+/// Returns size after compression 
+///
+unsigned doubleExponentCompression ( long long unsigned * values, unsigned size, unsigned blimit, unsigned bsize){
+  unsigned long long limit = 0;
+  //define the appropriate size for the mask
+  switch(blimit){
+    case 1:
+      limit = 56;
+      break;
+    case 2:
+      limit = 48;
+      break;
+    default:
+      // std::cout << "Wrong blimit value = " <<  blimit << std::endl;
+      exit(1);
+  }
+  // finding bases: # BASES
+  // find how many elements can be compressed with mbases
+  unsigned compCount = 0;
+  unsigned int i;
+  for (i = 0; i < size; i++) {
+         if( (values[0] >> limit) ==  (values[i] >> limit))  {
+             compCount++;
+         }
+  }
+  //return compressed size
+  if(compCount != size )
+     return size * bsize;
+  return size * bsize - (compCount - 1) * blimit;
+}
+
+
+///
+/// Check if the cache line values can be compressed with multiple base + 1,2,or 4-byte offset 
+/// Returns size after compression 
+///
+unsigned multBaseCompression ( long long unsigned * values, unsigned size, unsigned blimit, unsigned bsize){
+  unsigned long long limit = 0;
+  unsigned BASES = 2;
+  //define the appropriate size for the mask
+  switch(blimit){
+    case 1:
+      limit = 0xFF;
+      break;
+    case 2:
+      limit = 0xFFFF;
+      break;
+    case 4:
+      limit = 0xFFFFFFFF;
+      break;
+    default:
+      //std::cout << "Wrong blimit value = " <<  blimit << std::endl;
+      exit(1);
+  }
+  // finding bases: # BASES
+  //std::vector<unsigned long long> mbases;
+  //mbases.push_back(values[0]); //add the first base
+  unsigned long long mbases [64];
+  unsigned baseCount = 1;
+  mbases[0] = 0;
+  unsigned int i,j;
+  for (i = 0; i < size; i++) {
+      for(j = 0; j <  baseCount; j++){
+         if( my_llabs((long long int)(mbases[j] -  values[i])) > limit ){
+             //mbases.push_back(values[i]); // add new base
+             mbases[baseCount++] = values[i];  
+         }
+     }
+     if(baseCount >= BASES) //we don't have more bases
+       break;
+  }
+  // find how many elements can be compressed with mbases
+  unsigned compCount = 0;
+  for (i = 0; i < size; i++) {
+      //ol covered = 0;
+      for(j = 0; j <  baseCount; j++){
+         if( my_llabs((long long int)(mbases[j] -  values[i])) <= limit ){
+             compCount++;
+             break;
+         }
+     }
+  }
+  //return compressed size
+  unsigned mCompSize = blimit * compCount + bsize * (BASES-1) + (size - compCount) * bsize;
+  if(compCount < size)
+     return size * bsize;
+  //VG_(printf)("%d-bases bsize = %d osize = %d CompCount = %d CompSize = %d\n", BASES, bsize, blimit, compCount, mCompSize);
+  return mCompSize;
+}
+
+unsigned BDICompress (char * buffer, unsigned _blockSize)
+{
+  //char * dst = new char [_blockSize];
+//  print_value(buffer, _blockSize);
+ 
+  long long unsigned * values = convertBuffer2Array( buffer, _blockSize, 8);
+  unsigned bestCSize = _blockSize;
+  unsigned currCSize = _blockSize;
+  if( isZeroPackable( values, _blockSize / 8))
+      bestCSize = 1;
+  if( isSameValuePackable( values, _blockSize / 8))
+      currCSize = 8;
+  bestCSize = bestCSize > currCSize ? currCSize: bestCSize;
+  currCSize = multBaseCompression( values, _blockSize / 8, 1, 8);
+  bestCSize = bestCSize > currCSize ? currCSize: bestCSize;
+  currCSize = multBaseCompression( values, _blockSize / 8, 2, 8);
+  bestCSize = bestCSize > currCSize ? currCSize: bestCSize;
+  currCSize =  multBaseCompression( values, _blockSize / 8, 4, 8);
+  bestCSize = bestCSize > currCSize ? currCSize: bestCSize;
+  free(values);
+  values = convertBuffer2Array( buffer, _blockSize, 4);
+  // if( isSameValuePackable( values, _blockSize / 4))
+  //    currCSize = 4;
+  bestCSize = bestCSize > currCSize ? currCSize: bestCSize;
+  currCSize = multBaseCompression( values, _blockSize / 4, 1, 4);
+  bestCSize = bestCSize > currCSize ? currCSize: bestCSize;
+  currCSize = multBaseCompression( values, _blockSize / 4, 2, 4);
+  bestCSize = bestCSize > currCSize ? currCSize: bestCSize;
+  free(values);
+  values = convertBuffer2Array( buffer, _blockSize, 2);
+  currCSize = multBaseCompression( values, _blockSize / 2, 1, 2);
+  bestCSize = bestCSize > currCSize ? currCSize: bestCSize;
+  free(values);
+
+  //exponent base compression
+  /*values = convertBuffer2Array( buffer, _blockSize, 8);
+  currCSize = doubleExponentCompression( values, _blockSize / 8, 2, 8);
+  bestCSize = bestCSize > currCSize ? currCSize: bestCSize;
+  currCSize = doubleExponentCompression( values, _blockSize / 8, 1, 8);
+  bestCSize = bestCSize > currCSize ? currCSize: bestCSize;
+  VG_(free)(values);*/
+ 
+  //delete [] buffer;
+  buffer = NULL;
+  values = NULL;
+  //SIM_printf(" BestCSize = %d \n", bestCSize);
+  return bestCSize;
+
+}
+
@@ -0,0 +1,70 @@
+/** $lic$
+ * Copyright (C) 2012-2015 by Massachusetts Institute of Technology
+ * Copyright (C) 2010-2013 by The Board of Trustees of Stanford University
+ *
+ * This file is part of zsim.
+ *
+ * zsim is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, version 2.
+ *
+ * If you use this software in your research, we request that you reference
+ * the zsim paper ("ZSim: Fast and Accurate Microarchitectural Simulation of
+ * Thousand-Core Systems", Sanchez and Kozyrakis, ISCA-40, June 2013) as the
+ * source of the simulator in any publications that use this software, and that
+ * you send us a citation of your work.
+ *
+ * zsim is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef BDI_H_
+#define BDI_H_
+
+#include <stdint.h>
+
+/* Base-Delta-Immediate size estimation for a 64-byte line.
+ *
+ * All functions return the raw size produced by the original BDI model:
+ * 1 (all zeros), 8 (repeated 8-byte value), 16 (B8D1), 20 (B4D1), 24 (B8D2),
+ * 34 (B2D1), 36 (B4D2), 40 (B8D4) or the uncompressed block size. Each
+ * base/delta scheme uses an implicit zero base plus one explicit base.
+ */
+
+#define BDI_LINE_BYTES 64
+
+// Fast kernel: SIMD (AVX2 or SSE4.2, chosen at compile time) with a scalar
+// fallback. Does not allocate.
+uint32_t BDICompressLine(const void* line);
+
+// Instruction set BDICompressLine was built for: "AVX2", "SSE4.2" or "scalar"
+const char* BDICompressLineKernel();
+
+// Portable, allocation-free scalar kernel; always available
+uint32_t BDICompressLineScalar(const void* line);
+
+// Original reference implementation, kept to check the kernels against
+unsigned BDICompress(char* buffer, unsigned _blockSize);
+
+/* Lossless BDI storage. BDIEncodeLine picks the scheme BDICompressLine does,
+ * returns its size, and writes BDIPayloadBytes(size) bytes to payload: nothing
+ * for zeros, the value for repeated lines, the line itself if uncompressible,
+ * and otherwise the explicit base followed by one delta magnitude per value.
+ * Deltas span [-limit, limit], one bit more than their bytes hold, so what
+ * does not fit the payload goes in *selectors: bit i is set if value i uses
+ * the zero base, and bit 32 + i if its delta is negative. BDIDecodeLine
+ * rebuilds the line from the size, payload and selectors.
+ */
+uint32_t BDIEncodeLine(const void* line, uint8_t* payload, uint64_t* selectors);
+void BDIDecodeLine(uint32_t size, const uint8_t* payload, uint64_t selectors, void* line);
+
+static inline uint32_t BDIPayloadBytes(uint32_t size) {
+    return (size == 1)? 0 : size;
+}
+
+#endif  // BDI_H_
@@ -0,0 +1,276 @@
+/** $lic$
+ * Copyright (C) 2012-2015 by Massachusetts Institute of Technology
+ * Copyright (C) 2010-2013 by The Board of Trustees of Stanford University
+ *
+ * This file is part of zsim.
+ *
+ * zsim is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, version 2.
+ *
+ * If you use this software in your research, we request that you reference
+ * the zsim paper ("ZSim: Fast and Accurate Microarchitectural Simulation of
+ * Thousand-Core Systems", Sanchez and Kozyrakis, ISCA-40, June 2013) as the
+ * source of the simulator in any publications that use this software, and that
+ * you send us a citation of your work.
+ *
+ * zsim is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Equivalence test for the BDI kernels that does not need pin. Checks that
+ * BDICompressLine (in whichever SIMD flavor bdi.cpp was built for),
+ * BDICompressLineScalar and ApproximateBDIDataArray::compress agree with the
+ * reference BDICompress on random lines and on structured lines that hit every
+ * size class: zeros, repeated values, and, for each base/delta width, lines
+ * that just fit the scheme and lines that just miss it. Also checks that
+ * BDIEncodeLine and BDIDecodeLine round-trip each line. Panics on the first
+ * mismatch and dumps the offending line. Runs are deterministic (fixed seed).
+ *
+ * SConscript builds one binary per kernel: bditest (default flags),
+ * bditest_sse42 and bditest_avx2.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "bdi.h"
+#include "bithacks.h"
+#include "cache_arrays.h"
+#include "galloc.h"
+#include "log.h"
+#include "mtrand.h"
+#include "zsim.h"
+
+// Process-wide globals, normally defined in zsim.cpp. compress() only reads zinfo's line size
+GlobSimInfo* zinfo;
+uint32_t lineBits;
+
+#define NUM_RANDOM_LINES (1 << 20)
+#define NUM_SCHEME_LINES (1 << 14)  // per scheme and case
+
+struct Scheme {
+    uint32_t width;  // bytes per value
+    uint32_t deltaBytes;
+    uint32_t size;  // reference size when the scheme fits
+    BDICompressionEncoding encoding;
+};
+
+// In increasing size order, as the kernels try them
+static const Scheme schemes[] = {
+    {8, 1, 16, BASE8DELTA1},
+    {4, 1, 20, BASE4DELTA1},
+    {8, 2, 24, BASE8DELTA2},
+    {2, 1, 34, BASE2DELTA1},
+    {4, 2, 36, BASE4DELTA2},
+    {8, 4, 40, BASE8DELTA4},
+};
+#define NUM_SCHEMES (sizeof(schemes)/sizeof(schemes[0]))
+
+static uint64_t sizeCounts[BDI_LINE_BYTES + 1];
+
+static inline uint64_t rand64(MTRand& rng) {
+    return (((uint64_t)rng.randInt()) << 32) | rng.randInt();
+}
+
+static inline uint64_t widthMax(uint32_t width) {
+    return (width == 8)? ~0ull : ((1ull << (8*width)) - 1);
+}
+
+// Little-endian, like the x86 loads in the kernels
+static inline void setValue(uint8_t* line, uint32_t width, uint32_t i, uint64_t v) {
+    memcpy(line + i*width, &v, width);
+}
+
+static BDICompressionEncoding expectedEncoding(uint32_t refSize) {
+    if (refSize == 1) return ZERO;
+    if (refSize == 8) return REPETITIVE;
+    for (uint32_t s = 0; s < NUM_SCHEMES; s++) {
+        if (schemes[s].size == refSize) return schemes[s].encoding;
+    }
+    if (refSize == BDI_LINE_BYTES) return NONE;
+    panic("BDICompress returned impossible size %d", refSize);
+}
+
+static void dumpLine(const uint8_t* line) {
+    for (uint32_t i = 0; i < BDI_LINE_BYTES/8; i++) {
+        uint64_t v;
+        memcpy(&v, line + 8*i, 8);
+        info("  %2d: 0x%016lx", 8*i, v);
+    }
+}
+
+// Checks every kernel against the reference on one line, returns the reference size
+static uint32_t check(const uint8_t* line, const char* desc) {
+    char refLine[BDI_LINE_BYTES];
+    memcpy(refLine, line, BDI_LINE_BYTES);
+    uint32_t ref = BDICompress(refLine, BDI_LINE_BYTES);
+    uint32_t fast = BDICompressLine(line);
+    uint32_t scalar = BDICompressLineScalar(line);
+
+    uint8_t arrLine[BDI_LINE_BYTES];
+    memcpy(arrLine, line, BDI_LINE_BYTES);
+    ApproximateBDIDataArray arr;
+    uint16_t size;
+    BDICompressionEncoding encoding = arr.compress(arrLine, &size);
+    uint32_t expSize = (ref + 7) & ~7u;  // compress() rounds to whole segments
+    BDICompressionEncoding expEncoding = expectedEncoding(ref);
+
+    if (fast != ref || scalar != ref || size != expSize || encoding != expEncoding) {
+        info("%s line:", desc);
+        dumpLine(line);
+        panic("%s: BDICompress %d, BDICompressLine (%s) %d, BDICompressLineScalar %d, compress() %d/%s (expected %d/%s)",
+                desc, ref, BDICompressLineKernel(), fast, scalar, size, BDICompressionName(encoding), expSize, BDICompressionName(expEncoding));
+    }
+
+    // Lossless storage must round-trip at the same size
+    uint8_t payload[BDI_LINE_BYTES];
+    uint8_t decoded[BDI_LINE_BYTES];
+    uint64_t selectors;
+    uint32_t encodedSize = BDIEncodeLine(line, payload, &selectors);
+    BDIDecodeLine(encodedSize, payload, selectors, decoded);
+    if (encodedSize != ref || memcmp(decoded, line, BDI_LINE_BYTES)) {
+        info("%s line:", desc);
+        dumpLine(line);
+        info("decoded as:");
+        dumpLine(decoded);
+        panic("%s: BDIEncodeLine %d (expected %d), selectors 0x%016lx", desc, encodedSize, ref, selectors);
+    }
+    sizeCounts[ref]++;
+    return ref;
+}
+
+static void checkZerosAndRepeats(MTRand& rng) {
+    uint8_t line[BDI_LINE_BYTES];
+    memset(line, 0, BDI_LINE_BYTES);
+    if (check(line, "zero") != 1) panic("Zero line did not compress to 1 byte");
+
+    // A single non-zero byte anywhere breaks zero and repeated packing
+    for (uint32_t b = 0; b < BDI_LINE_BYTES; b++) {
+        memset(line, 0, BDI_LINE_BYTES);
+        line[b] = 1 + rng.randInt(254);
+        if (check(line, "one non-zero byte") <= 8) panic("Line with a non-zero byte at %d packed as zero/repeated", b);
+    }
+
+    for (uint32_t t = 0; t < NUM_SCHEME_LINES; t++) {
+        uint64_t v = rand64(rng) | 1;
+        for (uint32_t i = 0; i < BDI_LINE_BYTES/8; i++) setValue(line, 8, i, v);
+        if (check(line, "repeated") != 8) panic("Repeated line did not compress to 8 bytes");
+
+        // Same, with one value off by one bit
+        uint32_t i = rng.randInt(BDI_LINE_BYTES/8 - 1);
+        setValue(line, 8, i, v ^ (1ull << rng.randInt(63)));
+        if (check(line, "repeated but one") <= 8) panic("Line with a differing value packed as repeated");
+    }
+}
+
+/* Fills a line that fits the scheme: value 0 is the explicit base (too large
+ * for the zero base), and every other value is within the delta limit of
+ * either the base or zero, often exactly at the limit. If miss is nonzero, one
+ * value is placed one past the limit of the base (above it if miss > 0, below
+ * otherwise), so the scheme no longer fits.
+ */
+static void fillScheme(uint8_t* line, const Scheme& s, int miss, MTRand& rng) {
+    uint32_t n = BDI_LINE_BYTES/s.width;
+    uint64_t limit = widthMax(s.deltaBytes);
+    // Keep base - limit - 1 above the zero base's reach, and base + limit + 1 within the width
+    uint64_t lo = 2*limit + 2;
+    uint64_t hi = widthMax(s.width) - limit - 1;
+    uint64_t base = lo + rand64(rng) % (hi - lo + 1);
+
+    setValue(line, s.width, 0, base);
+    for (uint32_t i = 1; i < n; i++) {
+        uint64_t delta = (rng.randInt(3) == 0)? limit : rand64(rng) % (limit + 1);
+        uint64_t v;
+        switch (rng.randInt(3)) {
+            case 0: v = base + delta; break;
+            case 1: v = base - delta; break;
+            case 2: v = delta; break;  // zero base
+            default: v = base; break;
+        }
+        setValue(line, s.width, i, v);
+    }
+    if (miss) {
+        uint32_t i = 1 + rng.randInt(n - 2);
+        setValue(line, s.width, i, (miss > 0)? base + limit + 1 : base - limit - 1);
+    }
+}
+
+static void checkSchemes(MTRand& rng) {
+    uint8_t line[BDI_LINE_BYTES];
+    for (uint32_t s = 0; s < NUM_SCHEMES; s++) {
+        const Scheme& sch = schemes[s];
+        char desc[64];
+        snprintf(desc, sizeof(desc), "base %d delta %d", sch.width, sch.deltaBytes);
+        uint64_t exact = 0;
+        for (uint32_t t = 0; t < NUM_SCHEME_LINES; t++) {
+            fillScheme(line, sch, 0, rng);
+            uint32_t size = check(line, desc);
+            // A smaller scheme may also fit (e.g., all deltas happened to be small)
+            if (size > sch.size) panic("%s: line that fits compressed to %d bytes", desc, size);
+            if (size == sch.size) exact++;
+
+            fillScheme(line, sch, 1, rng);
+            if (check(line, desc) == sch.size) panic("%s: line one above the delta limit still fits", desc);
+            fillScheme(line, sch, -1, rng);
+            if (check(line, desc) == sch.size) panic("%s: line one below the delta limit still fits", desc);
+        }
+        if (!exact) panic("%s: no fitting line compressed to exactly %d bytes", desc, sch.size);
+    }
+}
+
+/* Random lines: uniform bytes, and values at a random width scattered around
+ * a random base with deltas of random bit lengths (up to a per-line maximum),
+ * so they land near every delta limit.
+ */
+static void checkRandom(MTRand& rng) {
+    uint8_t line[BDI_LINE_BYTES];
+    for (uint32_t t = 0; t < NUM_RANDOM_LINES; t++) {
+        if (t % 4 == 0) {
+            for (uint32_t i = 0; i < BDI_LINE_BYTES/8; i++) setValue(line, 8, i, rand64(rng));
+        } else {
+            uint32_t width = 2 << rng.randInt(2);
+            uint64_t base = rand64(rng) & widthMax(width);
+            uint32_t maxBits = rng.randInt(8*width);
+            for (uint32_t i = 0; i < BDI_LINE_BYTES/width; i++) {
+                uint32_t bits = rng.randInt(maxBits);
+                uint64_t delta = (bits == 64)? rand64(rng) : (rand64(rng) & ((1ull << bits) - 1));
+                uint64_t v = rng.randInt(1)? base + delta : base - delta;
+                if (rng.randInt(7) == 0) v = delta;  // zero base
+                setValue(line, width, i, v);
+            }
+        }
+        check(line, "random");
+    }
+}
+
+int main(int argc, const char* argv[]) {
+    InitLog("");  // no log header
+    if (argc > 1) {
+        info("Checks the BDI kernels against the reference BDICompress; takes no arguments");
+        exit(1);
+    }
+
+    gm_init(1ul << 26);
+    zinfo = gm_calloc<GlobSimInfo>();
+    zinfo->lineSize = BDI_LINE_BYTES;
+    lineBits = ilog2(zinfo->lineSize);
+
+    MTRand rng(0x5AFEC0DE);
+    checkZerosAndRepeats(rng);
+    checkSchemes(rng);
+    checkRandom(rng);
+
+    uint64_t total = 0;
+    for (uint32_t s = 0; s <= BDI_LINE_BYTES; s++) total += sizeCounts[s];
+    info("BDI kernels (%s) match BDICompress on %ld lines", BDICompressLineKernel(), total);
+    for (uint32_t s = 0; s <= BDI_LINE_BYTES; s++) {
+        if (sizeCounts[s]) info("  %2d bytes: %ld lines", s, sizeCounts[s]);
+    }
+    return 0;
+}
@@ -26,11 +26,12 @@
 #include <limits>
 
 #include "cache_arrays.h"
+#include "bdi.h"
 #include "hash.h"
+#include "pad.h"
 #include "repl_policies.h"
 #include "zsim.h"
 
-#include "pin.H"
 #include <cstdlib>
 #include <time.h>
 #include <algorithm>
@@ -550,6 +551,7 @@ rp(_rp), hf(_hf), numLines(_numLines), assoc(_assoc), dataAssoc(_dataAssoc) {
     }
     approximateArray = gm_calloc<bool>(numLines);
     numSets = numLines/assoc;
+    occupiedSpace = gm_calloc<uint32_t>(numSets);
     setMask = numSets - 1;
     validLines = 0;
     dataValidSegments = 0;
@@ -562,6 +564,11 @@ ApproximateBDITagArray::~ApproximateBDITagArray() {
     gm_free(segmentPointerArray);
     gm_free(compressionEncodingArray);
     gm_free(approximateArray);
+    gm_free(occupiedSpace);
+}
+
+uint16_t ApproximateBDITagArray::lineSpace(int32_t tagId) const {
+    return (segmentPointerArray[tagId] != -1)? BDICompressionToSize(compressionEncodingArray[tagId], zinfo->lineSize) : 0;
 }
 
 int32_t ApproximateBDITagArray::lookup(Address lineAddr, const MemReq* req, bool updateReplacement) {
@@ -589,17 +596,16 @@ int32_t ApproximateBDITagArray::preinsert(Address lineAddr, const MemReq* req, A
 int32_t ApproximateBDITagArray::needEviction(Address lineAddr, const MemReq* req, uint16_t size, g_vector<uint32_t>& alreadyEvicted, Address* wbLineAddr) {
     uint32_t set = hf->hash(0, lineAddr) & setMask;
     uint32_t first = set*assoc;
-    uint16_t occupiedSpace = 0;
-    for (uint32_t id = first; id < first + assoc; id++) {
-        bool found = false;
-        for (uint32_t i = 0; i < alreadyEvicted.size(); i++) {
-            if (alreadyEvicted[i] == id) {found = true; break;}
-        }
-        if (segmentPointerArray[id] != -1 && !found) {
-            occupiedSpace += BDICompressionToSize(compressionEncodingArray[id], zinfo->lineSize);
-        }
-    }
-    if (dataAssoc*zinfo->lineSize - occupiedSpace >= size)
+    // alreadyEvicted holds distinct ids of this set (rank() never returns one twice)
+    uint32_t occupied = occupiedSpace[set];
+    for (uint32_t i = 0; i < alreadyEvicted.size(); i++)
+        occupied -= lineSpace(alreadyEvicted[i]);
+#ifdef __DEBUG__
+    uint32_t counted = 0;
+    for (uint32_t id = first; id < first + assoc; id++) counted += lineSpace(id);
+    assert_msg(counted == occupiedSpace[set], "BDI set %d: occupied %d bytes, tracked %d", set, counted, occupiedSpace[set]);
+#endif
+    if (dataAssoc*zinfo->lineSize - occupied >= size)
         return -1;
     else {
         uint32_t candidate = rp->rank(req, SetAssocCands(first, first+assoc), alreadyEvicted);
@@ -622,9 +628,12 @@ void ApproximateBDITagArray::postinsert(Address lineAddr, const MemReq* req, int
         dataValidSegments+=BDICompressionToSize(compression, zinfo->lineSize)/8;
     }
     rp->replaced(tagId);
+    uint32_t set = tagId/assoc;
+    occupiedSpace[set] -= lineSpace(tagId);
     tagArray[tagId] = lineAddr;
     segmentPointerArray[tagId] = segmentId;
     compressionEncodingArray[tagId] = compression;
+    occupiedSpace[set] += lineSpace(tagId);
     approximateArray[tagId] = approximate;
     if(updateReplacement) rp->update(tagId, req);
 }
@@ -639,7 +648,9 @@ int8_t ApproximateBDITagArray::readSegmentPointer(int32_t tagId) {
 
 void ApproximateBDITagArray::writeCompressionEncoding(int32_t tagId, BDICompressionEncoding encoding) {
     dataValidSegments-=BDICompressionToSize(compressionEncodingArray[tagId], zinfo->lineSize)/8;
+    occupiedSpace[tagId/assoc] -= lineSpace(tagId);
     compressionEncodingArray[tagId] = encoding;
+    occupiedSpace[tagId/assoc] += lineSpace(tagId);
     dataValidSegments+=BDICompressionToSize(encoding, zinfo->lineSize)/8;
 }
 
@@ -744,212 +755,14 @@ void ApproximateBDITagArray::print() {
 //     return retVal;
 // }
 
-static unsigned long long my_llabs ( long long x )
-{
-   unsigned long long t = x >> 63;
-   return (x ^ t) - t;
-}
-
-long long unsigned * convertBuffer2Array (char * buffer, unsigned size, unsigned step)
-{
-      long long unsigned * values = (long long unsigned *) malloc(sizeof(long long unsigned) * size/step);
-//      std::cout << std::dec << "ConvertBuffer = " << size/step << std::endl;
-     //init
-     unsigned int i,j; 
-     for (i = 0; i < size / step; i++) {
-          values[i] = 0;    // Initialize all elements to zero.
-      }
-      //SIM_printf("Element Size = %d \n", step);
-      for (i = 0; i < size; i += step ){
-          for (j = 0; j < step; j++){
-              //SIM_printf("Buffer = %02x \n", (unsigned char) buffer[i + j]);
-              values[i / step] += (long long unsigned)((unsigned char)buffer[i + j]) << (8*j);
-              //SIM_printf("step %d value = ", j);
-              //printLLwithSize(values[i / step], step);  
-          }
-          //std::cout << "Current value = " << values[i / step] << std::endl;
-          //printLLwithSize(values[i / step], step);
-          //SIM_printf("\n");
-      }
-      //std::cout << "End ConvertBuffer = " << size/step << std::endl;
-      return values;
-}
-
-///
-/// Check if the cache line consists of only zero values
-///
-int isZeroPackable ( long long unsigned * values, unsigned size){
-  int nonZero = 0;
-  unsigned int i;
-  for (i = 0; i < size; i++) {
-      if( values[i] != 0){
-          nonZero = 1;
-          break;
-      }
-  }
-  return !nonZero;
-}
-
-///
-/// Check if the cache line consists of only same values
-///
-int isSameValuePackable ( long long unsigned * values, unsigned size){
-  int notSame = 0;
-  unsigned int i;
-  for (i = 0; i < size; i++) {
-      if( values[0] != values[i]){
-          notSame = 1;
-          break;
-      }
-  }
-  return !notSame;
-}
-
-///
-/// Check if the cache line values can be compressed with multiple base + 1,2,or 4-byte offset 
-/// Returns size after compression 
-///
-unsigned doubleExponentCompression ( long long unsigned * values, unsigned size, unsigned blimit, unsigned bsize){
-  unsigned long long limit = 0;
-  //define the appropriate size for the mask
-  switch(blimit){
-    case 1:
-      limit = 56;
-      break;
-    case 2:
-      limit = 48;
-      break;
-    default:
-      // std::cout << "Wrong blimit value = " <<  blimit << std::endl;
-      exit(1);
-  }
-  // finding bases: # BASES
-  // find how many elements can be compressed with mbases
-  unsigned compCount = 0;
-  unsigned int i;
-  for (i = 0; i < size; i++) {
-         if( (values[0] >> limit) ==  (values[i] >> limit))  {
-             compCount++;
-         }
-  }
-  //return compressed size
-  if(compCount != size )
-     return size * bsize;
-  return size * bsize - (compCount - 1) * blimit;
-}
-
-
-///
-/// Check if the cache line values can be compressed with multiple base + 1,2,or 4-byte offset 
-/// Returns size after compression 
-///
-unsigned multBaseCompression ( long long unsigned * values, unsigned size, unsigned blimit, unsigned bsize){
-  unsigned long long limit = 0;
-  unsigned BASES = 2;
-  //define the appropriate size for the mask
-  switch(blimit){
-    case 1:
-      limit = 0xFF;
-      break;
-    case 2:
-      limit = 0xFFFF;
-      break;
-    case 4:
-      limit = 0xFFFFFFFF;
-      break;
-    default:
-      //std::cout << "Wrong blimit value = " <<  blimit << std::endl;
-      exit(1);
-  }
-  // finding bases: # BASES
-  //std::vector<unsigned long long> mbases;
-  //mbases.push_back(values[0]); //add the first base
-  unsigned long long mbases [64];
-  unsigned baseCount = 1;
-  mbases[0] = 0;
-  unsigned int i,j;
-  for (i = 0; i < size; i++) {
-      for(j = 0; j <  baseCount; j++){
-         if( my_llabs((long long int)(mbases[j] -  values[i])) > limit ){
-             //mbases.push_back(values[i]); // add new base
-             mbases[baseCount++] = values[i];  
-         }
-     }
-     if(baseCount >= BASES) //we don't have more bases
-       break;
-  }
-  // find how many elements can be compressed with mbases
-  unsigned compCount = 0;
-  for (i = 0; i < size; i++) {
-      //ol covered = 0;
-      for(j = 0; j <  baseCount; j++){
-         if( my_llabs((long long int)(mbases[j] -  values[i])) <= limit ){
-             compCount++;
-             break;
-         }
-     }
-  }
-  //return compressed size
-  unsigned mCompSize = blimit * compCount + bsize * (BASES-1) + (size - compCount) * bsize;
-  if(compCount < size)
-     return size * bsize;
-  //VG_(printf)("%d-bases bsize = %d osize = %d CompCount = %d CompSize = %d\n", BASES, bsize, blimit, compCount, mCompSize);
-  return mCompSize;
-}
-
-unsigned BDICompress (char * buffer, unsigned _blockSize)
-{
-  //char * dst = new char [_blockSize];
-//  print_value(buffer, _blockSize);
- 
-  long long unsigned * values = convertBuffer2Array( buffer, _blockSize, 8);
-  unsigned bestCSize = _blockSize;
-  unsigned currCSize = _blockSize;
-  if( isZeroPackable( values, _blockSize / 8))
-      bestCSize = 1;
-  if( isSameValuePackable( values, _blockSize / 8))
-      currCSize = 8;
-  bestCSize = bestCSize > currCSize ? currCSize: bestCSize;
-  currCSize = multBaseCompression( values, _blockSize / 8, 1, 8);
-  bestCSize = bestCSize > currCSize ? currCSize: bestCSize;
-  currCSize = multBaseCompression( values, _blockSize / 8, 2, 8);
-  bestCSize = bestCSize > currCSize ? currCSize: bestCSize;
-  currCSize =  multBaseCompression( values, _blockSize / 8, 4, 8);
-  bestCSize = bestCSize > currCSize ? currCSize: bestCSize;
-  free(values);
-  values = convertBuffer2Array( buffer, _blockSize, 4);
-  // if( isSameValuePackable( values, _blockSize / 4))
-  //    currCSize = 4;
-  bestCSize = bestCSize > currCSize ? currCSize: bestCSize;
-  currCSize = multBaseCompression( values, _blockSize / 4, 1, 4);
-  bestCSize = bestCSize > currCSize ? currCSize: bestCSize;
-  currCSize = multBaseCompression( values, _blockSize / 4, 2, 4);
-  bestCSize = bestCSize > currCSize ? currCSize: bestCSize;
-  free(values);
-  values = convertBuffer2Array( buffer, _blockSize, 2);
-  currCSize = multBaseCompression( values, _blockSize / 2, 1, 2);
-  bestCSize = bestCSize > currCSize ? currCSize: bestCSize;
-  free(values);
-
-  //exponent base compression
-  /*values = convertBuffer2Array( buffer, _blockSize, 8);
-  currCSize = doubleExponentCompression( values, _blockSize / 8, 2, 8);
-  bestCSize = bestCSize > currCSize ? currCSize: bestCSize;
-  currCSize = doubleExponentCompression( values, _blockSize / 8, 1, 8);
-  bestCSize = bestCSize > currCSize ? currCSize: bestCSize;
-  VG_(free)(values);*/
- 
-  //delete [] buffer;
-  buffer = NULL;
-  values = NULL;
-  //SIM_printf(" BestCSize = %d \n", bestCSize);
-  return bestCSize;
-
-}
-
 BDICompressionEncoding ApproximateBDIDataArray::compress(const DataLine data, uint16_t* size) {
     // info("\tApproximate Data: %lu,%lu,%lu,%lu,%lu,%lu,%lu,%lu", ((uint64_t*)data)[0], ((uint64_t*)data)[1], ((uint64_t*)data)[2], ((uint64_t*)data)[3], ((uint64_t*)data)[4], ((uint64_t*)data)[5], ((uint64_t*)data)[6], ((uint64_t*)data)[7]);
-    *size = BDICompress((char*)data, 64);
+    *size = BDICompressLine(data);
+#ifdef __DEBUG__
+    // Cross-check the fast kernels against the reference BDI implementation
+    assert_msg(*size == BDICompressLineScalar(data), "BDI scalar kernel mismatch: %i vs %i", *size, BDICompressLineScalar(data));
+    assert_msg(*size == BDICompress((char*)data, BDI_LINE_BYTES), "BDI kernel mismatch: %i vs reference %i", *size, BDICompress((char*)data, BDI_LINE_BYTES));
+#endif
     if (*size == 1){                                                                               // Size 1
         *size = 8;
         // info("Compression: ZERO, %i segments", 1);
@@ -1017,6 +830,50 @@ void ApproximateBDIDataArray::approximate(const DataLine data, DataType type) {
 // BDI end
 
 // Dedup begin
+LineContentIndex::LineContentIndex(uint32_t _numSlots) : numSlots(_numSlots) {
+    uint32_t numBuckets = 1;
+    while (numBuckets < numSlots) numBuckets <<= 1;
+    bucketMask = numBuckets - 1;
+    heads = gm_malloc<int32_t>(numBuckets);
+    next = gm_malloc<int32_t>(numSlots);
+    digests = gm_calloc<uint64_t>(numSlots);
+    for (uint32_t i = 0; i < numBuckets; i++) heads[i] = -1;
+    for (uint32_t i = 0; i < numSlots; i++) next[i] = -2;
+}
+
+LineContentIndex::~LineContentIndex() {
+    gm_free(heads);
+    gm_free(next);
+    gm_free(digests);
+}
+
+uint64_t LineContentIndex::digest(const DataLine data) {
+    uint64_t h = 0x9E3779B97F4A7C15ull;
+    for (uint32_t i = 0; i < zinfo->lineSize/8; i++) {
+        h = (h ^ ((uint64_t*)data)[i]) * 0xFF51AFD7ED558CCDull;
+        h ^= h >> 32;
+    }
+    return h;
+}
+
+void LineContentIndex::insert(int32_t slot, uint64_t digest) {
+    assert(!contains(slot));
+    digests[slot] = digest;
+    next[slot] = heads[digest & bucketMask];
+    heads[digest & bucketMask] = slot;
+}
+
+void LineContentIndex::remove(int32_t slot) {
+    assert(contains(slot));
+    int32_t* link = &heads[digests[slot] & bucketMask];
+    while (*link != slot) {
+        assert(*link >= 0);
+        link = &next[*link];
+    }
+    *link = next[slot];
+    next[slot] = -2;
+}
+
 ApproximateDedupTagArray::ApproximateDedupTagArray(uint32_t _numLines, uint32_t _assoc, ReplPolicy* _rp, HashFamily* _hf) : rp(_rp), hf(_hf), numLines(_numLines), assoc(_assoc)  {
     tagArray = gm_calloc<Address>(numLines);
     prevPointerArray = gm_calloc<int32_t>(numLines);
@@ -1184,6 +1041,8 @@ ApproximateDedupDataArray::ApproximateDedupDataArray(uint32_t _numLines, uint32_
     std::random_device rd;
     RNG = new std::mt19937(rd());
     DIST = new std::uniform_int_distribution<>(0, numLines-1);
+    contentIndex = NULL;
+    victims = NULL;
     info("Dedup Data Array: %i lines and %i sets", numLines, numSets);
     assert_msg(isPow2(numSets), "must have a power of 2 # sets, but you specified %d", numSets);
 }
@@ -1196,13 +1055,18 @@ ApproximateDedupDataArray::~ApproximateDedupDataArray() {
         gm_free(dataArray[i]);
     }
     gm_free(dataArray);
+    if (contentIndex) delete contentIndex;
+    if (victims) delete victims;
 }
 
 void ApproximateDedupDataArray::lookup(int32_t dataId, const MemReq* req, bool updateReplacement) {
-    if (updateReplacement) rp->update(dataId, req);
+    if (updateReplacement) {
+        rp->update(dataId, req);
+        if (victims) victims->touch(dataId);
+    }
 }
 
-int32_t ApproximateDedupDataArray::preinsert(int32_t* tagPointer) {
+int32_t ApproximateDedupDataArray::preinsert(int32_t* tagPointer, int32_t keepId) {
     int32_t leastValue = 999999;
     int32_t leastId = 0;
     if (freeList.size()) {
@@ -1211,18 +1075,27 @@ int32_t ApproximateDedupDataArray::preinsert(int32_t* tagPointer) {
         *tagPointer = tagPointerArray[leastId];
         return leastId;
     }
-    for (uint32_t i = 0; i < 4; i++) {
-        int32_t id = DIST->operator()(*RNG);
-        if (tagPointerArray[id] == -1) {
-            *tagPointer = tagPointerArray[id];
-            panic("Shouldn't happen");
-            return id;
-        }
-        if (tagCounterArray[id] < leastValue) {
-            leastValue = tagCounterArray[id];
-            leastId = id;
-        }
+    if (victims) {
+        leastId = (keepId >= 0)? victims->minExcept(keepId) : victims->min();
+        *tagPointer = tagPointerArray[leastId];
+        return leastId;
     }
+    do {
+        leastValue = 999999;
+        leastId = 0;
+        for (uint32_t i = 0; i < 4; i++) {
+            int32_t id = DIST->operator()(*RNG);
+            if (tagPointerArray[id] == -1) {
+                *tagPointer = tagPointerArray[id];
+                panic("Shouldn't happen");
+                return id;
+            }
+            if (tagCounterArray[id] < leastValue) {
+                leastValue = tagCounterArray[id];
+                leastId = id;
+            }
+        }
+    } while (leastId == keepId);
     *tagPointer = tagPointerArray[leastId];
     return leastId;
 }
@@ -1241,12 +1114,18 @@ void ApproximateDedupDataArray::postinsert(int32_t tagId, const MemReq* req, int
         assert(validLines);
     }
     if (data)
-        PIN_SafeCopy(dataArray[dataId], data, zinfo->lineSize);
+        memcpy(dataArray[dataId], data, zinfo->lineSize);
     rp->replaced(dataId);
     tagCounterArray[dataId] = counter;
     tagPointerArray[dataId] = tagId;
     approximateArray[dataId] = approximate;
     if(updateReplacement) rp->update(dataId, req);
+    if (victims) {
+        victims->setRefs(dataId, counter);
+        if (updateReplacement) victims->touch(dataId);
+        else victims->replaced(dataId);
+    }
+    reindex(dataId, data != NULL);
     // info("Data %i: %i, %i, %s", dataId, tagCounterArray[dataId], tagPointerArray[dataId], approximateArray[dataId]? "approximate":"exact");
 }
 
@@ -1258,12 +1137,17 @@ void ApproximateDedupDataArray::changeInPlace(int32_t tagId, const MemReq* req,
         assert(validLines);
     }
     if (data)
-        PIN_SafeCopy(dataArray[dataId], data, zinfo->lineSize);
+        memcpy(dataArray[dataId], data, zinfo->lineSize);
     // rp->replaced(dataId);
     tagCounterArray[dataId] = counter;
     tagPointerArray[dataId] = tagId;
     approximateArray[dataId] = approximate;
     if(updateReplacement) rp->update(dataId, req);
+    if (victims) {
+        victims->setRefs(dataId, counter);
+        if (updateReplacement) victims->touch(dataId);
+    }
+    reindex(dataId, data != NULL);
     // info("Data %i: %i, %i, %s", dataId, tagCounterArray[dataId], tagPointerArray[dataId], approximateArray[dataId]? "approximate":"exact");
 }
 
@@ -1274,6 +1158,53 @@ bool ApproximateDedupDataArray::isSame(int32_t dataId, DataLine data) {
     return true;
 }
 
+void ApproximateDedupDataArray::enableContentIndex() {
+    if (contentIndex) return;
+    contentIndex = new LineContentIndex(numLines);
+    for (uint32_t i = 0; i < numLines; i++)
+        reindex(i, true);
+}
+
+void ApproximateDedupDataArray::enableExactVictims() {
+    if (victims) return;
+    assert_msg(!validLines, "Exact victim selection must be enabled before the array is used");
+    victims = new VictimIndex(numLines);
+}
+
+// Keeps the content index in sync: it holds exactly the lines with a non-zero counter
+void ApproximateDedupDataArray::reindex(int32_t dataId, bool dataChanged) {
+    if (!contentIndex) return;
+    bool indexed = contentIndex->contains(dataId);
+    if (!tagCounterArray[dataId]) {
+        if (indexed) contentIndex->remove(dataId);
+    } else if (!indexed || dataChanged) {
+        if (indexed) contentIndex->remove(dataId);
+        contentIndex->insert(dataId, LineContentIndex::digest(dataArray[dataId]));
+    }
+}
+
+int32_t ApproximateDedupDataArray::findSameByScan(DataLine data) {
+    for (uint32_t i = 0; i < numLines; i++) {
+        if (tagCounterArray[i] && isSame(i, data))
+            return i;
+    }
+    return -1;
+}
+
+int32_t ApproximateDedupDataArray::findSame(DataLine data) {
+    if (!contentIndex) return findSameByScan(data);
+    int32_t found = -1;
+    uint64_t digest = LineContentIndex::digest(data);
+    for (int32_t i = contentIndex->first(digest); i != -1; i = contentIndex->chainNext(i)) {
+        if (contentIndex->slotDigest(i) == digest && (found == -1 || i < found) && isSame(i, data))
+            found = i;
+    }
+#ifdef __DEBUG__
+    assert_msg(found == findSameByScan(data), "content index returned %i, scan %i", found, findSameByScan(data));
+#endif
+    return found;
+}
+
 int32_t ApproximateDedupDataArray::readListHead(int32_t dataId) {
     return tagPointerArray[dataId];
 }
@@ -1287,8 +1218,12 @@ DataLine ApproximateDedupDataArray::readData(int32_t dataId) {
 }
 
 void ApproximateDedupDataArray::writeData(int32_t dataId, DataLine data, const MemReq* req, bool updateReplacement) {
-    PIN_SafeCopy(dataArray[dataId], data, zinfo->lineSize);
-    if(updateReplacement) rp->update(dataId, req);
+    memcpy(dataArray[dataId], data, zinfo->lineSize);
+    if(updateReplacement) {
+        rp->update(dataId, req);
+        if (victims) victims->touch(dataId);
+    }
+    reindex(dataId, true);
 }
 
 uint32_t ApproximateDedupDataArray::getValidLines() {
@@ -1311,7 +1246,7 @@ void ApproximateDedupDataArray::print() {
     }
 }
 
-ApproximateDedupHashArray::ApproximateDedupHashArray(uint32_t _numLines, uint32_t _assoc, ReplPolicy* _rp, HashFamily* _hf, H3HashFamily* _dataHash) : rp(_rp), hf(_hf), dataHash(_dataHash), numLines(_numLines), assoc(_assoc)  {
+ApproximateDedupHashArray::ApproximateDedupHashArray(uint32_t _numLines, uint32_t _assoc, ReplPolicy* _rp, HashFamily* _hf, LineHasher* _dataHash) : rp(_rp), hf(_hf), dataHash(_dataHash), numLines(_numLines), assoc(_assoc)  {
     hashArray = gm_malloc<uint64_t>(numLines);
     dataPointerArray = gm_malloc<int32_t>(numLines);
     for (uint32_t i = 0; i < numLines; i++) {
@@ -1320,6 +1255,7 @@ ApproximateDedupHashArray::ApproximateDedupHashArray(uint32_t _numLines, uint32_
     }
     numSets = numLines/assoc;
     setMask = numSets - 1;
+    validLines = 0;
     assert_msg(isPow2(numSets), "must have a power of 2 # sets, but you specified %d", numSets);
 }
 
@@ -1364,6 +1300,12 @@ int32_t ApproximateDedupHashArray::preinsert(uint64_t hash, const MemReq* req) {
 }
 
 void ApproximateDedupHashArray::postinsert(uint64_t hash, const MemReq* req, int32_t dataPointer, int32_t hashId, bool updateReplacement) {
+    if (dataPointerArray[hashId] == -1 && dataPointer != -1) {
+        validLines++;
+    } else if (dataPointerArray[hashId] != -1 && dataPointer == -1) {
+        assert(validLines);
+        validLines--;
+    }
     rp->replaced(hashId);
     hashArray[hashId] = hash;
     dataPointerArray[hashId] = dataPointer;
@@ -1394,40 +1336,11 @@ void ApproximateDedupHashArray::approximate(const DataLine data, DataType type)
 
 uint64_t ApproximateDedupHashArray::hash(const DataLine data)
 {
-    uint8_t _0;
-    uint8_t _1;
-    uint8_t _2;
-    uint8_t _3;
-    uint8_t _4;
-    uint8_t _5;
-    uint8_t _6;
-    uint8_t _7;
-    uint8_t* dataLine = (uint8_t*) data;
-
-    uint64_t XORs =0;
-    uint8_t xorNeeded = zinfo->lineSize/8;
-
-    if ((xorNeeded == 2) || (xorNeeded == 4) || (xorNeeded == 8)) {
-        for (int i=0; i < xorNeeded; i++) {
-            _0 =  dataLine[0+8*i];
-            _1 =  dataLine[1+8*i];
-            _2 =  dataLine[2+8*i];
-            _3 =  dataLine[3+8*i];
-            _4 =  dataLine[4+8*i];
-            _5 =  dataLine[5+8*i];
-            _6 =  dataLine[6+8*i];
-            _7 =  dataLine[7+8*i];
-
-            uint64_t step_64B = ((uint64_t) _0) + (((uint64_t) _1) << 8)  + (((uint64_t) _2) << 16) + (((uint64_t) _3) << 24)
-                            + (((uint64_t) _4) << 32) + (((uint64_t) _5) << 40) + (((uint64_t) _6) << 48) + (((uint64_t) _7) << 56);
-
-            XORs = XORs ^ dataHash->hash(0, step_64B);
-        }
-    } else {
-        panic("not implemented yet for lines other than 16B/32B/64B");
-    }
+    return dataHash->hash((const uint64_t*)data, zinfo->lineSize/8);
+}
 
-    return XORs & ((uint64_t)std::pow(2, (zinfo->hashSize))-1);
+uint32_t ApproximateDedupHashArray::getValidLines() {
+    return validLines;
 }
 
 uint32_t ApproximateDedupHashArray::countValidLines() {
@@ -1656,52 +1569,67 @@ void ApproximateDedupBDITagArray::print() {
 
 ApproximateDedupBDIDataArray::ApproximateDedupBDIDataArray(uint32_t _numLines, uint32_t _assoc, HashFamily* _hf) : hf(_hf), numLines(_numLines), assoc(_assoc)  {
     numSets = numLines/assoc;
-    tagCounterArray = gm_calloc<int32_t*>(numSets);
-    tagPointerArray = gm_malloc<int32_t*>(numSets);
-    // approximateArray = gm_calloc<bool>(numLines);
-    compressedDataArray = gm_malloc<DataLine*>(numSets);
+    lineSize = zinfo->lineSize;
+    segmentsPerSet = assoc*lineSize/8;
+    // Flat, line-aligned slabs indexed by (set, segment); see segmentSlot()
+    tagCounterArray = gm_memalign<int32_t>(CACHE_LINE_BYTES, numSets*segmentsPerSet);
+    tagPointerArray = gm_memalign<int32_t>(CACHE_LINE_BYTES, numSets*segmentsPerSet);
+    memset(tagCounterArray, 0, numSets*segmentsPerSet*sizeof(int32_t));
+    memset(tagPointerArray, -1, numSets*segmentsPerSet*sizeof(int32_t));
+    // Contents take the modeled capacity, segmentsPerSet*8 bytes per set, plus per-segment selectors and offsets
+    assert_msg(lineSize == BDI_LINE_BYTES, "BDI data arrays need %d-byte lines, not %d", BDI_LINE_BYTES, lineSize);
+    assert_msg(segmentsPerSet*8 <= (1 << 16), "%d-byte sets overflow 16-bit segment offsets", segmentsPerSet*8);
+    compressedDataArray = gm_memalign<uint8_t>(CACHE_LINE_BYTES, (size_t)numSets*segmentsPerSet*8);
+    dataSizeArray = gm_calloc<uint8_t>(numSets*segmentsPerSet);
+    dataOffsetArray = gm_calloc<uint16_t>(numSets*segmentsPerSet);
+    dataSelectorArray = gm_calloc<uint64_t>(numSets*segmentsPerSet);
+    setFillArray = gm_calloc<uint32_t>(numSets);
+    compactBuffer = gm_malloc<uint8_t>(segmentsPerSet*8);
+    readBuffer = gm_malloc<uint8_t>(lineSize);
+    segmentSizeArray = gm_calloc<uint8_t>(numSets*segmentsPerSet);
+    usedSegmentsArray = gm_calloc<uint32_t>(numSets);
     rp = gm_calloc<DataLRUReplPolicy*>(numSets);
-    // notice that you will always need to access freeList by [size-1]
-    g_vector<g_vector<int32_t>> tmp(8);
-    freeList = tmp;
+    // Buckets go up to one full line's worth of segments
+    freeSets = new FreeSpaceIndex(numSets, lineSize/8);
     for (uint32_t i = 0; i < numSets; i++) {
-        tagCounterArray[i] = gm_calloc<int32_t>(assoc*zinfo->lineSize/8);
-        tagPointerArray[i] = gm_calloc<int32_t>(assoc*zinfo->lineSize/8);
-        compressedDataArray[i] = gm_calloc<DataLine>(assoc*zinfo->lineSize/8);
-        rp[i] = new DataLRUReplPolicy(assoc*zinfo->lineSize/8);
-        freeList[7].push_back(i);
-        for (uint32_t j = 0; j < assoc*zinfo->lineSize/8; j++) {
-            tagPointerArray[i][j] = -1;
-            compressedDataArray[i][j] = gm_calloc<uint8_t>(zinfo->lineSize);
-        }
+        rp[i] = new DataLRUReplPolicy(segmentsPerSet);
+        freeSets->update(i, segmentsPerSet);
     }
+    sampledEvictions.reserve(segmentsPerSet);
+    contentIndex = NULL;
+    victims = NULL;
     setMask = numSets - 1;
     validLines = 0;
     // srand (time(NULL));
     std::random_device rd;
     RNG = new std::mt19937(rd());
     DIST = new std::uniform_int_distribution<>(0, numSets-1);
-    popped = false;
 
     assert_msg(isPow2(numSets), "must have a power of 2 # sets, but you specified %d", numSets);
 }
 
 ApproximateDedupBDIDataArray::~ApproximateDedupBDIDataArray() {
-    for (uint32_t i = 0; i < numSets; i++) {
-        for (uint32_t j = 0; j < assoc*zinfo->lineSize/8; j++) {
-            gm_free(compressedDataArray[i][j]);
-        }
-        gm_free(tagCounterArray[i]);
-        gm_free(tagPointerArray[i]);
-        gm_free(compressedDataArray[i]);
-    }
     gm_free(tagCounterArray);
     gm_free(tagPointerArray);
     gm_free(compressedDataArray);
+    gm_free(dataSizeArray);
+    gm_free(dataOffsetArray);
+    gm_free(dataSelectorArray);
+    gm_free(setFillArray);
+    gm_free(compactBuffer);
+    gm_free(readBuffer);
+    gm_free(segmentSizeArray);
+    gm_free(usedSegmentsArray);
+    delete freeSets;
+    if (contentIndex) delete contentIndex;
+    if (victims) delete victims;
 }
 
 void ApproximateDedupBDIDataArray::lookup(int32_t dataId, int32_t segmentId, const MemReq* req, bool updateReplacement) {
-    if (updateReplacement) rp[dataId]->update(segmentId, req);
+    if (updateReplacement) {
+        rp[dataId]->update(segmentId, req);
+        if (victims) victims->touch(dataId);
+    }
 }
 
 void ApproximateDedupBDIDataArray::assignTagArray(ApproximateDedupBDITagArray* _tagArray) {
@@ -1710,36 +1638,31 @@ void ApproximateDedupBDIDataArray::assignTagArray(ApproximateDedupBDITagArray* _
 
 int32_t ApproximateDedupBDIDataArray::preinsert(uint16_t lineSize) {
     float leastValue = 999999;
-    int32_t leastId = 0;
-    for (uint32_t i = (lineSize/8)-1; i < 8; i++) {
-        if (freeList[i].size()) {
-            leastId = freeList[i].back();
-            freeList[i].pop_back();
-            popped = true;
-            return leastId;
-        }
-    }
+    int32_t leastId = freeSets->first(lineSize/8);
+    if (leastId != -1)
+        return leastId;
+    if (victims)
+        return victims->min();
+    leastId = 0;
     int32_t zeroFound = 1;
     for (uint32_t i = 0; i < zinfo->randomLoopTrial; i++) {
         int32_t id = DIST->operator()(*RNG);
         int32_t counts = 0;
-        int32_t sizes = 0;
+        int32_t sizes = usedSegmentsArray[id]*8;
         for (uint32_t j = 0; j < assoc*zinfo->lineSize/8; j++) {
-            counts += tagCounterArray[id][j];
-            if (tagCounterArray[id][j])
-                sizes += BDICompressionToSize(tagArray->readCompressionEncoding(tagPointerArray[id][j]), zinfo->lineSize);
+            counts += tagCounterArray[segmentSlot(id, j)];
         }
         if (counts == 0)
             panic("Cannot happen");
         if ((assoc*zinfo->lineSize - sizes) >= lineSize)
             return id;
-        g_vector<uint32_t> keptFromEvictions;
+        g_vector<uint32_t>& keptFromEvictions = sampledEvictions;
+        keptFromEvictions.clear();
         counts = 0;
         do {
             int32_t candidate = rp[id]->rank(NULL, SetAssocCands(0, (assoc*zinfo->lineSize/8)), keptFromEvictions);
-            if (tagCounterArray[id][candidate])
-                sizes -= BDICompressionToSize(tagArray->readCompressionEncoding(tagPointerArray[id][candidate]), zinfo->lineSize);
-            counts += tagCounterArray[id][candidate];
+            sizes -= segmentSizeArray[segmentSlot(id, candidate)]*8;
+            counts += tagCounterArray[segmentSlot(id, candidate)];
             keptFromEvictions.push_back(candidate);
         } while((assoc*zinfo->lineSize-sizes) < lineSize);
         if (counts <= leastValue) {
@@ -1766,96 +1689,251 @@ int32_t ApproximateDedupBDIDataArray::preinsert(int32_t dataId, int32_t* tagId,
         candidate = rp[dataId]->rank(NULL, SetAssocCands(0, (assoc*zinfo->lineSize/8)), exceptions);
         break;
     }
-    *tagId = tagPointerArray[dataId][candidate];
+    *tagId = tagPointerArray[segmentSlot(dataId, candidate)];
     return candidate;
 }
 
 void ApproximateDedupBDIDataArray::postinsert(int32_t tagId, const MemReq* req, int32_t counter, int32_t dataId, int32_t segmentId, DataLine data, bool updateReplacement) {
     rp[dataId]->replaced(segmentId);
 
-    if (!popped) {
-        for (uint32_t i = 0; i < 8; i++) {
-            auto it = std::find(freeList[i].begin(), freeList[i].end(), dataId);
-            if(it != freeList[i].end()) {
-                auto index = std::distance(freeList[i].begin(), it);
-                freeList[i].erase(freeList[i].begin() + index);
-                break;
-            }
-        }
-    }
-
-    tagCounterArray[dataId][segmentId] = counter;
-    if (tagPointerArray[dataId][segmentId] == -1 && tagId != -1) {
+    recount(dataId, segmentId, counter);
+    tagCounterArray[segmentSlot(dataId, segmentId)] = counter;
+    if (tagPointerArray[segmentSlot(dataId, segmentId)] == -1 && tagId != -1) {
         validLines++;
-    } else if (tagPointerArray[dataId][segmentId] != -1 && tagId == -1) {
+    } else if (tagPointerArray[segmentSlot(dataId, segmentId)] != -1 && tagId == -1) {
         validLines--;
     }
-    tagPointerArray[dataId][segmentId] = tagId;
-    if (data)
-        PIN_SafeCopy(compressedDataArray[dataId][segmentId], data, zinfo->lineSize);
-    if (updateReplacement) rp[dataId]->update(segmentId, req);
-
-    int count = assoc*zinfo->lineSize/8;
-    for (uint32_t i = 0; i < assoc*zinfo->lineSize/8; i++)
-        if (tagPointerArray[dataId][i] != -1)
-            count -= BDICompressionToSize(tagArray->readCompressionEncoding(tagPointerArray[dataId][i]), zinfo->lineSize)/8;
-    if (count > 8)
-        count = 8;
-    if (count)
-        freeList[count-1].push_back(dataId);
-    popped = false;
-    // info("Data was %i,%i: %i, %i", dataId, segmentId, tagCounterArray[dataId][segmentId], tagPointerArray[dataId][segmentId]);
+    tagPointerArray[segmentSlot(dataId, segmentId)] = tagId;
+    // Emptied segments give their bytes back
+    if (data || (tagId == -1 && !counter))
+        storeData(dataId, segmentId, data);
+    if (updateReplacement) {
+        rp[dataId]->update(segmentId, req);
+        if (victims) victims->touch(dataId);
+    }
+    reindex(dataId, segmentId, data != NULL);
+    resize(dataId, segmentId);
+    // info("Data was %i,%i: %i, %i", dataId, segmentId, tagCounterArray[segmentSlot(dataId, segmentId)], tagPointerArray[segmentSlot(dataId, segmentId)]);
     // info("Data is %i,%i: %i, %i", dataId, segmentId, counter, tagId);
 }
 
 void ApproximateDedupBDIDataArray::changeInPlace(int32_t tagId, const MemReq* req, int32_t counter, int32_t dataId, int32_t segmentId, DataLine data, bool updateReplacement) {
-    tagCounterArray[dataId][segmentId] = counter;
-    tagPointerArray[dataId][segmentId] = tagId;
-    if (data)
-        PIN_SafeCopy(compressedDataArray[dataId][segmentId], data, zinfo->lineSize);
-    if (updateReplacement) rp[dataId]->update(segmentId, req);
-    // info("Data was %i,%i: %i, %i", dataId, segmentId, tagCounterArray[dataId][segmentId], tagPointerArray[dataId][segmentId]);
+    if (tagPointerArray[segmentSlot(dataId, segmentId)] == -1 && tagId != -1) {
+        validLines++;
+    } else if (tagPointerArray[segmentSlot(dataId, segmentId)] != -1 && tagId == -1) {
+        validLines--;
+    }
+    recount(dataId, segmentId, counter);
+    tagCounterArray[segmentSlot(dataId, segmentId)] = counter;
+    tagPointerArray[segmentSlot(dataId, segmentId)] = tagId;
+    // Emptied segments give their bytes back
+    if (data || (tagId == -1 && !counter))
+        storeData(dataId, segmentId, data);
+    if (updateReplacement) {
+        rp[dataId]->update(segmentId, req);
+        if (victims) victims->touch(dataId);
+    }
+    reindex(dataId, segmentId, data != NULL);
+    resize(dataId, segmentId);
+    // info("Data was %i,%i: %i, %i", dataId, segmentId, tagCounterArray[segmentSlot(dataId, segmentId)], tagPointerArray[segmentSlot(dataId, segmentId)]);
     // info("Data is %i,%i: %i, %i", dataId, segmentId, counter, tagId);
 }
 
+// Re-sizes a segment from its (new) list head's encoding; the tag array must already hold that encoding
+void ApproximateDedupBDIDataArray::resize(int32_t dataId, int32_t segmentId) {
+    uint32_t slot = segmentSlot(dataId, segmentId);
+    int32_t tagId = tagPointerArray[slot];
+    uint8_t size = (tagId != -1)? BDICompressionToSize(tagArray->readCompressionEncoding(tagId), zinfo->lineSize)/8 : 0;
+    usedSegmentsArray[dataId] += size - segmentSizeArray[slot];
+    segmentSizeArray[slot] = size;
+    indexSet(dataId);
+}
+
+// Keeps the set's total reference count in victims in step with a segment's new counter
+void ApproximateDedupBDIDataArray::recount(int32_t dataId, int32_t segmentId, int32_t counter) {
+    if (!victims) return;
+    victims->setRefs(dataId, victims->getRefs(dataId) + counter - tagCounterArray[segmentSlot(dataId, segmentId)]);
+}
+
+void ApproximateDedupBDIDataArray::indexSet(int32_t dataId) {
+    freeSets->update(dataId, (int32_t)segmentsPerSet - (int32_t)usedSegmentsArray[dataId]);
+}
+
 bool ApproximateDedupBDIDataArray::isSame(int32_t dataId, int32_t segmentId, DataLine data) {
-    for (uint32_t i = 0; i < zinfo->lineSize/8; i++)
-        if (((uint64_t*)data)[i] != ((uint64_t*)compressedDataArray[dataId][segmentId])[i])
-            return false;
-    return true;
+    uint8_t line[BDI_LINE_BYTES];
+    loadData(dataId, segmentId, line);
+    return !memcmp(line, data, lineSize);
+}
+
+void ApproximateDedupBDIDataArray::storeData(int32_t dataId, int32_t segmentId, DataLine data) {
+    uint32_t slot = segmentSlot(dataId, segmentId);
+    if (!data) {
+        dataSizeArray[slot] = 0;
+        return;
+    }
+    uint8_t payload[BDI_LINE_BYTES];
+    uint64_t selectors;
+    uint32_t size = BDIEncodeLine(data, payload, &selectors);
+    uint32_t bytes = BDIPayloadBytes(size);
+    // Rewrite in place if the old payload's bytes suffice, otherwise append
+    if (bytes > BDIPayloadBytes(dataSizeArray[slot])) {
+        dataSizeArray[slot] = 0;
+        if (setFillArray[dataId] + bytes > segmentsPerSet*8) compactSet(dataId);
+        if (setFillArray[dataId] + bytes > segmentsPerSet*8)
+            panic("Data set %i holds %i bytes, no room for %i more", dataId, setFillArray[dataId], bytes);
+        dataOffsetArray[slot] = setFillArray[dataId];
+        setFillArray[dataId] += bytes;
+    }
+    memcpy(&setData(dataId)[dataOffsetArray[slot]], payload, bytes);
+    dataSizeArray[slot] = size;
+    dataSelectorArray[slot] = selectors;
+#ifdef __DEBUG__
+    uint8_t line[BDI_LINE_BYTES];
+    loadData(dataId, segmentId, line);
+    assert_msg(!memcmp(line, data, lineSize), "Segment %i,%i does not decode to the line stored", dataId, segmentId);
+#endif
+}
+
+// Squeezes the holes out of a set, keeping payloads in segment order
+void ApproximateDedupBDIDataArray::compactSet(int32_t dataId) {
+    uint8_t* set = setData(dataId);
+    uint32_t fill = 0;
+    for (uint32_t j = 0; j < segmentsPerSet; j++) {
+        uint32_t slot = segmentSlot(dataId, j);
+        uint32_t bytes = BDIPayloadBytes(dataSizeArray[slot]);
+        if (!bytes) continue;
+        memcpy(&compactBuffer[fill], &set[dataOffsetArray[slot]], bytes);
+        dataOffsetArray[slot] = fill;
+        fill += bytes;
+    }
+    memcpy(set, compactBuffer, fill);
+    setFillArray[dataId] = fill;
+}
+
+void ApproximateDedupBDIDataArray::loadData(int32_t dataId, int32_t segmentId, uint8_t* line) const {
+    uint32_t slot = segmentSlot(dataId, segmentId);
+    BDIDecodeLine(dataSizeArray[slot], &setData(dataId)[dataOffsetArray[slot]], dataSelectorArray[slot], line);
+}
+
+void ApproximateDedupBDIDataArray::enableContentIndex() {
+    if (contentIndex) return;
+    contentIndex = new LineContentIndex(numSets*segmentsPerSet);
+    for (uint32_t i = 0; i < numSets; i++)
+        for (uint32_t j = 0; j < segmentsPerSet; j++)
+            reindex(i, j, true);
+}
+
+void ApproximateDedupBDIDataArray::enableExactVictims() {
+    if (victims) return;
+    assert_msg(!validLines, "Exact victim selection must be enabled before the array is used");
+    victims = new VictimIndex(numSets);
+}
+
+// Keeps the content index in sync: it holds exactly the segments with a non-zero counter
+void ApproximateDedupBDIDataArray::reindex(int32_t dataId, int32_t segmentId, bool dataChanged) {
+    if (!contentIndex) return;
+    int32_t slot = segmentSlot(dataId, segmentId);
+    bool indexed = contentIndex->contains(slot);
+    if (!tagCounterArray[slot]) {
+        if (indexed) contentIndex->remove(slot);
+    } else if (!indexed || dataChanged) {
+        if (indexed) contentIndex->remove(slot);
+        uint8_t line[BDI_LINE_BYTES];
+        loadData(dataId, segmentId, line);
+        contentIndex->insert(slot, LineContentIndex::digest(line));
+    }
+}
+
+// The ideal caches' original sweep keeps the last set with a match, and the
+// first matching segment within it
+bool ApproximateDedupBDIDataArray::findSameByScan(DataLine data, int32_t* dataId, int32_t* segmentId) {
+    *dataId = -1;
+    *segmentId = -1;
+    for (uint32_t i = 0; i < numSets; i++) {
+        for (uint32_t j = 0; j < segmentsPerSet; j++) {
+            if (tagCounterArray[segmentSlot(i, j)] && isSame(i, j, data)) {
+                *dataId = i;
+                *segmentId = j;
+                break;
+            }
+        }
+    }
+    return *dataId != -1;
+}
+
+// Same preference order as findSameByScan, so results do not depend on the index
+bool ApproximateDedupBDIDataArray::findSame(DataLine data, int32_t* dataId, int32_t* segmentId) {
+    if (!contentIndex) return findSameByScan(data, dataId, segmentId);
+    int32_t foundData = -1;
+    int32_t foundSegment = -1;
+    uint64_t digest = LineContentIndex::digest(data);
+    for (int32_t slot = contentIndex->first(digest); slot != -1; slot = contentIndex->chainNext(slot)) {
+        int32_t i = slot / segmentsPerSet;
+        int32_t j = slot % segmentsPerSet;
+        if (contentIndex->slotDigest(slot) != digest) continue;
+        if (foundData != -1 && (i < foundData || (i == foundData && j > foundSegment))) continue;
+        if (isSame(i, j, data)) {
+            foundData = i;
+            foundSegment = j;
+        }
+    }
+#ifdef __DEBUG__
+    int32_t scanData, scanSegment;
+    findSameByScan(data, &scanData, &scanSegment);
+    assert_msg(foundData == scanData && foundSegment == scanSegment, "content index returned %i,%i, scan %i,%i", foundData, foundSegment, scanData, scanSegment);
+#endif
+    *dataId = foundData;
+    *segmentId = foundSegment;
+    return foundData != -1;
 }
 
 int32_t ApproximateDedupBDIDataArray::readListHead(int32_t dataId, int32_t segmentId) {
-    return tagPointerArray[dataId][segmentId];
+    return tagPointerArray[segmentSlot(dataId, segmentId)];
 }
 
 int32_t ApproximateDedupBDIDataArray::readCounter(int32_t dataId, int32_t segmentId) {
-    return tagCounterArray[dataId][segmentId];
+    return tagCounterArray[segmentSlot(dataId, segmentId)];
 }
 
 DataLine ApproximateDedupBDIDataArray::readData(int32_t dataId, int32_t segmentId) {
-    return compressedDataArray[dataId][segmentId];
+    loadData(dataId, segmentId, readBuffer);
+    return readBuffer;
 }
 
 void ApproximateDedupBDIDataArray::writeData(int32_t dataId, int32_t segmentId, DataLine data, const MemReq* req, bool updateReplacement) {
-    PIN_SafeCopy(compressedDataArray[dataId][segmentId], data, zinfo->lineSize);
-    if (updateReplacement) rp[dataId]->update(segmentId, req);
+    storeData(dataId, segmentId, data);
+    if (updateReplacement) {
+        rp[dataId]->update(segmentId, req);
+        if (victims) victims->touch(dataId);
+    }
+    reindex(dataId, segmentId, true);
 }
 
 uint32_t ApproximateDedupBDIDataArray::getValidLines() {
     return validLines;
 }
 
+uint32_t ApproximateDedupBDIDataArray::countValidLines() {
+    uint32_t Counter = 0;
+    for (uint32_t i = 0; i < numSets; i++) {
+        for (uint32_t j = 0; j < assoc*zinfo->lineSize/8; j++) {
+            if (tagPointerArray[segmentSlot(i, j)] != -1)
+                Counter++;
+        }
+    }
+    return Counter;
+}
+
 void ApproximateDedupBDIDataArray::print() {
     for (uint32_t i = 0; i < numSets; i++) {
         for (uint32_t j = 0; j < assoc*zinfo->lineSize/8; j++) {
-            if (tagPointerArray[i][j] != -1)
-                info("%i,%i: %i, %i", i, j, tagCounterArray[i][j], tagPointerArray[i][j]);
+            if (tagPointerArray[segmentSlot(i, j)] != -1)
+                info("%i,%i: %i, %i", i, j, tagCounterArray[segmentSlot(i, j)], tagPointerArray[segmentSlot(i, j)]);
         }
     }
 }
 
-ApproximateDedupBDIHashArray::ApproximateDedupBDIHashArray(uint32_t _numLines, uint32_t _assoc, ReplPolicy* _rp, HashFamily* _hf, H3HashFamily* _dataHash) : rp(_rp), hf(_hf), dataHash(_dataHash), numLines(_numLines), assoc(_assoc)  {
+ApproximateDedupBDIHashArray::ApproximateDedupBDIHashArray(uint32_t _numLines, uint32_t _assoc, ReplPolicy* _rp, HashFamily* _hf, LineHasher* _dataHash) : rp(_rp), hf(_hf), dataHash(_dataHash), numLines(_numLines), assoc(_assoc)  {
     hashArray = gm_malloc<uint64_t>(numLines);
     dataPointerArray = gm_malloc<int32_t>(numLines);
     segmentPointerArray = gm_malloc<int32_t>(numLines);
@@ -1866,6 +1944,7 @@ ApproximateDedupBDIHashArray::ApproximateDedupBDIHashArray(uint32_t _numLines, u
     }
     numSets = numLines/assoc;
     setMask = numSets - 1;
+    validLines = 0;
     assert_msg(isPow2(numSets), "must have a power of 2 # sets, but you specified %d", numSets);
 }
 
@@ -1912,6 +1991,12 @@ int32_t ApproximateDedupBDIHashArray::preinsert(uint64_t hash, const MemReq* req
 }
 
 void ApproximateDedupBDIHashArray::postinsert(uint64_t hash, const MemReq* req, int32_t dataPointer, int32_t segmentPointer, int32_t hashId, bool updateReplacement) {
+    if (dataPointerArray[hashId] == -1 && dataPointer != -1) {
+        validLines++;
+    } else if (dataPointerArray[hashId] != -1 && dataPointer == -1) {
+        assert(validLines);
+        validLines--;
+    }
     rp->replaced(hashId);
     hashArray[hashId] = hash;
     dataPointerArray[hashId] = dataPointer;
@@ -1920,6 +2005,12 @@ void ApproximateDedupBDIHashArray::postinsert(uint64_t hash, const MemReq* req,
 }
 
 void ApproximateDedupBDIHashArray::changeInPlace(uint64_t hash, const MemReq* req, int32_t dataPointer, int32_t segmentPointer, int32_t hashId, bool updateReplacement) {
+    if (dataPointerArray[hashId] == -1 && dataPointer != -1) {
+        validLines++;
+    } else if (dataPointerArray[hashId] != -1 && dataPointer == -1) {
+        assert(validLines);
+        validLines--;
+    }
     hashArray[hashId] = hash;
     dataPointerArray[hashId] = dataPointer;
     segmentPointerArray[hashId] = segmentPointer;
@@ -1954,40 +2045,11 @@ void ApproximateDedupBDIHashArray::approximate(const DataLine data, DataType typ
 
 uint64_t ApproximateDedupBDIHashArray::hash(const DataLine data)
 {
-    uint8_t _0;
-    uint8_t _1;
-    uint8_t _2;
-    uint8_t _3;
-    uint8_t _4;
-    uint8_t _5;
-    uint8_t _6;
-    uint8_t _7;
-    uint8_t* dataLine = (uint8_t*) data;
-
-    uint64_t XORs =0;
-    uint8_t xorNeeded = zinfo->lineSize/8;
-
-    if ((xorNeeded == 2) || (xorNeeded == 4) || (xorNeeded == 8)) {
-        for (int i=0; i < xorNeeded; i++) {
-            _0 =  dataLine[0+8*i];
-            _1 =  dataLine[1+8*i];
-            _2 =  dataLine[2+8*i];
-            _3 =  dataLine[3+8*i];
-            _4 =  dataLine[4+8*i];
-            _5 =  dataLine[5+8*i];
-            _6 =  dataLine[6+8*i];
-            _7 =  dataLine[7+8*i];
-
-            uint64_t step_64B = ((uint64_t) _0) + (((uint64_t) _1) << 8)  + (((uint64_t) _2) << 16) + (((uint64_t) _3) << 24)
-                            + (((uint64_t) _4) << 32) + (((uint64_t) _5) << 40) + (((uint64_t) _6) << 48) + (((uint64_t) _7) << 56);
-
-            XORs = XORs ^ dataHash->hash(0, step_64B);
-        }
-    } else {
-        panic("not implemented yet for lines other than 16B/32B/64B");
-    }
+    return dataHash->hash((const uint64_t*)data, zinfo->lineSize/8);
+}
 
-    return XORs & ((uint64_t)std::pow(2, (zinfo->hashSize))-1);
+uint32_t ApproximateDedupBDIHashArray::getValidLines() {
+    return validLines;
 }
 
 uint32_t ApproximateDedupBDIHashArray::countValidLines() {
@@ -2008,38 +2070,29 @@ void ApproximateDedupBDIHashArray::print() {
 // BDI and ApproximateBDI End
 
 ApproximateNaiiveDedupBDIDataArray::ApproximateNaiiveDedupBDIDataArray(uint32_t _numLines, uint32_t _assoc, HashFamily* _hf) : ApproximateDedupBDIDataArray(_numLines, _assoc, _hf) {
+    // The base constructor can't dispatch to our indexSet(), so every set is empty and indexed with 1 here
     for (uint32_t i = 0; i < numSets; i++) {
-        freeList.push_back(i);
+        freeSets->update(i, 1);
     }
 }
 
 ApproximateNaiiveDedupBDIDataArray::~ApproximateNaiiveDedupBDIDataArray() {
-    for (uint32_t i = 0; i < numSets; i++) {
-        for (uint32_t j = 0; j < assoc*zinfo->lineSize/8; j++) {
-            gm_free(compressedDataArray[i][j]);
-        }
-        gm_free(tagCounterArray[i]);
-        gm_free(tagPointerArray[i]);
-        gm_free(compressedDataArray[i]);
-    }
-    gm_free(tagCounterArray);
-    gm_free(tagPointerArray);
-    gm_free(compressedDataArray);
+    // Slabs are owned and freed by ApproximateDedupBDIDataArray
 }
 
 int32_t ApproximateNaiiveDedupBDIDataArray::preinsert(uint16_t lineSize) {
     float leastValue = 999999;
-    int32_t leastId = 0;
-    if (freeList.size()) {
-        leastId = freeList.back();
-        freeList.pop_back();
+    int32_t leastId = freeSets->first(1);
+    if (leastId != -1)
         return leastId;
-    }
+    if (victims)
+        return victims->min();
+    leastId = 0;
     for (uint32_t i = 0; i < zinfo->randomLoopTrial; i++) {
         int32_t id = DIST->operator()(*RNG);
         int32_t counts = 0;
         for (uint32_t j = 0; j < assoc*zinfo->lineSize/8; j++) {
-            counts += tagCounterArray[id][j];
+            counts += tagCounterArray[segmentSlot(id, j)];
         }
         if (counts == 0)
             panic("Cannot happen");
@@ -2065,38 +2118,12 @@ int32_t ApproximateNaiiveDedupBDIDataArray::preinsert(int32_t dataId, int32_t* t
         candidate = rp[dataId]->rank(NULL, SetAssocCands(0, (assoc*zinfo->lineSize/8)), exceptions);
         break;
     }
-    *tagId = tagPointerArray[dataId][candidate];
+    *tagId = tagPointerArray[segmentSlot(dataId, candidate)];
     return candidate;
 }
 
-void ApproximateNaiiveDedupBDIDataArray::postinsert(int32_t tagId, const MemReq* req, int32_t counter, int32_t dataId, int32_t segmentId, DataLine data, bool updateReplacement) {
-    rp[dataId]->replaced(segmentId);
-
-    auto it = std::find(freeList.begin(), freeList.end(), dataId);
-    if(it != freeList.end()) {
-        auto index = std::distance(freeList.begin(), it);
-        freeList.erase(freeList.begin() + index);
-    }
-
-    tagCounterArray[dataId][segmentId] = counter;
-    if (tagPointerArray[dataId][segmentId] == -1 && tagId != -1) {
-        validLines++;
-    } else if (tagPointerArray[dataId][segmentId] != -1 && tagId == -1) {
-        validLines--;
-    }
-    tagPointerArray[dataId][segmentId] = tagId;
-    if (data)
-        PIN_SafeCopy(compressedDataArray[dataId][segmentId], data, zinfo->lineSize);
-    if (updateReplacement) rp[dataId]->update(segmentId, req);
-
-    int count = 0;
-    for (uint32_t i = 0; i < assoc*zinfo->lineSize/8; i++)
-        if (tagPointerArray[dataId][i] != -1)
-            count += BDICompressionToSize(tagArray->readCompressionEncoding(tagPointerArray[dataId][i]), zinfo->lineSize)/8;
-    if (!count)
-        freeList.push_back(dataId);
-    // info("Data was %i,%i: %i, %i", dataId, segmentId, tagCounterArray[dataId][segmentId], tagPointerArray[dataId][segmentId]);
-    // info("Data is %i,%i: %i, %i", dataId, segmentId, counter, tagId);
+void ApproximateNaiiveDedupBDIDataArray::indexSet(int32_t dataId) {
+    freeSets->update(dataId, usedSegmentsArray[dataId]? 0 : 1);
 }
 
 // uniDoppelganger BDI Start
@@ -2260,23 +2287,19 @@ void uniDoppelgangerBDITagArray::print() {
 
 uniDoppelgangerBDIDataArray::uniDoppelgangerBDIDataArray(uint32_t _numLines, uint32_t _assoc, ReplPolicy* _rp, HashFamily* _hf, uint32_t _tagRatio) : rp(_rp), hf(_hf), numLines(_numLines), assoc(_assoc), tagRatio(_tagRatio) {
     numSets = numLines/assoc;
-    tagCounterArray = gm_calloc<int32_t*>(numSets);
-    tagPointerArray = gm_malloc<int32_t*>(numSets);
-    mtagArray = gm_malloc<int32_t*>(numSets);
-    approximateArray = gm_calloc<bool*>(numLines);
-    compressionEncodingArray = gm_malloc<BDICompressionEncoding*>(numLines);
+    // Flat, line-aligned arrays indexed by (set, segment); see segmentSlot()
+    tagCounterArray = gm_memalign<int32_t>(CACHE_LINE_BYTES, numSets*assoc);
+    tagPointerArray = gm_memalign<int32_t>(CACHE_LINE_BYTES, numSets*assoc);
+    mtagArray = gm_memalign<int32_t>(CACHE_LINE_BYTES, numSets*assoc);
+    approximateArray = gm_memalign<bool>(CACHE_LINE_BYTES, numSets*assoc);
+    compressionEncodingArray = gm_memalign<BDICompressionEncoding>(CACHE_LINE_BYTES, numSets*assoc);
     info("%i, %i", numSets, assoc);
-    for (uint32_t i = 0; i < numSets; i++) {
-        tagCounterArray[i] = gm_calloc<int32_t>(assoc);
-        tagPointerArray[i] = gm_malloc<int32_t>(assoc);
-        compressionEncodingArray[i] = gm_malloc<BDICompressionEncoding>(assoc);
-        mtagArray[i] = gm_malloc<int32_t>(assoc);
-        approximateArray[i] = gm_calloc<bool>(assoc);
-        for (uint32_t j = 0; j < assoc; j++) {
-            tagPointerArray[i][j] = -1;
-            mtagArray[i][j] = -1;
-            compressionEncodingArray[i][j] = NONE;
-        }
+    memset(tagCounterArray, 0, numSets*assoc*sizeof(int32_t));
+    memset(tagPointerArray, -1, numSets*assoc*sizeof(int32_t));
+    memset(mtagArray, -1, numSets*assoc*sizeof(int32_t));
+    memset(approximateArray, 0, numSets*assoc*sizeof(bool));
+    for (uint32_t i = 0; i < numSets*assoc; i++) {
+        compressionEncodingArray[i] = NONE;
     }
     setMask = numSets - 1;
     validSegments = 0;
@@ -2284,16 +2307,11 @@ uniDoppelgangerBDIDataArray::uniDoppelgangerBDIDataArray(uint32_t _numLines, uin
 }
 
 uniDoppelgangerBDIDataArray::~uniDoppelgangerBDIDataArray() {
-    for (uint32_t i = 0; i < numSets; i++) {
-        gm_free(mtagArray[i]);
-        gm_free(tagCounterArray[i]);
-        gm_free(tagPointerArray[i]);
-        gm_free(approximateArray[i]);
-    }
     gm_free(mtagArray);
     gm_free(tagPointerArray);
     gm_free(tagCounterArray);
     gm_free(approximateArray);
+    gm_free(compressionEncodingArray);
 }
 
 int32_t uniDoppelgangerBDIDataArray::lookup(uint32_t map) {
@@ -2303,7 +2321,7 @@ int32_t uniDoppelgangerBDIDataArray::lookup(uint32_t map) {
 
 int32_t uniDoppelgangerBDIDataArray::lookup(uint32_t map, uint32_t set, const MemReq* req, bool updateReplacement) {
     for (uint32_t id = 0; id < assoc; id++) {
-        if (mtagArray[set][id] == (int32_t)map && approximateArray[set][id] == true) {
+        if (mtagArray[segmentSlot(set, id)] == (int32_t)map && approximateArray[segmentSlot(set, id)] == true) {
             if (updateReplacement) rp->update(set*assoc+id, req);
             return id;
         }
@@ -2546,67 +2564,67 @@ int32_t uniDoppelgangerBDIDataArray::preinsert(uint32_t set, const MemReq* req,
 
     uint32_t mapId = rp->rank(req, SetAssocCands(first, first+assoc), exceptions);
 
-    *tagId = tagPointerArray[set][mapId%assoc];
+    *tagId = tagPointerArray[segmentSlot(set, mapId%assoc)];
     return mapId%assoc;
 }
 
 void uniDoppelgangerBDIDataArray::postinsert(int32_t map, const MemReq* req, int32_t mapId, int32_t segmentId, int32_t tagId, int32_t counter, BDICompressionEncoding compression, bool approximate, bool updateReplacement) {
-    if (tagPointerArray[mapId][segmentId] == -1 && tagId != -1) {
+    if (tagPointerArray[segmentSlot(mapId, segmentId)] == -1 && tagId != -1) {
         validSegments+=BDICompressionToSize(compression, zinfo->lineSize)/8;
             // info("UP");
         // validLines++;
-    } else if (tagPointerArray[mapId][segmentId] != -1 && tagId == -1) {
-        validSegments-=BDICompressionToSize(compressionEncodingArray[mapId][segmentId], zinfo->lineSize)/8;
+    } else if (tagPointerArray[segmentSlot(mapId, segmentId)] != -1 && tagId == -1) {
+        validSegments-=BDICompressionToSize(compressionEncodingArray[segmentSlot(mapId, segmentId)], zinfo->lineSize)/8;
         assert(validSegments);
-    } else if (tagPointerArray[mapId][segmentId] != -1 && tagId != -1) {
+    } else if (tagPointerArray[segmentSlot(mapId, segmentId)] != -1 && tagId != -1) {
         validSegments+=BDICompressionToSize(compression, zinfo->lineSize)/8;
-        validSegments-=BDICompressionToSize(compressionEncodingArray[mapId][segmentId], zinfo->lineSize)/8;
+        validSegments-=BDICompressionToSize(compressionEncodingArray[segmentSlot(mapId, segmentId)], zinfo->lineSize)/8;
     }
     rp->replaced(mapId*assoc+segmentId);
-    mtagArray[mapId][segmentId] = map;
-    tagPointerArray[mapId][segmentId] = tagId;
-    tagCounterArray[mapId][segmentId] = counter;
-    compressionEncodingArray[mapId][segmentId] = compression;
-    approximateArray[mapId][segmentId] = approximate;
+    mtagArray[segmentSlot(mapId, segmentId)] = map;
+    tagPointerArray[segmentSlot(mapId, segmentId)] = tagId;
+    tagCounterArray[segmentSlot(mapId, segmentId)] = counter;
+    compressionEncodingArray[segmentSlot(mapId, segmentId)] = compression;
+    approximateArray[segmentSlot(mapId, segmentId)] = approximate;
     if(updateReplacement) rp->update(mapId*assoc+segmentId, req);
 }
 
 void uniDoppelgangerBDIDataArray::changeInPlace(int32_t map, const MemReq* req, int32_t mapId, int32_t segmentId, int32_t tagId, int32_t counter, BDICompressionEncoding compression, bool approximate, bool updateReplacement) {
-    validSegments-=BDICompressionToSize(compressionEncodingArray[mapId][segmentId], zinfo->lineSize)/8;
+    validSegments-=BDICompressionToSize(compressionEncodingArray[segmentSlot(mapId, segmentId)], zinfo->lineSize)/8;
     validSegments+=BDICompressionToSize(compression, zinfo->lineSize)/8;
-    mtagArray[mapId][segmentId] = map;
-    tagPointerArray[mapId][segmentId] = tagId;
-    tagCounterArray[mapId][segmentId] = counter;
-    compressionEncodingArray[mapId][segmentId] = compression;
-    approximateArray[mapId][segmentId] = approximate;
+    mtagArray[segmentSlot(mapId, segmentId)] = map;
+    tagPointerArray[segmentSlot(mapId, segmentId)] = tagId;
+    tagCounterArray[segmentSlot(mapId, segmentId)] = counter;
+    compressionEncodingArray[segmentSlot(mapId, segmentId)] = compression;
+    approximateArray[segmentSlot(mapId, segmentId)] = approximate;
     if(updateReplacement) rp->update(mapId*assoc+segmentId, req);
 }
 
 int32_t uniDoppelgangerBDIDataArray::readListHead(int32_t mapId, int32_t segmentId) {
-    return tagPointerArray[mapId][segmentId];
+    return tagPointerArray[segmentSlot(mapId, segmentId)];
 }
 
 int32_t uniDoppelgangerBDIDataArray::readCounter(int32_t mapId, int32_t segmentId) {
-    return tagCounterArray[mapId][segmentId];
+    return tagCounterArray[segmentSlot(mapId, segmentId)];
 }
 
 bool uniDoppelgangerBDIDataArray::readApproximate(int32_t mapId, int32_t segmentId) {
-    return approximateArray[mapId][segmentId];
+    return approximateArray[segmentSlot(mapId, segmentId)];
 }
 
 BDICompressionEncoding uniDoppelgangerBDIDataArray::readCompressionEncoding(int32_t mapId, int32_t segmentId) {
-    return compressionEncodingArray[mapId][segmentId];
+    return compressionEncodingArray[segmentSlot(mapId, segmentId)];
 }
 
 int32_t uniDoppelgangerBDIDataArray::readMap(int32_t mapId, int32_t segmentId) {
-    return mtagArray[mapId][segmentId];
+    return mtagArray[segmentSlot(mapId, segmentId)];
 }
 
 void uniDoppelgangerBDIDataArray::print() {
     for (uint32_t i = 0; i < this->numSets; i++) {
         for (uint32_t j = 0; j < assoc; j++) {
-            if (tagPointerArray[i][j] != -1)
-                info("%i, %i: %i, %i, %i, %s, %s", i,j, mtagArray[i][j], tagPointerArray[i][j], tagCounterArray[i][j], BDICompressionName(compressionEncodingArray[i][j]), approximateArray[i][j]? "approximate":"exact");
+            if (tagPointerArray[segmentSlot(i, j)] != -1)
+                info("%i, %i: %i, %i, %i, %s, %s", i,j, mtagArray[segmentSlot(i, j)], tagPointerArray[segmentSlot(i, j)], tagCounterArray[segmentSlot(i, j)], BDICompressionName(compressionEncodingArray[segmentSlot(i, j)]), approximateArray[segmentSlot(i, j)]? "approximate":"exact");
         }
     }
 }
@@ -2615,16 +2633,16 @@ uint32_t uniDoppelgangerBDIDataArray::getValidSegments() {
     return validSegments;
 }
 
-// uint32_t uniDoppelgangerBDIDataArray::countValidLines() {
-//     uint32_t Counter = 0;
-//     for (uint32_t i = 0; i < numSets; i++) {
-//         for (uint32_t j = 0; j < assoc; j++) {
-//             if (tagPointerArray[i][j] != -1)
-//                 Counter++;
-//         }
-//     }
-//     return Counter;
-// }
+uint32_t uniDoppelgangerBDIDataArray::countValidSegments() {
+    uint32_t Counter = 0;
+    for (uint32_t i = 0; i < numSets; i++) {
+        for (uint32_t j = 0; j < assoc; j++) {
+            if (tagPointerArray[segmentSlot(i, j)] != -1)
+                Counter += BDICompressionToSize(compressionEncodingArray[segmentSlot(i, j)], zinfo->lineSize)/8;
+        }
+    }
+    return Counter;
+}
 // Doppelganger BDI End
 
 /* ZCache implementation */
@@ -30,6 +30,8 @@
 #include "stats.h"
 #include <random>
 #include "g_std/g_unordered_map.h"
+#include "free_space_index.h"
+#include "victim_index.h"
 
 /* General interface of a cache array. The array is a fixed-size associative container that
  * translates addresses to line IDs. A line ID represents the position of the tag. The other
@@ -56,7 +58,7 @@ class CacheArray : public GlobAlloc {
 class ReplPolicy;
 class DataLRUReplPolicy;
 class HashFamily;
-class H3HashFamily;
+class LineHasher;
 
 /* Set-associative cache array */
 class SetAssocArray : public CacheArray {
@@ -173,6 +175,8 @@ class ApproximateBDITagArray {
         uint32_t setMask;
         uint32_t validLines;
         uint32_t dataValidSegments;
+        uint32_t* occupiedSpace;    // per set, in bytes, so needEviction() need not sum the set
+        uint16_t lineSpace(int32_t tagId) const;
     public:
         ApproximateBDITagArray(uint32_t _numLines, uint32_t _assoc, uint32_t _dataAssoc, ReplPolicy* _rp, HashFamily* _hf);
         ~ApproximateBDITagArray();
@@ -209,6 +213,30 @@ class ApproximateBDIDataArray {
 // BDI Begin
 
 // Dedup Begin
+// Exact content index over data slots, used by the ideal dedup caches to find
+// duplicates without sweeping the whole data array. Slots are chained in
+// buckets keyed by a full-line digest; digests may collide, so callers must
+// still compare contents.
+class LineContentIndex : public GlobAlloc {
+    private:
+        int32_t* heads;     // per bucket: first slot, -1 if empty
+        int32_t* next;      // per slot: next slot in chain, -1 at tail, -2 if not indexed
+        uint64_t* digests;  // per slot: digest it was indexed with
+        uint32_t numSlots;
+        uint32_t bucketMask;
+    public:
+        explicit LineContentIndex(uint32_t _numSlots);
+        ~LineContentIndex();
+        static uint64_t digest(const DataLine data);
+        bool contains(int32_t slot) const {return next[slot] != -2;}
+        void insert(int32_t slot, uint64_t digest);
+        void remove(int32_t slot);
+        // Chain walk over the candidates for a digest: first(d), then chainNext(slot) until -1
+        int32_t first(uint64_t digest) const {return heads[digest & bucketMask];}
+        int32_t chainNext(int32_t slot) const {return next[slot];}
+        uint64_t slotDigest(int32_t slot) const {return digests[slot];}
+};
+
 // This in fact is exactly the same as uniDoppelgangerTagArray
 class ApproximateDedupTagArray {
     protected:
@@ -268,16 +296,27 @@ class ApproximateDedupDataArray {
         std::mt19937* RNG;
         std::uniform_int_distribution<>* DIST;
         g_vector<int32_t> freeList;
+        LineContentIndex* contentIndex;
+        VictimIndex* victims;
+        void reindex(int32_t dataId, bool dataChanged);
+        int32_t findSameByScan(DataLine data);
     public:
         ApproximateDedupDataArray(uint32_t _numLines, uint32_t _assoc, ReplPolicy* _rp, HashFamily* _hf);
         ~ApproximateDedupDataArray();
         void lookup(int32_t dataId, const MemReq* req, bool updateReplacement);
-        int32_t preinsert(int32_t* tagPointer);
+        // Never picks keepId, a line the caller still uses
+        int32_t preinsert(int32_t* tagPointer, int32_t keepId = -1);
         // Actually inserts
         void postinsert(int32_t tagId, const MemReq* req, int32_t counter, int32_t dataId, bool approximate, DataLine data, bool updateReplacement);
         void changeInPlace(int32_t tagId, const MemReq* req, int32_t counter, int32_t dataId, bool approximate, DataLine data, bool updateReplacement);
         void writeData(int32_t dataId, DataLine data, const MemReq* req, bool updateReplacement);
         bool isSame(int32_t dataId, DataLine data);
+        // Index line contents so findSame() need not scan; off by default
+        void enableContentIndex();
+        // Evict the least-referenced line (LRU among ties) instead of sampling; off by default
+        void enableExactVictims();
+        // returns the lowest valid dataId holding data, -1 if none
+        int32_t findSame(DataLine data);
         // returns tagId
         int32_t readListHead(int32_t dataId);
         // returns counter
@@ -295,14 +334,15 @@ class ApproximateDedupHashArray {
         int32_t* dataPointerArray;
         ReplPolicy* rp;
         HashFamily* hf;
-        H3HashFamily* dataHash;
+        LineHasher* dataHash;
         uint32_t numLines;
         uint32_t numSets;
         uint32_t assoc;
         uint32_t setMask;
+        uint32_t validLines;
         ApproximateDedupDataArray* dataArray;
     public:
-        ApproximateDedupHashArray(uint32_t _numLines, uint32_t _assoc, ReplPolicy* _rp, HashFamily* _hf, H3HashFamily* _dataHash);
+        ApproximateDedupHashArray(uint32_t _numLines, uint32_t _assoc, ReplPolicy* _rp, HashFamily* _hf, LineHasher* _dataHash);
         ~ApproximateDedupHashArray();
         void registerDataArray(ApproximateDedupDataArray* dataArray);
         int32_t lookup(uint64_t hash, const MemReq* req, bool updateReplacement);
@@ -311,6 +351,7 @@ class ApproximateDedupHashArray {
         int32_t readDataPointer(int32_t hashId);
         void approximate(const DataLine data, DataType type);
         uint64_t hash(const DataLine data);
+        uint32_t getValidLines();
         uint32_t countValidLines();
         void print();
 };
@@ -369,9 +410,20 @@ class ApproximateDedupBDITagArray {
 
 class ApproximateDedupBDIDataArray : public ApproximateBDIDataArray {
     protected:
-        int32_t** tagCounterArray;
-        int32_t** tagPointerArray;
-        DataLine** compressedDataArray;
+        // Per-segment state lives in flat slabs of numSets*segmentsPerSet entries
+        int32_t* tagCounterArray;
+        int32_t* tagPointerArray;
+        // Segment contents, BDI-encoded (see BDIEncodeLine) and packed into
+        // segmentsPerSet*8 bytes per set. A segment's payload sits at its
+        // offset; freed payloads leave holes, squeezed out when the set's
+        // fill pointer reaches the end. Sizes are BDI sizes, 0 if empty.
+        uint8_t* compressedDataArray;
+        uint8_t* dataSizeArray;
+        uint16_t* dataOffsetArray;
+        uint64_t* dataSelectorArray;
+        uint32_t* setFillArray;
+        uint8_t* compactBuffer;
+        uint8_t* readBuffer;
         DataLRUReplPolicy** rp;
         HashFamily* hf;
         uint32_t numLines;
@@ -379,15 +431,40 @@ class ApproximateDedupBDIDataArray : public ApproximateBDIDataArray {
         uint32_t assoc;
         uint32_t setMask;
         uint32_t validLines;
+        uint32_t segmentsPerSet;
+        uint32_t lineSize;
         std::mt19937* RNG;
         std::uniform_int_distribution<>* DIST;
-        g_vector<g_vector<int32_t>> freeList;
+        // Occupied segments, per segment (as sized when last inserted or changed) and per set
+        uint8_t* segmentSizeArray;
+        uint32_t* usedSegmentsArray;
+        FreeSpaceIndex* freeSets;
+        g_vector<uint32_t> sampledEvictions;  // preinsert(lineSize) scratch, reused to keep accesses allocation-free
         ApproximateDedupBDITagArray* tagArray;
-        bool popped;
+        LineContentIndex* contentIndex;
+        VictimIndex* victims;    // over sets, keyed by the sum of their segments' counters
+        void reindex(int32_t dataId, int32_t segmentId, bool dataChanged);
+        void recount(int32_t dataId, int32_t segmentId, int32_t counter);
+        void resize(int32_t dataId, int32_t segmentId);
+        // Files dataId in freeSets after its occupancy changes
+        virtual void indexSet(int32_t dataId);
+        bool findSameByScan(DataLine data, int32_t* dataId, int32_t* segmentId);
+
+        inline uint32_t segmentSlot(int32_t dataId, int32_t segmentId) const {
+            return dataId*segmentsPerSet + segmentId;
+        }
+        inline uint8_t* setData(int32_t dataId) const {
+            return &compressedDataArray[(size_t)dataId*segmentsPerSet*8];
+        }
+        // Stores data as the segment's contents, or drops them if data is NULL
+        void storeData(int32_t dataId, int32_t segmentId, DataLine data);
+        void compactSet(int32_t dataId);
+        // Decodes the segment's contents into line (lineSize bytes)
+        void loadData(int32_t dataId, int32_t segmentId, uint8_t* line) const;
 
     public:
         ApproximateDedupBDIDataArray(uint32_t _numLines, uint32_t _assoc, HashFamily* _hf);
-        ~ApproximateDedupBDIDataArray();
+        virtual ~ApproximateDedupBDIDataArray();
         void assignTagArray(ApproximateDedupBDITagArray* _tagArray);
         void lookup(int32_t dataId, int32_t segmentId, const MemReq* req, bool updateReplacement);
         int32_t preinsert(uint16_t lineSize);
@@ -397,12 +474,21 @@ class ApproximateDedupBDIDataArray : public ApproximateBDIDataArray {
         void changeInPlace(int32_t tagId, const MemReq* req, int32_t counter, int32_t dataId, int32_t segmentId, DataLine data, bool updateReplacement);
         void writeData(int32_t dataId, int32_t segmentId, DataLine data, const MemReq* req, bool updateReplacement);
         bool isSame(int32_t dataId, int32_t segmentId, DataLine data);
+        // Index segment contents so findSame() need not scan; off by default
+        void enableContentIndex();
+        // Evict from the least-referenced set (LRU among ties) instead of sampling; off by default
+        void enableExactVictims();
+        // finds a valid segment holding data, preferring the highest dataId and then the lowest segmentId; false if none
+        bool findSame(DataLine data, int32_t* dataId, int32_t* segmentId);
         // returns tagId
         int32_t readListHead(int32_t dataId, int32_t segmentId);
         // returns counter
         int32_t readCounter(int32_t dataId, int32_t segmentId);
+        // Decoded into a buffer that the next call overwrites
         DataLine readData(int32_t dataId, int32_t segmentId);
+        // returns the number of distinct compressed lines, i.e., segments heading a tag list
         uint32_t getValidLines();
+        uint32_t countValidLines();
         void initStats(AggregateStat* parent) {}
         uint32_t getAssoc() {return assoc;}
         void print();
@@ -415,14 +501,15 @@ class ApproximateDedupBDIHashArray {
         int32_t* segmentPointerArray;
         ReplPolicy* rp;
         HashFamily* hf;
-        H3HashFamily* dataHash;
+        LineHasher* dataHash;
         uint32_t numLines;
         uint32_t numSets;
         uint32_t assoc;
         uint32_t setMask;
+        uint32_t validLines;
         ApproximateDedupBDIDataArray* dataArray;
     public:
-        ApproximateDedupBDIHashArray(uint32_t _numLines, uint32_t _assoc, ReplPolicy* _rp, HashFamily* _hf, H3HashFamily* _dataHash);
+        ApproximateDedupBDIHashArray(uint32_t _numLines, uint32_t _assoc, ReplPolicy* _rp, HashFamily* _hf, LineHasher* _dataHash);
         ~ApproximateDedupBDIHashArray();
         void registerDataArray(ApproximateDedupBDIDataArray* dataArray);
         int32_t lookup(uint64_t hash, const MemReq* req, bool updateReplacement);
@@ -433,6 +520,7 @@ class ApproximateDedupBDIHashArray {
         int32_t readSegmentPointer(int32_t hashId);
         void approximate(const DataLine data, DataType type);
         uint64_t hash(const DataLine data);
+        uint32_t getValidLines();
         uint32_t countValidLines();
         void print();
 };
@@ -440,15 +528,14 @@ class ApproximateDedupBDIHashArray {
 
 class ApproximateNaiiveDedupBDIDataArray : public ApproximateDedupBDIDataArray {
     protected:
-        g_vector<int32_t> freeList;
+        // Only fully empty sets are indexed, all with 1 free "segment"
+        void indexSet(int32_t dataId);
 
     public:
         ApproximateNaiiveDedupBDIDataArray(uint32_t _numLines, uint32_t _assoc, HashFamily* _hf);
         ~ApproximateNaiiveDedupBDIDataArray();
         int32_t preinsert(uint16_t lineSize);
         int32_t preinsert(int32_t dataId, int32_t* tagId, g_vector<uint32_t>& exceptions);
-        // Actually inserts
-        void postinsert(int32_t tagId, const MemReq* req, int32_t counter, int32_t dataId, int32_t segmentId, DataLine data, bool updateReplacement);
 };
 
 // Doppelganger BDI Begin
@@ -498,11 +585,12 @@ class uniDoppelgangerBDITagArray {
 
 class uniDoppelgangerBDIDataArray : public ApproximateBDIDataArray {
     protected:
-        bool** approximateArray;
-        int32_t** mtagArray;
-        int32_t** tagPointerArray;
-        int32_t** tagCounterArray;
-        BDICompressionEncoding** compressionEncodingArray;
+        // Flat arrays of numSets*assoc entries, indexed by segmentSlot()
+        bool* approximateArray;
+        int32_t* mtagArray;
+        int32_t* tagPointerArray;
+        int32_t* tagCounterArray;
+        BDICompressionEncoding* compressionEncodingArray;
         ReplPolicy* rp;
         HashFamily* hf;
         uint32_t numLines;
@@ -511,6 +599,10 @@ class uniDoppelgangerBDIDataArray : public ApproximateBDIDataArray {
         uint32_t setMask;
         uint32_t validSegments;
         uint32_t tagRatio;
+
+        inline uint32_t segmentSlot(int32_t mapId, int32_t segmentId) const {
+            return mapId*assoc + segmentId;
+        }
     public:
         uniDoppelgangerBDIDataArray(uint32_t _numLines, uint32_t _assoc, ReplPolicy* _rp, HashFamily* _hf, uint32_t _tagRatio);
         ~uniDoppelgangerBDIDataArray();
@@ -533,7 +625,7 @@ class uniDoppelgangerBDIDataArray : public ApproximateBDIDataArray {
         int32_t readMap(int32_t mapId, int32_t segmentId);
         BDICompressionEncoding readCompressionEncoding(int32_t mapId, int32_t segmentId);
         uint32_t getValidSegments();
-        // uint32_t countValidLines();
+        uint32_t countValidSegments();
         void initStats(AggregateStat* parent) {}
         uint32_t getAssoc() {return assoc;}
         uint32_t getRatio() {return tagRatio;}
@@ -0,0 +1,592 @@
+/** $lic$
+ * Copyright (C) 2012-2015 by Massachusetts Institute of Technology
+ * Copyright (C) 2010-2013 by The Board of Trustees of Stanford University
+ *
+ * This file is part of zsim.
+ *
+ * zsim is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, version 2.
+ *
+ * If you use this software in your research, we request that you reference
+ * the zsim paper ("ZSim: Fast and Accurate Microarchitectural Simulation of
+ * Thousand-Core Systems", Sanchez and Kozyrakis, ISCA-40, June 2013) as the
+ * source of the simulator in any publications that use this software, and that
+ * you send us a citation of your work.
+ *
+ * zsim is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Microbenchmarks for the cache arrays, replacement policies and compression
+ * kernels that does not need pin. Drives them with synthetic address streams
+ * and line contents, and reports throughput, time per operation, and the heap
+ * memory each structure uses. Runs are deterministic (fixed seeds), so
+ * results can be compared across changes to these hot paths.
+ */
+
+#include <algorithm>
+#include <functional>
+#include <math.h>
+#include <stdio.h>
+#include <time.h>
+#include <vector>
+
+#include "bdi.h"
+#include "bithacks.h"
+#include "cache_arrays.h"
+#include "coherence_ctrls.h"
+#include "galloc.h"
+#include "hash.h"
+#include "log.h"
+#include "mtrand.h"
+#include "repl_policies.h"
+#include "zsim.h"
+
+// Process-wide globals, normally defined in zsim.cpp. The arrays only read zinfo's line size and approximation parameters
+GlobSimInfo* zinfo;
+uint32_t lineBits;
+
+#define POOL_LINES 16384  // distinct data lines per distribution (1MB)
+#define DUP_SOURCES 64  // distinct contents in the duplicate-heavy pool
+#define STRIDE_LINES 4
+#define DATA_RATIO 8  // tags per data line in the dedup BDI benchmarks, so fills overflow the data array
+#define FILL_RATIO 256  // accesses per op of the dedup BDI benchmarks, whose sampled victim selection can take ms per fill
+#define ZIPF_ALPHA 0.99
+
+static volatile uint64_t sink;  // keeps results of timed code alive
+
+static inline uint64_t getNs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec*1000000000ul + ts.tv_nsec;
+}
+
+/* Stands in for the coherence controller, which LRU policies ask about the
+ * validity and sharers of candidates. Lines are valid once inserted.
+ */
+class BenchCC : public CC {
+    private:
+        bool* valid;
+
+    public:
+        explicit BenchCC(uint32_t numLines) {valid = gm_calloc<bool>(numLines);}
+        ~BenchCC() {gm_free(valid);}
+
+        void insert(uint32_t lineId) {valid[lineId] = true;}
+
+        uint32_t numSharers(uint32_t lineId) {return 0;}
+        bool isValid(uint32_t lineId) {return valid[lineId];}
+
+        void setParents(uint32_t childId, const g_vector<MemObject*>& parents, Network* network) {panic("BenchCC only answers replacement queries");}
+        void setChildren(const g_vector<BaseCache*>& children, Network* network) {panic("BenchCC only answers replacement queries");}
+        void initStats(AggregateStat* cacheStat) {}
+        bool startAccess(MemReq& req) {panic("BenchCC only answers replacement queries");}
+        bool shouldAllocate(const MemReq& req) {panic("BenchCC only answers replacement queries");}
+        uint64_t processEviction(const MemReq& triggerReq, Address wbLineAddr, int32_t lineId, uint64_t startCycle) {panic("BenchCC only answers replacement queries");}
+        uint64_t processAccess(const MemReq& req, int32_t lineId, uint64_t startCycle, uint64_t* getDoneCycle) {panic("BenchCC only answers replacement queries");}
+        void endAccess(const MemReq& req) {}
+        void startInv() {}
+        uint64_t processInv(const InvReq& req, int32_t lineId, uint64_t startCycle) {panic("BenchCC only answers replacement queries");}
+};
+
+/* Mutes info() while in scope. The arrays log their geometry when built,
+ * which would otherwise land in the middle of the result tables.
+ */
+class QuietLog {
+    private:
+        FILE* saved;
+        static FILE* devNull;
+
+    public:
+        QuietLog() : saved(logFdOut) {
+            if (!devNull) devNull = fopen("/dev/null", "w");
+            if (devNull) logFdOut = devNull;
+        }
+        ~QuietLog() {logFdOut = saved;}
+};
+FILE* QuietLog::devNull = nullptr;
+
+/* The dedup BDI tag and data arrays, with the fill path of the compressed
+ * caches' tag misses minus timing and coherence (see
+ * CompressedTimingCache::evictSegments): a tag victim drops its segment, and
+ * the new line either joins a segment with the same contents or gets room in
+ * a victim set, evicting the tags of the segments it takes.
+ */
+struct DedupBDIArrays {
+    BenchCC* cc;
+    ReplPolicy* rp;
+    HashFamily* tagHf;
+    HashFamily* dataHf;
+    ApproximateDedupBDITagArray* tags;
+    ApproximateDedupBDIDataArray* data;
+    size_t dataBytes;  // heap used by the data array and its indexes
+    g_vector<uint32_t> kept;
+    uint64_t dedups;
+    uint64_t evictions;
+
+    // numTags tags with LRU replacement over numDataLines of data, which finds duplicates through the content index
+    DedupBDIArrays(uint32_t numTags, uint32_t numDataLines, uint32_t ways, bool exactVictims) : dedups(0), evictions(0) {
+        QuietLog quiet;
+        cc = new BenchCC(numTags);
+        rp = new LRUReplPolicy<true>(numTags);
+        rp->setCC(cc);
+        tagHf = new H3HashFamily(1, ilog2(numTags/ways), 0xCAC7EAFFA1);
+        tags = new ApproximateDedupBDITagArray(numTags, ways, rp, tagHf);
+        dataHf = new H3HashFamily(1, ilog2(numDataLines/ways), 0xCAC7EAFFA1);
+        size_t heapStart = gm_used_bytes();
+        data = new ApproximateDedupBDIDataArray(numDataLines, ways, dataHf);
+        data->enableContentIndex();
+        if (exactVictims) data->enableExactVictims();
+        dataBytes = gm_used_bytes() - heapStart;
+        data->assignTagArray(tags);
+    }
+
+    ~DedupBDIArrays() {
+        delete data;
+        delete dataHf;
+        delete tags;
+        delete tagHf;
+        delete rp;
+        delete cc;
+    }
+
+    // Unlinks tagId from its segment, freeing the segment if no other tag points to it, and invalidates it
+    void release(const MemReq* req, int32_t tagId) {
+        int32_t newLLHead;
+        bool evictData = tags->evictAssociatedData(tagId, &newLLHead);
+        int32_t dataId = tags->readDataId(tagId);
+        int32_t segmentId = tags->readSegmentPointer(tagId);
+        if (evictData) {
+            data->postinsert(-1, req, 0, dataId, segmentId, NULL, false);
+        } else if (newLLHead != -1) {
+            data->changeInPlace(newLLHead, req, data->readCounter(dataId, segmentId) - 1, dataId, segmentId, NULL, false);
+        } else if (dataId != -1 && segmentId != -1) {
+            data->changeInPlace(data->readListHead(dataId, segmentId), req, data->readCounter(dataId, segmentId) - 1, dataId, segmentId, NULL, false);
+        }
+        tags->postinsert(0, req, tagId, -1, -1, NONE, -1, false);
+    }
+
+    // Points released tag tagId to a segment holding line, which compresses to lineSize bytes with encoding
+    void fill(const MemReq* req, int32_t tagId, Address lineAddr, DataLine line, BDICompressionEncoding encoding, uint16_t lineSize) {
+        int32_t dataId, segmentId;
+        if (data->findSame(line, &dataId, &segmentId)) {
+            dedups++;
+            int32_t counter = data->readCounter(dataId, segmentId);
+            tags->postinsert(lineAddr, req, tagId, dataId, segmentId, encoding, data->readListHead(dataId, segmentId), true);
+            data->changeInPlace(tagId, req, counter + 1, dataId, segmentId, NULL, true);
+            return;
+        }
+
+        dataId = data->preinsert(lineSize);
+        kept.clear();
+        uint16_t freeSpace = 0;
+        do {
+            uint16_t occupiedSpace = 0;
+            for (uint32_t i = 0; i < data->getAssoc()*zinfo->lineSize/8; i++)
+                if (data->readListHead(dataId, i) != -1)
+                    occupiedSpace += BDICompressionToSize(tags->readCompressionEncoding(data->readListHead(dataId, i)), zinfo->lineSize);
+            freeSpace = data->getAssoc()*zinfo->lineSize - occupiedSpace;
+            int32_t listHead;
+            int32_t victimSegmentId = data->preinsert(dataId, &listHead, kept);
+            if (data->readListHead(dataId, victimSegmentId) != -1)
+                freeSpace += BDICompressionToSize(tags->readCompressionEncoding(data->readListHead(dataId, victimSegmentId)), zinfo->lineSize);
+            kept.push_back(victimSegmentId);
+            while (listHead != -1) {
+                int32_t next = tags->readNextLL(listHead);
+                if (listHead != tagId) {
+                    tags->postinsert(0, req, listHead, -1, -1, NONE, -1, false);
+                    evictions++;
+                }
+                listHead = next;
+            }
+            data->postinsert(-1, req, 0, dataId, victimSegmentId, NULL, false);
+        } while (freeSpace < lineSize);
+        tags->postinsert(lineAddr, req, tagId, dataId, kept[0], encoding, -1, true);
+        data->postinsert(tagId, req, 1, dataId, kept[0], line, true);
+    }
+};
+
+/* Address streams */
+
+enum Stream {UNIFORM, ZIPF, STRIDED, NUM_STREAMS};
+static const char* streamNames[] = {"uniform", "zipf", "strided"};
+
+// Fills addrs with line addresses over footprint lines (a power of 2), never 0 (tag arrays use 0 for invalid lines)
+static void genStream(Stream stream, Address* addrs, uint64_t n, uint64_t footprint, MTRand& rng) {
+    Address base = footprint;
+    switch (stream) {
+        case UNIFORM:
+            for (uint64_t i = 0; i < n; i++) addrs[i] = base + rng.randInt(footprint - 1);
+            break;
+        case ZIPF: {
+            std::vector<double> cdf(footprint);
+            double sum = 0.0;
+            for (uint64_t r = 0; r < footprint; r++) {
+                sum += 1.0/pow(r + 1, ZIPF_ALPHA);
+                cdf[r] = sum;
+            }
+            for (uint64_t i = 0; i < n; i++) {
+                uint64_t rank = std::lower_bound(cdf.begin(), cdf.end(), rng.randExc()*sum) - cdf.begin();
+                // Scatter ranks over the footprint (odd multiplier, so this is a permutation)
+                addrs[i] = base + ((MIN(rank, footprint - 1)*0x9E3779B97F4A7C15ull) & (footprint - 1));
+            }
+            break;
+        }
+        case STRIDED:
+            for (uint64_t i = 0; i < n; i++) addrs[i] = base + ((i*STRIDE_LINES) & (footprint - 1));
+            break;
+        default:
+            panic("Unknown stream %d", stream);
+    }
+}
+
+/* Data distributions */
+
+enum Distribution {ZEROS, NARROW_INTS, FLOATS, DUPLICATES, NUM_DISTRIBUTIONS};
+static const char* distributionNames[] = {"zeros", "narrow ints", "floats", "duplicates"};
+
+static void genPool(Distribution dist, uint8_t* pool, MTRand& rng) {
+    uint8_t sources[DUP_SOURCES][BDI_LINE_BYTES];
+    if (dist == DUPLICATES) {
+        for (uint32_t s = 0; s < DUP_SOURCES; s++) {
+            for (uint32_t b = 0; b < BDI_LINE_BYTES; b++) sources[s][b] = rng.randInt(255);
+        }
+    }
+
+    for (uint32_t l = 0; l < POOL_LINES; l++) {
+        uint8_t* line = &pool[l*BDI_LINE_BYTES];
+        switch (dist) {
+            case ZEROS:
+                memset(line, 0, BDI_LINE_BYTES);
+                break;
+            case NARROW_INTS: {  // 32-bit values near a per-line base (BDI base4-delta1)
+                int32_t* words = (int32_t*) line;
+                int32_t base = rng.randInt(1 << 20);
+                for (uint32_t w = 0; w < BDI_LINE_BYTES/4; w++) words[w] = base + (int32_t)rng.randInt(255) - 128;
+                break;
+            }
+            case FLOATS: {  // within 1% of a per-line value, as in smooth numeric data
+                float* words = (float*) line;
+                float base = 1000.0*rng.rand();
+                for (uint32_t w = 0; w < BDI_LINE_BYTES/4; w++) words[w] = base*(1.0 + 0.01*rng.rand());
+                break;
+            }
+            case DUPLICATES:
+                memcpy(line, sources[rng.randInt(DUP_SOURCES - 1)], BDI_LINE_BYTES);
+                break;
+            default:
+                panic("Unknown distribution %d", dist);
+        }
+    }
+}
+
+/* Benchmarks */
+
+// ns per line of each compression and hashing kernel, and the average BDI size
+static void benchKernels(uint64_t numOps, MTRand& rng) {
+    uint8_t* pool = gm_calloc<uint8_t>(POOL_LINES*BDI_LINE_BYTES);
+    ApproximateBDIDataArray bdiArray;
+    LineHasher* hashers[] = {new H3LineHasher(64, 0xCAC7EAFFA1), new CRC32CLineHasher(64, 0xCAC7EAFFA1), new XXLineHasher(64, 0xCAC7EAFFA1)};
+
+    info("Compression and hashing, ns/line");
+    info("%12s %10s %10s %10s %10s %10s %10s %10s", "Data", "BDI", "BDIScalar", "compress", "H3", "CRC32C", "XX", "Avg size");
+    for (uint32_t d = 0; d < NUM_DISTRIBUTIONS; d++) {
+        genPool((Distribution) d, pool, rng);
+        auto time = [&](std::function<uint64_t(const uint8_t*)> kernel) {
+            uint64_t acc = 0;
+            uint64_t start = getNs();
+            for (uint64_t i = 0; i < numOps; i++) acc += kernel(&pool[(i % POOL_LINES)*BDI_LINE_BYTES]);
+            uint64_t ns = getNs() - start;
+            sink += acc;
+            return ((double) ns)/numOps;
+        };
+
+        uint64_t totalSize = 0;
+        for (uint32_t l = 0; l < POOL_LINES; l++) totalSize += BDICompressLine(&pool[l*BDI_LINE_BYTES]);
+
+        double bdiNs = time([](const uint8_t* l) {return (uint64_t) BDICompressLine(l);});
+        double scalarNs = time([](const uint8_t* l) {return (uint64_t) BDICompressLineScalar(l);});
+        double compressNs = time([&](const uint8_t* l) {
+            uint16_t size;
+            return (uint64_t) bdiArray.compress((DataLine) l, &size) + size;
+        });
+        double hashNs[3];
+        for (uint32_t h = 0; h < 3; h++) {
+            LineHasher* hasher = hashers[h];
+            hashNs[h] = time([&](const uint8_t* l) {return hasher->hash((const uint64_t*) l, BDI_LINE_BYTES/8);});
+        }
+        info("%12s %10.2f %10.2f %10.2f %10.2f %10.2f %10.2f %10.2f", distributionNames[d], bdiNs, scalarNs, compressNs,
+                hashNs[0], hashNs[1], hashNs[2], ((double) totalSize)/POOL_LINES);
+    }
+
+    for (LineHasher* h : hashers) delete h;
+    gm_free(pool);
+}
+
+// Lookup, and on misses replace and insert, as caches do on each access. Returns the hit rate
+template <typename Array, typename Insert>
+static double runTagStream(Array* array, const Address* addrs, uint64_t numOps, Insert insert, double* nsPerAcc) {
+    MemReq req = {0, GETS, 0, nullptr, 0, nullptr, I, 0, 0, nullptr};
+    uint64_t hits = 0;
+    uint64_t start = getNs();
+    for (uint64_t i = 0; i < numOps; i++) {
+        req.lineAddr = addrs[i];
+        req.cycle = i;
+        if (array->lookup(addrs[i], &req, true) != -1) {
+            hits++;
+        } else {
+            Address wbLineAddr;
+            int32_t id = array->preinsert(addrs[i], &req, &wbLineAddr);
+            insert(addrs[i], &req, id);
+        }
+    }
+    *nsPerAcc = ((double) (getNs() - start))/numOps;
+    return ((double) hits)/numOps;
+}
+
+// Throughput of the set-associative and dedup tag arrays, with LRU replacement and H3 set hashing
+static void benchTagArrays(uint32_t numLines, uint32_t ways, uint64_t numOps, MTRand& rng) {
+    uint64_t footprint = 4ul*numLines;
+    Address* addrs = gm_calloc<Address>(numOps);
+
+    info("Tag arrays (%d lines, %d ways, footprint %ld lines): Macc/s, hit rate", numLines, ways, footprint);
+    info("%12s %10s %10s %10s %10s", "Stream", "SetAssoc", "hits", "DedupBDI", "hits");
+    size_t setAssocBytes = 0, dedupBytes = 0;
+    for (uint32_t s = 0; s < NUM_STREAMS; s++) {
+        genStream((Stream) s, addrs, numOps, footprint, rng);
+
+        size_t heapStart = gm_used_bytes();
+        BenchCC* cc = new BenchCC(numLines);
+        ReplPolicy* rp = new LRUReplPolicy<false>(numLines);
+        rp->setCC(cc);
+        HashFamily* hf = new H3HashFamily(1, ilog2(numLines/ways), 0xCAC7EAFFA1);
+        SetAssocArray* setAssoc;
+        {
+            QuietLog quiet;
+            setAssoc = new SetAssocArray(numLines, ways, rp, hf);
+        }
+        setAssocBytes = gm_used_bytes() - heapStart;
+        double setAssocNs;
+        double setAssocHits = runTagStream(setAssoc, addrs, numOps, [&](Address lineAddr, const MemReq* req, int32_t id) {
+            setAssoc->postinsert(lineAddr, req, id);
+            cc->insert(id);
+        }, &setAssocNs);
+        delete setAssoc;
+        delete hf;
+        delete rp;
+        delete cc;
+
+        heapStart = gm_used_bytes();
+        cc = new BenchCC(numLines);
+        rp = new LRUReplPolicy<true>(numLines);
+        rp->setCC(cc);
+        hf = new H3HashFamily(1, ilog2(numLines/ways), 0xCAC7EAFFA1);
+        ApproximateDedupBDITagArray* dedup;
+        {
+            QuietLog quiet;
+            dedup = new ApproximateDedupBDITagArray(numLines, ways, rp, hf);
+        }
+        dedupBytes = gm_used_bytes() - heapStart;
+        double dedupNs;
+        double dedupHits = runTagStream(dedup, addrs, numOps, [&](Address lineAddr, const MemReq* req, int32_t id) {
+            dedup->postinsert(lineAddr, req, id, -1, -1, NONE, -1, true);
+            cc->insert(id);
+        }, &dedupNs);
+        delete dedup;
+        delete hf;
+        delete rp;
+        delete cc;
+
+        info("%12s %10.2f %10.3f %10.2f %10.3f", streamNames[s], 1e3/setAssocNs, setAssocHits, 1e3/dedupNs, dedupHits);
+    }
+    info("Memory: SetAssoc %ld KB, DedupBDI %ld KB (with replacement policy and coherence stub)", setAssocBytes/1024, dedupBytes/1024);
+    gm_free(addrs);
+}
+
+// Dedup hash array: hash each line, look it up, and insert it on a miss, as dedup caches do on fills
+static void benchHashArray(uint32_t numLines, uint32_t ways, uint64_t numOps, MTRand& rng) {
+    uint8_t* pool = gm_calloc<uint8_t>(POOL_LINES*BDI_LINE_BYTES);
+    MemReq req = {0, GETS, 0, nullptr, 0, nullptr, I, 0, 0, nullptr};
+
+    // The data array only answers the hash array's replacement queries (all its lines are unreferenced)
+    HashFamily* hf = new H3HashFamily(1, ilog2(numLines/ways), 0xCAC7EAFFA1);
+    ApproximateDedupBDIDataArray* dataArray;
+    {
+        QuietLog quiet;
+        dataArray = new ApproximateDedupBDIDataArray(numLines, ways, hf);
+    }
+
+    info("Dedup hash array (%d lines, %d ways): ns/line, hit rate", numLines, ways);
+    info("%12s %10s %10s", "Data", "ns/line", "hits");
+    size_t hashArrayBytes = 0;
+    for (uint32_t d = 0; d < NUM_DISTRIBUTIONS; d++) {
+        genPool((Distribution) d, pool, rng);
+
+        size_t heapStart = gm_used_bytes();
+        ReplPolicy* rp = new DataLRUReplPolicy(numLines);
+        LineHasher* lineHasher = new XXLineHasher(64, 0xCAC7EAFFA1);
+        ApproximateDedupBDIHashArray* hashArray;
+        {
+            QuietLog quiet;
+            hashArray = new ApproximateDedupBDIHashArray(numLines, ways, rp, hf, lineHasher);
+        }
+        hashArray->registerDataArray(dataArray);
+        hashArrayBytes = gm_used_bytes() - heapStart;
+
+        uint64_t hits = 0;
+        uint64_t start = getNs();
+        for (uint64_t i = 0; i < numOps; i++) {
+            DataLine data = &pool[(i % POOL_LINES)*BDI_LINE_BYTES];
+            uint64_t hash = hashArray->hash(data);
+            if (hashArray->lookup(hash, &req, true) != -1) {
+                hits++;
+            } else {
+                int32_t hashId = hashArray->preinsert(hash, &req);
+                if (hashId != -1) hashArray->postinsert(hash, &req, 0, 0, hashId, true);
+            }
+        }
+        double ns = ((double) (getNs() - start))/numOps;
+        info("%12s %10.2f %10.3f", distributionNames[d], ns, ((double) hits)/numOps);
+
+        delete hashArray;
+        delete lineHasher;
+        delete rp;
+    }
+    info("Memory: hash array %ld KB (with replacement policy and hasher)", hashArrayBytes/1024);
+    gm_free(pool);
+}
+
+// Dedup BDI data array fills (preinsert by size, segment eviction, postinsert), with tags refilled round-robin from a pool
+static void benchDataArrays(uint32_t numLines, uint32_t ways, uint64_t numOps, MTRand& rng) {
+    uint32_t dataLines = numLines/DATA_RATIO;
+    uint8_t* pool = gm_calloc<uint8_t>(POOL_LINES*BDI_LINE_BYTES);
+    BDICompressionEncoding* encodings = gm_calloc<BDICompressionEncoding>(POOL_LINES);
+    uint16_t* sizes = gm_calloc<uint16_t>(POOL_LINES);
+    uint32_t* picks = gm_calloc<uint32_t>(numOps);
+    for (uint64_t i = 0; i < numOps; i++) picks[i] = rng.randInt(POOL_LINES - 1);
+    ApproximateBDIDataArray bdiArray;
+    MemReq req = {0, GETS, 0, nullptr, 0, nullptr, I, 0, 0, nullptr};
+
+    DedupBDIArrays* arrays[2];
+    size_t dataBytes[2];
+    info("Dedup BDI data array (%d lines, %d ways, %d tags, %ld fills): Kfills/s, dedup rate, evictions/fill", dataLines, ways, numLines, numOps);
+    info("%12s %10s %10s %10s %10s %10s %10s", "Data", "Sampled", "dedups", "evictions", "Exact", "dedups", "evictions");
+    for (uint32_t d = 0; d < NUM_DISTRIBUTIONS; d++) {
+        genPool((Distribution) d, pool, rng);
+        for (uint32_t l = 0; l < POOL_LINES; l++) encodings[l] = bdiArray.compress(&pool[l*BDI_LINE_BYTES], &sizes[l]);
+
+        double kfills[2];
+        for (uint32_t v = 0; v < 2; v++) {
+            DedupBDIArrays* a = new DedupBDIArrays(numLines, dataLines, ways, v == 1);
+            uint64_t start = getNs();
+            for (uint64_t i = 0; i < numOps; i++) {
+                int32_t tagId = i % numLines;
+                uint32_t p = picks[i];
+                req.lineAddr = i + 1;
+                req.cycle = i;
+                a->release(&req, tagId);
+                a->fill(&req, tagId, i + 1, &pool[p*BDI_LINE_BYTES], encodings[p], sizes[p]);
+            }
+            kfills[v] = 1e6*numOps/(getNs() - start);
+            dataBytes[v] = a->dataBytes;
+            arrays[v] = a;
+        }
+        info("%12s %10.1f %10.3f %10.3f %10.1f %10.3f %10.3f", distributionNames[d],
+                kfills[0], ((double) arrays[0]->dedups)/numOps, ((double) arrays[0]->evictions)/numOps,
+                kfills[1], ((double) arrays[1]->dedups)/numOps, ((double) arrays[1]->evictions)/numOps);
+        for (DedupBDIArrays* a : arrays) delete a;
+    }
+    info("Memory: data array %ld KB with sampled victims, %ld KB with exact victims (with content index)", dataBytes[0]/1024, dataBytes[1]/1024);
+    gm_free(picks);
+    gm_free(sizes);
+    gm_free(encodings);
+    gm_free(pool);
+}
+
+// The dedup BDI caches' access path: tag lookup, and on misses compress, replace the tag and fill the data array
+static void benchAccessPath(uint32_t numLines, uint32_t ways, uint64_t numOps, MTRand& rng) {
+    uint64_t footprint = 4ul*numLines;
+    uint32_t dataLines = numLines/DATA_RATIO;
+    Address* addrs = gm_calloc<Address>(numOps);
+    uint8_t* pools = gm_calloc<uint8_t>(NUM_DISTRIBUTIONS*POOL_LINES*BDI_LINE_BYTES);
+    for (uint32_t d = 0; d < NUM_DISTRIBUTIONS; d++) genPool((Distribution) d, &pools[d*POOL_LINES*BDI_LINE_BYTES], rng);
+    MemReq req = {0, GETS, 0, nullptr, 0, nullptr, I, 0, 0, nullptr};
+
+    info("Dedup BDI access path (%d tags, %d data lines, %d ways, footprint %ld lines, %ld accesses): Kacc/s, hit rate", numLines, dataLines, ways, footprint, numOps);
+    info("%12s %10s %10s %10s %10s %10s %10s %10s %10s", "Stream", distributionNames[0], "hits", distributionNames[1], "hits",
+            distributionNames[2], "hits", distributionNames[3], "hits");
+    for (uint32_t s = 0; s < NUM_STREAMS; s++) {
+        genStream((Stream) s, addrs, numOps, footprint, rng);
+        double kaccs[NUM_DISTRIBUTIONS], hitRates[NUM_DISTRIBUTIONS];
+        for (uint32_t d = 0; d < NUM_DISTRIBUTIONS; d++) {
+            const uint8_t* pool = &pools[d*POOL_LINES*BDI_LINE_BYTES];
+            DedupBDIArrays* a = new DedupBDIArrays(numLines, dataLines, ways, false);
+            uint64_t hits = 0;
+            uint64_t start = getNs();
+            for (uint64_t i = 0; i < numOps; i++) {
+                Address lineAddr = addrs[i];
+                req.lineAddr = lineAddr;
+                req.cycle = i;
+                int32_t tagId = a->tags->lookup(lineAddr, &req, true);
+                if (tagId != -1) {
+                    hits++;
+                    a->data->lookup(a->tags->readDataId(tagId), a->tags->readSegmentPointer(tagId), &req, true);
+                } else {
+                    DataLine line = (DataLine) &pool[((lineAddr*0x9E3779B97F4A7C15ull) & (POOL_LINES - 1))*BDI_LINE_BYTES];
+                    uint16_t lineSize;
+                    BDICompressionEncoding encoding = a->data->compress(line, &lineSize);
+                    Address wbLineAddr;
+                    tagId = a->tags->preinsert(lineAddr, &req, &wbLineAddr);
+                    a->release(&req, tagId);
+                    a->fill(&req, tagId, lineAddr, line, encoding, lineSize);
+                    a->cc->insert(tagId);
+                }
+            }
+            kaccs[d] = 1e6*numOps/(getNs() - start);
+            hitRates[d] = ((double) hits)/numOps;
+            delete a;
+        }
+        info("%12s %10.1f %10.3f %10.1f %10.3f %10.1f %10.3f %10.1f %10.3f", streamNames[s],
+                kaccs[0], hitRates[0], kaccs[1], hitRates[1], kaccs[2], hitRates[2], kaccs[3], hitRates[3]);
+    }
+    gm_free(pools);
+    gm_free(addrs);
+}
+
+int main(int argc, const char* argv[]) {
+    InitLog("");  // no log header
+    if (argc > 4) {
+        info("Microbenchmarks for the cache arrays and compression kernels");
+        info("Usage: %s [lines [ways [accesses]]]", argv[0]);
+        exit(1);
+    }
+    uint32_t numLines = (argc > 1)? strtoul(argv[1], nullptr, 0) : 65536;
+    uint32_t ways = (argc > 2)? strtoul(argv[2], nullptr, 0) : 16;
+    uint64_t numOps = (argc > 3)? strtoul(argv[3], nullptr, 0) : 4*1024*1024;
+    if (!ways || numLines % ways || !isPow2(numLines/ways)) panic("Need a power-of-2 number of sets (%d lines, %d ways)", numLines, ways);
+    if (numLines/ways < DATA_RATIO) panic("Need at least %d sets for the dedup BDI data array (%d lines, %d ways)", DATA_RATIO, numLines, ways);
+
+    gm_init(1ul << 30);
+    zinfo = gm_calloc<GlobSimInfo>();
+    zinfo->lineSize = BDI_LINE_BYTES;
+    lineBits = ilog2(zinfo->lineSize);
+    // Defaults from init.cpp
+    zinfo->mapSize = 14;
+    zinfo->floatCutSize = 16;
+    zinfo->doubleCutSize = 32;
+    zinfo->randomLoopTrial = 10;
+
+    MTRand rng(0x5AFEC0DE);
+    benchKernels(numOps, rng);
+    benchTagArrays(numLines, ways, numOps, rng);
+    benchHashArray(numLines, ways, numOps, rng);
+    benchDataArrays(numLines, ways, MAX(numOps/FILL_RATIO, 1ul), rng);
+    benchAccessPath(numLines, ways, MAX(numOps/FILL_RATIO, 1ul), rng);
+    return 0;
+}
@@ -0,0 +1,632 @@
+/** $lic$
+ * Copyright (C) 2012-2015 by Massachusetts Institute of Technology
+ * Copyright (C) 2010-2013 by The Board of Trustees of Stanford University
+ *
+ * This file is part of zsim.
+ *
+ * zsim is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, version 2.
+ *
+ * If you use this software in your research, we request that you reference
+ * the zsim paper ("ZSim: Fast and Accurate Microarchitectural Simulation of
+ * Thousand-Core Systems", Sanchez and Kozyrakis, ISCA-40, June 2013) as the
+ * source of the simulator in any publications that use this software, and that
+ * you send us a citation of your work.
+ *
+ * zsim is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef COMPRESSED_TIMING_CACHE_H_
+#define COMPRESSED_TIMING_CACHE_H_
+
+#include "access_scratch.h"
+#include "approx_regions.h"
+#include "compression_memo.h"
+#include "compressor_units.h"
+#include "event_queue.h"
+#include "event_recorder.h"
+#include "stats.h"
+#include "timing_cache.h"
+#include "timing_event.h"
+#include "zsim.h"
+
+/* Writeback of the lines evicted by a write hit that grew the line; holds an
+ * MSHR like a miss writeback would.
+ */
+template <typename CacheT>
+class CompressedHitWritebackEvent : public TimingEvent {
+    private:
+        CacheT* cache;
+
+    public:
+        CompressedHitWritebackEvent(CacheT* _cache, uint32_t postDelay, int32_t domain) : TimingEvent(0, postDelay, domain), cache(_cache) {}
+        void simulate(uint64_t startCycle) {cache->simulateHitWriteback(this, startCycle);}
+};
+
+/* Common base of the compressed timing caches (BDI, dedup, Doppelganger and
+ * their combinations), templated on the scheme itself (CRTP) and on its
+ * concrete tag and data arrays so that array and scheme calls are statically
+ * bound. It owns the state and stats every scheme shares, the access scratch,
+ * approximate-region classification, the event wiring helpers, and access():
+ * every scheme looks up the tag, evicts the tag victim, fetches the line, then
+ * compresses it and makes room for it in the data array, and only the last
+ * steps differ. The scheme supplies them as hooks:
+ *  - victimReadLat(a): cycles to read the tag victim's data before evicting it
+ *  - releaseTagVictim(a, tagId, evicted): drops the tag victim's data
+ *  - fill(a, tagId): compresses/indexes the missing line and evicts for it
+ *  - hit(a, tagId): serves a hit, recompressing and evicting on writes
+ *  - invalidateTag(a, tagId): clears a tag evicted along with its data
+ *  - checkArrays(): sanity checks after every access
+ * and the flags countsTagAccesses (keeps zinfo->tagAll and friends),
+ * tagWritebackAfterDataRead (the tag victim's writeback waits for a data
+ * array read) and fetchesExactLines (exact lines are fetched, not zeroed).
+ */
+template <typename SchemeT, typename TagArrayT, typename DataArrayT>
+class CompressedTimingCache : public TimingCache {
+    protected:
+        typedef CompressedHitWritebackEvent<CompressedTimingCache> HitWritebackEvent;
+
+        // Cache stuff
+        uint32_t numTagLines;
+        uint32_t numDataLines;
+
+        TagArrayT* tagArray;
+        DataArrayT* dataArray;
+
+        ReplPolicy* tagRP;
+        ReplPolicy* dataRP;
+
+        RunningStats* crStats;
+        RunningStats* tutStats;
+        RunningStats* dutStats;
+
+        AccessScratch scratch;
+        CompressionMemo memo;  // disabled unless sim.compressionMemoEntries is set
+        EventRecorder* untimedRecorder;  // only in trace-driven simulations, see eventRecorder()
+
+        // Compression hardware; latencies are 0 unless configured
+        const CompressionTiming* compTiming;
+        CompressorUnits compressors;
+        CompressorUnits decompressors;
+
+        // Occupancy distributions, in OCC_BUCKETS equal buckets over [0, 1]
+        static const uint32_t OCC_BUCKETS = 20;
+        VectorCounter crHist;
+        VectorCounter tutHist;
+        VectorCounter dutHist;
+
+        // Samples occupancy on every access, every sim.occupancySampleCycles
+        // cycles (see sampleAccessOccupancy), or every sim.occupancySamplePhases
+        // phases from the event queue (see sampledOccupancy)
+        class OccupancySampleEvent : public Event {
+            private:
+                CompressedTimingCache* cache;
+            public:
+                OccupancySampleEvent(CompressedTimingCache* _cache, uint64_t _period) : Event(_period), cache(_cache) {}
+                void callback() {cache->sampleOccupancy(period);}
+        };
+        const bool sampledOccupancy;
+        const uint64_t occupancySampleCycles;
+        uint64_t lastSampleCycle;
+
+        // Called on every access; weighs each sample by the cycles it covers
+        inline void sampleAccessOccupancy(uint64_t cycle) {
+            if (sampledOccupancy) return;
+            if (!occupancySampleCycles) {
+                sampleOccupancy(1);
+            } else if (cycle >= lastSampleCycle + occupancySampleCycles) {
+                sampleOccupancy(cycle - lastSampleCycle);
+                lastSampleCycle = cycle;
+            }
+        }
+
+        // State of the access in flight, shared by access() and the scheme's hooks
+        struct Access {
+            MemReq& req;
+            EventRecorder* evRec;
+            DataType type;
+            DataValue min, max;
+            bool approximate;
+            bool updateReplacement;
+            uint64_t respCycle;       // hooks add the data array latencies they model
+            uint64_t tagEvDoneCycle;  // when the tag victim's eviction ends, 0 if there is none
+            uint64_t evictions;       // writebacks caused, for evStats
+
+            Access(MemReq& _req, EventRecorder* _evRec) : req(_req), evRec(_evRec), type(ZSIM_FLOAT), approximate(false), updateReplacement(false),
+                respCycle(_req.cycle), tagEvDoneCycle(0), evictions(0) {}
+        };
+
+        // How a miss writes its line into the data array: the writeback takes wbLat cycles, starts no earlier than
+        // wbMinStart and fillLat cycles of compression after the response, and waits for the writebacks of the lines
+        // the fill evicted, which are timed from the response or, if evictFromStart, from the end of the tag access
+        struct FillPlan {
+            uint32_t fillLat;
+            uint32_t wbLat;
+            uint64_t wbMinStart;
+            bool evictFromStart;
+
+            FillPlan(uint32_t _fillLat, uint32_t _wbLat, uint64_t _wbMinStart, bool _evictFromStart = false)
+                : fillLat(_fillLat), wbLat(_wbLat), wbMinStart(_wbMinStart), evictFromStart(_evictFromStart) {}
+        };
+
+        // How a hit is timed: compLat and decompLat as in hitEvents(). Hits that rewrite the data array off the
+        // critical path add a writeback of wbLat cycles, starting no earlier than wbMinStart, that waits for the
+        // writebacks of the lines they evicted, timed from evictBase
+        struct HitPlan {
+            static const uint32_t UNTIL_RESPONSE = (uint32_t)-1;  // wbLat: as long as the hit
+            static const uint64_t AT_RESPONSE = (uint64_t)-1;     // wbMinStart: the response cycle
+
+            uint32_t compLat;
+            uint32_t decompLat;
+            bool writeback;
+            uint32_t wbLat;
+            uint64_t wbMinStart;
+            uint64_t evictBase;
+
+            HitPlan(uint32_t _compLat, uint32_t _decompLat)
+                : compLat(_compLat), decompLat(_decompLat), writeback(false), wbLat(0), wbMinStart(0), evictBase(0) {}
+
+            void writeBack(uint32_t _wbLat, uint64_t _wbMinStart, uint64_t _evictBase) {
+                writeback = true;
+                wbLat = _wbLat;
+                wbMinStart = _wbMinStart;
+                evictBase = _evictBase;
+            }
+        };
+
+    private:
+        const char* statsDesc;
+
+    public:
+        CompressedTimingCache(uint32_t _numTagLines, uint32_t _numDataLines, CC* _cc, TagArrayT* _tagArray, DataArrayT* _dataArray, ReplPolicy* _tagRP,
+                ReplPolicy* _dataRP, uint32_t _accLat, uint32_t _invLat, uint32_t mshrs, uint32_t ways, uint32_t cands, uint32_t _domain, const g_string& _name,
+                RunningStats* _crStats, RunningStats* _evStats, RunningStats* _tutStats, RunningStats* _dutStats, Counter* _tag_hits, Counter* _tag_misses,
+                Counter* _tag_all, const CompressionTiming* _compTiming, const char* _statsDesc)
+            : TimingCache(_numTagLines, _cc, NULL, _tagRP, _accLat, _invLat, mshrs, _accLat, ways, cands, _domain, _name, _evStats, _tag_hits, _tag_misses, _tag_all),
+              numTagLines(_numTagLines), numDataLines(_numDataLines), tagArray(_tagArray), dataArray(_dataArray), tagRP(_tagRP), dataRP(_dataRP),
+              crStats(_crStats), tutStats(_tutStats), dutStats(_dutStats), scratch(zinfo->lineSize, ways*zinfo->lineSize/8 + 1),
+              untimedRecorder(zinfo->traceDriven? new EventRecorder(true /*discarding*/) : nullptr), compTiming(_compTiming), sampledOccupancy(zinfo->occupancySamplePhases),
+              occupancySampleCycles(zinfo->occupancySampleCycles), lastSampleCycle(0), statsDesc(_statsDesc) {
+            // Phase- and cycle-sampled stats weigh each sample by the time it covers, so they average over time, not accesses
+            if (sampledOccupancy) zinfo->eventQueue->insert(new OccupancySampleEvent(this, zinfo->occupancySamplePhases));
+            zinfo->numRegionCaches++;  // see classify()
+            compressors.init(compTiming->compressors);
+            decompressors.init(compTiming->decompressors);
+            memo.init(zinfo->compressionMemoEntries, zinfo->storeTracker, lineBits);
+        }
+
+        void initStats(AggregateStat* parentStat) {
+            AggregateStat* cacheStat = new AggregateStat();
+            cacheStat->init(name.c_str(), statsDesc);
+            initCacheStats(cacheStat);
+
+            //Stats specific to timing cacheStat
+            profOccHist.init("occHist", "Occupancy MSHR cycle histogram", numMSHRs+1);
+            cacheStat->append(&profOccHist);
+
+            profHitLat.init("latHit", "Cumulative latency accesses that hit (demand and non-demand)");
+            profMissRespLat.init("latMissResp", "Cumulative latency for miss start to response");
+            profMissLat.init("latMiss", "Cumulative latency for miss start to finish (free MSHR)");
+
+            cacheStat->append(&profHitLat);
+            cacheStat->append(&profMissRespLat);
+            cacheStat->append(&profMissLat);
+            scratch.initStats(cacheStat);
+            memo.initStats(cacheStat);
+            compressors.initStats(cacheStat, "compOps", "Hash/compress operations on fills and writes", "compWait", "Cycles fills and writes waited for a compressor");
+            decompressors.initStats(cacheStat, "decompOps", "Decompress operations on read hits", "decompWait", "Cycles read hits waited for a decompressor");
+
+            // Tag counters and occupancy stats are created by init.cpp, outside the stats tree
+            if (tag_hits) appendCounter(cacheStat, tag_hits, "tagHits", "Tag array hits");
+            if (tag_misses) appendCounter(cacheStat, tag_misses, "tagMisses", "Tag array misses");
+            if (tag_all) appendCounter(cacheStat, tag_all, "tagAccesses", "Tag array accesses");
+            appendRunningStats(cacheStat, crStats, "compressionRatio", "Compression ratio");
+            appendRunningStats(cacheStat, evStats, "evictionsPerAccess", "Evictions per non-PUTS access");
+            appendRunningStats(cacheStat, tutStats, "tagUtil", "Tag array utilization");
+            appendRunningStats(cacheStat, dutStats, "dataUtil", "Data array utilization");
+            crHist.init("compressionRatioHist", "Compression ratio histogram", OCC_BUCKETS);
+            tutHist.init("tagUtilHist", "Tag array utilization histogram", OCC_BUCKETS);
+            dutHist.init("dataUtilHist", "Data array utilization histogram", OCC_BUCKETS);
+            cacheStat->append(&crHist);
+            cacheStat->append(&tutHist);
+            cacheStat->append(&dutHist);
+
+            parentStat->append(cacheStat);
+        }
+
+        void simulateHitWriteback(HitWritebackEvent* ev, uint64_t cycle) {
+            uint64_t lookupCycle = tryLowPrioAccess(cycle);
+            if (lookupCycle) { //success, release MSHR
+                if (!pendingQueue.empty()) {
+                    for (TimingEvent* qev : pendingQueue) {
+                        qev->requeue(cycle+1);
+                    }
+                    pendingQueue.clear();
+                }
+                ev->done(cycle);
+            } else {
+                ev->requeue(cycle+1);
+            }
+        }
+
+        uint64_t access(MemReq& req) {
+            Access a(req, eventRecorder(req));
+            if (tag_all) tag_all->inc();
+            a.approximate = classify(req.lineAddr, &a.type, &a.min, &a.max);
+            debug("%s: received %s %s req of data type %s on address %lu on cycle %lu", name.c_str(), (a.approximate? "approximate":""), AccessTypeName(req.type), DataTypeName(a.type), req.lineAddr, req.cycle);
+            timing("%s: received %s req on address %lu on cycle %lu", name.c_str(), AccessTypeName(req.type), req.lineAddr, req.cycle);
+
+            bool skipAccess = cc->startAccess(req); //may need to skip access due to races (NOTE: may change req.type!)
+            if (likely(!skipAccess)) {
+                scratch.begin(req.lineAddr << lineBits, req.data, SchemeT::fetchesExactLines || a.approximate);
+                a.updateReplacement = (req.type == GETS) || (req.type == GETX);
+                int32_t tagId = tagArray->lookup(req.lineAddr, &req, a.updateReplacement);
+                if (SchemeT::countsTagAccesses) zinfo->tagAll++;
+                // Timing: Tag array access latency.
+                a.respCycle += accLat;
+                timing("%s: tag accessed on cycle %lu", name.c_str(), a.respCycle);
+
+                TimingRecord tr = (tagId == -1)? missAccess(a) : hitAccess(a, tagId);
+                scratch.end();
+                recordAccess(a.evRec, tr);
+            }
+            cc->endAccess(req);
+
+            scheme()->checkArrays();
+            if (req.type != PUTS) evStats->add((double)a.evictions, 1);
+            sampleAccessOccupancy(req.cycle);
+
+            assert_msg(a.respCycle >= req.cycle, "[%s] resp < req? 0x%lx type %s childState %s, respCycle %ld reqCycle %ld",
+                    name.c_str(), req.lineAddr, AccessTypeName(req.type), MESIStateName(*req.state), a.respCycle, req.cycle);
+            return a.respCycle;
+        }
+
+    protected:
+        virtual void initCacheStats(AggregateStat* cacheStat) = 0;
+
+        // Adds the current occupancy to the occupancy stats, weighted by the accesses or phases it stands for
+        virtual void sampleOccupancy(uint64_t weight) = 0;
+
+        static void addSample(RunningStats* rs, VectorCounter* hist, double sample, uint64_t weight) {
+            rs->add(sample, weight);
+            if (sample != sample) return;  // NaN, e.g. an empty array
+            uint32_t bucket = (sample >= 1)? OCC_BUCKETS - 1 : (sample > 0)? (uint32_t)(sample*OCC_BUCKETS) : 0;
+            hist->inc(bucket, weight);
+        }
+
+        // Registers a plain uint64_t event counter in the stats tree
+        static void appendCounter(AggregateStat* parent, uint64_t* counter, const char* name, const char* desc) {
+            ProxyStat* s = new ProxyStat();
+            s->init(name, desc, counter);
+            parent->append(s);
+        }
+
+        static void appendCounter(AggregateStat* parent, const Counter* counter, const char* name, const char* desc) {
+            auto f = [counter]() { return counter->get(); };
+            LambdaStat<decltype(f)>* s = new LambdaStat<decltype(f)>(f);
+            s->init(name, desc);
+            parent->append(s);
+        }
+
+        static void appendRunningStats(AggregateStat* parent, const RunningStats* rs, const char* name, const char* desc) {
+            RunningStatsStat* s = new RunningStatsStat();
+            s->init(name, desc, rs);
+            parent->append(s);
+        }
+
+        // The requester's event recorder. Trace-driven simulations have no cores and no weave phase, so accesses
+        // record their events on a private recorder instead, and recordAccess() drops them
+        inline EventRecorder* eventRecorder(const MemReq& req) const {
+            if (untimedRecorder) return untimedRecorder;
+            EventRecorder* evRec = zinfo->eventRecorders[req.srcId];
+            assert_msg(evRec, "%s is not connected to TimingCore", name.c_str());
+            return evRec;
+        }
+
+        // Ends an access, handing its timing record to the requester
+        inline void recordAccess(EventRecorder* evRec, const TimingRecord& tr) {
+            if (evRec == untimedRecorder) {
+                evRec->discardEvents();
+            } else {
+                evRec->pushRecord(tr);
+            }
+        }
+
+        // Cycles a read hit spends decompressing a line stored with this encoding
+        inline uint32_t decompressLatency(BDICompressionEncoding encoding) const {
+            return compTiming->decompressLat[encoding];
+        }
+
+        // Builds the events of a hit that responds on tr.respCycle and fills in tr. The hit first waits compLat cycles
+        // on a compressor (written data) and is followed by decompLat cycles on a decompressor (read data)
+        HitEvent* hitEvents(EventRecorder* evRec, TimingRecord& tr, uint32_t compLat, uint32_t decompLat) {
+            HitEvent* ev = new (evRec) HitEvent(this, tr.respCycle - tr.reqCycle - compLat - decompLat, domain);
+            ev->setMinStartCycle(tr.reqCycle + compLat);
+            timing("%s: hitEvent Min Start: %lu, duration: %lu", name.c_str(), tr.reqCycle + compLat, tr.respCycle - tr.reqCycle - compLat - decompLat);
+            tr.startEvent = tr.endEvent = ev;
+            if (compLat) {
+                CompressorEvent* cev = new (evRec) CompressorEvent(&compressors, compLat, domain);
+                cev->setMinStartCycle(tr.reqCycle);
+                cev->addChild(ev, evRec);
+                tr.startEvent = cev;
+            }
+            if (decompLat) {
+                CompressorEvent* dev = new (evRec) CompressorEvent(&decompressors, decompLat, domain);
+                dev->setMinStartCycle(tr.respCycle - decompLat);
+                tr.endEvent = ev->addChild(dev, evRec);
+            }
+            return ev;
+        }
+
+        // Compression of a fill happens after the response is sent, so it only delays the writeback (and MSHR release).
+        // Returns the event the writeback must follow
+        TimingEvent* fillEvent(EventRecorder* evRec, MissResponseEvent* mre, uint32_t compLat) {
+            if (!compLat) return mre;
+            CompressorEvent* cev = new (evRec) CompressorEvent(&compressors, compLat, domain);
+            cev->setMinStartCycle(mre->getMinStartCycle());
+            return mre->addChild(cev, evRec);
+        }
+
+        // array->compress() of the accessed line's data (from scratch.fetchLine(), approximated if approximate), or its
+        // memoized result if the application has not written the line since it was last compressed
+        template <typename ArrayT>
+        inline BDICompressionEncoding compressLine(ArrayT* array, const DataLine data, bool approximate, DataType type, uint16_t* size) {
+            if (!memo.enabled()) return array->compress(data, size);
+            assert(data == scratch.fetchLine());
+            Address addr = scratch.lineAddress();
+            uint32_t gen = scratch.fetchGeneration();
+            BDICompressionEncoding encoding;
+            if (!memo.getEncoding(addr, gen, approximate, type, &encoding, size)) {
+                encoding = array->compress(data, size);
+                memo.putEncoding(addr, gen, approximate, type, encoding, *size);
+            }
+            return encoding;
+        }
+
+        // Ditto for array->hash()
+        template <typename ArrayT>
+        inline uint64_t hashLine(ArrayT* array, const DataLine data, bool approximate, DataType type) {
+            if (!memo.enabled()) return array->hash(data);
+            assert(data == scratch.fetchLine());
+            Address addr = scratch.lineAddress();
+            uint32_t gen = scratch.fetchGeneration();
+            uint64_t hash;
+            if (!memo.getHash(addr, gen, approximate, type, &hash)) {
+                hash = array->hash(data);
+                memo.putHash(addr, gen, approximate, type, hash);
+            }
+            return hash;
+        }
+
+        // If the line is in an approximate region, returns true and its data type and value range (min/max may be NULL)
+        inline bool classify(Address lineAddr, DataType* type, DataValue* min, DataValue* max) const {
+            Address start = lineAddr << lineBits;
+            return zinfo->approximateRegions->lookup(start, start + zinfo->lineSize - 1, type, min, max);
+        }
+
+        // Tie two events to an optional timing record
+        // TODO: Promote to evRec if this is more generally useful
+        void connect(EventRecorder* evRec, const TimingRecord* r, TimingEvent* startEv, TimingEvent* endEv, uint64_t startCycle, uint64_t endCycle) {
+            assert_msg(startCycle <= endCycle, "start > end? %ld %ld", startCycle, endCycle);
+            if (r) {
+                assert_msg(startCycle <= r->reqCycle, "%ld / %ld", startCycle, r->reqCycle);
+                assert_msg(r->respCycle <= endCycle, "%ld %ld %ld %ld", startCycle, r->reqCycle, r->respCycle, endCycle);
+                uint64_t upLat = r->reqCycle - startCycle;
+                uint64_t downLat = endCycle - r->respCycle;
+
+                if (upLat) {
+                    DelayEvent* dUp = new (evRec) DelayEvent(upLat);
+                    dUp->setMinStartCycle(startCycle);
+                    startEv->addChild(dUp, evRec)->addChild(r->startEvent, evRec);
+                } else {
+                    startEv->addChild(r->startEvent, evRec);
+                }
+
+                if (downLat) {
+                    DelayEvent* dDown = new (evRec) DelayEvent(downLat);
+                    dDown->setMinStartCycle(r->respCycle);
+                    r->endEvent->addChild(dDown, evRec)->addChild(endEv, evRec);
+                } else {
+                    r->endEvent->addChild(endEv, evRec);
+                }
+            } else {
+                if (startCycle == endCycle) {
+                    startEv->addChild(endEv, evRec);
+                } else {
+                    DelayEvent* dEv = new (evRec) DelayEvent(endCycle - startCycle);
+                    dEv->setMinStartCycle(startCycle);
+                    startEv->addChild(dEv, evRec)->addChild(endEv, evRec);
+                }
+            }
+        }
+
+        // Takes the writeback record of the eviction just processed, if any, to connect it to the access' writeback
+        bool recordEviction(Access& a, uint64_t startCycle, uint64_t endCycle) {
+            if (!a.evRec->hasRecord()) return false;
+            a.evictions++;
+            scratch.writebackRecords.push_back(a.evRec->popRecord());
+            scratch.wbStartCycles.push_back(startCycle);
+            scratch.wbEndCycles.push_back(endCycle);
+            return true;
+        }
+
+        // Makes wbEv wait for the recorded writebacks, delayed from ev, which starts on startCycle
+        void connectWritebacks(EventRecorder* evRec, TimingEvent* ev, uint64_t startCycle, TimingEvent* wbEv) {
+            g_vector<TimingRecord>& writebackRecords = scratch.writebackRecords;
+            g_vector<uint64_t>& wbStartCycles = scratch.wbStartCycles;
+            g_vector<uint64_t>& wbEndCycles = scratch.wbEndCycles;
+            for (uint32_t i = 0; i < wbStartCycles.size(); i++) {
+                DelayEvent* del = new (evRec) DelayEvent(wbStartCycles[i] - startCycle);
+                del->setMinStartCycle(startCycle);
+                ev->addChild(del, evRec);
+                connect(evRec, writebackRecords[i].isValid()? &writebackRecords[i] : nullptr, del, wbEv, wbStartCycles[i], wbEndCycles[i]);
+            }
+        }
+
+        // Evicts the tags in the list starting at listHead, but keepTagId, when their data line is replaced. Evictions
+        // that write back start accLat apart from *evBeginCycle, and *lastEvDoneCycle is when the last one ends
+        void evictList(Access& a, int32_t listHead, int32_t keepTagId, uint64_t* evBeginCycle, uint64_t* lastEvDoneCycle, uint64_t* caused) {
+            uint64_t evDoneCycle = *evBeginCycle;
+            while (listHead != -1) {
+                int32_t next;
+                Address wbLineAddr = 0;
+                if (listHead != keepTagId) {
+                    wbLineAddr = tagArray->readAddress(listHead);
+                    timing("%s: dedup caused eviction, evicting address %lu on cycle %lu", name.c_str(), wbLineAddr, *evBeginCycle);
+                    evDoneCycle = cc->processEviction(a.req, wbLineAddr, listHead, *evBeginCycle);
+                    timing("%s: finished eviction on cycle %lu", name.c_str(), evDoneCycle);
+                    next = tagArray->readNextLL(listHead);
+                    scheme()->invalidateTag(a, listHead);
+                } else {
+                    next = tagArray->readNextLL(listHead);
+                }
+                if (recordEviction(a, *evBeginCycle, evDoneCycle)) {
+                    debug("%s: dedup caused eviction from tagId %i for address %lu", name.c_str(), listHead, wbLineAddr);
+                    if (caused) (*caused)++;
+                    *lastEvDoneCycle = evDoneCycle;
+                    *evBeginCycle += accLat;
+                }
+                listHead = next;
+            }
+        }
+
+        // Frees room for a lineSize line in segmented data line dataId, one segment (and the tags pointing to it, but
+        // keepTagId) at a time; credit is the room the line already holds there. The segments freed are left in
+        // scratch.keptFromEvictions. *lastEvDoneCycle only covers the last segment's evictions if lastSegmentOnly,
+        // and bdiCaused counts the segments whose eviction wrote back
+        void evictSegments(Access& a, int32_t dataId, uint16_t lineSize, uint16_t credit, int32_t keepTagId, uint64_t evBeginCycle,
+                bool lastSegmentOnly, uint64_t* lastEvDoneCycle, uint64_t* bdiCaused, uint64_t* dedupCaused) {
+            g_vector<uint32_t>& keptFromEvictions = scratch.keptFromEvictions;
+            keptFromEvictions.clear();
+            uint16_t freeSpace = 0;
+            do {
+                uint16_t occupiedSpace = 0;
+                for (uint32_t i = 0; i < dataArray->getAssoc()*zinfo->lineSize/8; i++)
+                    if (dataArray->readListHead(dataId, i) != -1)
+                        occupiedSpace += BDICompressionToSize(tagArray->readCompressionEncoding(dataArray->readListHead(dataId, i)), zinfo->lineSize);
+                freeSpace = dataArray->getAssoc()*zinfo->lineSize - occupiedSpace;
+                debug("%s: line now has %i segments free.", name.c_str(), freeSpace/8);
+                int32_t victimListHeadId;
+                int32_t victimSegmentId = dataArray->preinsert(dataId, &victimListHeadId, keptFromEvictions);
+                if (dataArray->readListHead(dataId, victimSegmentId) != -1) {
+                    freeSpace += BDICompressionToSize(tagArray->readCompressionEncoding(dataArray->readListHead(dataId, victimSegmentId)), zinfo->lineSize);
+                }
+                debug("%s: Picked victim segment %i", name.c_str(), victimSegmentId);
+                keptFromEvictions.push_back(victimSegmentId);
+                if (lastSegmentOnly) *lastEvDoneCycle = a.tagEvDoneCycle;
+                uint64_t evicted = 0;
+                evictList(a, victimListHeadId, keepTagId, &evBeginCycle, lastEvDoneCycle, &evicted);
+                if (evicted && bdiCaused) (*bdiCaused)++;
+                if (dedupCaused) *dedupCaused += evicted;
+                dataArray->postinsert(-1, &a.req, 0, dataId, victimSegmentId, NULL, false);
+            } while (freeSpace + credit < lineSize);
+        }
+
+    private:
+        inline SchemeT* scheme() {return static_cast<SchemeT*>(this);}
+
+        TimingRecord missAccess(Access& a) {
+            MemReq& req = a.req;
+            EventRecorder* evRec = a.evRec;
+            if (tag_misses) tag_misses->inc();
+            if (SchemeT::countsTagAccesses) zinfo->tagMisses++;
+            assert(cc->shouldAllocate(req));
+            // Get the eviction candidate
+            Address wbLineAddr;
+            int32_t victimTagId = tagArray->preinsert(req.lineAddr, &req, &wbLineAddr); //find the lineId to replace
+            debug("%s: tag miss, inserting into line %i", name.c_str(), victimTagId);
+            // Need to evict the tag.
+            uint64_t evictCycle = req.cycle + accLat + scheme()->victimReadLat(a);
+            timing("%s: tag access missed, evicting address %lu on cycle %lu", name.c_str(), wbLineAddr, evictCycle);
+            a.tagEvDoneCycle = cc->processEviction(req, wbLineAddr, victimTagId, evictCycle);
+            timing("%s: finished eviction on cycle %lu", name.c_str(), a.tagEvDoneCycle);
+            TimingRecord tagWritebackRecord, accessRecord;
+            tagWritebackRecord.clear();
+            accessRecord.clear();
+            bool evicted = evRec->hasRecord();
+            if (evicted) {
+                debug("%s: tag miss caused eviction of address %lu", name.c_str(), wbLineAddr);
+                a.evictions++;
+                tagWritebackRecord = evRec->popRecord();
+            }
+            scheme()->releaseTagVictim(a, victimTagId, evicted);
+
+            // Need to get the line we want
+            uint64_t getDoneCycle = a.respCycle;
+            timing("%s: doing processAccess on cycle %lu", name.c_str(), a.respCycle);
+            a.respCycle = cc->processAccess(req, victimTagId, a.respCycle, &getDoneCycle);
+            timing("%s: finished processAccess on cycle %lu", name.c_str(), a.respCycle);
+            if (evRec->hasRecord()) accessRecord = evRec->popRecord();
+
+            FillPlan plan = scheme()->fill(a, victimTagId);
+            assert_msg(getDoneCycle == a.respCycle, "gdc %ld rc %ld", getDoneCycle, a.respCycle);
+
+            MissStartEvent* mse = new (evRec) MissStartEvent(this, accLat, domain);
+            MissResponseEvent* mre = new (evRec) MissResponseEvent(this, mse, domain);
+            MissWritebackEvent* mwe = new (evRec) MissWritebackEvent(this, mse, plan.wbLat, domain);
+            mse->setMinStartCycle(req.cycle);
+            mre->setMinStartCycle(a.respCycle);
+            mwe->setMinStartCycle(plan.wbMinStart);
+            timing("%s: missStartEvent Min Start: %lu, duration: %u", name.c_str(), req.cycle, accLat);
+            timing("%s: missResponseEvent Min Start: %lu", name.c_str(), a.respCycle);
+            timing("%s: missWritebackEvent Min Start: %lu, duration: %u", name.c_str(), plan.wbMinStart, plan.wbLat);
+
+            connect(evRec, accessRecord.isValid()? &accessRecord : nullptr, mse, mre, req.cycle + accLat, a.respCycle);
+            if (plan.evictFromStart) {
+                connectWritebacks(evRec, mse, req.cycle + accLat, mwe);
+            } else {
+                connectWritebacks(evRec, mre, a.respCycle, mwe);
+            }
+            fillEvent(evRec, mre, plan.fillLat)->addChild(mwe, evRec);
+            if (a.tagEvDoneCycle) {
+                const TimingRecord* r = tagWritebackRecord.isValid()? &tagWritebackRecord : nullptr;
+                if (SchemeT::tagWritebackAfterDataRead) {
+                    DelayEvent* del = new (evRec) DelayEvent(accLat);
+                    del->setMinStartCycle(req.cycle + accLat);
+                    mse->addChild(del, evRec);
+                    connect(evRec, r, del, mwe, req.cycle + 2*accLat, a.tagEvDoneCycle);
+                } else {
+                    connect(evRec, r, mse, mwe, req.cycle + accLat, a.tagEvDoneCycle);
+                }
+            }
+            TimingRecord tr = {req.lineAddr << lineBits, req.cycle, a.respCycle, req.type, mse, mre};
+            return tr;
+        }
+
+        TimingRecord hitAccess(Access& a, int32_t tagId) {
+            MemReq& req = a.req;
+            EventRecorder* evRec = a.evRec;
+            if (tag_hits) tag_hits->inc();
+            if (SchemeT::countsTagAccesses) zinfo->tagHits++;
+            debug("%s: tag hit on line %i", name.c_str(), tagId);
+            HitPlan plan = scheme()->hit(a, tagId);
+
+            uint64_t getDoneCycle = a.respCycle;
+            timing("%s: doing processAccess on cycle %lu", name.c_str(), a.respCycle);
+            a.respCycle = cc->processAccess(req, tagId, a.respCycle, &getDoneCycle);
+            timing("%s: finished processAccess on cycle %lu", name.c_str(), a.respCycle);
+            if (evRec->hasRecord()) evRec->popRecord();
+            TimingRecord tr = {req.lineAddr << lineBits, req.cycle, a.respCycle, req.type, nullptr, nullptr};
+
+            HitEvent* he = hitEvents(evRec, tr, plan.compLat, plan.decompLat);
+            if (plan.writeback) {
+                uint32_t wbLat = (plan.wbLat == HitPlan::UNTIL_RESPONSE)? a.respCycle - req.cycle : plan.wbLat;
+                uint64_t wbMinStart = (plan.wbMinStart == HitPlan::AT_RESPONSE)? a.respCycle : plan.wbMinStart;
+                HitWritebackEvent* hwe = new (evRec) HitWritebackEvent(this, wbLat, domain);
+                hwe->setMinStartCycle(wbMinStart);
+                timing("%s: hitWritebackEvent Min Start: %lu, duration: %u", name.c_str(), wbMinStart, wbLat);
+                connectWritebacks(evRec, he, plan.evictBase, hwe);
+                he->addChild(hwe, evRec);
+            }
+            return tr;
+        }
+};
+
+#endif  // COMPRESSED_TIMING_CACHE_H_
@@ -0,0 +1,202 @@
+/** $lic$
+ * Copyright (C) 2012-2015 by Massachusetts Institute of Technology
+ * Copyright (C) 2010-2013 by The Board of Trustees of Stanford University
+ *
+ * This file is part of zsim.
+ *
+ * zsim is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, version 2.
+ *
+ * If you use this software in your research, we request that you reference
+ * the zsim paper ("ZSim: Fast and Accurate Microarchitectural Simulation of
+ * Thousand-Core Systems", Sanchez and Kozyrakis, ISCA-40, June 2013) as the
+ * source of the simulator in any publications that use this software, and that
+ * you send us a citation of your work.
+ *
+ * zsim is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef COMPRESSION_MEMO_H_
+#define COMPRESSION_MEMO_H_
+
+#include <stdint.h>
+#include "galloc.h"
+#include "log.h"
+#include "memory_hierarchy.h"
+#include "stats.h"
+
+/* Tracks which lines the application may have written, so the compressed
+ * caches can reuse a line's compression and hash results (see
+ * CompressionMemo) instead of recomputing them on every fill and writeback.
+ *
+ * Every line address maps to a 4-byte generation counter (lines alias modulo
+ * the table size; a cache line of counters covers 16 consecutive lines, so a
+ * 4KB page's counters span 4 cache lines). The store instrumentation bumps
+ * the counter of every line a store writes, after the store is performed
+ * (stores without a fall-through are bumped both before and at their branch
+ * target); anything that may write memory behind the
+ * instrumentation's back (syscalls, uninstrumented fast-forwarding) bumps the
+ * global epoch instead, dirtying every line at once. A line's generation is
+ * its counter plus the epoch, so it changes whenever the line may have.
+ *
+ * Counters are bumped without atomics: two racing bumps may lose one, but the
+ * counter still changes, which is all readers check. Aliasing and the
+ * epoch only ever cause spurious recomputations.
+ */
+class StoreTracker : public GlobAlloc {
+    private:
+        volatile uint32_t* gens;
+        uint64_t mask;
+        volatile uint32_t epoch;
+
+    public:
+        explicit StoreTracker(uint32_t numLines) : mask(numLines - 1), epoch(0) {
+            if (numLines == 0 || (numLines & (numLines - 1))) panic("StoreTracker: number of lines (%d) must be a power of two", numLines);
+            gens = gm_calloc<uint32_t>(numLines);
+        }
+
+        // Marks the lines written by a size-byte store to addr (lineBits: log2 of the line size)
+        inline void markStore(Address addr, uint32_t size, uint32_t lineBits) {
+            Address first = addr >> lineBits;
+            Address last = (addr + size - 1) >> lineBits;
+            for (Address l = first; l <= last; l++) gens[l & mask]++;
+        }
+
+        inline void markAll() {
+            epoch++;
+        }
+
+        inline uint32_t generation(Address lineAddr) const {
+            return gens[lineAddr & mask] + epoch;
+        }
+};
+
+/* Per-cache memo of the compression encoding, compressed size and hash of
+ * recently compressed lines, tagged with the line's generation when its data
+ * was fetched (see StoreTracker) and with the approximation applied to it.
+ * Direct-mapped; an entry is only reused while the line's generation is
+ * unchanged, i.e., the application has not written the line since.
+ *
+ * Like AccessScratch, only use it between cc->startAccess() and
+ * cc->endAccess().
+ */
+class CompressionMemo {
+    private:
+        struct Entry {
+            Address lineAddr;  // byte address
+            uint32_t gen;
+            DataType type;
+            uint64_t hash;
+            uint16_t size;
+            BDICompressionEncoding encoding;
+            bool approximate;
+            bool valid;
+            bool hasEncoding;
+            bool hasHash;
+        };
+
+        Entry* entries;
+        uint32_t mask;
+        const StoreTracker* tracker;
+        uint32_t lineBits;
+
+        Counter profHits, profMisses;
+
+    public:
+        CompressionMemo() : entries(nullptr), mask(0), tracker(nullptr), lineBits(0) {}
+
+        // numEntries == 0 disables the memo
+        void init(uint32_t numEntries, const StoreTracker* _tracker, uint32_t _lineBits) {
+            if (!numEntries) return;
+            if (numEntries & (numEntries - 1)) panic("CompressionMemo: number of entries (%d) must be a power of two", numEntries);
+            assert(_tracker);
+            entries = gm_calloc<Entry>(numEntries);
+            mask = numEntries - 1;
+            tracker = _tracker;
+            lineBits = _lineBits;
+        }
+
+        void initStats(AggregateStat* parentStat) {
+            if (!entries) return;
+            profHits.init("memoHits", "Compressions and hashes reused from the memo");
+            profMisses.init("memoMisses", "Compressions and hashes not found in the memo");
+            parentStat->append(&profHits);
+            parentStat->append(&profMisses);
+        }
+
+        inline bool enabled() const {return entries;}
+
+        // Generation of the line's data if read now; sample it *before* reading the data
+        inline uint32_t generation(Address lineAddr) const {
+            return tracker->generation(lineAddr >> lineBits);
+        }
+
+        // gen: generation of the data the caller holds. Return false on a miss
+        inline bool getEncoding(Address lineAddr, uint32_t gen, bool approximate, DataType type, BDICompressionEncoding* encoding, uint16_t* size) {
+            Entry* e = find(lineAddr, gen, approximate, type);
+            if (!e || !e->hasEncoding) {
+                profMisses.inc();
+                return false;
+            }
+            profHits.inc();
+            *encoding = e->encoding;
+            *size = e->size;
+            return true;
+        }
+
+        inline bool getHash(Address lineAddr, uint32_t gen, bool approximate, DataType type, uint64_t* hash) {
+            Entry* e = find(lineAddr, gen, approximate, type);
+            if (!e || !e->hasHash) {
+                profMisses.inc();
+                return false;
+            }
+            profHits.inc();
+            *hash = e->hash;
+            return true;
+        }
+
+        inline void putEncoding(Address lineAddr, uint32_t gen, bool approximate, DataType type, BDICompressionEncoding encoding, uint16_t size) {
+            Entry* e = claim(lineAddr, gen, approximate, type);
+            e->encoding = encoding;
+            e->size = size;
+            e->hasEncoding = true;
+        }
+
+        inline void putHash(Address lineAddr, uint32_t gen, bool approximate, DataType type, uint64_t hash) {
+            Entry* e = claim(lineAddr, gen, approximate, type);
+            e->hash = hash;
+            e->hasHash = true;
+        }
+
+    private:
+        inline Entry* find(Address lineAddr, uint32_t gen, bool approximate, DataType type) {
+            Entry* e = &entries[(lineAddr >> lineBits) & mask];
+            bool match = e->valid && e->lineAddr == lineAddr && e->gen == gen && e->approximate == approximate && (!approximate || e->type == type);
+            return match? e : nullptr;
+        }
+
+        // Returns the line's entry, replacing whatever the slot held if it does not match
+        inline Entry* claim(Address lineAddr, uint32_t gen, bool approximate, DataType type) {
+            Entry* e = find(lineAddr, gen, approximate, type);
+            if (!e) {
+                e = &entries[(lineAddr >> lineBits) & mask];
+                e->lineAddr = lineAddr;
+                e->gen = gen;
+                e->approximate = approximate;
+                e->type = type;
+                e->valid = true;
+                e->hasEncoding = false;
+                e->hasHash = false;
+            }
+            return e;
+        }
+};
+
+#endif  // COMPRESSION_MEMO_H_
@@ -0,0 +1,113 @@
+/** $lic$
+ * Copyright (C) 2012-2015 by Massachusetts Institute of Technology
+ * Copyright (C) 2010-2013 by The Board of Trustees of Stanford University
+ *
+ * This file is part of zsim.
+ *
+ * zsim is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, version 2.
+ *
+ * If you use this software in your research, we request that you reference
+ * the zsim paper ("ZSim: Fast and Accurate Microarchitectural Simulation of
+ * Thousand-Core Systems", Sanchez and Kozyrakis, ISCA-40, June 2013) as the
+ * source of the simulator in any publications that use this software, and that
+ * you send us a citation of your work.
+ *
+ * zsim is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef COMPRESSOR_UNITS_H_
+#define COMPRESSOR_UNITS_H_
+
+#include "galloc.h"
+#include "memory_hierarchy.h"
+#include "stats.h"
+#include "timing_event.h"
+
+/* Latencies and unit counts of a compressed cache bank's compression
+ * hardware. Fills and writes hash (for deduplication) and/or compress the
+ * line on a compressor unit; read hits of a BDI-encoded line decompress it on
+ * a decompressor unit, with a latency that depends on the encoding. All
+ * latencies default to 0, which leaves the corresponding operation untimed.
+ */
+struct CompressionTiming : public GlobAlloc {
+    uint32_t compressLat;
+    uint32_t hashLat;
+    uint32_t decompressLat[NONE+1];  // by encoding; NONE (stored uncompressed) is always 0
+    uint32_t compressors;
+    uint32_t decompressors;
+};
+
+/* A bank's pool of identical, unpipelined (de)compressor units. Like the
+ * MSHRs, it is only used from the bank's weave-phase events, which run in
+ * cycle order, so each unit just tracks the cycle it frees up on.
+ */
+class CompressorUnits {
+    private:
+        uint32_t numUnits;
+        uint64_t* freeCycles;
+
+        Counter profOps, profWaitCycles;
+
+    public:
+        CompressorUnits() : numUnits(0), freeCycles(nullptr) {}
+
+        void init(uint32_t _numUnits) {
+            assert(_numUnits > 0);
+            numUnits = _numUnits;
+            freeCycles = gm_calloc<uint64_t>(numUnits);
+        }
+
+        void initStats(AggregateStat* parentStat, const char* opsName, const char* opsDesc, const char* waitName, const char* waitDesc) {
+            profOps.init(opsName, opsDesc);
+            profWaitCycles.init(waitName, waitDesc);
+            parentStat->append(&profOps);
+            parentStat->append(&profWaitCycles);
+        }
+
+        // Grants an op ready on cycle the unit that frees up first, for lat cycles. Returns cycle if granted, or when to retry
+        uint64_t acquire(uint64_t cycle, uint32_t lat) {
+            uint32_t unit = 0;
+            for (uint32_t u = 1; u < numUnits; u++) {
+                if (freeCycles[u] < freeCycles[unit]) unit = u;
+            }
+            if (freeCycles[unit] > cycle) return freeCycles[unit];
+            freeCycles[unit] = cycle + lat;
+            return cycle;
+        }
+
+        void profile(uint64_t waitCycles) {
+            profOps.inc();
+            profWaitCycles.inc(waitCycles);
+        }
+};
+
+// An op that holds one of units for its latency, which it adds as postDelay
+class CompressorEvent : public TimingEvent {
+    private:
+        CompressorUnits* units;
+        uint64_t readyCycle;
+
+    public:
+        CompressorEvent(CompressorUnits* _units, uint32_t lat, int32_t domain) : TimingEvent(0, lat, domain), units(_units), readyCycle(-1L) {}
+
+        void simulate(uint64_t startCycle) {
+            if (readyCycle == (uint64_t)-1L) readyCycle = startCycle;
+            uint64_t grantCycle = units->acquire(startCycle, getPostDelay());
+            if (grantCycle == startCycle) {
+                units->profile(startCycle - readyCycle);
+                done(startCycle);
+            } else {
+                requeue(grantCycle);
+            }
+        }
+};
+
+#endif  // COMPRESSOR_UNITS_H_
@@ -25,7 +25,6 @@
 
 #include "contention_sim.h"
 #include <algorithm>
-#include <queue>
 #include <sstream>
 #include <string>
 #include <typeinfo>
@@ -41,16 +40,22 @@
 #define POST_MORTEM 0
 //#define POST_MORTEM 1
 
+/* With fewer threads than domains, threads claim domains dynamically: each
+ * runs batches of up to DOMAIN_BATCH_EVENTS events on the most lagging free
+ * domain, and switches domains when its own stalls on a crossing or gets
+ * DOMAIN_STEAL_LAG cycles ahead of another free domain. While the crossing's
+ * source domain is running on another thread, a stalled domain is kept for up
+ * to DOMAIN_STALL_RETRIES retries, as the source will likely catch up soon
+ * and switching costs a claimDomain() scan.
+ */
+#define DOMAIN_BATCH_EVENTS 64
+#define DOMAIN_STEAL_LAG 64
+#define DOMAIN_STALL_RETRIES 8
+
 bool ContentionSim::CompareEvents::operator()(TimingEvent* lhs, TimingEvent* rhs) const {
     return lhs->cycle > rhs->cycle;
 }
 
-bool ContentionSim::CompareDomains::operator()(DomainData* d1, DomainData* d2) const {
-    uint64_t v1 = d1->queuePrio;
-    uint64_t v2 = d2->queuePrio;
-    return (v1 > v2);
-}
-
 
 void ContentionSim::SimThreadTrampoline(void* arg) {
     ContentionSim* csim = static_cast<ContentionSim*>(arg);
@@ -65,6 +70,8 @@ ContentionSim::ContentionSim(uint32_t _numDomains, uint32_t _numSimThreads) {
     limit = 0;
     lastLimit = 0;
     inCSim = false;
+    phase = 0;
+    domainsDone = 0;
 
     domains = gm_calloc<DomainData>(numDomains);
     simThreads = gm_calloc<SimThreadData>(numSimThreads);
@@ -73,15 +80,15 @@ ContentionSim::ContentionSim(uint32_t _numDomains, uint32_t _numSimThreads) {
         new (&domains[i].pq) PrioQueue<TimingEvent, PQ_BLOCKS>();
         domains[i].curCycle = 0;
         futex_init(&domains[i].pqLock);
+        spin_init(&domains[i].runLock);
+        domains[i].donePhase = 0;
     }
 
-    if ((numDomains % numSimThreads) != 0) panic("numDomains(%d) must be a multiple of numSimThreads(%d) for now", numDomains, numSimThreads);
+    if (numSimThreads > numDomains) panic("numSimThreads(%d) must not exceed numDomains(%d)", numSimThreads, numDomains);
 
     for (uint32_t i = 0; i < numSimThreads; i++) {
         futex_init(&simThreads[i].wakeLock);
         futex_lock(&simThreads[i].wakeLock); //starts locked, so first actual call to lock blocks
-        simThreads[i].firstDomain = i*numDomains/numSimThreads;
-        simThreads[i].supDomain = (i+1)*numDomains/numSimThreads;
     }
 
     futex_init(&waitLock);
@@ -157,6 +164,15 @@ void ContentionSim::simulatePhase(uint64_t limit) {
         if (ocore) ocore->cSimStart();
     }
 
+    //Dynamic scheduling starts each phase with the domains that took longest in the last one
+    phase++;
+    domainsDone = 0;
+    for (uint32_t i = 0; i < numDomains; i++) {
+        uint64_t ns = domains[i].profTime.get();
+        domains[i].lastPhaseNs = ns - domains[i].lastProfNs;
+        domains[i].lastProfNs = ns;
+    }
+
     inCSim = true;
     __sync_synchronize();
 
@@ -289,11 +305,8 @@ void ContentionSim::simThreadLoop(uint32_t thid) {
 }
 
 void ContentionSim::simulatePhaseThread(uint32_t thid) {
-    uint32_t thDomains = simThreads[thid].supDomain - simThreads[thid].firstDomain;
-    uint32_t numFinished = 0;
-
-    if (thDomains == 1) {
-        DomainData& domain = domains[simThreads[thid].firstDomain];
+    if (numSimThreads == numDomains) {
+        DomainData& domain = domains[thid];
         domain.profTime.start();
         PrioQueue<TimingEvent, PQ_BLOCKS>& pq = domain.pq;
         while (pq.size() && pq.firstCycle() < limit) {
@@ -346,63 +359,33 @@ void ContentionSim::simulatePhaseThread(uint32_t thid) {
 #endif
 
     } else {
-        //info("XXX %d / %d %d %d", thid, thDomains, simThreads[thid].supDomain, simThreads[thid].firstDomain);
-
-        std::priority_queue<DomainData*, std::vector<DomainData*>, CompareDomains> domPq;
-        for (uint32_t i = simThreads[thid].firstDomain; i < simThreads[thid].supDomain; i++) {
-            domPq.push(&domains[i]);
-        }
-
-        std::vector<DomainData*> sq1;
-        std::vector<DomainData*> sq2;
-
-        std::vector<DomainData*>& stalledQueue = sq1;
-        std::vector<DomainData*>& nextStalledQueue = sq2;
-
-        while (numFinished < thDomains) {
-            while (domPq.size()) {
-                DomainData* domain = domPq.top();
-                domPq.pop();
-                PrioQueue<TimingEvent, PQ_BLOCKS>& pq = domain->pq;
-                if (!pq.size() || pq.firstCycle() > limit) {
-                    numFinished++;
-                    domain->curCycle = limit;
-                } else {
-                    //info("YYY %d %ld %ld %d", numFinished, domPq.size(), domain->curCycle, domain->prio);
-                    uint64_t cycle;
-                    TimingEvent* te = pq.dequeue(cycle);
-                    //uint64_t nextCycle = pq.size()? pq.firstCycle() : cycle;
-                    if (cycle != domain->curCycle) domain->curCycle = cycle;
-                    te->run(cycle);
-                    domain->curCycle = pq.size()? pq.firstCycle() : limit;
-                    domain->queuePrio = domain->curCycle;
-                    if (domain->prio == 0) domPq.push(domain);
-                    else stalledQueue.push_back(domain);
+        DomainData* domain = nullptr;
+        uint32_t stallRetries = 0;
+        while (domainsDone < numDomains) {
+            if (!domain) {
+                domain = claimDomain(thid);
+                if (!domain) { //all unfinished domains are being simulated
+                    _mm_pause();
+                    continue;
                 }
+                domain->profTime.start();
             }
 
-            while (stalledQueue.size()) {
-                DomainData* domain = stalledQueue.back();
-                stalledQueue.pop_back();
-                PrioQueue<TimingEvent, PQ_BLOCKS>& pq = domain->pq;
-                if (!pq.size() || pq.firstCycle() > limit) {
-                    numFinished++;
-                    domain->curCycle = limit;
-                } else {
-                    //info("SSS %d %ld %ld", numFinished, stalledQueue.size(), domain->curCycle);
-                    uint64_t cycle;
-                    TimingEvent* te = pq.dequeue(cycle);
-                    if (cycle != domain->curCycle) domain->curCycle = cycle;
-                    te->state = EV_RUNNING;
-                    te->simulate(cycle);
-                    domain->curCycle = pq.size()? pq.firstCycle() : limit;
-                    domain->queuePrio = domain->curCycle;
-                    if (domain->prio == 0) domPq.push(domain);
-                    else nextStalledQueue.push_back(domain);
-                }
-                if (domPq.size()) break;
+            bool finished = runDomain(domain);
+            if (finished) {
+                domain->donePhase = phase;
+                __sync_fetch_and_add(&domainsDone, 1);
+            } else if (domain->prio && stallRetries < DOMAIN_STALL_RETRIES && domains[domain->stallSrc].runLock) {
+                stallRetries++;
+                continue;
+            }
+            stallRetries = 0;
+
+            if (finished || domain->prio || hasLaggingDomain(domain->curCycle)) {
+                domain->profTime.end();
+                spin_unlock(&domain->runLock);
+                domain = nullptr;
             }
-            if (!stalledQueue.size()) std::swap(stalledQueue, nextStalledQueue);
         }
     }
 
@@ -410,6 +393,77 @@ void ContentionSim::simulatePhaseThread(uint32_t thid) {
     __sync_synchronize();
 }
 
+/* Claims the free, unfinished domain that lags the most, preferring domains
+ * not stalled on a crossing and, on ties (e.g., at the start of the phase),
+ * those that took longest in the last phase. Returns nullptr if every
+ * unfinished domain is being simulated by another thread.
+ */
+ContentionSim::DomainData* ContentionSim::claimDomain(uint32_t thid) {
+    while (true) {
+        DomainData* best = nullptr;
+        uint32_t first = thid*numDomains/numSimThreads; //on ties, threads keep to their share of domains
+        for (uint32_t i = 0; i < numDomains; i++) {
+            DomainData* d = &domains[(first + i) % numDomains];
+            if (d->donePhase == phase || d->runLock) continue;
+            if (best) {
+                bool stalled = d->prio;
+                bool bestStalled = best->prio;
+                if (stalled != bestStalled) {
+                    if (stalled) continue;
+                } else if (d->curCycle != best->curCycle) {
+                    if (d->curCycle > best->curCycle) continue;
+                } else if (d->lastPhaseNs <= best->lastPhaseNs) {
+                    continue;
+                }
+            }
+            best = d;
+        }
+
+        if (!best) return nullptr;
+        if (spin_trylock(&best->runLock) == 0) {
+            if (best->donePhase != phase) return best;
+            spin_unlock(&best->runLock); //finished since we scanned it
+        }
+    }
+}
+
+//True if a free, unfinished domain that is not stalled lags cycle by more than DOMAIN_STEAL_LAG cycles
+bool ContentionSim::hasLaggingDomain(uint64_t cycle) const {
+    for (uint32_t i = 0; i < numDomains; i++) {
+        const DomainData& d = domains[i];
+        if (d.donePhase != phase && !d.runLock && !d.prio && d.curCycle + DOMAIN_STEAL_LAG < cycle) return true;
+    }
+    return false;
+}
+
+/* Runs a batch of the domain's events, stopping early if it stalls on a
+ * crossing. Stalled domains run a single event, so that the domains they
+ * wait on can catch up. Returns true if the domain has finished the phase.
+ */
+bool ContentionSim::runDomain(DomainData* domain) {
+    PrioQueue<TimingEvent, PQ_BLOCKS>& pq = domain->pq;
+    bool stalled = domain->prio;
+    for (uint32_t i = 0; i < DOMAIN_BATCH_EVENTS; i++) {
+        if (!pq.size() || pq.firstCycle() > limit) {
+            domain->curCycle = limit;
+            return true;
+        }
+
+        uint64_t cycle;
+        TimingEvent* te = pq.dequeue(cycle);
+        if (cycle != domain->curCycle) domain->curCycle = cycle;
+        if (stalled) {
+            te->state = EV_RUNNING;
+            te->simulate(cycle);
+        } else {
+            te->run(cycle);
+        }
+        domain->curCycle = pq.size()? pq.firstCycle() : limit;
+        if (stalled || domain->prio) break;
+    }
+    return false;
+}
+
 void ContentionSim::finish() {
     assert(!terminate);
     terminate = true;
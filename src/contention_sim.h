@@ -69,10 +69,13 @@ class ContentionSim : public GlobAlloc {
 
             volatile uint64_t curCycle;
             lock_t pqLock; //used on phase 1 enqueues
-            //lock_t domainLock; //used by simulation thread
+            lock_t runLock; //held by the simulation thread running this domain
+            volatile uint64_t donePhase; //last phase this domain finished
 
             uint32_t prio;
-            uint64_t queuePrio;
+            uint32_t stallSrc; //if prio, source domain of the crossing this domain is stalled on
+            uint64_t lastPhaseNs; //weave time in the last phase, from profTime
+            uint64_t lastProfNs;
 
             PAD();
 
@@ -85,14 +88,8 @@ class ContentionSim : public GlobAlloc {
 #endif
         };
 
-        struct CompareDomains : public std::binary_function<DomainData*, DomainData*, bool> {
-             bool operator()(DomainData* d1, DomainData* d2) const;
-        };
-
         struct SimThreadData {
             lock_t wakeLock; //used to sleep/wake up simulation thread
-            uint32_t firstDomain;
-            uint32_t supDomain; //supreme, ie first not included
 
             std::vector<std::pair<uint64_t, TimingEvent*> > logVec;
         };
@@ -118,6 +115,9 @@ class ContentionSim : public GlobAlloc {
         volatile uint32_t threadsDone;
         volatile uint32_t threadTicket; //used only at init
 
+        volatile uint64_t phase; //number of simulated phases, tags finished domains
+        volatile uint32_t domainsDone; //domains that finished this phase, with dynamic scheduling
+
         volatile bool inCSim; //true when inside contention simulation
 
         PAD();
@@ -149,7 +149,10 @@ class ContentionSim : public GlobAlloc {
             return c;
         }
 
-        void setPrio(uint32_t domain, uint32_t prio) {domains[domain].prio = prio;}
+        void setPrio(uint32_t domain, uint32_t prio, uint32_t stallSrc = 0) {
+            domains[domain].stallSrc = stallSrc;
+            domains[domain].prio = prio;
+        }
 
 #if PROFILE_CROSSINGS
         void profileCrossing(uint32_t srcDomain, uint32_t dstDomain, uint32_t count) {
@@ -163,6 +166,11 @@ class ContentionSim : public GlobAlloc {
         void simThreadLoop(uint32_t thid);
         void simulatePhaseThread(uint32_t thid);
 
+        //Dynamic domain scheduling, used with fewer threads than domains
+        DomainData* claimDomain(uint32_t thid);
+        bool hasLaggingDomain(uint64_t cycle) const;
+        bool runDomain(DomainData* domain);
+
         static void SimThreadTrampoline(void* arg);
 };
 
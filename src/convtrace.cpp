@@ -0,0 +1,49 @@
+/** $lic$
+ * Copyright (C) 2012-2015 by Massachusetts Institute of Technology
+ * Copyright (C) 2010-2013 by The Board of Trustees of Stanford University
+ *
+ * This file is part of zsim.
+ *
+ * zsim is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, version 2.
+ *
+ * If you use this software in your research, we request that you reference
+ * the zsim paper ("ZSim: Fast and Accurate Microarchitectural Simulation of
+ * Thousand-Core Systems", Sanchez and Kozyrakis, ISCA-40, June 2013) as the
+ * source of the simulator in any publications that use this software, and that
+ * you send us a citation of your work.
+ *
+ * zsim is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Converts an HDF5 access trace to the binary format, which TraceDriver and
+ * the other trace tools mmap and read in place (see BinaryTraceHeader)
+ */
+
+#include <stdio.h>
+
+#include "access_tracing.h"
+#include "galloc.h"
+
+int main(int argc, const char* argv[]) {
+    InitLog(""); //no log header
+    if (argc != 3) {
+        info("Converts an HDF5 access trace to a binary one");
+        info("Usage: %s <input_trace> <output_trace>", argv[0]);
+        exit(1);
+    }
+
+    gm_init(1<<28 /*256 MB, only holds a chunk at a time*/);
+    ConvertTraceToBinary(argv[1], argv[2]);
+
+    AccessTraceReader tr(argv[2]);
+    info("Converted %ld records (%d children) to %s", tr.getNumRecords(), tr.getNumChildren(), argv[2]);
+    return 0;
+}
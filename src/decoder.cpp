@@ -31,9 +31,11 @@
 #include <string.h>
 #include <string>
 #include <vector>
+#include "bbl_cache.h"
 #include "core.h"
 #include "locks.h"
 #include "log.h"
+#include "zsim.h"
 
 extern "C" {
 #include "xed-interface.h"
@@ -1258,11 +1260,25 @@ static std::vector<uint32_t>* bblApproxOpcodes[MAX_BBLS];
 
 #endif
 
+const char* Decoder::buildId() {
+    return __DATE__ " " __TIME__;
+}
+
 BblInfo* Decoder::decodeBbl(BBL bbl, bool oooDecoding) {
     uint32_t instrs = BBL_NumIns(bbl);
     uint32_t bytes = BBL_Size(bbl);
     BblInfo* bblInfo;
 
+    DecodedBblCache* bblCache = nullptr;
+    uint8_t code[bytes];
+#ifndef BBL_PROFILING  // profiling keeps per-BBL data, so it always decodes
+    if (oooDecoding && zinfo->bblCache && PIN_SafeCopy(code, (const VOID*) BBL_Address(bbl), bytes) == bytes) {
+        bblCache = zinfo->bblCache;
+        bblInfo = bblCache->lookup(BBL_Address(bbl), code, bytes);
+        if (bblInfo) return bblInfo;
+    }
+#endif
+
     if (oooDecoding) {
         //Decode BBL
         uint32_t approxInstrs = 0;
@@ -1447,6 +1463,7 @@ BblInfo* Decoder::decodeBbl(BBL bbl, bool oooDecoding) {
     bblInfo->instrs = instrs;
     bblInfo->bytes = bytes;
 
+    if (bblCache) bblCache->insert(BBL_Address(bbl), code, bytes, bblInfo);
     return bblInfo;
 }
 
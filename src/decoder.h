@@ -128,6 +128,9 @@ class Decoder {
         //If oooDecoding is true, produces a DynBbl with DynUops that can be used in OOO cores
         static BblInfo* decodeBbl(BBL bbl, bool oooDecoding);
 
+        //Changes on every rebuild of the decoder; decodings cached across runs are only valid for the same build
+        static const char* buildId();
+
 #ifdef BBL_PROFILING
         static void profileBbl(uint64_t bblIdx);
         static void dumpBblProfile();
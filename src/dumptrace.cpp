@@ -32,6 +32,16 @@
 #include "galloc.h"
 #include "memory_hierarchy.h"  // to translate access type to strings
 
+// Prints the region updates due before the next access
+static void printRegions(AccessTraceReader& tr) {
+    const char* ops[] = {"add", "resize", "remove"};
+    while (tr.regionDue()) {
+        const PackedRegionRecord& reg = tr.readRegion();
+        info("%12ld region %s [%p, %p] %s", reg.cycle, (reg.op <= REGION_REMOVE)? ops[reg.op] : "?", (uint64_t*)reg.start, (uint64_t*)reg.end,
+                (reg.op == REGION_ADD)? DataTypeName((DataType) reg.type) : "");
+    }
+}
+
 int main(int argc, const char* argv[]) {
     InitLog(""); //no log header
     if (argc != 2) {
@@ -40,14 +50,16 @@ int main(int argc, const char* argv[]) {
         exit(1);
     }
 
-    gm_init(32<<20 /*32 MB, should be enough*/);
+    gm_init(1<<30 /*1 GB, traces with data keep their distinct lines in memory*/);
     AccessTraceReader tr(argv[1]);
 
     info("%12s %6s %6s %20s %10s", "Cycle", "Src", "Type", "LineAddr", "Latency");
     while(!tr.empty()) {
+        printRegions(tr);
         AccessRecord acc = tr.read();
         info("%12ld %6d   %s %20p %10d", acc.reqCycle, acc.childId, AccessTypeName(acc.type), (uint64_t*)acc.lineAddr, acc.latency);
     }
+    printRegions(tr);  // updates after the last access
 
     return 0;
 }
@@ -67,6 +67,11 @@ class EventRecorder : public GlobAlloc {
             tr.clear();
         }
 
+        // A discarding recorder's events are never simulated; discardEvents() drops them in bulk
+        explicit EventRecorder(bool discarding) : slabAlloc(discarding) {
+            tr.clear();
+        }
+
         //Alloc interface
 
         template <typename T>
@@ -97,6 +102,13 @@ class EventRecorder : public GlobAlloc {
             return tr.isValid();
         }
 
+        // Drops the current record and every event allocated so far (discarding recorders only)
+        void discardEvents() {
+            tr.clear();
+            crossingStack.clear();
+            slabAlloc.discardAll();
+        }
+
         //Called by crossing events
         inline uint64_t getSlack(uint64_t origStartCycle) const {
             return origStartCycle + lastStartSlack;
@@ -0,0 +1,107 @@
+/** $lic$
+ * Copyright (C) 2012-2015 by Massachusetts Institute of Technology
+ * Copyright (C) 2010-2013 by The Board of Trustees of Stanford University
+ *
+ * This file is part of zsim.
+ *
+ * zsim is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, version 2.
+ *
+ * If you use this software in your research, we request that you reference
+ * the zsim paper ("ZSim: Fast and Accurate Microarchitectural Simulation of
+ * Thousand-Core Systems", Sanchez and Kozyrakis, ISCA-40, June 2013) as the
+ * source of the simulator in any publications that use this software, and that
+ * you send us a citation of your work.
+ *
+ * zsim is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef FREE_SPACE_INDEX_H_
+#define FREE_SPACE_INDEX_H_
+
+#include <stdint.h>
+#include "galloc.h"
+#include "log.h"
+
+/* Index of sets by free space, for the compressed data arrays.
+ *
+ * Each set sits in at most one bucket, keyed by its free space (in segments,
+ * clamped to maxFree). Buckets are intrusive doubly-linked lists threaded
+ * through per-set prev/next arrays, and a bitmap records which buckets are
+ * non-empty, so update(), remove() and first() are all O(1).
+ *
+ * Within a bucket, the most recently updated set is returned first.
+ */
+class FreeSpaceIndex : public GlobAlloc {
+    private:
+        int32_t* prev;
+        int32_t* next;
+        int32_t* bucket;  // -1 if the set is not indexed
+        int32_t* heads;
+        uint64_t occupied;
+        uint32_t numSets;
+        uint32_t maxFree;
+
+        inline void unlink(uint32_t set) {
+            int32_t b = bucket[set];
+            if (b < 0) return;
+            if (prev[set] != -1) next[prev[set]] = next[set];
+            else heads[b] = next[set];
+            if (next[set] != -1) prev[next[set]] = prev[set];
+            if (heads[b] == -1) occupied &= ~(1ul << b);
+            bucket[set] = -1;
+        }
+
+    public:
+        FreeSpaceIndex(uint32_t _numSets, uint32_t _maxFree) : occupied(0), numSets(_numSets), maxFree(_maxFree) {
+            assert_msg(maxFree && maxFree < 64, "FreeSpaceIndex: maxFree must be in [1, 63], %d given", maxFree);
+            prev = gm_malloc<int32_t>(numSets);
+            next = gm_malloc<int32_t>(numSets);
+            bucket = gm_malloc<int32_t>(numSets);
+            heads = gm_malloc<int32_t>(maxFree + 1);
+            for (uint32_t i = 0; i < numSets; i++) bucket[i] = -1;
+            for (uint32_t i = 0; i <= maxFree; i++) heads[i] = -1;
+        }
+
+        ~FreeSpaceIndex() {
+            gm_free(prev);
+            gm_free(next);
+            gm_free(bucket);
+            gm_free(heads);
+        }
+
+        // (Re)files set under its new free space; sets with no free space are dropped
+        inline void update(uint32_t set, int32_t free) {
+            assert(set < numSets);
+            unlink(set);
+            if (free <= 0) return;
+            int32_t b = ((uint32_t)free > maxFree)? maxFree : free;
+            prev[set] = -1;
+            next[set] = heads[b];
+            if (heads[b] != -1) prev[heads[b]] = set;
+            heads[b] = set;
+            bucket[set] = b;
+            occupied |= 1ul << b;
+        }
+
+        inline void remove(uint32_t set) {
+            assert(set < numSets);
+            unlink(set);
+        }
+
+        // Returns a set from the tightest bucket with at least minFree free segments, or -1 if none
+        inline int32_t first(uint32_t minFree) const {
+            if (minFree > maxFree) return -1;
+            uint64_t fits = occupied & ~((1ul << minFree) - 1);
+            return fits? heads[__builtin_ctzl(fits)] : -1;
+        }
+};
+
+#endif  // FREE_SPACE_INDEX_H_
@@ -33,6 +33,7 @@
 
 #include "log.h"  // NOLINT must precede dlmalloc, which defines assert if undefined
 #include "g_heap/dlmalloc.h.c"
+#include "constants.h"
 #include "locks.h"
 #include "pad.h"
 
@@ -63,6 +64,122 @@ struct gm_segment {
 static gm_segment* GM = nullptr;
 static int gm_shmid = 0;
 
+/* Per-thread size-class caches
+ *
+ * Small blocks freed by a thread go to a free list for their size class in
+ * that thread's cache, and the thread's next allocations of that class are
+ * served from it without taking the global heap lock. Lists are refilled and
+ * drained in batches, so the lock is taken once per batch instead of once per
+ * call.
+ *
+ * Caches are process-local: they only hold pointers to blocks in the shared
+ * segment, which any thread of any process can still gm_free(). A block's
+ * class is derived from its dlmalloc usable size, so blocks that came from
+ * calloc, memalign, or the locked path can be cached too.
+ */
+#define GM_CLASS_BYTES (16)
+#define GM_NUM_CLASSES (32)  // up to 512-byte blocks
+#define GM_CACHE_MAX (64)  // blocks per class; beyond this, drain half
+#define GM_REFILL_BATCH (16)
+
+struct gm_free_block {
+    gm_free_block* next;
+};
+
+struct gm_thread_cache {
+    gm_free_block* lists[GM_NUM_CLASSES];
+    uint32_t counts[GM_NUM_CLASSES];
+
+    // Stats
+    uint64_t allocs;
+    uint64_t cachedAllocs;  // served without taking the heap lock
+    uint64_t frees;
+    uint64_t cachedFrees;
+    uint64_t refills;
+    uint64_t drains;
+} ATTR_LINE_ALIGNED;
+
+static gm_thread_cache gm_tcaches[MAX_THREADS];
+static gm_thread_id_fn gm_get_tid = nullptr;
+
+static inline gm_thread_cache* gm_tcache() {
+    if (!gm_get_tid) return nullptr;
+    uint32_t tid = gm_get_tid();
+    return (tid < MAX_THREADS)? &gm_tcaches[tid] : nullptr;
+}
+
+// Requested size -> class, or -1 if not cached
+static inline int gm_alloc_class(size_t size) {
+    if (size == 0 || size > GM_CLASS_BYTES*GM_NUM_CLASSES) return -1;
+    return (size + GM_CLASS_BYTES - 1)/GM_CLASS_BYTES - 1;
+}
+
+// Usable size of an existing block -> largest class it can serve, or -1
+static inline int gm_free_class(size_t usable) {
+    size_t c = usable/GM_CLASS_BYTES;
+    if (c == 0 || c > GM_NUM_CLASSES) return -1;
+    return c - 1;
+}
+
+static void* gm_cache_alloc(gm_thread_cache* tc, int cls) {
+    if (!tc->lists[cls]) {
+        // Refill; keep one block to return
+        size_t bytes = (cls + 1)*GM_CLASS_BYTES;
+        futex_lock(&GM->lock);
+        for (uint32_t i = 0; i < GM_REFILL_BATCH; i++) {
+            gm_free_block* b = static_cast<gm_free_block*>(mspace_malloc(GM->mspace_ptr, bytes));
+            if (!b) break;
+            b->next = tc->lists[cls];
+            tc->lists[cls] = b;
+            tc->counts[cls]++;
+        }
+        futex_unlock(&GM->lock);
+        tc->refills++;
+        if (!tc->lists[cls]) return nullptr;
+    } else {
+        tc->cachedAllocs++;
+    }
+    gm_free_block* b = tc->lists[cls];
+    tc->lists[cls] = b->next;
+    tc->counts[cls]--;
+    return b;
+}
+
+static void gm_cache_drain(gm_thread_cache* tc, int cls, uint32_t keep) {
+    futex_lock(&GM->lock);
+    while (tc->counts[cls] > keep) {
+        gm_free_block* b = tc->lists[cls];
+        tc->lists[cls] = b->next;
+        tc->counts[cls]--;
+        mspace_free(GM->mspace_ptr, b);
+    }
+    futex_unlock(&GM->lock);
+    tc->drains++;
+}
+
+void gm_set_thread_id_fn(gm_thread_id_fn fn) {
+    gm_get_tid = fn;
+}
+
+void gm_flush_thread_cache(uint32_t tid) {
+    assert(tid < MAX_THREADS);
+    gm_thread_cache* tc = &gm_tcaches[tid];
+    for (int cls = 0; cls < GM_NUM_CLASSES; cls++) {
+        if (tc->counts[cls]) gm_cache_drain(tc, cls, 0);
+    }
+}
+
+uint64_t gm_thread_allocs() {
+    gm_thread_cache* tc = gm_tcache();
+    return tc? tc->allocs : 0;
+}
+
+void gm_reset_thread_caches() {
+    for (uint32_t tid = 0; tid < MAX_THREADS; tid++) {
+        memset(&gm_tcaches[tid], 0, sizeof(gm_thread_cache));
+    }
+}
+
 /* Heap segment size, in bytes. Can't grow for now, so choose something sensible, and within the machine's limits (see sysctl vars kernel.shmmax and kernel.shmall) */
 int gm_init(size_t segmentSize) {
     /* Create a SysV IPC shared memory segment, attach to it, and mark the segment to
@@ -124,6 +241,14 @@ void gm_attach(int shmid) {
 void* gm_malloc(size_t size) {
     assert(GM);
     assert(GM->mspace_ptr);
+    gm_thread_cache* tc = gm_tcache();
+    if (tc) tc->allocs++;
+    int cls = gm_alloc_class(size);
+    if (tc && cls >= 0) {
+        void* ptr = gm_cache_alloc(tc, cls);
+        if (!ptr) panic("gm_malloc(): Out of global heap memory, use a larger GM segment");
+        return ptr;
+    }
     futex_lock(&GM->lock);
     void* ptr = mspace_malloc(GM->mspace_ptr, size);
     futex_unlock(&GM->lock);
@@ -134,6 +259,15 @@ void* gm_malloc(size_t size) {
 void* __gm_calloc(size_t num, size_t size) {
     assert(GM);
     assert(GM->mspace_ptr);
+    gm_thread_cache* tc = gm_tcache();
+    if (tc) tc->allocs++;
+    int cls = (num && size <= SIZE_MAX/num)? gm_alloc_class(num*size) : -1;
+    if (tc && cls >= 0) {
+        void* ptr = gm_cache_alloc(tc, cls);
+        if (!ptr) panic("gm_calloc(): Out of global heap memory, use a larger GM segment");
+        memset(ptr, 0, num*size);
+        return ptr;
+    }
     futex_lock(&GM->lock);
     void* ptr = mspace_calloc(GM->mspace_ptr, num, size);
     futex_unlock(&GM->lock);
@@ -144,6 +278,8 @@ void* __gm_calloc(size_t num, size_t size) {
 void* __gm_memalign(size_t blocksize, size_t bytes) {
     assert(GM);
     assert(GM->mspace_ptr);
+    gm_thread_cache* tc = gm_tcache();
+    if (tc) tc->allocs++;
     futex_lock(&GM->lock);
     void* ptr = mspace_memalign(GM->mspace_ptr, blocksize, bytes);
     futex_unlock(&GM->lock);
@@ -155,6 +291,20 @@ void* __gm_memalign(size_t blocksize, size_t bytes) {
 void gm_free(void* ptr) {
     assert(GM);
     assert(GM->mspace_ptr);
+    gm_thread_cache* tc = gm_tcache();
+    if (tc && ptr) {
+        tc->frees++;
+        int cls = gm_free_class(mspace_usable_size(ptr));
+        if (cls >= 0) {
+            gm_free_block* b = static_cast<gm_free_block*>(ptr);
+            b->next = tc->lists[cls];
+            tc->lists[cls] = b;
+            tc->counts[cls]++;
+            tc->cachedFrees++;
+            if (tc->counts[cls] > GM_CACHE_MAX) gm_cache_drain(tc, cls, GM_CACHE_MAX/2);
+            return;
+        }
+    }
     futex_lock(&GM->lock);
     mspace_free(GM->mspace_ptr, ptr);
     futex_unlock(&GM->lock);
@@ -196,6 +346,30 @@ void* gm_get_secondary_ptr() {
 void gm_stats() {
     assert(GM);
     mspace_malloc_stats(GM->mspace_ptr);
+
+    // Per-thread caches are process-local, so this only covers the calling process
+    uint64_t allocs = 0, cachedAllocs = 0, frees = 0, cachedFrees = 0, cachedBytes = 0;
+    for (uint32_t tid = 0; tid < MAX_THREADS; tid++) {
+        gm_thread_cache* tc = &gm_tcaches[tid];
+        if (!tc->allocs && !tc->frees) continue;
+        uint64_t bytes = 0;
+        for (uint32_t cls = 0; cls < GM_NUM_CLASSES; cls++) bytes += tc->counts[cls]*(cls + 1)*GM_CLASS_BYTES;
+        info("gm thread %d: %ld allocs (%ld cached), %ld frees (%ld cached), %ld refills, %ld drains, %ld bytes cached",
+                tid, tc->allocs, tc->cachedAllocs, tc->frees, tc->cachedFrees, tc->refills, tc->drains, bytes);
+        allocs += tc->allocs;
+        cachedAllocs += tc->cachedAllocs;
+        frees += tc->frees;
+        cachedFrees += tc->cachedFrees;
+        cachedBytes += bytes;
+    }
+    if (allocs || frees) {
+        info("gm thread caches: %ld allocs (%ld cached), %ld frees (%ld cached), %ld bytes cached", allocs, cachedAllocs, frees, cachedFrees, cachedBytes);
+    }
+}
+
+size_t gm_used_bytes() {
+    assert(GM);
+    return mspace_mallinfo(GM->mspace_ptr).uordblks;
 }
 
 bool gm_isready() {
@@ -26,6 +26,7 @@
 #ifndef GALLOC_H_
 #define GALLOC_H_
 
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 
@@ -60,6 +61,16 @@ void gm_set_secondary_ptr(void* ptr);
 void* gm_get_secondary_ptr();
 
 void gm_stats();
+size_t gm_used_bytes();  // bytes allocated from the heap, including blocks held in per-thread caches
+
+/* Per-thread size-class caches (see galloc.cpp). Disabled until the process
+ * registers a function that returns the calling thread's id.
+ */
+typedef uint32_t (*gm_thread_id_fn)();
+void gm_set_thread_id_fn(gm_thread_id_fn fn);
+void gm_flush_thread_cache(uint32_t tid);  // returns tid's cached blocks to the heap
+void gm_reset_thread_caches();  // after fork(), in the child: drops (leaks) the inherited caches, which the parent still owns
+uint64_t gm_thread_allocs();  // allocations made so far by the calling thread (0 if caches are disabled)
 
 bool gm_isready();
 void gm_detach();
@@ -123,6 +123,90 @@ uint64_t H3HashFamily::hash(uint32_t id, uint64_t val) {
     return res;
 }
 
+H3LineHasher::H3LineHasher(uint32_t outputBits, uint64_t randSeed) : LineHasher(outputBits) {
+    h3 = new H3HashFamily(1, outputBits, randSeed);
+}
+
+H3LineHasher::~H3LineHasher() {
+    delete h3;
+}
+
+uint64_t H3LineHasher::hash(const uint64_t* words, uint32_t numWords) {
+    uint64_t res = 0;
+    // Qualified call avoids a virtual dispatch per word
+    for (uint32_t i = 0; i < numWords; i++) res ^= h3->H3HashFamily::hash(0, words[i]);
+    return res & mask;
+}
+
+#ifndef __SSE4_2__
+/* Table-driven CRC32C (Castagnoli, reflected polynomial 0x82F63B78) */
+static uint32_t crc32cTable[256];
+
+static void initCRC32CTable() {
+    for (uint32_t i = 0; i < 256; i++) {
+        uint32_t crc = i;
+        for (uint32_t j = 0; j < 8; j++) crc = (crc >> 1) ^ ((crc & 1)? 0x82F63B78 : 0);
+        crc32cTable[i] = crc;
+    }
+}
+
+static inline uint32_t crc32cWord(uint32_t crc, uint64_t word) {
+    for (uint32_t i = 0; i < 8; i++) {
+        crc = (crc >> 8) ^ crc32cTable[(crc ^ word) & 0xFF];
+        word >>= 8;
+    }
+    return crc;
+}
+#else
+#include <nmmintrin.h>
+
+static inline uint32_t crc32cWord(uint32_t crc, uint64_t word) {
+    return (uint32_t)_mm_crc32_u64(crc, word);
+}
+#endif
+
+CRC32CLineHasher::CRC32CLineHasher(uint32_t outputBits, uint64_t randSeed) : LineHasher(outputBits), seed((uint32_t)(randSeed ^ (randSeed >> 32))) {
+#ifndef __SSE4_2__
+    initCRC32CTable();
+#endif
+}
+
+uint64_t CRC32CLineHasher::hash(const uint64_t* words, uint32_t numWords) {
+    uint32_t lo = seed;
+    for (uint32_t i = 0; i < numWords; i++) lo = crc32cWord(lo, words[i]);
+    uint64_t res = lo;
+    if (mask >> 32) {
+        uint32_t hi = ~seed ^ lo;
+        for (uint32_t i = 0; i < numWords; i++) hi = crc32cWord(hi, words[i]);
+        res |= ((uint64_t)hi) << 32;
+    }
+    return res & mask;
+}
+
+static inline uint64_t rotl64(uint64_t x, uint32_t r) {
+    return (x << r) | (x >> (64 - r));
+}
+
+uint64_t XXLineHasher::hash(const uint64_t* words, uint32_t numWords) {
+    const uint64_t P1 = 0x9E3779B185EBCA87ull;
+    const uint64_t P2 = 0xC2B2AE3D27D4EB4Full;
+    const uint64_t P3 = 0x165667B19E3779F9ull;
+    const uint64_t P4 = 0x85EBCA77C2B2AE63ull;
+    const uint64_t P5 = 0x27D4EB2F165667C5ull;
+
+    uint64_t h = seed + P5 + numWords*8;
+    for (uint32_t i = 0; i < numWords; i++) {
+        uint64_t k = rotl64(words[i] * P2, 31) * P1;
+        h = rotl64(h ^ k, 27) * P1 + P4;
+    }
+    h ^= h >> 33;
+    h *= P2;
+    h ^= h >> 29;
+    h *= P3;
+    h ^= h >> 32;
+    return h & mask;
+}
+
 #if _WITH_POLARSSL_
 
 #include "polarssl/sha1.h"
@@ -67,4 +67,49 @@ class IdHashFamily : public HashFamily {
         inline uint64_t hash(uint32_t id, uint64_t val) {return val;}
 };
 
+/* Hashes whole cache lines, read as 64-bit words, down to outputBits bits.
+ * Unlike HashFamily, implementations are called once per line rather than
+ * once per word, and the output mask is computed once at construction.
+ */
+class LineHasher : public GlobAlloc {
+    protected:
+        const uint64_t mask;
+    public:
+        explicit LineHasher(uint32_t outputBits) : mask((outputBits >= 64)? ~0ull : ((1ull << outputBits) - 1)) {}
+        virtual ~LineHasher() {}
+
+        virtual uint64_t hash(const uint64_t* words, uint32_t numWords) = 0;
+        uint64_t getMask() const {return mask;}
+};
+
+/* XOR of the H3 hash of each word; matches the original dedup hash */
+class H3LineHasher : public LineHasher {
+    private:
+        H3HashFamily* h3;
+    public:
+        H3LineHasher(uint32_t outputBits, uint64_t randSeed);
+        ~H3LineHasher();
+        uint64_t hash(const uint64_t* words, uint32_t numWords);
+};
+
+/* CRC32C over the line's words (uses the SSE4.2 crc32 instruction if
+ * available). Outputs wider than 32 bits chain a second, differently seeded
+ * CRC into the upper half. */
+class CRC32CLineHasher : public LineHasher {
+    private:
+        const uint32_t seed;
+    public:
+        CRC32CLineHasher(uint32_t outputBits, uint64_t randSeed);
+        uint64_t hash(const uint64_t* words, uint32_t numWords);
+};
+
+/* xxHash64-style multiply-rotate mixing, one round per word plus a final avalanche */
+class XXLineHasher : public LineHasher {
+    private:
+        const uint64_t seed;
+    public:
+        XXLineHasher(uint32_t outputBits, uint64_t randSeed) : LineHasher(outputBits), seed(randSeed) {}
+        uint64_t hash(const uint64_t* words, uint32_t numWords);
+};
+
 #endif  // HASH_H_
@@ -31,8 +31,12 @@
 #include <string>
 #include <sys/time.h>
 #include <vector>
+#include "approx_regions.h"
+#include "bbl_cache.h"
+#include "bdi.h"
 #include "cache.h"
 #include "cache_arrays.h"
+#include "compression_memo.h"
 #include "config.h"
 #include "constants.h"
 #include "contention_sim.h"
@@ -90,6 +94,53 @@ extern void EndOfPhaseActions(); //in zsim.cpp
  * follow the layout of zinfo, top-down.
  */
 
+// Content hash used by the dedup hash arrays
+static LineHasher* BuildLineHasher(Config& config, const string& prefix, g_string& name) {
+    string hashFunction = config.get<const char*>(prefix + "hashFunction", "H3");
+    uint32_t hashBits = config.get<uint32_t>(prefix + "hashSize", zinfo->hashSize);
+    size_t seed = _Fnv_hash_bytes(prefix.c_str(), prefix.size()+1, 0xB4AC5B);
+    uint64_t randSeed = 0xCAC7EAFFA1 + seed; /*make randSeed depend on prefix*/
+    if (hashBits == 0 || hashBits > 64) panic("%s: Invalid hashSize %d, must be in 1..64", name.c_str(), hashBits);
+    if (hashFunction == "H3") {
+        return new H3LineHasher(hashBits, randSeed);
+    } else if (hashFunction == "CRC32C") {
+        return new CRC32CLineHasher(hashBits, randSeed);
+    } else if (hashFunction == "XXHash") {
+        return new XXLineHasher(hashBits, randSeed);
+    } else {
+        panic("%s: Invalid value %s on hashFunction", name.c_str(), hashFunction.c_str());
+    }
+}
+
+// Dedup data arrays sample for the least-referenced victim by default; MinRefLRU tracks it exactly
+static bool UseExactVictims(Config& config, const string& prefix, g_string& name) {
+    string victimSelection = config.get<const char*>(prefix + "victimSelection", "Sampled");
+    if (victimSelection == "MinRefLRU") {
+        return true;
+    } else if (victimSelection != "Sampled") {
+        panic("%s: Invalid value %s on victimSelection", name.c_str(), victimSelection.c_str());
+    }
+    return false;
+}
+
+// Compression hardware of a compressed cache bank; with the default 0 latencies, (de)compression and hashing are free
+static CompressionTiming* BuildCompressionTiming(Config& config, const string& prefix, g_string& name) {
+    CompressionTiming* ct = new CompressionTiming();
+    ct->compressLat = config.get<uint32_t>(prefix + "compressLat", 0);
+    ct->hashLat = config.get<uint32_t>(prefix + "hashLat", 0);
+    uint32_t decompressLat = config.get<uint32_t>(prefix + "decompressLat", 0);
+    for (uint32_t e = 0; e < NONE; e++) {
+        const char* encoding = BDICompressionName((BDICompressionEncoding)e);
+        ct->decompressLat[e] = config.get<uint32_t>(prefix + "decompressLatencies." + encoding, decompressLat);
+    }
+    ct->decompressLat[NONE] = 0;
+    ct->compressors = config.get<uint32_t>(prefix + "compressors", 1);
+    ct->decompressors = config.get<uint32_t>(prefix + "decompressors", 1);
+    if (ct->compressors == 0) panic("%s: Invalid compressors %d, must be > 0", name.c_str(), ct->compressors);
+    if (ct->decompressors == 0) panic("%s: Invalid decompressors %d, must be > 0", name.c_str(), ct->decompressors);
+    return ct;
+}
+
 BaseCache* BuildCacheBank(Config& config, const string& prefix, g_string& name, uint32_t bankSize, bool isTerminal, uint32_t domain) {
     if (!zinfo->compressionRatioStats) zinfo->compressionRatioStats = new g_vector<RunningStats*>();
     if (!zinfo->evictionStats) zinfo->evictionStats = new g_vector<RunningStats*>();
@@ -118,6 +169,10 @@ BaseCache* BuildCacheBank(Config& config, const string& prefix, g_string& name,
     uint32_t numHashes = 1;
     uint32_t ways = config.get<uint32_t>(prefix + "array.ways", 4);
     string arrayType = config.get<const char*>(prefix + "array.type", "SetAssoc");
+    // The BDI kernels model 64-byte lines only
+    if (arrayType.find("BDI") != string::npos && lineSize != BDI_LINE_BYTES) {
+        panic("%s: %s arrays need %d-byte lines, but sys.lineSize is %d", name.c_str(), arrayType.c_str(), BDI_LINE_BYTES, lineSize);
+    }
     uint32_t candidates = (arrayType == "Z")? config.get<uint32_t>(prefix + "array.candidates", 16) : ways;
 
     //Need to know number of hash functions before instantiating array
@@ -279,31 +334,31 @@ BaseCache* BuildCacheBank(Config& config, const string& prefix, g_string& name,
         dataRP = new DataLRUReplPolicy(numLines);
         dtagArray = new ApproximateDedupTagArray(numLines*tagRatio, ways, tagRP, hf);
         ddataArray = new ApproximateDedupDataArray(numLines, ways, dataRP, hf);
+        if (UseExactVictims(config, prefix, name)) ddataArray->enableExactVictims();
         uint32_t hashLines = config.get<uint32_t>(prefix + "hashLines", 64);
         uint32_t hashAssoc = config.get<uint32_t>(prefix + "hashAssoc", 8);
         hashRP = new DataLRUReplPolicy(hashLines);
-        size_t seed = _Fnv_hash_bytes(prefix.c_str(), prefix.size()+1, 0xB4AC5B);
-        H3HashFamily* hashCompression = new H3HashFamily(1, zinfo->hashSize, 0xCAC7EAFFA1 + seed /*make randSeed depend on prefix*/);
+        LineHasher* hashCompression = BuildLineHasher(config, prefix, name);
         dhashArray = new ApproximateDedupHashArray(hashLines, hashAssoc, hashRP, hf, hashCompression);
     } else if (arrayType == "ApproximateDedupBDI") {
         tagRP = new LRUReplPolicy<true>(numLines*tagRatio);
         dbtagArray = new ApproximateDedupBDITagArray(numLines*tagRatio, ways*tagRatio, tagRP, hf);
         dbdataArray = new ApproximateDedupBDIDataArray(numLines, ways, hf);
+        if (UseExactVictims(config, prefix, name)) dbdataArray->enableExactVictims();
         uint32_t hashLines = config.get<uint32_t>(prefix + "hashLines", 64);
         uint32_t hashAssoc = config.get<uint32_t>(prefix + "hashAssoc", 8);
         hashRP = new DataLRUReplPolicy(hashLines);
-        size_t seed = _Fnv_hash_bytes(prefix.c_str(), prefix.size()+1, 0xB4AC5B);
-        H3HashFamily* hashCompression = new H3HashFamily(1, zinfo->hashSize, 0xCAC7EAFFA1 + seed /*make randSeed depend on prefix*/);
+        LineHasher* hashCompression = BuildLineHasher(config, prefix, name);
         dbhashArray = new ApproximateDedupBDIHashArray(hashLines, hashAssoc, hashRP, hf, hashCompression);
     } else if (arrayType == "ApproximateNaiiveDedupBDI") {
         tagRP = new LRUReplPolicy<true>(numLines*tagRatio);
         dbtagArray = new ApproximateDedupBDITagArray(numLines*tagRatio, ways*tagRatio, tagRP, hf);
         ndbdataArray = new ApproximateNaiiveDedupBDIDataArray(numLines, ways, hf);
+        if (UseExactVictims(config, prefix, name)) ndbdataArray->enableExactVictims();
         uint32_t hashLines = config.get<uint32_t>(prefix + "hashLines", 64);
         uint32_t hashAssoc = config.get<uint32_t>(prefix + "hashAssoc", 8);
         hashRP = new DataLRUReplPolicy(hashLines);
-        size_t seed = _Fnv_hash_bytes(prefix.c_str(), prefix.size()+1, 0xB4AC5B);
-        H3HashFamily* hashCompression = new H3HashFamily(1, zinfo->hashSize, 0xCAC7EAFFA1 + seed /*make randSeed depend on prefix*/);
+        LineHasher* hashCompression = BuildLineHasher(config, prefix, name);
         dbhashArray = new ApproximateDedupBDIHashArray(hashLines, hashAssoc, hashRP, hf, hashCompression);
     } else if (arrayType == "uniDoppelgangerBDI") {
         tagRP = new LRUReplPolicy<true>(numLines*tagRatio);
@@ -374,7 +429,7 @@ BaseCache* BuildCacheBank(Config& config, const string& prefix, g_string& name,
             tagRP->setCC(cc);
 
             cache = new uniDoppelgangerCache(numLines*tagRatio, numLines*tagRatio, cc, utagArray, udataArray, tagRP, dataRP,
-                accLat, invLat, mshrs, ways, timingCandidates, domain, name, crStats, evStats, tutStats, dutStats, hitStats, missStats, allStats);
+                accLat, invLat, mshrs, ways, timingCandidates, domain, name, crStats, evStats, tutStats, dutStats, hitStats, missStats, allStats, BuildCompressionTiming(config, prefix, name));
             zinfo->compressionRatioStats->push_back(crStats);
             zinfo->evictionStats->push_back(evStats);
             zinfo->tagUtilizationStats->push_back(tutStats);
@@ -397,7 +452,7 @@ BaseCache* BuildCacheBank(Config& config, const string& prefix, g_string& name,
             tagRP->setCC(cc);
 
             cache = new uniDoppelgangerBDICache(numLines*tagRatio, numLines, cc, ubtagArray, ubdataArray, tagRP, dataRP,
-                accLat, invLat, mshrs, ways, timingCandidates, domain, name, crStats, evStats, tutStats, dutStats, hitStats, missStats, allStats);
+                accLat, invLat, mshrs, ways, timingCandidates, domain, name, crStats, evStats, tutStats, dutStats, hitStats, missStats, allStats, BuildCompressionTiming(config, prefix, name));
             zinfo->compressionRatioStats->push_back(crStats);
             zinfo->evictionStats->push_back(evStats);
             zinfo->tagUtilizationStats->push_back(tutStats);
@@ -420,7 +475,7 @@ BaseCache* BuildCacheBank(Config& config, const string& prefix, g_string& name,
             tagRP->setCC(cc);
 
             cache = new ApproximateBDICache(numLines*tagRatio, numLines, cc, atagArray, adataArray, tagRP, dataRP,
-                accLat, invLat, mshrs, ways, timingCandidates, domain, name, crStats, evStats, tutStats, dutStats, hitStats, missStats, allStats);
+                accLat, invLat, mshrs, ways, timingCandidates, domain, name, crStats, evStats, tutStats, dutStats, hitStats, missStats, allStats, BuildCompressionTiming(config, prefix, name));
             zinfo->compressionRatioStats->push_back(crStats);
             zinfo->evictionStats->push_back(evStats);
             zinfo->tagUtilizationStats->push_back(tutStats);
@@ -443,7 +498,7 @@ BaseCache* BuildCacheBank(Config& config, const string& prefix, g_string& name,
             tagRP->setCC(cc);
 
             cache = new ApproximateDedupCache(numLines*tagRatio, numLines, cc, dtagArray, ddataArray, dhashArray, tagRP, dataRP,
-                hashRP, accLat, invLat, mshrs, ways, timingCandidates, domain, name, crStats, evStats, tutStats, dutStats, hitStats, missStats, allStats);
+                hashRP, accLat, invLat, mshrs, ways, timingCandidates, domain, name, crStats, evStats, tutStats, dutStats, hitStats, missStats, allStats, BuildCompressionTiming(config, prefix, name));
             zinfo->compressionRatioStats->push_back(crStats);
             zinfo->evictionStats->push_back(evStats);
             zinfo->tagUtilizationStats->push_back(tutStats);
@@ -466,7 +521,7 @@ BaseCache* BuildCacheBank(Config& config, const string& prefix, g_string& name,
             tagRP->setCC(cc);
 
             cache = new ApproximateIdealDedupCache(numLines*tagRatio, numLines, cc, dtagArray, ddataArray, dhashArray, tagRP, dataRP,
-                hashRP, accLat, invLat, mshrs, ways, timingCandidates, domain, name, crStats, evStats, tutStats, dutStats, hitStats, missStats, allStats);
+                hashRP, accLat, invLat, mshrs, ways, timingCandidates, domain, name, crStats, evStats, tutStats, dutStats, hitStats, missStats, allStats, BuildCompressionTiming(config, prefix, name));
             zinfo->compressionRatioStats->push_back(crStats);
             zinfo->evictionStats->push_back(evStats);
             zinfo->tagUtilizationStats->push_back(tutStats);
@@ -489,7 +544,7 @@ BaseCache* BuildCacheBank(Config& config, const string& prefix, g_string& name,
             tagRP->setCC(cc);
 
             cache = new ApproximateDedupBDICache(numLines*tagRatio, numLines, cc, dbtagArray, dbdataArray, dbhashArray, tagRP, dataRP,
-                hashRP, accLat, invLat, mshrs, ways, timingCandidates, domain, name, crStats, evStats, tutStats, dutStats, hitStats, missStats, allStats);
+                hashRP, accLat, invLat, mshrs, ways, timingCandidates, domain, name, crStats, evStats, tutStats, dutStats, hitStats, missStats, allStats, BuildCompressionTiming(config, prefix, name));
             zinfo->compressionRatioStats->push_back(crStats);
             zinfo->evictionStats->push_back(evStats);
             zinfo->tagUtilizationStats->push_back(tutStats);
@@ -512,7 +567,7 @@ BaseCache* BuildCacheBank(Config& config, const string& prefix, g_string& name,
             tagRP->setCC(cc);
 
             cache = new ApproximateNaiiveDedupBDICache(numLines*tagRatio, numLines, cc, dbtagArray, ndbdataArray, dbhashArray, tagRP, dataRP,
-                hashRP, accLat, invLat, mshrs, ways, timingCandidates, domain, name, crStats, evStats, tutStats, dutStats, hitStats, missStats, allStats);
+                hashRP, accLat, invLat, mshrs, ways, timingCandidates, domain, name, crStats, evStats, tutStats, dutStats, hitStats, missStats, allStats, BuildCompressionTiming(config, prefix, name));
             zinfo->compressionRatioStats->push_back(crStats);
             zinfo->evictionStats->push_back(evStats);
             zinfo->tagUtilizationStats->push_back(tutStats);
@@ -535,7 +590,7 @@ BaseCache* BuildCacheBank(Config& config, const string& prefix, g_string& name,
             tagRP->setCC(cc);
 
             cache = new ApproximateIdealDedupBDICache(numLines*tagRatio, numLines, cc, dbtagArray, dbdataArray, dbhashArray, tagRP, dataRP,
-                hashRP, accLat, invLat, mshrs, ways, timingCandidates, domain, name, crStats, evStats, tutStats, dutStats, hitStats, missStats, allStats);
+                hashRP, accLat, invLat, mshrs, ways, timingCandidates, domain, name, crStats, evStats, tutStats, dutStats, hitStats, missStats, allStats, BuildCompressionTiming(config, prefix, name));
             zinfo->compressionRatioStats->push_back(crStats);
             zinfo->evictionStats->push_back(evStats);
             zinfo->tagUtilizationStats->push_back(tutStats);
@@ -559,7 +614,8 @@ BaseCache* BuildCacheBank(Config& config, const string& prefix, g_string& name,
         } else if (type == "Tracing") {
             g_string traceFile = config.get<const char*>(prefix + "traceFile","");
             if (traceFile.empty()) traceFile = g_string(zinfo->outputDir) + "/" + name + ".trace";
-            cache = new TracingCache(numLines, cc, array, rp, accLat, invLat, traceFile, name);
+            bool traceData = config.get<bool>(prefix + "traceData", false);  // needed to trace-drive compressed caches
+            cache = new TracingCache(numLines, cc, array, rp, accLat, invLat, traceFile, traceData, name);
         } else {
             panic("Invalid cache type %s", type.c_str());
         }
@@ -1144,7 +1200,7 @@ void SimInit(const char* configFile, const char* outputDir, uint32_t shmid) {
     zinfo = gm_calloc<GlobSimInfo>();
     zinfo->outputDir = gm_strdup(outputDir);
     zinfo->statsBackends = new g_vector<StatsBackend*>();
-    zinfo->approximateRegions = new g_vector<std::tuple<uint64_t, uint64_t, DataType, DataValue, DataValue>>();
+    zinfo->approximateRegions = new ApproxRegionIndex();
 
     Config config(configFile);
 
@@ -1167,6 +1223,15 @@ void SimInit(const char* configFile, const char* outputDir, uint32_t shmid) {
     zinfo->floatCutSize = config.get<uint32_t>("sim.floatCutSize", 16);
     zinfo->mruListSize = config.get<uint32_t>("sim.mruListSize", 512);
     zinfo->randomLoopTrial = config.get<uint32_t>("sim.randomLoopTrial", 10);
+    zinfo->occupancySamplePhases = config.get<uint32_t>("sim.occupancySamplePhases", 0);
+    zinfo->occupancySampleCycles = config.get<uint32_t>("sim.occupancySampleCycles", 0);
+    if (zinfo->occupancySamplePhases && zinfo->occupancySampleCycles) panic("Set at most one of sim.occupancySamplePhases and sim.occupancySampleCycles");
+    zinfo->compressionMemoEntries = config.get<uint32_t>("sim.compressionMemoEntries", 0);
+    if (zinfo->traceDriven && zinfo->compressionMemoEntries) {
+        warn("Ignoring sim.compressionMemoEntries, trace-driven simulations have no stores to track");
+        zinfo->compressionMemoEntries = 0;
+    }
+    if (zinfo->compressionMemoEntries) zinfo->storeTracker = new StoreTracker(config.get<uint32_t>("sim.storeTrackerLines", 1 << 20));
     zinfo->doubleCutSize = config.get<uint32_t>("sim.doubleCutSize", 32);
     zinfo->hashSize = config.get<uint32_t>("sim.hashSize", 16);
 
@@ -1192,7 +1257,8 @@ void SimInit(const char* configFile, const char* outputDir, uint32_t shmid) {
     uint32_t numSimThreads = config.get<uint32_t>("sim.contentionThreads", MAX((uint32_t)1, zinfo->numDomains/2)); //gives a bit of parallelism, TODO tune
     zinfo->contentionSim = new ContentionSim(zinfo->numDomains, numSimThreads);
     zinfo->contentionSim->initStats(zinfo->rootStat);
-    zinfo->eventRecorders = gm_calloc<EventRecorder*>(zinfo->numCores);
+    // Trace-driven requests use the trace's child ids as source ids, and have no recorders
+    zinfo->eventRecorders = gm_calloc<EventRecorder*>(zinfo->traceDriven? MAX_THREADS : zinfo->numCores);
 
     zinfo->traceWriters = new g_vector<AccessTraceWriter*>();
 
@@ -1269,6 +1335,17 @@ void SimInit(const char* configFile, const char* outputDir, uint32_t shmid) {
     //Caches, cores, memory controllers
     InitSystem(config);
 
+    //Decoded-BBL cache (needs InitSystem to know whether any core decodes to uops)
+    const char* bblCacheFile = config.get<const char*>("sim.bblCacheFile", "");
+    if (strlen(bblCacheFile)) {
+        if (zinfo->oooDecode) {
+            zinfo->bblCache = new DecodedBblCache(bblCacheFile);
+            zinfo->bblCache->initStats(zinfo->rootStat);
+        } else {
+            warn("Ignoring sim.bblCacheFile, no core needs OOO decoding");
+        }
+    }
+
     //Sched stats (deferred because of circular deps)
     if (zinfo->sched) zinfo->sched->initStats(zinfo->rootStat);
 
@@ -151,6 +151,9 @@ struct MemReq {
     };
     uint32_t flags;
 
+    //Contents of the line, if the requester knows them (e.g., replayed from a trace); nullptr otherwise. Does not propagate across levels
+    const void* data;
+
     inline void set(Flag f) {flags |= f;}
     inline bool is (Flag f) const {return flags & f;}
 };
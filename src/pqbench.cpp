@@ -0,0 +1,292 @@
+/** $lic$
+ * Copyright (C) 2012-2015 by Massachusetts Institute of Technology
+ * Copyright (C) 2010-2013 by The Board of Trustees of Stanford University
+ *
+ * This file is part of zsim.
+ *
+ * zsim is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, version 2.
+ *
+ * If you use this software in your research, we request that you reference
+ * the zsim paper ("ZSim: Fast and Accurate Microarchitectural Simulation of
+ * Thousand-Core Systems", Sanchez and Kozyrakis, ISCA-40, June 2013) as the
+ * source of the simulator in any publications that use this software, and that
+ * you send us a citation of your work.
+ *
+ * zsim is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Microbenchmark for the weave phase's event queues (no pin needed). Runs a
+ * hold model like ContentionSim's domain loop: each phase dequeues every
+ * event before the phase limit, and each dequeued event enqueues a successor
+ * some delay later, so the queue keeps a fixed number of events. A fraction of
+ * delays goes beyond the queue's near blocks, like refreshes and long
+ * DelayEvents. Compares PrioQueue against the multimap-based queue it
+ * replaced, after checking step by step that both dequeue the same cycles.
+ */
+
+#include <stdio.h>
+#include <time.h>
+
+#include "g_std/g_multimap.h"
+#include "galloc.h"
+#include "log.h"
+#include "mtrand.h"
+#include "prio_queue.h"
+
+#define PQ_BLOCKS 1024  // as in contention_sim.h
+#define PHASE_LENGTH 10000  // sim.phaseLength default
+#define NUM_DELAYS (1 << 20)
+
+static volatile uint64_t sink;  // keeps results of timed code alive
+
+struct BenchEvent {
+    uint64_t privCycle;
+    BenchEvent* next;
+};
+
+/* The previous PrioQueue, which kept far elements in a multimap and moved
+ * them to the blocks every B/2 blocks.
+ */
+template <typename T, uint32_t B>
+class MapPrioQueue {
+    struct PQBlock {
+        T* array[64];
+        uint64_t occ; // bit i is 1 if array[i] is populated
+
+        PQBlock() {
+            for (uint32_t i = 0; i < 64; i++) array[i] = nullptr;
+            occ = 0;
+        }
+
+        inline T* dequeue(uint32_t& offset) {
+            assert(occ);
+            uint32_t pos = __builtin_ctzl(occ);
+            T* res = array[pos];
+            T* next = res->next;
+            array[pos] = next;
+            if (!next) occ ^= 1L << pos;
+            assert(res);
+            offset = pos;
+            res->next = nullptr;
+            return res;
+        }
+
+        inline void enqueue(T* obj, uint32_t pos) {
+            occ |= 1L << pos;
+            assert(!obj->next);
+            obj->next = array[pos];
+            array[pos] = obj;
+        }
+    };
+
+    PQBlock blocks[B];
+
+    typedef g_multimap<uint64_t, T*> FEMap; //far element map
+    typedef typename FEMap::iterator FEMapIterator;
+
+    FEMap feMap;
+
+    uint64_t curBlock;
+    uint64_t elems;
+
+    public:
+        MapPrioQueue() {
+            curBlock = 0;
+            elems = 0;
+        }
+
+        void enqueue(T* obj, uint64_t cycle) {
+            uint64_t absBlock = cycle/64;
+            assert(absBlock >= curBlock);
+
+            if (absBlock < curBlock + B) {
+                uint32_t i = absBlock % B;
+                uint32_t offset = cycle % 64;
+                blocks[i].enqueue(obj, offset);
+            } else {
+                feMap.insert(std::pair<uint64_t, T*>(cycle, obj));
+            }
+            elems++;
+        }
+
+        T* dequeue(uint64_t& deqCycle) {
+            assert(elems);
+            while (!blocks[curBlock % B].occ) {
+                curBlock++;
+                if ((curBlock % (B/2)) == 0 && !feMap.empty()) {
+                    uint64_t topCycle = (curBlock + B)*64;
+                    //Move every element with cycle < topCycle to blocks[]
+                    FEMapIterator it = feMap.begin();
+                    while (it != feMap.end() && it->first < topCycle) {
+                        uint64_t cycle = it->first;
+                        T* obj = it->second;
+
+                        uint64_t absBlock = cycle/64;
+                        assert(absBlock >= curBlock);
+                        assert(absBlock < curBlock + B);
+                        uint32_t i = absBlock % B;
+                        uint32_t offset = cycle % 64;
+                        blocks[i].enqueue(obj, offset);
+                        it++;
+                    }
+                    feMap.erase(feMap.begin(), it);
+                }
+            }
+
+            //We're now at the first populated block
+            uint32_t offset;
+            T* obj = blocks[curBlock % B].dequeue(offset);
+            elems--;
+
+            deqCycle = curBlock*64 + offset;
+            return obj;
+        }
+
+        inline uint64_t size() const {
+            return elems;
+        }
+
+        inline uint64_t firstCycle() const {
+            assert(elems);
+            for (uint32_t i = 0; i < B/2; i++) {
+                uint64_t occ = blocks[(curBlock + i) % B].occ;
+                if (occ) {
+                    uint64_t pos = __builtin_ctzl(occ);
+                    return (curBlock + i)*64 + pos;
+                }
+            }
+            for (uint32_t i = B/2; i < B; i++) { //beyond B/2 blocks, there may be a far element that comes earlier
+                uint64_t occ = blocks[(curBlock + i) % B].occ;
+                if (occ) {
+                    uint64_t pos = __builtin_ctzl(occ);
+                    uint64_t cycle = (curBlock + i)*64 + pos;
+                    return feMap.empty()? cycle : MIN(cycle, feMap.begin()->first);
+                }
+            }
+
+            return feMap.begin()->first;
+        }
+};
+
+static inline uint64_t getNs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec*1000000000ul + ts.tv_nsec;
+}
+
+// Delays are drawn up front, so both queues see the same sequence and the timed loop does not include the RNG
+static void genDelays(uint32_t* delays, double farFrac, MTRand& rng) {
+    const uint32_t nearCycles = PQ_BLOCKS*64;
+    for (uint32_t i = 0; i < NUM_DELAYS; i++) {
+        if (rng.randExc() < farFrac) delays[i] = nearCycles + rng.randInt(7*nearCycles);
+        else delays[i] = 1 + rng.randInt(399);  // cache and memory latencies
+    }
+}
+
+// Returns ns/event
+template <typename PQ>
+static double runHold(uint32_t numEvents, uint64_t numOps, const uint32_t* delays) {
+    PQ* pq = new (gm_malloc<PQ>()) PQ();
+    BenchEvent* events = gm_calloc<BenchEvent>(numEvents);
+    for (uint32_t i = 0; i < numEvents; i++) pq->enqueue(&events[i], delays[i] % PHASE_LENGTH);
+
+    uint64_t ops = 0;
+    uint64_t limit = 0;
+    uint64_t acc = 0;
+    uint64_t start = getNs();
+    while (ops < numOps) {
+        limit += PHASE_LENGTH;
+        while (pq->size() && pq->firstCycle() < limit) {
+            uint64_t cycle;
+            BenchEvent* ev = pq->dequeue(cycle);
+            acc += (uint64_t) ev;
+            pq->enqueue(ev, cycle + delays[ops % NUM_DELAYS]);
+            ops++;
+        }
+    }
+    uint64_t ns = getNs() - start;
+
+    sink += acc;
+    pq->~PQ();
+    gm_free(pq);
+    gm_free(events);
+    return ((double) ns)/ops;
+}
+
+/* Runs the hold model on both queues in lockstep, untimed, and panics on the
+ * first step where their first or dequeued cycles differ. Events dequeued in
+ * the same cycle may come out in different orders, but they get the same
+ * delays, so the cycle sequences must match exactly.
+ */
+template <typename PQ, typename RefPQ>
+static void checkHold(uint32_t numEvents, uint64_t numOps, const uint32_t* delays) {
+    PQ* pq = new (gm_malloc<PQ>()) PQ();
+    RefPQ* ref = new (gm_malloc<RefPQ>()) RefPQ();
+    BenchEvent* events = gm_calloc<BenchEvent>(2*numEvents);
+    for (uint32_t i = 0; i < numEvents; i++) {
+        pq->enqueue(&events[i], delays[i] % PHASE_LENGTH);
+        ref->enqueue(&events[numEvents + i], delays[i] % PHASE_LENGTH);
+    }
+
+    uint64_t ops = 0;
+    uint64_t limit = 0;
+    while (ops < numOps) {
+        limit += PHASE_LENGTH;
+        while (ref->size() && ref->firstCycle() < limit) {
+            if (pq->size() != ref->size() || pq->firstCycle() != ref->firstCycle()) {
+                panic("Step %ld: first cycle %ld, expected %ld (%ld/%ld events)", ops, pq->firstCycle(), ref->firstCycle(), pq->size(), ref->size());
+            }
+            uint64_t cycle, refCycle;
+            BenchEvent* ev = pq->dequeue(cycle);
+            BenchEvent* refEv = ref->dequeue(refCycle);
+            if (cycle != refCycle) panic("Step %ld: dequeued cycle %ld, expected %ld", ops, cycle, refCycle);
+            pq->enqueue(ev, cycle + delays[ops % NUM_DELAYS]);
+            ref->enqueue(refEv, refCycle + delays[ops % NUM_DELAYS]);
+            ops++;
+        }
+    }
+
+    pq->~PQ();
+    ref->~RefPQ();
+    gm_free(pq);
+    gm_free(ref);
+    gm_free(events);
+}
+
+int main(int argc, const char* argv[]) {
+    InitLog("");  // no log header
+    if (argc > 2) {
+        info("Microbenchmark for the weave phase's event queues");
+        info("Usage: %s [events]", argv[0]);
+        exit(1);
+    }
+    uint64_t numOps = (argc > 1)? strtoul(argv[1], nullptr, 0) : 16*1024*1024;
+
+    gm_init(1ul << 28);
+    uint32_t* delays = gm_calloc<uint32_t>(NUM_DELAYS);
+    MTRand rng(0x5AFEC0DE);
+
+    const uint32_t queueSizes[] = {16, 256, 4096};
+    const double farFracs[] = {0.0, 0.001, 0.01, 0.1};
+
+    info("Weave-phase event queues (%d blocks, %d-cycle phases), ns/event", PQ_BLOCKS, PHASE_LENGTH);
+    info("%8s %8s %10s %10s %8s", "Events", "Far", "PrioQueue", "Multimap", "Speedup");
+    for (double farFrac : farFracs) {
+        genDelays(delays, farFrac, rng);
+        for (uint32_t numEvents : queueSizes) {
+            checkHold<PrioQueue<BenchEvent, PQ_BLOCKS>, MapPrioQueue<BenchEvent, PQ_BLOCKS>>(numEvents, numOps, delays);
+            double ns = runHold<PrioQueue<BenchEvent, PQ_BLOCKS>>(numEvents, numOps, delays);
+            double mapNs = runHold<MapPrioQueue<BenchEvent, PQ_BLOCKS>>(numEvents, numOps, delays);
+            info("%8d %8.3f %10.2f %10.2f %7.2fx", numEvents, farFrac, ns, mapNs, mapNs/ns);
+        }
+    }
+    return 0;
+}
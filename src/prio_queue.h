@@ -26,10 +26,29 @@
 #ifndef PRIO_QUEUE_H_
 #define PRIO_QUEUE_H_
 
-#include "g_std/g_multimap.h"
-
+#include <stdint.h>
+#include "bithacks.h"
+#include "log.h"
+
+/* Monotone priority queue of intrusive elements (T::next links them).
+ * Elements less than B blocks of 64 cycles ahead live in a circular array of
+ * blocks, one list per cycle plus an occupancy bitmap per block; a second
+ * level of bitmaps tracks populated blocks, so finding the next element skips
+ * empty blocks 64 at a time.
+ *
+ * Farther elements (e.g., refreshes or long delays) live in a radix heap over
+ * their cycles, stored in T::privCycle: far bucket i holds the elements whose
+ * cycle first differs from farRef at bit i. farRef is below every far element,
+ * so lower buckets hold earlier elements, and each bucket tracks its minimum.
+ * As the blocks advance, the lowest bucket is redistributed relative to its
+ * minimum, which moves every element in it to the blocks or to a lower bucket.
+ * Thus enqueues are O(1), each far element is moved at most 64 times over the
+ * whole 64-bit cycle range, and nothing is allocated.
+ */
 template <typename T, uint32_t B>
 class PrioQueue {
+    static_assert(B % 64 == 0, "PrioQueue blocks must be a multiple of 64");
+
     struct PQBlock {
         T* array[64];
         uint64_t occ; // bit i is 1 if array[i] is populated
@@ -61,19 +80,26 @@ class PrioQueue {
     };
 
     PQBlock blocks[B];
+    uint64_t blockOcc[B/64];  // bit i%64 of word i/64 is 1 if blocks[i] is populated
 
-    typedef g_multimap<uint64_t, T*> FEMap; //far element map
-    typedef typename FEMap::iterator FEMapIterator;
-
-    FEMap feMap;
+    T* far[64];
+    uint64_t farMins[64];  // earliest cycle in each far bucket
+    uint64_t farOcc;  // bit i is 1 if far[i] is populated
+    uint64_t farRef;
 
     uint64_t curBlock;
     uint64_t elems;
+    uint64_t farElems;
 
     public:
         PrioQueue() {
+            for (uint32_t i = 0; i < B/64; i++) blockOcc[i] = 0;
+            for (uint32_t i = 0; i < 64; i++) far[i] = nullptr;
+            farOcc = 0;
+            farRef = 0;
             curBlock = 0;
             elems = 0;
+            farElems = 0;
         }
 
         void enqueue(T* obj, uint64_t cycle) {
@@ -81,43 +107,29 @@ class PrioQueue {
             assert(absBlock >= curBlock);
 
             if (absBlock < curBlock + B) {
-                uint32_t i = absBlock % B;
-                uint32_t offset = cycle % 64;
-                blocks[i].enqueue(obj, offset);
+                nearEnqueue(obj, cycle);
             } else {
                 //info("XXX far enq() %ld", cycle);
-                feMap.insert(std::pair<uint64_t, T*>(cycle, obj));
+                farEnqueue(obj, cycle);
+                farElems++;
             }
             elems++;
         }
 
         T* dequeue(uint64_t& deqCycle) {
             assert(elems);
-            while (!blocks[curBlock % B].occ) {
-                curBlock++;
-                if ((curBlock % (B/2)) == 0 && !feMap.empty()) {
-                    uint64_t topCycle = (curBlock + B)*64;
-                    //Move every element with cycle < topCycle to blocks[]
-                    FEMapIterator it = feMap.begin();
-                    while (it != feMap.end() && it->first < topCycle) {
-                        uint64_t cycle = it->first;
-                        T* obj = it->second;
-
-                        uint64_t absBlock = cycle/64;
-                        assert(absBlock >= curBlock);
-                        assert(absBlock < curBlock + B);
-                        uint32_t i = absBlock % B;
-                        uint32_t offset = cycle % 64;
-                        blocks[i].enqueue(obj, offset);
-                        it++;
-                    }
-                    feMap.erase(feMap.begin(), it);
-                }
+            if (!blocks[curBlock % B].occ) {
+                //Advance to the first populated block, or if there is none, to
+                //the first far element's block; far elements are always beyond blocks[]
+                curBlock = (elems == farElems)? farMin()/64 : firstBlock();
+                if (farElems && farMin() < (curBlock + B)*64) refill();
             }
 
             //We're now at the first populated block
+            uint32_t i = curBlock % B;
             uint32_t offset;
-            T* obj = blocks[curBlock % B].dequeue(offset);
+            T* obj = blocks[i].dequeue(offset);
+            if (!blocks[i].occ) blockOcc[i/64] ^= 1ul << (i % 64);
             elems--;
 
             deqCycle = curBlock*64 + offset;
@@ -130,23 +142,80 @@ class PrioQueue {
 
         inline uint64_t firstCycle() const {
             assert(elems);
-            for (uint32_t i = 0; i < B/2; i++) {
-                uint64_t occ = blocks[(curBlock + i) % B].occ;
-                if (occ) {
-                    uint64_t pos = __builtin_ctzl(occ);
-                    return (curBlock + i)*64 + pos;
+            //Far elements are always beyond blocks[], so only check them if blocks[] is empty
+            if (elems == farElems) return farMin();
+            uint64_t occ = blocks[curBlock % B].occ;
+            if (occ) return curBlock*64 + __builtin_ctzl(occ);
+            uint64_t block = firstBlock();
+            return block*64 + __builtin_ctzl(blocks[block % B].occ);
+        }
+
+    private:
+        inline void nearEnqueue(T* obj, uint64_t cycle) {
+            uint32_t i = (cycle/64) % B;
+            blocks[i].enqueue(obj, cycle % 64);
+            blockOcc[i/64] |= 1ul << (i % 64);
+        }
+
+        //Absolute index of the first populated block at or after curBlock; blocks[] must not be empty
+        inline uint64_t firstBlock() const {
+            uint32_t start = curBlock % B;
+            uint32_t w = start/64;
+            uint64_t word = blockOcc[w] & (~0ul << (start % 64));
+            for (uint32_t i = 0; i <= B/64; i++) {  //the last iteration wraps around to the start's word
+                if (word) {
+                    uint32_t pos = w*64 + __builtin_ctzl(word);
+                    return curBlock + (pos + B - start) % B;
                 }
+                w = (w + 1) % (B/64);
+                word = blockOcc[w];
             }
-            for (uint32_t i = B/2; i < B; i++) { //beyond B/2 blocks, there may be a far element that comes earlier
-                uint64_t occ = blocks[(curBlock + i) % B].occ;
-                if (occ) {
-                    uint64_t pos = __builtin_ctzl(occ);
-                    uint64_t cycle = (curBlock + i)*64 + pos;
-                    return feMap.empty()? cycle : MIN(cycle, feMap.begin()->first);
+            panic("PrioQueue: %ld elements, but no populated blocks", elems - farElems);
+        }
+
+        inline uint64_t farMin() const {
+            assert(farOcc);
+            return farMins[__builtin_ctzl(farOcc)];
+        }
+
+        inline void farEnqueue(T* obj, uint64_t cycle) {
+            assert(cycle > farRef);
+            uint32_t b = 63 - __builtin_clzl(cycle ^ farRef);
+            assert(!obj->next);
+            obj->privCycle = cycle;
+            obj->next = far[b];
+            far[b] = obj;
+            uint64_t bit = 1ul << b;
+            farMins[b] = (farOcc & bit)? MIN(farMins[b], cycle) : cycle;
+            farOcc |= bit;
+        }
+
+        //Moves every far element within B blocks of curBlock to blocks[]
+        void refill() {
+            uint64_t topCycle = (curBlock + B)*64;
+            while (farOcc) {
+                uint32_t b = __builtin_ctzl(farOcc);
+                if (farMins[b] >= topCycle) break;
+
+                //Rebase on the lowest bucket's minimum; since every element in
+                //the bucket shares its bits down to b, they all move lower
+                farRef = farMins[b];
+                T* obj = far[b];
+                far[b] = nullptr;
+                farOcc ^= 1ul << b;
+                while (obj) {
+                    T* next = obj->next;
+                    obj->next = nullptr;
+                    uint64_t cycle = obj->privCycle;
+                    if (cycle < topCycle) {
+                        nearEnqueue(obj, cycle);
+                        farElems--;
+                    } else {
+                        farEnqueue(obj, cycle);
+                    }
+                    obj = next;
                 }
             }
-
-            return feMap.begin()->first;
         }
 };
 
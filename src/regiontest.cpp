@@ -0,0 +1,211 @@
+/** $lic$
+ * Copyright (C) 2012-2015 by Massachusetts Institute of Technology
+ * Copyright (C) 2010-2013 by The Board of Trustees of Stanford University
+ *
+ * This file is part of zsim.
+ *
+ * zsim is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, version 2.
+ *
+ * If you use this software in your research, we request that you reference
+ * the zsim paper ("ZSim: Fast and Accurate Microarchitectural Simulation of
+ * Thousand-Core Systems", Sanchez and Kozyrakis, ISCA-40, June 2013) as the
+ * source of the simulator in any publications that use this software, and that
+ * you send us a citation of your work.
+ *
+ * zsim is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Test for ApproxRegionIndex that does not need pin. Checks lookups against a
+ * linear scan of the registered regions, both on hand-built overlapping and
+ * nested regions, where it also checks that the earliest-registered region
+ * wins, and on random sequences of adds, resizes and removes in a small
+ * address space, so that regions overlap and nest often. Each region is
+ * tagged with its registration number in its min value. Panics on the first
+ * mismatch. Runs are deterministic (fixed seed).
+ */
+
+#include <stdio.h>
+#include <vector>
+
+#include "approx_regions.h"
+#include "galloc.h"
+#include "log.h"
+#include "mtrand.h"
+
+#define NUM_RANDOM_RUNS 64
+#define OPS_PER_RUN 512
+#define LOOKUPS_PER_OP 64
+
+struct RefRegion {
+    uint64_t start;
+    uint64_t end;
+    uint64_t tag;
+};
+
+// Regions in registration order, as the index saw them
+static std::vector<RefRegion> refRegions;
+static uint64_t nextTag;
+static uint64_t numLookups;
+
+static void add(ApproxRegionIndex* index, uint64_t start, uint64_t end) {
+    DataValue min, max;
+    min.UINT64 = nextTag;
+    max.UINT64 = 0;
+    index->add(start, end, ZSIM_UINT64, min, max);
+    refRegions.push_back({start, end, nextTag++});
+}
+
+static bool resize(ApproxRegionIndex* index, uint64_t start, uint64_t newEnd) {
+    bool res = index->resize(start, newEnd);
+    for (RefRegion& r : refRegions) {
+        if (r.start == start) {
+            r.end = newEnd;
+            if (!res) panic("resize(0x%lx) missed region %ld", start, r.tag);
+            return true;
+        }
+    }
+    if (res) panic("resize(0x%lx) found no region", start);
+    return false;
+}
+
+static bool remove(ApproxRegionIndex* index, uint64_t start) {
+    bool res = index->remove(start);
+    for (auto it = refRegions.begin(); it != refRegions.end(); it++) {
+        if (it->start == start) {
+            if (!res) panic("remove(0x%lx) missed region %ld", start, it->tag);
+            refRegions.erase(it);
+            return true;
+        }
+    }
+    if (res) panic("remove(0x%lx) found no region", start);
+    return false;
+}
+
+// Checks one lookup against the linear scan; returns the tag of the region found, or -1
+static int64_t check(ApproxRegionIndex* index, uint64_t start, uint64_t end) {
+    int64_t expected = -1;
+    for (const RefRegion& r : refRegions) {
+        if (r.start <= start && r.end >= end) {
+            expected = r.tag;
+            break;
+        }
+    }
+    DataType type;
+    DataValue min;
+    int64_t found = index->lookup(start, end, &type, &min, NULL)? (int64_t)min.UINT64 : -1;
+    if (found != expected) panic("lookup(0x%lx, 0x%lx) found region %ld, expected %ld", start, end, found, expected);
+    numLookups++;
+    return found;
+}
+
+static void expect(ApproxRegionIndex* index, uint64_t start, uint64_t end, int64_t tag) {
+    int64_t found = check(index, start, end);
+    if (found != tag) panic("lookup(0x%lx, 0x%lx) found region %ld, the test expected %ld", start, end, found, tag);
+}
+
+static void checkOverlapping() {
+    ApproxRegionIndex* index = new ApproxRegionIndex();
+    refRegions.clear();
+    nextTag = 0;
+
+    add(index, 0x1000, 0x8fff);   // 0: large, registered first
+    add(index, 0x2000, 0x2fff);   // 1: nested in 0
+    add(index, 0x2000, 0x3fff);   // 2: nested in 0, same start as 1
+    add(index, 0x2800, 0x28ff);   // 3: nested in 1 and 2
+    add(index, 0x8000, 0x9fff);   // 4: overlaps the end of 0
+    add(index, 0xa000, 0xafff);   // 5: disjoint
+
+    // The earliest-registered containing region wins, however deeply nested
+    expect(index, 0x1000, 0x103f, 0);
+    expect(index, 0x2000, 0x203f, 0);
+    expect(index, 0x2800, 0x283f, 0);
+    expect(index, 0x8f00, 0x8f3f, 0);
+    expect(index, 0x8fc0, 0x903f, 4);  // crosses the end of 0
+    expect(index, 0x9000, 0x903f, 4);
+    expect(index, 0xa000, 0xa03f, 5);
+    expect(index, 0x9fc0, 0xa03f, -1);  // spans two adjacent regions, neither contains it
+    expect(index, 0x0fc0, 0x103f, -1);
+    expect(index, 0xb000, 0xb03f, -1);
+
+    // Without 0, the nested regions show through, still in registration order
+    remove(index, 0x1000);
+    expect(index, 0x2000, 0x203f, 1);
+    expect(index, 0x2800, 0x283f, 1);
+    expect(index, 0x2fc0, 0x303f, 2);  // crosses the end of 1
+    expect(index, 0x3000, 0x303f, 2);
+    expect(index, 0x5000, 0x503f, -1);
+
+    // remove() and resize() act on the earliest region with that start
+    resize(index, 0x2000, 0x1fff + 0x100);
+    expect(index, 0x2000, 0x203f, 1);
+    expect(index, 0x2100, 0x213f, 2);
+    remove(index, 0x2000);
+    expect(index, 0x2000, 0x203f, 2);
+    expect(index, 0x2800, 0x283f, 2);
+    remove(index, 0x2000);
+    expect(index, 0x2800, 0x283f, 3);
+    expect(index, 0x2000, 0x203f, -1);
+
+    // A region running to the end of the address space
+    add(index, 0xfffffffffffff000ull, ~0ull);  // 6
+    expect(index, 0xffffffffffffffc0ull, ~0ull, 6);
+
+    info("Overlapping and nested regions: OK");
+}
+
+static void checkRandom(MTRand& rng) {
+    for (uint32_t run = 0; run < NUM_RANDOM_RUNS; run++) {
+        ApproxRegionIndex* index = new ApproxRegionIndex();
+        refRegions.clear();
+        nextTag = 0;
+        // Region and lookup bounds on a 16-byte grid over 64KB, so that regions often share starts and ends
+        const uint64_t space = 1 << 16;
+        for (uint32_t op = 0; op < OPS_PER_RUN; op++) {
+            uint32_t kind = rng.randInt(9);
+            uint64_t start = (rng.randInt(space/16 - 1))*16;
+            if (kind < 5 || refRegions.empty()) {
+                // Mostly short regions, some spanning a large part of the space
+                uint64_t len = (rng.randInt(7) == 0)? rng.randInt(space - 1) : rng.randInt(1023);
+                add(index, start, start + len);
+            } else if (kind < 7) {
+                const RefRegion& r = refRegions[rng.randInt(refRegions.size() - 1)];
+                resize(index, r.start, r.start + rng.randInt(4095));
+            } else if (kind < 9) {
+                remove(index, refRegions[rng.randInt(refRegions.size() - 1)].start);
+            } else {
+                remove(index, start);  // usually not a region start
+            }
+            for (uint32_t l = 0; l < LOOKUPS_PER_OP; l++) {
+                uint64_t addr = rng.randInt(space + 1023);
+                check(index, addr, addr + rng.randInt(127));
+            }
+            if (index->size() != refRegions.size()) panic("size() %d, expected %ld", index->size(), refRegions.size());
+        }
+        index->reclaim();
+    }
+    info("Random regions: OK");
+}
+
+int main(int argc, const char* argv[]) {
+    InitLog("");  // no log header
+    if (argc > 1) {
+        info("Checks ApproxRegionIndex lookups against a linear scan; takes no arguments");
+        exit(1);
+    }
+
+    gm_init(1ul << 26);
+
+    MTRand rng(0xA99C0DE);
+    checkOverlapping();
+    checkRandom(rng);
+    info("ApproxRegionIndex matches the linear scan on %ld lookups", numLookups);
+    return 0;
+}
@@ -98,8 +98,12 @@ class SlabAlloc {
         uint32_t liveSlabs;
         mutex freeLock;  // used because slab frees may be concurrent
 
+        // Only in discarding allocators: full slabs, reclaimed by discardAll()
+        const bool discarding;
+        g_vector<Slab*> fullSlabs;
+
     public:
-        SlabAlloc() : curSlab(nullptr), liveSlabs(0) {
+        explicit SlabAlloc(bool _discarding = false) : curSlab(nullptr), liveSlabs(0), discarding(_discarding) {
             allocSlab();
         }
 
@@ -117,9 +121,25 @@ class SlabAlloc {
 
         template <typename T> T* alloc() { return (T*)alloc(sizeof(T)); }
 
+        // Reclaims every slab, dropping the objects in them without freeing them one by one.
+        // Only for discarding allocators, whose objects are never freed (e.g., events that never run)
+        void discardAll() {
+            assert(discarding);
+            scoped_mutex sm(freeLock);
+            for (Slab* s : fullSlabs) {
+                s->clear();
+                freeList.push_back(s);
+                liveSlabs--;
+            }
+            fullSlabs.clear();
+            curSlab->clear();
+            assert(liveSlabs == 1);
+        }
+
     private:
         void allocSlab() {
             scoped_mutex sm(freeLock);
+            if (discarding && curSlab) fullSlabs.push_back(curSlab);
             if (!freeList.empty()) {
                 curSlab = freeList.back();
                 freeList.pop_back();
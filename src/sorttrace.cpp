@@ -28,6 +28,9 @@
  * out. This may consume large amounts of memory if traces are largely
  * imbalanced. A simple way to fix this would be to dump N separate traces,
  * then join them together --- that's more I/O though.
+ *
+ * Region updates are kept in cycle order too: each is written before the
+ * first sorted access with a later cycle.
  */
 
 #include <deque>
@@ -52,14 +55,15 @@ int main(int argc, const char* argv[]) {
         exit(1);
     }
 
-    gm_init(32<<20 /*32 MB --- should be enough*/);
+    gm_init(1<<30 /*1 GB --- traces with data keep their distinct lines in memory*/);
 
     AccessTraceReader* tr = new AccessTraceReader(argv[1]);
     uint32_t numChildren = tr->getNumChildren();
-    AccessTraceWriter* tw = new AccessTraceWriter(argv[2], numChildren);
+    AccessTraceWriter* tw = new AccessTraceWriter(argv[2], numChildren, tr->getLineSize());
 
     deque<AccessRecord>* accs[numChildren];  // null if the child has no accesses
     for (uint32_t i = 0; i < numChildren; i++) accs[i] = nullptr;
+    deque<PackedRegionRecord> regions;  // read, not yet written
     priority_queue< pair<int64_t, uint32_t> > heads; //(negative cycle, child); we use negative cycles because priority_queue sorts from largest to smallest
     uint64_t readRecords  = 0;
     uint64_t writtenRecords  = 0;
@@ -69,6 +73,7 @@ int main(int argc, const char* argv[]) {
     while (!tr->empty() || heads.size() > 0) {
         if (!tr->empty() && heads.size() < numChildren) { //Read trace until all heads are filled
             for (uint32_t i = 0; i < 1024; i++) { //For performance, read at least a few accesses
+                while (tr->regionDue()) regions.push_back(tr->readRegion());
                 AccessRecord acc = tr->read();
                 readRecords++;
                 if ((readRecords % 1024) == 0) printProgress(readRecords, writtenRecords, totalRecords);
@@ -92,6 +97,10 @@ int main(int argc, const char* argv[]) {
             assert(!accs[child]->empty());
             AccessRecord acc = accs[child]->front();
             accs[child]->pop_front();
+            while (!regions.empty() && regions.front().cycle <= acc.reqCycle) {
+                tw->writeRegion(regions.front());
+                regions.pop_front();
+            }
             tw->write(acc);
             writtenRecords++;
             if ((writtenRecords % 1024) == 0) printProgress(readRecords, writtenRecords, totalRecords);
@@ -104,6 +113,8 @@ int main(int argc, const char* argv[]) {
             }
         }
     }
+    while (tr->regionDue()) regions.push_back(tr->readRegion());  // updates after the last access
+    for (const PackedRegionRecord& reg : regions) tw->writeRegion(reg);
     printProgress(readRecords, writtenRecords, totalRecords);
     printf("\n");
     assert(readRecords == writtenRecords);
@@ -441,7 +441,7 @@ class RunningStats {
         double getMean() const throw();
         double getStdDev() const throw();
         void combineWith(const RunningStats &otherStats) throw();
-        inline unsigned long long sampleCount()  { return numSamples; }
+        inline unsigned long long sampleCount() const { return numSamples; }
         void dump();
         void dumpFile(std::ofstream* file);
     private:
@@ -454,4 +454,46 @@ class RunningStats {
         g_string name;
 };
 
+/* Exports a RunningStats to the stats backends, as a vector of its sample
+ * count and its min, mean, max and standard deviation. Backends only take
+ * integers, so the latter four are fixed-point, in thousandths (non-finite
+ * values saturate, and an empty RunningStats reads as all zeros).
+ */
+class RunningStatsStat : public VectorStat {
+    private:
+        const RunningStats* rs;
+
+        static uint64_t fixedPoint(double v) {
+            if (!(v > 0)) return 0;  // also catches NaN
+            return (v < 1.8e16)? (uint64_t)(v*1000.0) : (uint64_t)-1L;
+        }
+
+    public:
+        RunningStatsStat() : VectorStat(), rs(nullptr) {}
+
+        void init(const char* name, const char* desc, const RunningStats* _rs) {
+            static const char* names[] = {"samples", "min", "mean", "max", "stdDev"};
+            initStat(name, desc);
+            rs = _rs;
+            _counterNames = names;
+        }
+
+        uint64_t count(uint32_t idx) const {
+            assert(rs);
+            if (!rs->sampleCount()) return 0;
+            switch (idx) {
+                case 0: return rs->sampleCount();
+                case 1: return fixedPoint(rs->getMin());
+                case 2: return fixedPoint(rs->getMean());
+                case 3: return fixedPoint(rs->getMax());
+                case 4: return fixedPoint(rs->getStdDev());
+                default: panic("RunningStatsStat: invalid index %d", idx);
+            }
+        }
+
+        uint32_t size() const {
+            return 5;
+        }
+};
+
 #endif  // STATS_H_
@@ -66,7 +66,7 @@ class CrossingEvent;
 
 class TimingEvent {
     private:
-        uint64_t privCycle; //only touched by ContentionSim
+        uint64_t privCycle; //only touched by ContentionSim and PrioQueue
 
     public:
         TimingEvent* next; //used by PrioQueue --- PRIVATE
@@ -282,6 +282,7 @@ class TimingEvent {
 
 
     friend class ContentionSim;
+    template <typename T, uint32_t B> friend class PrioQueue; //keeps far events' cycles in privCycle
     friend class DelayEvent; //DelayEvent is, for now, the only child of TimingEvent that should do anything other than implement simulate
     friend class CrossingEvent;
 };
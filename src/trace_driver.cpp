@@ -24,15 +24,22 @@
  */
 
 #include <sstream>
+#include "approx_regions.h"
 #include "trace_driver.h"
 #include "zsim.h"
 
 TraceDriver::TraceDriver(std::string filename, std::string retraceFilename, std::vector<TraceDriverProxyCache*>& proxies, bool _useSkews, bool _playPuts, bool _playAllGets)
-    : tr(filename), numChildren(proxies.size()), useSkews(_useSkews), playPuts(_playPuts), playAllGets(_playAllGets)
+    : tr(filename, SpawnInternalThread), numChildren(proxies.size()), useSkews(_useSkews), playPuts(_playPuts), playAllGets(_playAllGets)
 {
     assert(numChildren > 0);
     assert(!useSkews || numChildren == 1);
     if (tr.getNumChildren() != numChildren) panic("Number of proxy caches (%d) does not match with streams in the trace file (%d)", numChildren, tr.getNumChildren());
+    if (numChildren > MAX_THREADS) panic("Trace has %d streams, at most %d are supported", numChildren, MAX_THREADS);
+    if (tr.getLineSize() && tr.getLineSize() != zinfo->lineSize) panic("Trace line size (%d) does not match sys.lineSize (%d)", tr.getLineSize(), zinfo->lineSize);
+    if (!tr.getLineSize()) info("Trace %s has no data, caches that need the lines' contents will see zeros", filename.c_str());
+    if (zinfo->numRegionCaches && !tr.hasRegions()) {
+        panic("Trace %s has no approximate-region records, but %d caches classify lines by region; record the trace again", filename.c_str(), zinfo->numRegionCaches);
+    }
     children = new ChildInfo[numChildren];
     futex_init(&lock);
     lastAcc.childId = -1;
@@ -41,7 +48,7 @@ TraceDriver::TraceDriver(std::string filename, std::string retraceFilename, std:
 
     if (retraceFilename != "") { //we're doing retracing with the new skews
         g_string fname(retraceFilename.c_str());
-        atw = new AccessTraceWriter(fname, numChildren);
+        atw = new AccessTraceWriter(fname, numChildren, tr.getLineSize(), SpawnInternalThread);
         zinfo->traceWriters->push_back(atw);
     } else {
         atw = nullptr;
@@ -102,8 +109,7 @@ bool TraceDriver::executePhase() {
     AccessRecord acc;
     if (lastAcc.childId == (uint32_t)-1) {
         if (tr.empty()) return false;
-        acc = tr.read();
-        if (useSkews) acc.reqCycle += children[acc.childId].skew;
+        acc = readAccess();
     } else {
         acc = lastAcc;
         lastAcc.childId = (uint32_t)-1;
@@ -113,14 +119,38 @@ bool TraceDriver::executePhase() {
     while (acc.reqCycle < limit) {
         executeAccess(acc);
         if (tr.empty()) return false;
-        acc = tr.read();
-        if (useSkews) acc.reqCycle += children[acc.childId].skew;
+        acc = readAccess();
     }
 
     lastAcc = acc; //save this access for the next phase
     return true;
 }
 
+// Reads the next access, first applying the region updates recorded before it (all earlier accesses have executed)
+AccessRecord TraceDriver::readAccess() {
+    while (tr.regionDue()) applyRegion(tr.readRegion());
+    AccessRecord acc = tr.read();
+    if (useSkews) acc.reqCycle += children[acc.childId].skew;
+    return acc;
+}
+
+void TraceDriver::applyRegion(const PackedRegionRecord& reg) {
+    switch (reg.op) {
+        case REGION_ADD:
+            zinfo->approximateRegions->add(reg.start, reg.end, (DataType) reg.type, reg.min, reg.max);
+            break;
+        case REGION_RESIZE:
+            zinfo->approximateRegions->resize(reg.start, reg.end);
+            break;
+        case REGION_REMOVE:
+            zinfo->approximateRegions->remove(reg.start);
+            break;
+        default:
+            panic("Unknown region update %d, trace is probably corrupted", reg.op);
+    }
+    if (atw) atw->writeRegion(reg);
+}
+
 void TraceDriver::executeAccess(AccessRecord acc) {
     assert(acc.childId < numChildren);
     std::unordered_map<Address, MESIState>& cStore = children[acc.childId].cStore;
@@ -133,7 +163,7 @@ void TraceDriver::executeAccess(AccessRecord acc) {
                 if (!playPuts) return;
                 std::unordered_map<Address, MESIState>::iterator it = cStore.find(acc.lineAddr);
                 if (it == cStore.end()) return; //we don't currently have this line, skip
-                MemReq req = {acc.lineAddr, acc.type, acc.childId, &it->second, acc.reqCycle, nullptr, it->second, acc.childId};
+                MemReq req = {acc.lineAddr, acc.type, acc.childId, &it->second, acc.reqCycle, nullptr, it->second, acc.childId, 0, acc.data};
                 lat = parent->access(req) - acc.reqCycle; //note that PUT latency does not affect driver latency
                 assert(it->second == I);
                 cStore.erase(it);
@@ -147,7 +177,7 @@ void TraceDriver::executeAccess(AccessRecord acc) {
                 if (it != cStore.end()) {
                     if (!((it->second == S) && (acc.type == GETX))) { //we have the line, and it's not an upgrade miss, we can't replay this access directly
                         if (playAllGets) { //issue a PUT
-                            MemReq req = {acc.lineAddr, (it->second == M)? PUTX : PUTS, acc.childId, &it->second, acc.reqCycle, nullptr, it->second, acc.childId};
+                            MemReq req = {acc.lineAddr, (it->second == M)? PUTX : PUTS, acc.childId, &it->second, acc.reqCycle, nullptr, it->second, acc.childId, 0, acc.data};
                             parent->access(req);
                             assert(it->second == I);
                         } else {
@@ -157,7 +187,7 @@ void TraceDriver::executeAccess(AccessRecord acc) {
                         state = it->second;
                     }
                 }
-                MemReq req = {acc.lineAddr, acc.type, acc.childId, &state, acc.reqCycle, nullptr, state, acc.childId};
+                MemReq req = {acc.lineAddr, acc.type, acc.childId, &state, acc.reqCycle, nullptr, state, acc.childId, 0, acc.data};
                 uint64_t respCycle = parent->access(req);
                 lat = respCycle - acc.reqCycle;
                 children[acc.childId].profLat.inc(lat);
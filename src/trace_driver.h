@@ -76,6 +76,8 @@ class TraceDriver {
 
     private:
         inline void executeAccess(AccessRecord acc);
+        inline AccessRecord readAccess();
+        void applyRegion(const PackedRegionRecord& reg);
 };
 
 
@@ -24,18 +24,20 @@
  */
 
 #include "tracing_cache.h"
+#include "pin.H"
 #include "zsim.h"
 
-TracingCache::TracingCache(uint32_t _numLines, CC* _cc, CacheArray* _array, ReplPolicy* _rp, uint32_t _accLat, uint32_t _invLat, g_string& _tracefile, g_string& _name) :
-    Cache(_numLines, _cc, _array, _rp, _accLat, _invLat, _name), tracefile(_tracefile)
+TracingCache::TracingCache(uint32_t _numLines, CC* _cc, CacheArray* _array, ReplPolicy* _rp, uint32_t _accLat, uint32_t _invLat, g_string& _tracefile, bool _traceData, g_string& _name) :
+    Cache(_numLines, _cc, _array, _rp, _accLat, _invLat, _name), tracefile(_tracefile), traceData(_traceData)
 {
     futex_init(&traceLock);
+    lineBuf = traceData? gm_memalign<uint8_t>(CACHE_LINE_BYTES, zinfo->lineSize) : nullptr;
 }
 
 void TracingCache::setChildren(const g_vector<BaseCache*>& children, Network* network) {
     Cache::setChildren(children, network);
     //We need to initialize the trace writer here because it needs the number of children
-    atw = new AccessTraceWriter(tracefile, children.size());
+    atw = new AccessTraceWriter(tracefile, children.size(), traceData? zinfo->lineSize : 0, SpawnInternalThread);
     zinfo->traceWriters->push_back(atw); //register it so that it gets flushed when the simulation ends
 }
 
@@ -43,7 +45,12 @@ uint64_t TracingCache::access(MemReq& req) {
     uint64_t respCycle = Cache::access(req);
     futex_lock(&traceLock);
     uint32_t lat = respCycle - req.cycle;
-    AccessRecord acc = {req.lineAddr, req.cycle, lat, req.childId, req.type};
+    AccessRecord acc = {req.lineAddr, req.cycle, lat, req.childId, req.type, nullptr};
+    if (traceData) {
+        // Like the compressed caches, take the line's current contents from simulated memory
+        PIN_SafeCopy(lineBuf, (void*)(req.lineAddr << lineBits), zinfo->lineSize);
+        acc.data = lineBuf;
+    }
     atw->write(acc);
     futex_unlock(&traceLock);
     return respCycle;
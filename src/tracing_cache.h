@@ -34,9 +34,11 @@ class TracingCache : public Cache {
         g_string tracefile;
         AccessTraceWriter* atw;
         lock_t traceLock;
+        bool traceData;  // also trace the contents of each accessed line
+        DataLine lineBuf;
 
     public:
-        TracingCache(uint32_t _numLines, CC* _cc, CacheArray* _array, ReplPolicy* _rp, uint32_t _accLat, uint32_t _invLat, g_string& _tracefile, g_string& _name);
+        TracingCache(uint32_t _numLines, CC* _cc, CacheArray* _array, ReplPolicy* _rp, uint32_t _accLat, uint32_t _invLat, g_string& _tracefile, bool _traceData, g_string& _name);
         void setChildren(const g_vector<BaseCache*>& children, Network* network);
         uint64_t access(MemReq& req);
 };
@@ -1,49 +1,36 @@
 #ifndef UNIDOPPELGANGER_CACHE_H_
 #define UNIDOPPELGANGER_CACHE_H_
 
-#include "timing_cache.h"
-#include "stats.h"
+#include "compressed_timing_cache.h"
 
-class uHitWritebackEvent;
-
-class uniDoppelgangerCache : public TimingCache {
-    protected:
-        // Cache stuff
-        uint32_t numTagLines;
-        uint32_t numDataLines;
-
-        uniDoppelgangerTagArray* tagArray;
-        uniDoppelgangerDataArray* dataArray;
-
-        ReplPolicy* tagRP;
-        ReplPolicy* dataRP;
-
-        RunningStats* crStats;
-        RunningStats* evStats;
-        RunningStats* tutStats;
-        RunningStats* dutStats;
+class uniDoppelgangerCache : public CompressedTimingCache<uniDoppelgangerCache, uniDoppelgangerTagArray, uniDoppelgangerDataArray> {
+    friend class CompressedTimingCache<uniDoppelgangerCache, uniDoppelgangerTagArray, uniDoppelgangerDataArray>;
 
     public:
         uniDoppelgangerCache(uint32_t _numTagLines, uint32_t _numDataLines, CC* _cc, uniDoppelgangerTagArray* _tagArray, uniDoppelgangerDataArray* _dataArray,
                         ReplPolicy* tagRP, ReplPolicy* dataRP, uint32_t _accLat, uint32_t _invLat, uint32_t mshrs, uint32_t ways, uint32_t cands, uint32_t _domain, 
-                        const g_string& _name, RunningStats* _crStats, RunningStats* _evStats, RunningStats* _tutStats, RunningStats* _dutStats, Counter* _tag_hits, Counter* _tag_misses, Counter* _tag_all);
-
-        uint64_t access(MemReq& req);
-
-        void initStats(AggregateStat* parentStat);
-        void simulateHitWriteback(uHitWritebackEvent* ev, uint64_t cycle, HitEvent* he);
+                        const g_string& _name, RunningStats* _crStats, RunningStats* _evStats, RunningStats* _tutStats, RunningStats* _dutStats, Counter* _tag_hits, Counter* _tag_misses, Counter* _tag_all,
+                        const CompressionTiming* _compTiming);
 
     protected:
         void initCacheStats(AggregateStat* cacheStat);
-};
+        void sampleOccupancy(uint64_t weight);
+
+        // access() hooks, see CompressedTimingCache
+        static const bool countsTagAccesses = false;
+        static const bool tagWritebackAfterDataRead = false;
+        static const bool fetchesExactLines = false;  // exact lines are modelled as all zeros
+        // Timing: to evict an approximate line, need to read the data array too.
+        uint32_t victimReadLat(const Access& a) const {return a.approximate? accLat : 0;}
+        void releaseTagVictim(Access& a, int32_t victimTagId, bool evicted) {releaseData(a, victimTagId);}
+        FillPlan fill(Access& a, int32_t victimTagId);
+        HitPlan hit(Access& a, int32_t tagId);
+        void invalidateTag(Access& a, int32_t tagId) {tagArray->postinsert(0, &a.req, tagId, -1, -1, false, false);}
+        void checkArrays();
 
-class uHitWritebackEvent : public TimingEvent {
     private:
-        uniDoppelgangerCache* cache;
-        HitEvent* he;
-    public:
-        uHitWritebackEvent(uniDoppelgangerCache* _cache,  HitEvent* _he, uint32_t postDelay, int32_t domain) : TimingEvent(0, postDelay, domain), cache(_cache), he(_he) {}
-        void simulate(uint64_t startCycle) {cache->simulateHitWriteback(this, startCycle, he);}
+        // Unlinks the tag from its data line, freeing the line if it was the last one pointing to it
+        void releaseData(Access& a, int32_t tagId);
 };
 
 #endif // UNIDOPPELGANGER_CACHE_H_
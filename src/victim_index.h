@@ -0,0 +1,123 @@
+/** $lic$
+ * Copyright (C) 2012-2015 by Massachusetts Institute of Technology
+ * Copyright (C) 2010-2013 by The Board of Trustees of Stanford University
+ *
+ * This file is part of zsim.
+ *
+ * zsim is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, version 2.
+ *
+ * If you use this software in your research, we request that you reference
+ * the zsim paper ("ZSim: Fast and Accurate Microarchitectural Simulation of
+ * Thousand-Core Systems", Sanchez and Kozyrakis, ISCA-40, June 2013) as the
+ * source of the simulator in any publications that use this software, and that
+ * you send us a citation of your work.
+ *
+ * zsim is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef VICTIM_INDEX_H_
+#define VICTIM_INDEX_H_
+
+#include <stdint.h>
+#include "galloc.h"
+#include "log.h"
+
+/* Exact victim selection for the dedup data arrays: an indexed binary
+ * min-heap over entries (data lines or sets) keyed by (reference count, last
+ * use). min() is the least-referenced entry, least recently used among ties,
+ * in O(1); changing an entry's references or recency is O(log n).
+ *
+ * Recency mirrors DataLRUReplPolicy: touch() makes an entry the most recently
+ * used, replaced() makes it the least recently used.
+ */
+class VictimIndex : public GlobAlloc {
+    private:
+        int32_t* refs;
+        uint64_t* lastUse;
+        uint32_t* heap;  // heap[i] = entry
+        uint32_t* pos;   // pos[entry] = i
+        uint32_t numEntries;
+        uint64_t clock;
+
+        inline bool less(uint32_t a, uint32_t b) const {
+            return (refs[a] != refs[b])? refs[a] < refs[b] : lastUse[a] < lastUse[b];
+        }
+
+        inline void place(uint32_t i, uint32_t e) {
+            heap[i] = e;
+            pos[e] = i;
+        }
+
+        void fix(uint32_t e) {
+            uint32_t i = pos[e];
+            while (i && less(e, heap[(i-1)/2])) {
+                place(i, heap[(i-1)/2]);
+                i = (i-1)/2;
+            }
+            while (true) {
+                uint32_t c = 2*i + 1;
+                if (c >= numEntries) break;
+                if (c + 1 < numEntries && less(heap[c+1], heap[c])) c++;
+                if (!less(heap[c], e)) break;
+                place(i, heap[c]);
+                i = c;
+            }
+            place(i, e);
+        }
+
+    public:
+        explicit VictimIndex(uint32_t _numEntries) : numEntries(_numEntries), clock(0) {
+            refs = gm_calloc<int32_t>(numEntries);
+            lastUse = gm_calloc<uint64_t>(numEntries);
+            heap = gm_malloc<uint32_t>(numEntries);
+            pos = gm_malloc<uint32_t>(numEntries);
+            for (uint32_t i = 0; i < numEntries; i++) place(i, i);  // all keys equal, so already a heap
+        }
+
+        ~VictimIndex() {
+            gm_free(refs);
+            gm_free(lastUse);
+            gm_free(heap);
+            gm_free(pos);
+        }
+
+        inline int32_t getRefs(uint32_t e) const {return refs[e];}
+
+        inline void setRefs(uint32_t e, int32_t r) {
+            assert(e < numEntries);
+            if (refs[e] == r) return;
+            refs[e] = r;
+            fix(e);
+        }
+
+        inline void touch(uint32_t e) {
+            assert(e < numEntries);
+            lastUse[e] = ++clock;
+            fix(e);
+        }
+
+        inline void replaced(uint32_t e) {
+            assert(e < numEntries);
+            lastUse[e] = 0;
+            fix(e);
+        }
+
+        inline uint32_t min() const {return heap[0];}
+
+        // The least entry other than e (which the caller cannot evict)
+        inline uint32_t minExcept(uint32_t e) const {
+            assert(numEntries > 1);
+            if (heap[0] != e) return heap[0];
+            return (numEntries > 2 && less(heap[2], heap[1]))? heap[2] : heap[1];
+        }
+};
+
+#endif  // VICTIM_INDEX_H_
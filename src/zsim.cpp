@@ -41,7 +41,9 @@
 #include <sys/time.h>
 #include <unistd.h>
 #include "access_tracing.h"
+#include "approx_regions.h"
 #include "cache.h"
+#include "compression_memo.h"
 #include "constants.h"
 #include "contention_sim.h"
 #include "core.h"
@@ -64,8 +66,6 @@
 
 //#include <signal.h> //can't include this, conflicts with PIN's
 
-ADDRINT savedWriteAddress;
-
 /* Command-line switches (used to pass info from harness that cannot be passed through the config file, most config is file-based) */
 
 KNOB<INT32> KnobProcIdx(KNOB_MODE_WRITEONCE, "pintool",
@@ -169,12 +169,24 @@ VOID FFThread(VOID* arg);
 
 InstrFuncPtrs fPtrs[MAX_THREADS] ATTR_LINE_ALIGNED; //minimize false sharing
 
+/* Store addresses are computed before the store and simulated after it, so
+ * they are saved in between. Each thread has its own line of slots, one per
+ * written memory operand (instructions may write several).
+ */
+#define MAX_STORE_SLOTS (CACHE_LINE_BYTES/sizeof(ADDRINT))
+
+struct StoreSlots {
+    ADDRINT addrs[MAX_STORE_SLOTS];
+} ATTR_LINE_ALIGNED;
+
+static StoreSlots storeSlots[MAX_THREADS];
+
 VOID PIN_FAST_ANALYSIS_CALL IndirectLoadSingle(THREADID tid, ADDRINT addr) {
     fPtrs[tid].loadPtr(tid, addr);
 }
 
-VOID PIN_FAST_ANALYSIS_CALL IndirectStoreSingle(THREADID tid) {
-    fPtrs[tid].storePtr(tid, savedWriteAddress);
+VOID PIN_FAST_ANALYSIS_CALL IndirectStoreSingle(THREADID tid, UINT32 slot) {
+    fPtrs[tid].storePtr(tid, storeSlots[tid].addrs[slot]);
 }
 
 VOID PIN_FAST_ANALYSIS_CALL IndirectBasicBlock(THREADID tid, ADDRINT bblAddr, BblInfo* bblInfo) {
@@ -189,8 +201,8 @@ VOID PIN_FAST_ANALYSIS_CALL IndirectPredLoadSingle(THREADID tid, ADDRINT addr, B
     fPtrs[tid].predLoadPtr(tid, addr, pred);
 }
 
-VOID PIN_FAST_ANALYSIS_CALL IndirectPredStoreSingle(THREADID tid, BOOL pred) {
-    fPtrs[tid].predStorePtr(tid, savedWriteAddress, pred);
+VOID PIN_FAST_ANALYSIS_CALL IndirectPredStoreSingle(THREADID tid, UINT32 slot, BOOL pred) {
+    fPtrs[tid].predStorePtr(tid, storeSlots[tid].addrs[slot], pred);
 }
 
 
@@ -406,6 +418,7 @@ void ExitFastForward() {
     //Re-instrument; VM/client lock are not needed
     if (zinfo->ffReinstrument) {
         PIN_RemoveInstrumentation();
+        if (zinfo->storeTracker) zinfo->storeTracker->markAll();  // stores were not instrumented while fast-forwarding
     }
 }
 
@@ -491,6 +504,9 @@ VOID EndOfPhaseActions() {
         info("Synced fast-forwarding done, resuming simulation");
     }
 
+    // No cache access is in flight, so region index snapshots replaced during the phase can go
+    zinfo->approximateRegions->reclaim();
+
     CheckForTermination();
     zinfo->contentionSim->simulatePhase(zinfo->globPhaseCycles + zinfo->phaseLength);
     zinfo->eventQueue->tick();
@@ -530,10 +546,18 @@ uint32_t TakeBarrier(uint32_t tid, uint32_t cid) {
 //     }
 // }
 
+// Records a region update in every trace being written, so trace-driven runs can replay it
+static void TraceApproximateRegion(RegionOp op, ADDRINT regStart, ADDRINT regEnd, DataType dataType, DataValue minValue, DataValue maxValue) {
+    if (zinfo->traceWriters->empty()) return;
+    PackedRegionRecord reg = {0, zinfo->globPhaseCycles, regStart, regEnd, minValue, maxValue, (uint32_t) op, (uint32_t) dataType};
+    for (AccessTraceWriter* t : *(zinfo->traceWriters)) t->writeRegion(reg);
+}
+
 VOID PIN_FAST_ANALYSIS_CALL AllocateApproximateRegion(CONTEXT* cid, ADDRINT regStart, ADDRINT regSize, DataType dataType, DataValue* minValue, DataValue* maxValue)
 {
     // info("New Approximate Region: %lu, %lu, %u, %f, %f", regStart, regStart+regSize, dataType, minValue->FLOAT, maxValue->FLOAT);
-    zinfo->approximateRegions->push_back(std::make_tuple(regStart, regStart+regSize, dataType, *minValue, *maxValue));
+    zinfo->approximateRegions->add(regStart, regStart+regSize, dataType, *minValue, *maxValue);
+    TraceApproximateRegion(REGION_ADD, regStart, regStart+regSize, dataType, *minValue, *maxValue);
 }
 
 VOID PIN_FAST_ANALYSIS_CALL AllocateDefaultApproximateRegion(CONTEXT* cid, ADDRINT regStart, ADDRINT regSize, DataType dataType)
@@ -547,74 +571,87 @@ VOID PIN_FAST_ANALYSIS_CALL AllocateDefaultApproximateRegion(CONTEXT* cid, ADDRI
         maxValue.DOUBLE = DBL_MAX;
     }
     // info("New Approximate Region: %lu, %lu, %u, %f, %f", regStart, regStart+regSize, dataType, minValue.FLOAT, maxValue.FLOAT);
-    zinfo->approximateRegions->push_back(std::make_tuple(regStart, regStart+regSize, dataType, minValue, maxValue));
+    zinfo->approximateRegions->add(regStart, regStart+regSize, dataType, minValue, maxValue);
+    TraceApproximateRegion(REGION_ADD, regStart, regStart+regSize, dataType, minValue, maxValue);
 }
 
 VOID PIN_FAST_ANALYSIS_CALL ReallocateApproximateRegion(CONTEXT* cid, ADDRINT regStart, ADDRINT regSize)
 {
-    for (uint32_t i = 0; i < zinfo->approximateRegions->size(); i++)
-    {
-        if (std::get<0>((*zinfo->approximateRegions)[i]) == regStart)
-        {
-            // info("Approximate Region changed from: %lu, %lu to %lu, %lu", std::get<0>((*zinfo->approximateRegions)[i]), std::get<1>((*zinfo->approximateRegions)[i]), regStart, regStart+regSize);
-            std::get<1>((*zinfo->approximateRegions)[i]) = regStart + regSize;
-            break;
-        }
-    }
+    // info("Approximate Region changed to: %lu, %lu", regStart, regStart+regSize);
+    zinfo->approximateRegions->resize(regStart, regStart + regSize);
+    DataValue none;
+    none.UINT64 = 0;
+    TraceApproximateRegion(REGION_RESIZE, regStart, regStart + regSize, ZSIM_FLOAT /*unused*/, none, none);
 }
 
 VOID PIN_FAST_ANALYSIS_CALL DeallocateApproximateRegion(CONTEXT* cid, ADDRINT regStart)
 {
-    for (uint32_t i = 0; i < zinfo->approximateRegions->size(); i++)
-    {
-        if (std::get<0>((*zinfo->approximateRegions)[i]) == regStart)
-        {
-            // info("Deleted Approximate Region from: %lu, %lu", std::get<0>((*zinfo->approximateRegions)[i]), std::get<1>((*zinfo->approximateRegions)[i]));
-            zinfo->approximateRegions->erase(zinfo->approximateRegions->begin()+i);
-            break;
-        }
-    }
+    // info("Deleted Approximate Region from: %lu", regStart);
+    zinfo->approximateRegions->remove(regStart);
+    DataValue none;
+    none.UINT64 = 0;
+    TraceApproximateRegion(REGION_REMOVE, regStart, 0, ZSIM_FLOAT /*unused*/, none, none);
+}
+
+VOID PIN_FAST_ANALYSIS_CALL registerWriteAddress(THREADID tid, UINT32 slot, ADDRINT Address)
+{
+    storeSlots[tid].addrs[slot] = Address;
 }
 
-VOID PIN_FAST_ANALYSIS_CALL registerWriteAddress(ADDRINT Address)
+// Only instrumented with memoized compression; runs once the store has written memory (see compression_memo.h)
+VOID PIN_FAST_ANALYSIS_CALL MarkStoredLines(THREADID tid, UINT32 slot, UINT32 size)
 {
-    savedWriteAddress = Address;
+    zinfo->storeTracker->markStore(storeSlots[tid].addrs[slot], size, lineBits);
+}
+
+/* Approximate-region markers: a "nop dword ptr [rax+disp], eax" (compilers
+ * never emit this form), whose displacement identifies the call, followed by
+ * one instruction per argument whose first operand is the register holding
+ * it. Markers are matched on the decoded operands, without disassembling.
+ */
+struct ApproxMarker {
+    ADDRDELTA displacement;
+    AFUNPTR handler;
+    uint32_t numArgs;
+};
+
+static const ApproxMarker approxMarkers[] = {
+    {0x221100ff, (AFUNPTR) AllocateApproximateRegion, 5},
+    {0x551100ff, (AFUNPTR) AllocateDefaultApproximateRegion, 3},
+    {0x331100ff, (AFUNPTR) ReallocateApproximateRegion, 2},
+    {0x441100ff, (AFUNPTR) DeallocateApproximateRegion, 1},
+};
+
+static const ApproxMarker* MatchApproxMarker(INS ins) {
+    if (likely(INS_Opcode(ins) != XED_ICLASS_NOP)) return nullptr;
+    if (INS_MemoryBaseReg(ins) != REG_RAX || INS_MemoryIndexReg(ins) != REG_INVALID()) return nullptr;
+    if (INS_OperandCount(ins) < 2 || !INS_OperandIsReg(ins, 1) || INS_OperandReg(ins, 1) != REG_EAX) return nullptr;
+    ADDRDELTA disp = INS_MemoryDisplacement(ins);
+    for (const ApproxMarker& m : approxMarkers) {
+        if (m.displacement == disp) return &m;
+    }
+    return nullptr;
+}
+
+static void InstrumentApproxMarker(INS ins, const ApproxMarker* marker) {
+    IARGLIST args = IARGLIST_Alloc();
+    INS argIns = ins;
+    for (uint32_t i = 0; i < marker->numArgs; i++) {
+        argIns = INS_Next(argIns);
+        if (!INS_Valid(argIns)) panic("Approximate-region marker at 0x%lx is not followed by its %d arguments", INS_Address(ins), marker->numArgs);
+        IARGLIST_AddArguments(args, IARG_REG_VALUE, INS_OperandReg(argIns, 0), IARG_END);
+    }
+    INS_InsertCall(ins, IPOINT_BEFORE, marker->handler, IARG_FAST_ANALYSIS_CALL, IARG_CONST_CONTEXT, IARG_IARGLIST, args, IARG_END);
+    IARGLIST_Free(args);
 }
 
 VOID Instruction(INS ins) {
     //Uncomment to print an instruction trace
     // info("INS: %s", INS_Disassemble(ins).c_str());
     // INS_InsertCall(ins, IPOINT_BEFORE, (AFUNPTR)PrintIp, IARG_THREAD_ID, IARG_REG_VALUE, REG_INST_PTR, IARG_END);
-    if(unlikely(INS_Opcode(ins) == XED_ICLASS_NOP && INS_Disassemble(ins) == "nop dword ptr [rax+0x221100ff], eax")) {
-        if (zinfo->approximate) {
-            // info("ALLOC0: %lu: %s", INS_Address(ins), INS_Disassemble(ins).c_str());
-            // info("ALLOC1: %lu: %s", INS_Address(INS_Next(ins)), INS_Disassemble(INS_Next(ins)).c_str());
-            // info("ALLOC2: %lu: %s", INS_Address(INS_Next(INS_Next(ins))), INS_Disassemble(INS_Next(INS_Next(ins))).c_str());
-            // info("ALLOC3: %lu: %s", INS_Address(INS_Next(INS_Next(INS_Next(ins)))), INS_Disassemble(INS_Next(INS_Next(INS_Next(ins)))).c_str());
-            // info("ALLOC4: %lu: %s", INS_Address(INS_Next(INS_Next(INS_Next(INS_Next(ins))))), INS_Disassemble(INS_Next(INS_Next(INS_Next(INS_Next(ins))))).c_str());
-            // info("ALLOC5: %lu: %s", INS_Address(INS_Next(INS_Next(INS_Next(INS_Next(INS_Next((ins))))))), INS_Disassemble(INS_Next(INS_Next(INS_Next(INS_Next(INS_Next((ins))))))).c_str());
-            INS_InsertCall(ins, IPOINT_BEFORE, (AFUNPTR) AllocateApproximateRegion, IARG_FAST_ANALYSIS_CALL, IARG_CONST_CONTEXT, IARG_REG_VALUE, INS_OperandReg(INS_Next(ins), 0), IARG_REG_VALUE, INS_OperandReg(INS_Next(INS_Next(ins)), 0),
-            IARG_REG_VALUE, INS_OperandReg(INS_Next(INS_Next(INS_Next(ins))), 0), IARG_REG_VALUE, INS_OperandReg(INS_Next(INS_Next(INS_Next(INS_Next(ins)))), 0), IARG_REG_VALUE, INS_OperandReg(INS_Next(INS_Next(INS_Next(INS_Next(INS_Next(ins))))), 0), IARG_END);
-        }
-    } else if(unlikely(INS_Opcode(ins) == XED_ICLASS_NOP && INS_Disassemble(ins) == "nop dword ptr [rax+0x551100ff], eax")) {
-        if (zinfo->approximate) {
-            // info("ALLOC0: %lu: %s", INS_Address(ins), INS_Disassemble(ins).c_str());
-            // info("ALLOC1: %lu: %s", INS_Address(INS_Next(ins)), INS_Disassemble(INS_Next(ins)).c_str());
-            // info("ALLOC2: %lu: %s", INS_Address(INS_Next(INS_Next(ins))), INS_Disassemble(INS_Next(INS_Next(ins))).c_str());
-            // info("ALLOC3: %lu: %s", INS_Address(INS_Next(INS_Next(INS_Next(ins)))), INS_Disassemble(INS_Next(INS_Next(INS_Next(ins)))).c_str());
-            // info("ALLOC4: %lu: %s", INS_Address(INS_Next(INS_Next(INS_Next(INS_Next(ins))))), INS_Disassemble(INS_Next(INS_Next(INS_Next(INS_Next(ins))))).c_str());
-            // info("ALLOC5: %lu: %s", INS_Address(INS_Next(INS_Next(INS_Next(INS_Next(INS_Next((ins))))))), INS_Disassemble(INS_Next(INS_Next(INS_Next(INS_Next(INS_Next((ins))))))).c_str());
-            INS_InsertCall(ins, IPOINT_BEFORE, (AFUNPTR) AllocateDefaultApproximateRegion, IARG_FAST_ANALYSIS_CALL, IARG_CONST_CONTEXT, IARG_REG_VALUE, INS_OperandReg(INS_Next(ins), 0), IARG_REG_VALUE, INS_OperandReg(INS_Next(INS_Next(ins)), 0),
-            IARG_REG_VALUE, INS_OperandReg(INS_Next(INS_Next(INS_Next(ins))), 0), IARG_END);
-        }
-    } else if(unlikely(INS_Opcode(ins) == XED_ICLASS_NOP && INS_Disassemble(ins) == "nop dword ptr [rax+0x331100ff], eax")) {
-        if (zinfo->approximate) {
-            INS_InsertCall(ins, IPOINT_BEFORE, (AFUNPTR) ReallocateApproximateRegion, IARG_FAST_ANALYSIS_CALL, IARG_CONST_CONTEXT, IARG_REG_VALUE, INS_OperandReg(INS_Next(ins), 0), IARG_REG_VALUE, INS_OperandReg(INS_Next(INS_Next(ins)), 0), IARG_END);
-        }
-    } else if(unlikely(INS_Opcode(ins) == XED_ICLASS_NOP && INS_Disassemble(ins) == "nop dword ptr [rax+0x441100ff], eax")) {
-        if (zinfo->approximate) {
-            INS_InsertCall(ins, IPOINT_BEFORE, (AFUNPTR) DeallocateApproximateRegion, IARG_FAST_ANALYSIS_CALL, IARG_CONST_CONTEXT, IARG_REG_VALUE, INS_OperandReg(INS_Next(ins), 0), IARG_END);
-        }
+    const ApproxMarker* marker = MatchApproxMarker(ins);
+    if (unlikely(marker)) {
+        if (zinfo->approximate) InstrumentApproxMarker(ins, marker);
     } else if (!procTreeNode->isInFastForward() || !zinfo->ffReinstrument) {
         AFUNPTR LoadFuncPtr = (AFUNPTR) IndirectLoadSingle;
         AFUNPTR StoreFuncPtr = (AFUNPTR) IndirectStoreSingle;
@@ -631,19 +668,35 @@ VOID Instruction(INS ins) {
                 }
             }
             if (INS_MemoryOperandIsWritten(ins, memOp)) {
-                INS_InsertCall(ins, IPOINT_BEFORE, (AFUNPTR) registerWriteAddress, IARG_FAST_ANALYSIS_CALL, IARG_MEMORYOP_EA, memOp, IARG_END);
+                // Operands beyond the slots (only in vector scatters) share the last one
+                UINT32 slot = (memOp < MAX_STORE_SLOTS)? memOp : MAX_STORE_SLOTS - 1;
+                INS_InsertCall(ins, IPOINT_BEFORE, (AFUNPTR) registerWriteAddress, IARG_FAST_ANALYSIS_CALL, IARG_THREAD_ID, IARG_UINT32, slot, IARG_MEMORYOP_EA, memOp, IARG_END);
+                if (zinfo->storeTracker) {
+                    /* Stores without a fall-through (e.g., calls) are marked right
+                     * before they write, and again at the branch target once the
+                     * write is done. Without the second mark, a line compressed
+                     * in between would be memoized with pre-store data but the
+                     * new generation.
+                     */
+                    IPOINT markPoint = INS_HasFallThrough(ins)? IPOINT_AFTER : IPOINT_BEFORE;
+                    UINT32 size = INS_MemoryOperandSize(ins, memOp);
+                    INS_InsertPredicatedCall(ins, markPoint, (AFUNPTR) MarkStoredLines, IARG_FAST_ANALYSIS_CALL, IARG_THREAD_ID, IARG_UINT32, slot, IARG_UINT32, size, IARG_END);
+                    if (!INS_HasFallThrough(ins) && INS_IsBranchOrCall(ins)) {
+                        INS_InsertPredicatedCall(ins, IPOINT_TAKEN_BRANCH, (AFUNPTR) MarkStoredLines, IARG_FAST_ANALYSIS_CALL, IARG_THREAD_ID, IARG_UINT32, slot, IARG_UINT32, size, IARG_END);
+                    }
+                }
                 if (INS_HasFallThrough(ins)) {
                     if (!INS_IsPredicated(ins)) {
-                        INS_InsertCall(ins, IPOINT_AFTER, StoreFuncPtr, IARG_FAST_ANALYSIS_CALL, IARG_THREAD_ID, IARG_END);
+                        INS_InsertCall(ins, IPOINT_AFTER, StoreFuncPtr, IARG_FAST_ANALYSIS_CALL, IARG_THREAD_ID, IARG_UINT32, slot, IARG_END);
                     } else {
-                        INS_InsertCall(ins, IPOINT_AFTER, PredStoreFuncPtr, IARG_FAST_ANALYSIS_CALL, IARG_THREAD_ID, IARG_EXECUTING, IARG_END);
+                        INS_InsertCall(ins, IPOINT_AFTER, PredStoreFuncPtr, IARG_FAST_ANALYSIS_CALL, IARG_THREAD_ID, IARG_UINT32, slot, IARG_EXECUTING, IARG_END);
                     }
                 }
                 else {
                     if (!INS_IsPredicated(ins)) {
-                        INS_InsertCall(ins, IPOINT_BEFORE, StoreFuncPtr, IARG_FAST_ANALYSIS_CALL, IARG_THREAD_ID, IARG_END);
+                        INS_InsertCall(ins, IPOINT_BEFORE, StoreFuncPtr, IARG_FAST_ANALYSIS_CALL, IARG_THREAD_ID, IARG_UINT32, slot, IARG_END);
                     } else {
-                        INS_InsertCall(ins, IPOINT_BEFORE, PredStoreFuncPtr, IARG_FAST_ANALYSIS_CALL, IARG_THREAD_ID, IARG_EXECUTING, IARG_END);
+                        INS_InsertCall(ins, IPOINT_BEFORE, PredStoreFuncPtr, IARG_FAST_ANALYSIS_CALL, IARG_THREAD_ID, IARG_UINT32, slot, IARG_EXECUTING, IARG_END);
                     }
                 }
             }
@@ -961,6 +1014,7 @@ VOID SimThreadFini(THREADID tid) {
 
 VOID ThreadFini(THREADID tid, const CONTEXT *ctxt, INT32 flags, VOID *v) {
     //NOTE: Thread has no valid cid here!
+    gm_flush_thread_cache(tid);  // tid may be reused by a later thread
     if (fPtrs[tid].type == FPTR_NOP) {
         info("Shadow/NOP thread %d finished", tid);
         return;
@@ -1005,6 +1059,9 @@ VOID SyscallEnter(THREADID tid, CONTEXT *ctxt, SYSCALL_STANDARD std, VOID *v) {
 VOID SyscallExit(THREADID tid, CONTEXT *ctxt, SYSCALL_STANDARD std, VOID *v) {
     assert(inSyscall[tid]); inSyscall[tid] = false;
 
+    // The kernel may have written any of the process's memory (read(), mmap(), ...)
+    if (zinfo->storeTracker) zinfo->storeTracker->markAll();
+
     PostPatchAction ppa = VirtSyscallExit(tid, ctxt, std);
     if (ppa == PPA_USE_JOIN_PTRS) {
         if (!zinfo->blockingSyscalls) {
@@ -1076,6 +1133,11 @@ VOID ContextChange(THREADID tid, CONTEXT_CHANGE_REASON reason, const CONTEXT* fr
     //SyscallExit(tid, to, SYSCALL_STANDARD_IA32E_LINUX, nullptr); //NOTE: For now it is safe to do spurious syscall exits, but careful...
 }
 
+/* Per-thread shared heap caches are indexed by Pin thread id */
+static uint32_t GetGmThreadId() {
+    return PIN_ThreadId();
+}
+
 /* Fork and exec instrumentation */
 
 //For funky macro stuff
@@ -1130,6 +1192,7 @@ VOID AfterForkInParent(THREADID tid, const CONTEXT* ctxt, VOID * arg) {
 
 VOID AfterForkInChild(THREADID tid, const CONTEXT* ctxt, VOID * arg) {
     assert(forkedChildNode);
+    gm_reset_thread_caches();  // the parent still owns the blocks in our copy of its caches
     procTreeNode = forkedChildNode;
     procIdx = procTreeNode->getProcIdx();
     bool wasNotStarted = procTreeNode->notifyStart();
@@ -1159,6 +1222,10 @@ VOID AfterForkInChild(THREADID tid, const CONTEXT* ctxt, VOID * arg) {
     ThreadStart(tid, nullptr, 0, nullptr);
 }
 
+void SpawnInternalThread(void (*fn)(void*), void* arg) {
+    PIN_SpawnInternalThread(fn, arg, 1024*1024, nullptr);
+}
+
 /** Finalization **/
 
 VOID Fini(int code, VOID * v) {
@@ -1549,6 +1616,7 @@ int main(int argc, char *argv[]) {
     //info("setpriority, new prio %d", getpriority(PRIO_PROCESS, getpid()));
 
     gm_attach(KnobShmid.Value());
+    gm_set_thread_id_fn(GetGmThreadId);
 
     bool masterProcess = false;
     if (procIdx == 0 && !gm_isready()) {  // process 0 can exec() without fork()ing first, so we must check gm_isready() to ensure we don't initialize twice
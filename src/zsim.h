@@ -35,8 +35,6 @@
 #include "memory_hierarchy.h"
 #include "g_std/g_unordered_map.h"
 
-#include <tuple>
-
 class Cache;
 class Counter;
 class Core;
@@ -55,6 +53,9 @@ class PortVirtualizer;
 class VectorCounter;
 class AccessTraceWriter;
 class TraceDriver;
+class ApproxRegionIndex;
+class StoreTracker;
+class DecodedBblCache;
 template <typename T> class g_vector;
 
 struct ClockDomainInfo {
@@ -183,6 +184,8 @@ struct GlobSimInfo {
 
     struct LibInfo libzsimAddrs;
 
+    DecodedBblCache* bblCache; //OOO decodings persisted across runs, nullptr if disabled
+
     bool ffReinstrument; //true if we should reinstrument on ffwd, works fine with ST apps and it's faster since we run with basically no instrumentation, but it's not precise with MT apps
 
     //fftoggle stuff
@@ -199,12 +202,16 @@ struct GlobSimInfo {
     TraceDriver* traceDriver;
 
     bool approximate;
-    // start, end, type, min, max
-    g_vector<std::tuple<uint64_t, uint64_t, DataType, DataValue, DataValue>>* approximateRegions;
+    ApproxRegionIndex* approximateRegions;
+    uint32_t numRegionCaches;  // caches that classify lines by approximate region, which traces must then record
 
     uint32_t floatCutSize;
     uint32_t mruListSize;
     uint32_t randomLoopTrial;
+    uint32_t occupancySamplePhases;  // compressed-cache occupancy sampling period; if both are 0, sample on every access
+    uint32_t occupancySampleCycles;
+    uint32_t compressionMemoEntries;  // per compressed cache bank; 0 disables memoized compression
+    StoreTracker* storeTracker;  // lines written by the application, non-null iff compressionMemoEntries
     uint32_t doubleCutSize;
     uint16_t hashSize;
 
@@ -226,5 +233,6 @@ extern GlobSimInfo* zinfo;
 uint32_t getCid(uint32_t tid);
 uint32_t TakeBarrier(uint32_t tid, uint32_t cid);
 void SimEnd(); //only call point out of zsim.cpp should be watchdog threads
+void SpawnInternalThread(void (*fn)(void*), void* arg); //for helper threads of code that does not include pin.H (e.g., trace readers and writers)
 
 #endif  // ZSIM_H_